@@ -0,0 +1,105 @@
+#include "davGopCache.h"
+
+namespace ff_dynamic {
+
+/* how far back streams of all key frames go */
+static const int64_t s_allKeyWindowUs = 10 * AV_TIME_BASE;
+
+void DavGopCache::clear(Stream & s) {
+    for (auto & p : s.m_pkts)
+        av_packet_free(&p);
+    s.m_pkts.clear();
+    s.m_bytes = 0;
+}
+
+void DavGopCache::put(const DavProcBuf & buf, const size_t maxBytes) {
+    const AVPacket *pkt = buf.getAVPacket();
+    if (!pkt || pkt->dts == AV_NOPTS_VALUE)
+        return;
+    AVPacket *ref = av_packet_clone(pkt);
+    if (!ref)
+        return;
+    const bool bKey = (pkt->flags & AV_PKT_FLAG_KEY) != 0;
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    Stream & s = m_streams[buf.getAddress()];
+    if (buf.m_travelStatic)
+        s.m_timebase = buf.m_travelStatic->m_timebase;
+    if (!bKey)
+        s.m_bAllKey = false;
+    if (bKey && !s.m_bAllKey) { /* a new gop */
+        clear(s);
+        s.m_bOverflow = false;
+    }
+    if (s.m_bOverflow) {
+        av_packet_free(&ref);
+        return;
+    }
+    s.m_pkts.push_back(ref);
+    s.m_bytes += ref->size;
+    if (s.m_bAllKey) {
+        const int64_t windowStart = av_rescale_q(ref->dts, s.m_timebase, AV_TIME_BASE_Q) - s_allKeyWindowUs;
+        while (s.m_pkts.size() > 1 && (s.m_bytes > maxBytes ||
+               av_rescale_q(s.m_pkts.front()->dts, s.m_timebase, AV_TIME_BASE_Q) < windowStart)) {
+            s.m_bytes -= s.m_pkts.front()->size;
+            av_packet_free(&s.m_pkts.front());
+            s.m_pkts.pop_front();
+        }
+    } else if (s.m_bytes > maxBytes) {
+        clear(s);
+        s.m_bOverflow = true;
+    }
+}
+
+void DavGopCache::remove(const DavProc *producer) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (auto it = m_streams.begin(); it != m_streams.end();) {
+        if (it->first.m_from != producer) {
+            ++it;
+            continue;
+        }
+        clear(it->second);
+        it = m_streams.erase(it);
+    }
+}
+
+int DavGopCache::getGop(const DavProcFrom & from, const int64_t beforeDts,
+                        vector<AVPacket *> & pkts, int64_t & startUs) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_streams.find(from);
+    if (it == m_streams.end() || it->second.m_pkts.empty())
+        return AVERROR(ENOENT);
+    const Stream & s = it->second;
+    /* the producer may have run ahead into a later gop, then there is nothing before 'beforeDts' */
+    if (s.m_pkts.front()->dts >= beforeDts || !(s.m_pkts.front()->flags & AV_PKT_FLAG_KEY))
+        return AVERROR(ENOENT);
+    startUs = av_rescale_q(s.m_pkts.front()->dts, s.m_timebase, AV_TIME_BASE_Q);
+    for (auto p : s.m_pkts) {
+        if (p->dts >= beforeDts)
+            break;
+        AVPacket *ref = av_packet_clone(p);
+        if (ref)
+            pkts.push_back(ref);
+    }
+    return 0;
+}
+
+int DavGopCache::getSince(const DavProcFrom & from, const int64_t startUs, const int64_t beforeDts,
+                          vector<AVPacket *> & pkts) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_streams.find(from);
+    if (it == m_streams.end())
+        return AVERROR(ENOENT);
+    const Stream & s = it->second;
+    const int64_t start = av_rescale_q(startUs, AV_TIME_BASE_Q, s.m_timebase);
+    for (auto p : s.m_pkts) {
+        if (p->dts >= beforeDts)
+            break;
+        AVPacket *ref = p->dts >= start ? av_packet_clone(p) : nullptr;
+        if (ref)
+            pkts.push_back(ref);
+    }
+    return 0;
+}
+
+} // namespace ff_dynamic
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <deque>
+#include <map>
+#include <mutex>
+#include <vector>
+#include "ffmpegHeaders.h"
+#include "davProcBuf.h"
+
+namespace ff_dynamic {
+using ::std::deque;
+using ::std::map;
+using ::std::vector;
+
+/* Process wide cache of the latest packets each enabled producer (DavProc::setGopCache) outputs, so a
+   consumer connected late, such as a new muxer of a shared encoder, starts from a key frame right away
+   instead of waiting for (or requesting) the next one. Per output stream it keeps the packets since the
+   latest key frame; a gop over the byte bound is not kept. Streams of all key frames (audio) keep a
+   window of packets instead. Packets are references, the producer's buffers are not held. */
+class DavGopCache {
+public:
+    static DavGopCache & getOnlyInstance() {
+        static DavGopCache s_instance;
+        return s_instance;
+    }
+    void put(const DavProcBuf & buf, const size_t maxBytes);
+    /* a producer goes away */
+    void remove(const DavProc *producer);
+    /* new references of 'from''s packets starting at its latest key frame, with dts before 'beforeDts';
+       'startUs' is that key frame's dts in AV_TIME_BASE_Q. AVERROR(ENOENT) if there is no such gop */
+    int getGop(const DavProcFrom & from, const int64_t beforeDts, vector<AVPacket *> & pkts, int64_t & startUs);
+    /* new references of 'from''s packets with dts in [startUs (AV_TIME_BASE_Q), beforeDts) */
+    int getSince(const DavProcFrom & from, const int64_t startUs, const int64_t beforeDts, vector<AVPacket *> & pkts);
+
+private:
+    DavGopCache() = default;
+    DavGopCache(const DavGopCache &) = delete;
+    DavGopCache & operator= (const DavGopCache &) = delete;
+    struct Stream {
+        AVRational m_timebase {1, AV_TIME_BASE};
+        deque<AVPacket *> m_pkts;
+        size_t m_bytes = 0;
+        bool m_bAllKey = true;   /* till a non key packet shows up */
+        bool m_bOverflow = false; /* current gop too large, not kept */
+    };
+    static void clear(Stream & s);
+
+private:
+    std::mutex m_mutex;
+    map<DavProcFrom, Stream> m_streams;
+};
+
+} // namespace ff_dynamic
@@ -83,11 +83,31 @@ struct DavOptionReconnectRetries : public DavOption {
                     "ReconnectRetries") {}
 };
 
+/* '|' separated urls demux fails over to, in order, when the input url can't be opened or is lost */
+struct DavOptionInputBackupUrls : public DavOption {
+    DavOptionInputBackupUrls()
+        : DavOption(type_index(typeid(*this)), type_index(typeid(std::string)), "InputBackupUrls") {}
+};
+
+/* mpeg ts programs (program numbers, ',' separated, or "all") demux outputs; one demux parses the mux once.
+   The n-th audio/video stream of the p-th listed program outputs at stream index p * DavDemuxProgramStride + n */
+constexpr int DavDemuxProgramStride = 100;
+struct DavOptionDemuxPrograms : public DavOption {
+    DavOptionDemuxPrograms()
+        : DavOption(type_index(typeid(*this)), type_index(typeid(std::string)), "DemuxPrograms") {}
+};
+
 struct DavOptionRWTimeout : public DavOption {
     DavOptionRWTimeout()
         : DavOption(type_index(typeid(*this)), type_index(typeid(int)), "RWTimeout") {}
 };
 
+/* demux drops video packets (or seeks, if seekable) till the first key frame, so a new input shows up sooner */
+struct DavOptionFastJoin : public DavOption {
+    DavOptionFastJoin()
+        : DavOption(type_index(typeid(*this)), type_index(typeid(bool)), "FastJoin") {}
+};
+
 struct DavOptionFilterDesc : public DavOption {
     DavOptionFilterDesc()
         : DavOption(type_index(typeid(*this)), type_index(typeid(std::string)),
@@ -127,12 +147,60 @@ struct DavOptionOutputUrl : public DavOption {
                     "OutputUrl") {}
 };
 
+/* more destinations ('|' separated) of the same mux output; "[f=format]url" serializes for another format */
+struct DavOptionTeeOutputUrls : public DavOption {
+    DavOptionTeeOutputUrls()
+        : DavOption(type_index(typeid(*this)), type_index(typeid(std::string)), "TeeOutputUrls") {}
+};
+
 struct DavOptionContainerFmt : public DavOption {
     DavOptionContainerFmt()
         : DavOption(type_index(typeid(*this)), type_index(typeid(std::string)),
                     "ContainerFmt") {}
 };
 
+/* bitstream filter chain, such as 'h264_mp4toannexb' or 'a,b'; 'auto' picks by codec and target container */
+struct DavOptionBitstreamFilter : public DavOption {
+    DavOptionBitstreamFilter()
+        : DavOption(type_index(typeid(*this)), type_index(typeid(std::string)),
+                    "BitstreamFilter") {}
+};
+
+/* auto, frame, slice or lowlatency; ffmpeg video decoder internal threading policy */
+struct DavOptionDecodeThreadPolicy : public DavOption {
+    DavOptionDecodeThreadPolicy()
+        : DavOption(type_index(typeid(*this)), type_index(typeid(std::string)),
+                    "DecodeThreadPolicy") {}
+};
+
+/* interactive, broadcast or offline; video encode latency/efficiency trade-off */
+struct DavOptionEncodeProfile : public DavOption {
+    DavOptionEncodeProfile()
+        : DavOption(type_index(typeid(*this)), type_index(typeid(std::string)),
+                    "EncodeProfile") {}
+};
+
+/* bits per second; lower bound of congestion driven video encode bitrate, set it to enable adaptation */
+struct DavOptionBitrateAdaptMin : public DavOption {
+    DavOptionBitrateAdaptMin()
+        : DavOption(type_index(typeid(*this)), type_index(typeid(int)),
+                    "BitrateAdaptMin") {}
+};
+
+/* bits per second; upper bound of the adaptation, default is the configured bitrate */
+struct DavOptionBitrateAdaptMax : public DavOption {
+    DavOptionBitrateAdaptMax()
+        : DavOption(type_index(typeid(*this)), type_index(typeid(int)),
+                    "BitrateAdaptMax") {}
+};
+
+/* fast, balanced or high; used by waves which do audio resample (audio mix, audio encode) */
+struct DavOptionAudioResampleQuality : public DavOption {
+    DavOptionAudioResampleQuality()
+        : DavOption(type_index(typeid(*this)), type_index(typeid(std::string)),
+                    "AudioResampleQuality") {}
+};
+
 ////////////////////////////////////////////////////////
 //// DavClassOption: Use DavOption Derived class as enum
 using DavWaveClassCategory = DavOption;
@@ -188,6 +256,11 @@ struct DavWaveClassAudioFilter : public DavWaveClassCategory {
         : DavWaveClassCategory(type_index(typeid(*this)), type_index(typeid(std::string)),
                                nameTag) {}
 };
+struct DavWaveClassBitstreamFilter : public DavWaveClassCategory {
+    DavWaveClassBitstreamFilter(const string& nameTag = "BitstreamFilter")
+        : DavWaveClassCategory(type_index(typeid(*this)), type_index(typeid(std::string)),
+                               nameTag) {}
+};
 struct DavWaveClassVideoMix : public DavWaveClassCategory {
     DavWaveClassVideoMix(const string& nameTag = "VideoMix")
         : DavWaveClassCategory(type_index(typeid(*this)), type_index(typeid(std::string)),
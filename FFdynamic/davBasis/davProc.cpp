@@ -1,4 +1,5 @@
 #include "davProc.h"
+#include "davGopCache.h"
 
 namespace ff_dynamic {
 using ::std::mutex;
@@ -55,6 +56,8 @@ DavProc::~DavProc() {
          "Base destruct done. Total in stat: " + inputStat + "\nout stat: " + outputStat);
     m_dataTransmitor->clear();
     m_pubsubTransmitor->clear();
+    if (m_gopCacheBytes > 0)
+        DavGopCache::getOnlyInstance().remove(this);
     m_bAlive = false;
     m_bOnFire = false;
     return;
@@ -71,6 +74,10 @@ int DavProc::preProcess(shared_ptr<DavProcBuf>& inBuf) {
         shared_ptr<DavPeerEvent> event = m_pubsubTransmitor->retrive();
         if (event) {
             ret = m_impl->processPeerEvent(*event);
+            /* frame demand goes to every subscriber of a sparse consumer, only decoders and relays take it */
+            if (ret == DAV_ERROR_EVENT_PROCESS_NOT_SUPPORT &&
+                typeid(*event) == typeid(DavEventFrameDemand))
+                ret = 0;
             if (ret < 0) {
                 m_procInfo = m_impl->getImplErr();
                 ERROR(ret, "Fail process one event: " + m_procInfo.m_msgDetail);
@@ -125,6 +132,8 @@ int DavProc::postProcess(DavProcCtx& ctx) {
         // auto filterrdInBuf = prefilter(ctx.m_inBuf);
         //}
         buf->getAddress().setGroupFrom(this, m_groupId);
+        if (m_gopCacheBytes > 0)
+            DavGopCache::getOnlyInstance().put(*buf, m_gopCacheBytes);
         for (int k = 0; k < ctx.m_outputTimes; k++) {
             m_dataTransmitor->delivery(buf);
             auto r = m_dataTransmitor->getRecipients();
@@ -149,7 +158,12 @@ int DavProc::runDavProcThread() {
         else if (ret == AVERROR_EOF)
             break;
 
-        DavProcCtx ctx(m_dataTransmitor->getSenders());
+        /* output peers only change on (dis)connection, refresh the copy then */
+        if (m_recipientsVersion != m_dataTransmitor->getRecipientsVersion()) {
+            m_recipientsVersion = m_dataTransmitor->getRecipientsVersion();
+            m_recipientAddrs = m_dataTransmitor->getRecipientAddrs();
+        }
+        DavProcCtx ctx(m_dataTransmitor->getSenders(), m_recipientAddrs);
         { /* unique_lock with cv */
             std::unique_lock<mutex> lock(m_runLock);
             m_runCondVar.wait(lock,
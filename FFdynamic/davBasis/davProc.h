@@ -53,6 +53,8 @@ class DavProc {
     inline void setMaxNumOfProcBuf(int limitNum) noexcept {
         m_outbufLimiter->setMaxNumOfProcBuf(limitNum);
     }
+    /* keep latest gop of output packets in DavGopCache for late joining peers; 0 disables. Set before start */
+    inline void setGopCache(const size_t maxBytes) noexcept { m_gopCacheBytes = maxBytes; }
     inline shared_ptr<DavTransmitor<DavProcBuf, DavProcFrom>> getDataTransmitor() {
         return m_dataTransmitor;
     }
@@ -133,8 +135,11 @@ class DavProc {
     shared_ptr<DavTransmitor<DavProcBuf, DavProcFrom>> m_dataTransmitor;
     shared_ptr<DavTransmitor<DavPeerEvent, DavProcFrom>> m_pubsubTransmitor;
     DavExpect<DavProcFrom> m_expectInput;
+    vector<DavProcFrom> m_recipientAddrs; /* copy of data recipients, for DavProcCtx */
+    uint64_t m_recipientsVersion = UINT64_MAX;
     /* extending its scope, for limitor will travel with ProcBuf */
     shared_ptr<DavProcBufLimiter> m_outbufLimiter;
+    size_t m_gopCacheBytes = 0;
     DavMsgError m_procInfo;
 
    private: /* trvial */
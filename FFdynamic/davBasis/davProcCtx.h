@@ -18,7 +18,8 @@ class DavProc;
 
 struct DavProcCtx {
     DavProcCtx() = default;
-    explicit DavProcCtx (const vector<DavProcFrom> & froms) noexcept : m_froms(froms) {}
+    DavProcCtx (const vector<DavProcFrom> & froms, const vector<DavProcFrom> & tos) noexcept
+        : m_froms(froms), m_tos(tos) {}
     virtual ~DavProcCtx() {
         if (m_inRefPkt) /* in case process failed without release */
             av_packet_free(&m_inRefPkt);
@@ -27,6 +28,7 @@ struct DavProcCtx {
     }
 
     const vector<DavProcFrom> & m_froms; /* all input peers at the moment */
+    const vector<DavProcFrom> & m_tos;   /* all output peers at the moment */
     shared_ptr<DavProcBuf> m_inBuf;
     /* ref pkt/frame is used for one buffer output to several peers that have different timebase,
        so use ref frame to refer to converted timestamps */
@@ -1,6 +1,7 @@
 #pragma once
 // system
 #include <algorithm>
+#include <atomic>
 #include <chrono>
 #include <condition_variable>
 #include <map>
@@ -63,6 +64,7 @@ class DavTransmitor : public std::enable_shared_from_this<DavTransmitor<Load, Ad
         if (!bExist) {
             m_recipients.emplace(addr, r);
             m_sendCounts.emplace(r->getSelfAddress(), 0);
+            m_recipientsVersion++;
         }
         return 0;
     }
@@ -89,6 +91,7 @@ class DavTransmitor : public std::enable_shared_from_this<DavTransmitor<Load, Ad
         for (; it != m_recipients.end(); it++)
             if (it->second.get() == r.get()) break;
         if (it != m_recipients.end()) m_recipients.erase(it);
+        m_recipientsVersion++;
         return 0;
     }
     void deleteSenders() {
@@ -99,6 +102,7 @@ class DavTransmitor : public std::enable_shared_from_this<DavTransmitor<Load, Ad
     void deleteRecipients() {
         std::lock_guard<std::mutex> guard(m_mutex);
         m_recipients.clear();
+        m_recipientsVersion++;
     }
     void clear() {
         /* won't get upstream peers' output anymore */
@@ -116,6 +120,7 @@ class DavTransmitor : public std::enable_shared_from_this<DavTransmitor<Load, Ad
         m_senderAddrs.clear();
         m_senderTransmitor.clear();
         m_recipients.clear();
+        m_recipientsVersion++;
     }
 
    public: /* trivial ones */
@@ -137,6 +142,16 @@ class DavTransmitor : public std::enable_shared_from_this<DavTransmitor<Load, Ad
         const noexcept {
         return m_recipients;
     }
+    /* bumped whenever recipients change; cheap check before 'getRecipientAddrs' */
+    inline uint64_t getRecipientsVersion() const noexcept { return m_recipientsVersion; }
+    vector<Address> getRecipientAddrs() const {
+        std::lock_guard<std::mutex> guard(m_mutex);
+        vector<Address> addrs;
+        for (auto& r : m_recipients)
+            if (std::find(addrs.begin(), addrs.end(), r.second->getSelfAddress()) == addrs.end())
+                addrs.push_back(r.second->getSelfAddress());
+        return addrs;
+    }
     inline const map<Address, uint64_t>& getReceiveCounts() const noexcept {
         return m_receiveCounts;
     }
@@ -267,6 +282,7 @@ class DavTransmitor : public std::enable_shared_from_this<DavTransmitor<Load, Ad
     map<Address, uint64_t> m_receiveCounts;
     std::multimap<Address, shared_ptr<Transmitor>> m_recipients;
     map<Address, uint64_t> m_sendCounts;
+    std::atomic<uint64_t> m_recipientsVersion = ATOMIC_VAR_INIT(0);
     vector<shared_ptr<Load>> m_loads;
 };
 
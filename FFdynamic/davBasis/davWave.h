@@ -108,6 +108,13 @@ class DavWave : public DavProc {
         return m_impl->processExternalEvent(event);
     }
 
+    /* caller owns the dict, free it with av_dict_free */
+    int statistics(AVDictionary **stat) {
+        if (!m_impl) return -1;
+        std::unique_lock<std::mutex> lock(m_runLock);
+        return m_impl->statistics(stat);
+    }
+
    private:
     DavWave(const DavWave &) = delete;
     DavWave operator=(const DavWave &) = delete;
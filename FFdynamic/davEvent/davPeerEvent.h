@@ -3,6 +3,7 @@
 #include <vector>
 #include <string>
 #include <iostream>
+#include <iomanip>
 #include <typeinfo>
 #include <typeindex>
 
@@ -40,6 +41,48 @@ struct DavEventVideoMixSync : public DavPeerEvent {
     int64_t m_videoMixCurPts = 0; /* in AV_TIME_BASE_Q */
 };
 
+/* published periodically by audio mix; levels are in dBFS, computed during mixing */
+struct DavEventAudioMixLevels : public DavPeerEvent {
+    virtual const DavEventAudioMixLevels & getSelf() const {return *this;}
+    struct AudioLevel {
+        DavProcFrom m_from; /* audio stream mixed; its group id identifies the participant */
+        double m_rmsDb = -100.0;  /* rms of this report interval */
+        double m_peakDb = -100.0; /* peak of this report interval */
+        double m_smoothedRmsDb = -100.0;
+        bool m_bMuted = false;
+    };
+    vector<AudioLevel> m_levels;
+    int64_t m_mixPts = 0; /* in AV_TIME_BASE_Q */
+    int64_t m_activeSpeakerGroupId = -1; /* -1 if no one spoke yet */
+};
+
+/* published periodically by mux; how well the output keeps up with the media it is fed */
+struct DavEventMuxThroughput : public DavPeerEvent {
+    virtual const DavEventMuxThroughput & getSelf() const {return *this;}
+    string m_outputUrl;
+    int64_t m_intervalUs = 0;      /* wall time of this report */
+    int64_t m_mediaDurationUs = 0; /* media time muxed in this report */
+    int64_t m_writeBusyUs = 0;     /* wall time blocked in writing */
+    int64_t m_bytesWritten = 0;
+    int64_t m_writeBitrate = 0;    /* bits per second of wall time */
+    /* accumulated write time exceeding media time; growing means the output queue grows */
+    int64_t m_backlogUs = 0;
+};
+
+/* published by sparse frame consumers (such as detectors) to the decoder or relay feeding them */
+struct DavEventFrameDemand : public DavPeerEvent {
+    virtual const DavEventFrameDemand & getSelf() const {return *this;}
+    double m_fps = 0.0;            /* frames per second needed; 0 for every frame */
+    bool m_bReferenceExact = true; /* false if frames decoded with shortcuts (no deblocking) are fine */
+};
+
+/* published by a fast joining demux; an encoder in the same process producing its source
+   (subscribed to the demux) answers with a key frame, so the join won't wait a whole gop */
+struct DavEventKeyFrameRequest : public DavPeerEvent {
+    virtual const DavEventKeyFrameRequest & getSelf() const {return *this;}
+    bool m_bForceIdr = true;
+};
+
 //// Other basic structure could be used by derived events
 struct DavRect {
     int x = 0;
@@ -53,4 +96,31 @@ inline std::ostream & operator<<(std::ostream & os, const DavRect & r) {
     return os;
 }
 
+/* published by object detectors (see modules); consumed by post draw and roi encoding */
+struct ObjDetectEvent : public DavPeerEvent {
+    virtual const ObjDetectEvent & getSelf() const {return *this;}
+    int64_t m_framePts = 0;
+    AVRational m_timebase = {0, 1}; /* of m_framePts; {0, 1} if unknown */
+    int m_frameWidth = 0;  /* frame size the rects refer to; 0 if unknown */
+    int m_frameHeight = 0;
+    string m_detectOrClassify; /* for simplicity, use string. only two right now: 'classify' or 'detect' */
+    string m_detectorFrameworkTag; /* detailed tag of the model: yolo, ssd, etc.. */
+    double m_inferTime = -1.0; /* negative if unknown */
+    struct DetectResult {
+        string m_className{"unknown"};
+        double m_confidence = 0.0;
+        DavRect m_rect; /* not used for classify */
+    };
+    vector<DetectResult> m_results;
+};
+
+inline std::ostream & operator<<(std::ostream & os, const ObjDetectEvent & e) {
+    os << "{detector " << e.m_detectorFrameworkTag << ", inferTime " << e.m_inferTime << ", pts " << e.m_framePts;
+    for (auto & r : e.m_results)
+        os << " [className " << r.m_className << ", conf " << std::setprecision(3)
+           << r.m_confidence << " " << r.m_rect << "]";
+    os << "}\n";
+    return os;
+}
+
 } // namespace ff_dynamic
@@ -103,6 +103,9 @@ int FFmpegAudioEncode::openAudioResample(const DavTravelStatic & in, const DavTr
     arp.m_dstFmt = out.m_samplefmt;
     arp.m_dstSamplerate = out.m_samplerate;
     arp.m_dstLayout = out.m_channelLayout; /* mostly, it is AV_CH_LAYOUT_STEREO */
+    const string quality = m_options.get(DavOptionAudioResampleQuality());
+    if (!quality.empty() && audioResampleQualityFromStr(quality, arp.m_quality) < 0)
+        LOG(WARNING) << m_logtag << "unknown audio resample quality " << quality << ", use balanced";
 
     /* if src parameters == dst parameters, then there will be no actual resample happen */
     m_resampler = new AudioResample();
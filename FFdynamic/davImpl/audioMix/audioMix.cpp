@@ -1,3 +1,4 @@
+#include <cmath>
 #include "audioMix.h"
 
 namespace ff_dynamic {
@@ -82,6 +83,7 @@ int AudioMix::addOneSyncerStream(DavProcCtx & ctx) {
     arp.m_dstFmt = m_dstFmt;
     arp.m_dstSamplerate = m_dstSamplerate;
     arp.m_dstLayout = m_dstLayout;
+    arp.m_quality = m_resampleQuality;
     ret = syncer->initAudioSyncer(arp, from.m_groupId);
     if (ret < 0) {
         ERRORIT(ret, "failed to create audio syncer with " + toStringViaOss(arp));
@@ -101,6 +103,10 @@ int AudioMix::onConstruct() {
     /* how many samples that we would like to output as a whole frame */
     m_options.getInt("frame_size", m_frameSize);
     m_options.getBool("b_mute_at_start", m_bMuteAtStart);
+    m_options.getInt("level_interval_ms", m_levelIntervalMs);
+    const string quality = m_options.get(DavOptionAudioResampleQuality());
+    if (!quality.empty() && audioResampleQualityFromStr(quality, m_resampleQuality) < 0)
+        LOG(WARNING) << m_logtag << "unknown audio resample quality " << quality << ", use balanced";
 
     /* register event */
     std::function<int (const DavEventVideoMixSync &)> f =
@@ -210,31 +216,109 @@ int AudioMix::mixFrameByFramePts(DavProcCtx & ctx) {
         shared_ptr<AVFrame> frame = syncer.second->receiveFrame();
         if (!frame) /* could return null, if syncer in skip status */
             continue;
-        /* check muted participant here (skip mixing then) */
-        if (std::find(m_muteGroups.begin(), m_muteGroups.end(), syncer.second->getGroupId()) != m_muteGroups.end())
-            continue;
-        toMixFrame(mixFrame, frame.get());
+        /* check muted participant here (skip mixing then, but still metering its level) */
+        const bool bMuted = std::find(m_muteGroups.begin(), m_muteGroups.end(),
+                                      syncer.second->getGroupId()) != m_muteGroups.end();
+        toMixFrame(mixFrame, frame.get(), m_levelMeters[syncer.first], !bMuted);
     }
     mixFrame->pts = m_curMixPts;
     m_outputMixFrames++;
     outBuf->m_travelStatic = m_outputTravelStatic.at(IMPL_SINGLE_OUTPUT_STREAM_INDEX);
     ctx.m_outBufs.push_back(outBuf);
+
+    if (m_levelIntervalMs > 0) {
+        if (m_nextLevelReportPts == AV_NOPTS_VALUE)
+            m_nextLevelReportPts = m_curMixPts + av_rescale(m_levelIntervalMs, m_dstSamplerate, 1000);
+        if (m_curMixPts + m_frameSize >= m_nextLevelReportPts) {
+            publishAudioLevels(ctx);
+            m_nextLevelReportPts += av_rescale(m_levelIntervalMs, m_dstSamplerate, 1000);
+        }
+    }
     return 0;
 }
 
-int AudioMix::toMixFrame(AVFrame *mixFrame, const AVFrame *frame) {
+int AudioMix::publishAudioLevels(DavProcCtx & ctx) {
+    auto levelEvent = make_shared<DavEventAudioMixLevels>();
+    levelEvent->m_mixPts = av_rescale_q(m_curMixPts, AVRational {1, m_dstSamplerate}, AV_TIME_BASE_Q);
+    auto toDb = [] (const double v) {
+        return v > 0.00001 ? 20.0 * std::log10(v) : AUDIO_LEVEL_SILENCE_DB;
+    };
+
+    int64_t loudestGroupId = -1;
+    double loudestDb = AUDIO_LEVEL_SILENCE_DB;
+    double activeSpeakerDb = AUDIO_LEVEL_SILENCE_DB;
+    for (auto & m : m_levelMeters) {
+        auto & meter = m.second;
+        DavEventAudioMixLevels::AudioLevel level;
+        level.m_from = m.first;
+        level.m_bMuted = std::find(m_muteGroups.begin(), m_muteGroups.end(),
+                                   m.first.m_groupId) != m_muteGroups.end();
+        if (meter.m_samples > 0) {
+            level.m_rmsDb = toDb(std::sqrt(meter.m_sumSquare / meter.m_samples));
+            level.m_peakDb = toDb(meter.m_peak);
+        }
+        meter.m_smoothedRmsDb = AUDIO_LEVEL_SMOOTH_FACTOR * meter.m_smoothedRmsDb +
+            (1.0 - AUDIO_LEVEL_SMOOTH_FACTOR) * level.m_rmsDb;
+        level.m_smoothedRmsDb = meter.m_smoothedRmsDb;
+        meter.m_sumSquare = 0.0;
+        meter.m_peak = 0.0f;
+        meter.m_samples = 0;
+
+        if (!level.m_bMuted) {
+            if (level.m_smoothedRmsDb > loudestDb) {
+                loudestDb = level.m_smoothedRmsDb;
+                loudestGroupId = (int64_t)m.first.m_groupId;
+            }
+            if ((int64_t)m.first.m_groupId == m_activeSpeakerGroupId)
+                activeSpeakerDb = level.m_smoothedRmsDb;
+        }
+        levelEvent->m_levels.emplace_back(level);
+    }
+
+    /* keep the last speaker during silence; switch only if the new one is clearly louder */
+    if (loudestDb > ACTIVE_SPEAKER_THRESHOLD_DB && loudestGroupId != m_activeSpeakerGroupId &&
+        (activeSpeakerDb < ACTIVE_SPEAKER_THRESHOLD_DB ||
+         loudestDb > activeSpeakerDb + ACTIVE_SPEAKER_HYSTERESIS_DB)) {
+        LOG(INFO) << m_logtag << "active speaker changed from group " << m_activeSpeakerGroupId
+                  << " to " << loudestGroupId << ", level " << loudestDb << "dB";
+        m_activeSpeakerGroupId = loudestGroupId;
+    }
+    levelEvent->m_activeSpeakerGroupId = m_activeSpeakerGroupId;
+    levelEvent->getAddress().setFromStreamIndex(IMPL_SINGLE_OUTPUT_STREAM_INDEX);
+    ctx.m_pubEvents.emplace_back(levelEvent);
+    return 0;
+}
+
+int AudioMix::toMixFrame(AVFrame *mixFrame, const AVFrame *frame, AudioLevelMeter & meter, const bool bMix) {
     /* right now, only AV_SAMPLE_FMT_FLTP and AV_CH_LAYOUT_STEREO supported */
     /* frame->linesize[0] is one channel's size, it may not equal to m_frameSize */
     const int offset = mixFrame->nb_samples - frame->nb_samples;
     CHECK(offset >= 0 && m_dstFmt == AV_SAMPLE_FMT_FLTP && m_dstLayout == AV_CH_LAYOUT_STEREO);
     const int channels = av_get_channel_layout_nb_channels(m_dstLayout);
+    /* levels are accumulated in the same pass as mixing, no extra read of the input */
+    float peak = meter.m_peak;
     for (int k=0; k < channels; k++) {
         float *dataDst = (float *)mixFrame->data[k] + offset;
-        float *dataSrc = (float *)frame->data[k];
-        for (int j=0; j < frame->nb_samples; j++) {
-            dataDst[j] = (dataDst[j] + dataSrc[j]) / 2;
+        const float *dataSrc = (const float *)frame->data[k];
+        float sumSquare = 0.0f;
+        if (bMix) {
+            for (int j=0; j < frame->nb_samples; j++) {
+                const float s = dataSrc[j];
+                dataDst[j] = (dataDst[j] + s) / 2;
+                sumSquare += s * s;
+                peak = std::max(peak, std::fabs(s));
+            }
+        } else {
+            for (int j=0; j < frame->nb_samples; j++) {
+                const float s = dataSrc[j];
+                sumSquare += s * s;
+                peak = std::max(peak, std::fabs(s));
+            }
         }
+        meter.m_sumSquare += sumSquare;
     }
+    meter.m_peak = peak;
+    meter.m_samples += (int64_t)frame->nb_samples * channels;
     return 0;
 }
 
@@ -28,18 +28,33 @@ private:
     int processVideoMixSync(const DavEventVideoMixSync &);
     int processMuteUnute(const DavDynaEventAudioMixMuteUnmute & event);
 
+private:
+    /* per input level accumulated between two level reports */
+    struct AudioLevelMeter {
+        double m_sumSquare = 0.0;
+        float m_peak = 0.0f;
+        int64_t m_samples = 0;
+        double m_smoothedRmsDb = AUDIO_LEVEL_SILENCE_DB;
+    };
+    static constexpr double AUDIO_LEVEL_SILENCE_DB = -100.0;
+    static constexpr double AUDIO_LEVEL_SMOOTH_FACTOR = 0.7; /* weight of history in smoothed rms */
+    static constexpr double ACTIVE_SPEAKER_THRESHOLD_DB = -50.0;
+    static constexpr double ACTIVE_SPEAKER_HYSTERESIS_DB = 6.0;
+
 private:
     int addOneSyncerStream(DavProcCtx & ctx);
     int processVideoSyncEvent() {return 0;}
     int mixFrameByFramePts(DavProcCtx & ctx);
-    int toMixFrame(AVFrame *mixFrame, const AVFrame *frame);
+    int toMixFrame(AVFrame *mixFrame, const AVFrame *frame, AudioLevelMeter & meter, const bool bMix);
     int setupMixFrame(AVFrame *mixFrame);
+    int publishAudioLevels(DavProcCtx & ctx);
 
 private:
     map<DavProcFrom, unique_ptr<AudioSyncer>> m_syncers;
     vector<size_t> m_muteGroups;
     bool m_bMuteAtStart = false;
     int m_frameSize = 1024;
+    EAudioResampleQuality m_resampleQuality = EAudioResampleQuality::eBalanced;
     enum AVSampleFormat m_dstFmt = AV_SAMPLE_FMT_FLTP;
     int m_dstSamplerate = 44100;
     uint64_t m_dstLayout = AV_CH_LAYOUT_STEREO;
@@ -54,6 +69,11 @@ private:
     int64_t m_videoMixStartPts = AV_NOPTS_VALUE;
     int64_t m_videoMixCurPts = AV_NOPTS_VALUE;
     DavEventVideoMixSync m_lastVideoSync;
+    /* audio levels and active speaker; report interval <= 0 disables level events */
+    map<DavProcFrom, AudioLevelMeter> m_levelMeters;
+    int m_levelIntervalMs = 200;
+    int64_t m_nextLevelReportPts = AV_NOPTS_VALUE;
+    int64_t m_activeSpeakerGroupId = -1;
     bool m_bAutoQuit = true;
 };
 
@@ -57,7 +57,7 @@ bool AudioSyncer::processSync(const int desiredSize, const int64_t curMixPts) {
         /* video not coming, and we have audio data more than MAX, throw away one frame */
         const int64_t curPts = m_resampler->getCurPts();
         if (m_resampler->getFifoCurSizeInMs() > DEFAULT_MAX_AUDIO_SIZE_IN_MS) {
-            m_resampler->receiveResampledFrame(desiredSize);
+            m_resampler->discardResampledData(desiredSize);
             LOG(INFO) << m_logtag << " skip one frame with size " << desiredSize << ", pts " << curPts;
         }
         m_audioOutputDataLen = 0;
@@ -88,7 +88,7 @@ bool AudioSyncer::processSync(const int desiredSize, const int64_t curMixPts) {
         else {
             m_audioOutputDataLen = desiredSize;
             const int throwDataSize = (int)(desiredAudioDataPts - curAudioPts);
-            m_resampler->receiveResampledFrame(throwDataSize);
+            m_resampler->discardResampledData(throwDataSize);
             LOG(INFO) << m_logtag << " Throw dealyed data with size " << throwDataSize
                       << ", pts " << curAudioPts;
         }
@@ -99,7 +99,7 @@ bool AudioSyncer::processSync(const int desiredSize, const int64_t curMixPts) {
     int throwDataSize = (int)(desiredAudioDataPts - curAudioPts);
     throwDataSize = throwDataSize > curDataSampleSize ? curDataSampleSize : throwDataSize;
     if (throwDataSize > 0) {
-        m_resampler->receiveResampledFrame(throwDataSize);
+        m_resampler->discardResampledData(throwDataSize);
         LOG(INFO) << m_logtag << "In Past. Throw dealyed data with size "
                   << throwDataSize << ", pts " << curAudioPts;
     }
@@ -22,6 +22,15 @@ int DataRelay::onConstruct() {
     LOG(INFO) << "DataRelay just do data relay " << m_options.dump();
     m_bDataRelay = true;
     m_bDynamicallyInitialized = true;
+    std::function<int (const DavEventFrameDemand &)> f =
+        [this] (const DavEventFrameDemand & e) {m_frameDemand.update(e); return 0;};
+    m_implEvent.registerEvent(f);
+    std::function<int (const DavStopPubEvent &)> s =
+        [this] (const DavStopPubEvent & e) {m_frameDemand.remove(e.getAddress().m_from); return 0;};
+    m_implEvent.registerEvent(s);
+    /* relay subscribes detectors for their frame demand only, their results are not for it */
+    std::function<int (const ObjDetectEvent &)> d = [] (const ObjDetectEvent &) {return 0;};
+    m_implEvent.registerEvent(d);
     return 0;
 }
 
@@ -46,6 +55,15 @@ int DataRelay::onProcess(DavProcCtx & ctx) {
     outBuf->mkAVPacket(pkt);
     outBuf->m_travelStatic = ctx.m_inBuf->m_travelStatic;
     ctx.m_outBufs.emplace_back(outBuf);
+
+    DavFrameDemand::Demand combined;
+    if (m_frameDemand.combine(ctx.m_tos, combined)) {
+        auto demand = make_shared<DavEventFrameDemand>();
+        demand->m_fps = combined.m_fps;
+        demand->m_bReferenceExact = combined.m_bReferenceExact;
+        demand->getAddress().setFromStreamIndex(IMPL_SINGLE_OUTPUT_STREAM_INDEX);
+        ctx.m_pubEvents.emplace_back(demand);
+    }
     return 0;
 }
 
@@ -5,6 +5,7 @@
 #include "davDict.h"
 #include "davImpl.h"
 #include "davImplTravel.h"
+#include "davFrameDemand.h"
 
 namespace ff_dynamic {
 
@@ -24,6 +25,10 @@ private:
     virtual int onDynamicallyInitializeViaTravelStatic(DavProcCtx & ctx) {return 0;};
     virtual int onProcessTravelDynamic(DavProcCtx & ctx) {return 0;}
     virtual const DavRegisterProperties & getRegisterProperties() const noexcept;
+
+private:
+    /* pass consumers' combined frame demand to the upstream decoder */
+    DavFrameDemand m_frameDemand;
 };
 
 } //namespace ff_dynamic
@@ -0,0 +1,31 @@
+#include <algorithm>
+#include "davFrameDemand.h"
+
+namespace ff_dynamic {
+
+void DavFrameDemand::update(const DavEventFrameDemand & e) {
+    Demand d;
+    d.m_fps = std::max(e.m_fps, 0.0);
+    d.m_bReferenceExact = e.m_bReferenceExact;
+    m_demands[e.getAddress().m_from] = d;
+}
+
+bool DavFrameDemand::combine(const vector<DavProcFrom> & tos, Demand & combined) {
+    combined = Demand();
+    combined.m_bReferenceExact = tos.empty();
+    for (auto & to : tos) {
+        auto it = m_demands.find(to.m_from);
+        if (it == m_demands.end() || it->second.isDense()) {
+            combined = Demand();
+            break;
+        }
+        combined.m_fps = std::max(combined.m_fps, it->second.m_fps);
+        combined.m_bReferenceExact = combined.m_bReferenceExact || it->second.m_bReferenceExact;
+    }
+    const bool bChanged = combined.m_fps != m_combined.m_fps ||
+        combined.m_bReferenceExact != m_combined.m_bReferenceExact;
+    m_combined = combined;
+    return bChanged;
+}
+
+} // namespace ff_dynamic
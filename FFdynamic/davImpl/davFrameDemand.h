@@ -0,0 +1,33 @@
+#pragma once
+
+#include <map>
+#include <vector>
+#include "davPeerEvent.h"
+
+namespace ff_dynamic {
+using ::std::map;
+using ::std::vector;
+
+/* Frame demands declared by subscribed consumers (DavEventFrameDemand). Output peers which
+   never declared one take every frame, so the combined demand is sparse only if all of
+   the current output peers are sparse. */
+class DavFrameDemand {
+public:
+    struct Demand {
+        double m_fps = 0.0; /* 0 for every frame */
+        bool m_bReferenceExact = true;
+        inline bool isDense() const noexcept {return m_fps <= 0.0;}
+    };
+
+    void update(const DavEventFrameDemand & e);
+    void remove(const DavProc *consumer) {m_demands.erase(consumer);}
+    /* combine demands of 'tos'; return true if it differs from the last combined one */
+    bool combine(const vector<DavProcFrom> & tos, Demand & combined);
+    inline const Demand & getCombined() const noexcept {return m_combined;}
+
+private:
+    map<const DavProc *, Demand> m_demands;
+    Demand m_combined;
+};
+
+} // namespace ff_dynamic
@@ -93,7 +93,7 @@ class DavImpl {
 
     /* use AVDictionary for implementation's statistics (avoid introduce json dependency)
      */
-    virtual int statistics(AVDictionary &stat) { return 0; };
+    virtual int statistics(AVDictionary **stat) { return 0; };
     virtual const DavRegisterProperties &getRegisterProperties() const noexcept = 0;
 
     /* trival helpers */
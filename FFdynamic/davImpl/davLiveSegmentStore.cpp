@@ -0,0 +1,351 @@
+#include <stdio.h>
+#include <algorithm>
+#include <chrono>
+#include <glog/logging.h>
+#include "ffmpegHeaders.h"
+#include "davLiveSegmentStore.h"
+
+namespace ff_dynamic {
+
+static const char *s_logtag = "[DavLiveSegmentStore] ";
+static const size_t s_partialSegments = 3; /* complete segments still listing their parts */
+
+static string toSeconds(const int64_t us) {
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%.3f", us / 1000000.0);
+    return buf;
+}
+
+int DavLiveSegmentStore::openStream(const string & name, const DavLiveStreamParams & params) {
+    vector<std::pair<DavLiveWaitCallback, int>> done;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        Stream & s = m_streams[name];
+        s.m_params = params;
+        s.m_params.m_windowSegments = std::max(s.m_params.m_windowSegments, 2);
+        if (s.m_segments.size()) { /* reopened: close the cut off segment, continue after a discontinuity */
+            completeSegment(s);
+            s.m_bDiscontinuity = true;
+        }
+        s.m_bEnded = false;
+        LOG(INFO) << s_logtag << "open stream " << name << ", segment " << params.m_segmentUs / 1000
+                  << "ms, part " << params.m_partUs / 1000 << "ms, window " << s.m_params.m_windowSegments;
+        collectDone(done);
+    }
+    complete(done);
+    return 0;
+}
+
+int DavLiveSegmentStore::closeStream(const string & name) {
+    vector<std::pair<DavLiveWaitCallback, int>> done;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_streams.find(name);
+        if (it == m_streams.end())
+            return AVERROR(ENOENT);
+        it->second.m_bEnded = true;
+        LOG(INFO) << s_logtag << "stream " << name << " ended at sequence " << it->second.m_nextMsn;
+        collectDone(done);
+    }
+    complete(done);
+    return 0;
+}
+
+int DavLiveSegmentStore::removeStream(const string & name) {
+    vector<std::pair<DavLiveWaitCallback, int>> done;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_streams.erase(name) == 0)
+            return AVERROR(ENOENT);
+        collectDone(done);
+    }
+    complete(done);
+    return 0;
+}
+
+int DavLiveSegmentStore::setInit(const string & name, const string & data) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_streams.find(name);
+    if (it == m_streams.end())
+        return AVERROR(ENOENT);
+    it->second.m_initSeq++;
+    it->second.m_inits[it->second.m_initSeq] = std::make_shared<const string>(data);
+    return 0;
+}
+
+int DavLiveSegmentStore::addPart(const string & name, const string & data,
+                                 const int64_t durationUs, const bool bIndependent) {
+    vector<std::pair<DavLiveWaitCallback, int>> done;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_streams.find(name);
+        if (it == m_streams.end())
+            return AVERROR(ENOENT);
+        Stream & s = it->second;
+        if (s.m_segments.empty() || s.m_segments.back().m_bComplete) {
+            Segment seg;
+            seg.m_msn = s.m_nextMsn++;
+            seg.m_initSeq = s.m_initSeq;
+            seg.m_bDiscontinuity = s.m_bDiscontinuity;
+            s.m_bDiscontinuity = false;
+            s.m_segments.emplace_back(seg);
+        }
+        Part p;
+        p.m_data = std::make_shared<const string>(data);
+        p.m_durationUs = durationUs;
+        p.m_bIndependent = bIndependent;
+        s.m_segments.back().m_parts.emplace_back(p);
+        s.m_segments.back().m_durationUs += durationUs;
+        collectDone(done);
+    }
+    complete(done);
+    return 0;
+}
+
+int DavLiveSegmentStore::endSegment(const string & name) {
+    vector<std::pair<DavLiveWaitCallback, int>> done;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_streams.find(name);
+        if (it == m_streams.end())
+            return AVERROR(ENOENT);
+        completeSegment(it->second);
+        collectDone(done);
+    }
+    complete(done);
+    return 0;
+}
+
+void DavLiveSegmentStore::completeSegment(Stream & s) {
+    if (s.m_segments.empty() || s.m_segments.back().m_bComplete)
+        return;
+    Segment & seg = s.m_segments.back();
+    if (seg.m_parts.empty()) {
+        s.m_segments.pop_back();
+        return;
+    }
+    string data;
+    for (auto & p : seg.m_parts)
+        data += *p.m_data;
+    seg.m_data = std::make_shared<const string>(std::move(data));
+    seg.m_bComplete = true;
+    s.m_maxSegmentUs = std::max(s.m_maxSegmentUs, seg.m_durationUs);
+
+    /* window of complete segments, and parts only near the live edge */
+    while (s.m_segments.size() > (size_t)s.m_params.m_windowSegments) {
+        if (s.m_segments.front().m_bDiscontinuity)
+            s.m_discontinuitySeq++;
+        s.m_segments.pop_front();
+    }
+    if (s.m_segments.size() > s_partialSegments) {
+        Segment & old = s.m_segments[s.m_segments.size() - 1 - s_partialSegments];
+        for (auto & p : old.m_parts)
+            p.m_data.reset();
+    }
+    const int oldestInit = s.m_segments.front().m_initSeq;
+    for (auto init = s.m_inits.begin(); init != s.m_inits.end() && init->first < oldestInit;)
+        init = s.m_inits.erase(init);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool DavLiveSegmentStore::isAvailable(const Stream & s, const int64_t msn, const int part) const {
+    if (s.m_segments.empty())
+        return false;
+    const Segment & last = s.m_segments.back();
+    if (msn < last.m_msn)
+        return true;
+    if (msn > last.m_msn)
+        return false;
+    return part < 0 ? last.m_bComplete : (last.m_bComplete || (int)last.m_parts.size() > part);
+}
+
+void DavLiveSegmentStore::collectDone(vector<std::pair<DavLiveWaitCallback, int>> & done) {
+    const int64_t now = av_gettime_relative();
+    auto it = m_waiters.begin();
+    while (it != m_waiters.end()) {
+        int ret = 1;
+        auto s = m_streams.find(it->m_name);
+        if (s == m_streams.end())
+            ret = AVERROR(ENOENT);
+        else if (isAvailable(s->second, it->m_msn, it->m_part))
+            ret = 0;
+        else if (s->second.m_bEnded)
+            ret = AVERROR(ENOENT);
+        else if (now > it->m_deadline)
+            ret = AVERROR(ETIMEDOUT);
+        if (ret > 0) {
+            ++it;
+            continue;
+        }
+        done.emplace_back(std::move(it->m_callback), ret);
+        it = m_waiters.erase(it);
+    }
+}
+
+void DavLiveSegmentStore::complete(vector<std::pair<DavLiveWaitCallback, int>> & done) {
+    for (auto & d : done)
+        d.first(d.second);
+    done.clear();
+}
+
+DavLiveSegmentStore::~DavLiveSegmentStore() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_bStopSweep = true;
+    }
+    m_sweepCond.notify_one();
+    if (m_sweeper)
+        m_sweeper->join();
+}
+
+/* expire waits at their deadline; available/ended ones are completed by the publisher */
+void DavLiveSegmentStore::sweepLoop() {
+    vector<std::pair<DavLiveWaitCallback, int>> done;
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (!m_bStopSweep) {
+        if (m_waiters.empty()) {
+            m_sweepCond.wait(lock);
+        } else {
+            int64_t deadline = m_waiters[0].m_deadline;
+            for (auto & w : m_waiters)
+                deadline = std::min(deadline, w.m_deadline);
+            const int64_t waitUs = deadline - av_gettime_relative() + 1000;
+            if (waitUs > 0)
+                m_sweepCond.wait_for(lock, std::chrono::microseconds(waitUs));
+        }
+        if (m_bStopSweep)
+            break;
+        collectDone(done);
+        if (done.empty())
+            continue;
+        lock.unlock();
+        complete(done);
+        lock.lock();
+    }
+}
+
+int DavLiveSegmentStore::waitFor(const string & name, const int64_t msn, const int part,
+                                 const int64_t timeoutUs, const DavLiveWaitCallback & callback) {
+    int ret = 0;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_streams.find(name);
+        if (it == m_streams.end())
+            ret = AVERROR(ENOENT);
+        else if (msn > lastCompleteMsn(it->second) + 2) /* blocking reload: at most two segments ahead */
+            ret = AVERROR(EINVAL);
+        else if (isAvailable(it->second, msn, part))
+            ret = 0;
+        else if (it->second.m_bEnded)
+            ret = AVERROR(ENOENT);
+        else {
+            Waiter w;
+            w.m_name = name;
+            w.m_msn = msn;
+            w.m_part = part;
+            w.m_deadline = av_gettime_relative() + timeoutUs;
+            w.m_callback = callback;
+            m_waiters.emplace_back(std::move(w));
+            if (!m_sweeper)
+                m_sweeper.reset(new std::thread(&DavLiveSegmentStore::sweepLoop, this));
+            m_sweepCond.notify_one();
+            return 0;
+        }
+    }
+    callback(ret);
+    return 0;
+}
+
+int DavLiveSegmentStore::getPlaylist(const string & name, string & playlist) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_streams.find(name);
+    if (it == m_streams.end())
+        return AVERROR(ENOENT);
+    const Stream & s = it->second;
+    if (s.m_segments.empty())
+        return AVERROR(EAGAIN);
+    const int64_t targetUs = std::max(s.m_params.m_segmentUs, s.m_maxSegmentUs);
+    playlist = "#EXTM3U\n#EXT-X-VERSION:6\n";
+    playlist += "#EXT-X-TARGETDURATION:" + std::to_string((targetUs + 999999) / 1000000) + "\n";
+    playlist += "#EXT-X-SERVER-CONTROL:CAN-BLOCK-RELOAD=YES,PART-HOLD-BACK=" +
+        toSeconds(3 * s.m_params.m_partUs) + "\n";
+    playlist += "#EXT-X-PART-INF:PART-TARGET=" + toSeconds(s.m_params.m_partUs) + "\n";
+    playlist += "#EXT-X-MEDIA-SEQUENCE:" + std::to_string(s.m_segments.front().m_msn) + "\n";
+    playlist += "#EXT-X-DISCONTINUITY-SEQUENCE:" + std::to_string(s.m_discontinuitySeq) + "\n";
+    int initSeq = -1;
+    for (auto & seg : s.m_segments) {
+        if (seg.m_bDiscontinuity)
+            playlist += "#EXT-X-DISCONTINUITY\n";
+        if (seg.m_initSeq != initSeq) {
+            initSeq = seg.m_initSeq;
+            playlist += "#EXT-X-MAP:URI=\"init" + std::to_string(initSeq) + ".mp4\"\n";
+        }
+        const string msn = std::to_string(seg.m_msn);
+        for (size_t k = 0; k < seg.m_parts.size(); k++) {
+            if (!seg.m_parts[k].m_data)
+                break;
+            playlist += "#EXT-X-PART:DURATION=" + toSeconds(seg.m_parts[k].m_durationUs) + ",URI=\"part" +
+                msn + "." + std::to_string(k) + ".m4s\"" + (seg.m_parts[k].m_bIndependent ? ",INDEPENDENT=YES\n" : "\n");
+        }
+        if (seg.m_bComplete && seg.m_data)
+            playlist += "#EXTINF:" + toSeconds(seg.m_durationUs) + ",\nseg" + msn + ".m4s\n";
+    }
+    if (s.m_bEnded) {
+        playlist += "#EXT-X-ENDLIST\n";
+        return 0;
+    }
+    const Segment & last = s.m_segments.back();
+    const int64_t nextMsn = last.m_bComplete ? s.m_nextMsn : last.m_msn;
+    const size_t nextPart = last.m_bComplete ? 0 : last.m_parts.size();
+    playlist += "#EXT-X-PRELOAD-HINT:TYPE=PART,URI=\"part" + std::to_string(nextMsn) + "." +
+        std::to_string(nextPart) + ".m4s\"\n";
+    return 0;
+}
+
+const DavLiveSegmentStore::Segment *DavLiveSegmentStore::findSegment(const Stream & s, const int64_t msn) const {
+    if (s.m_segments.empty() || msn < s.m_segments.front().m_msn || msn > s.m_segments.back().m_msn)
+        return nullptr;
+    return &s.m_segments[msn - s.m_segments.front().m_msn];
+}
+
+int64_t DavLiveSegmentStore::lastCompleteMsn(const Stream & s) const {
+    if (s.m_segments.empty())
+        return s.m_nextMsn - 1;
+    return s.m_segments.back().m_bComplete ? s.m_segments.back().m_msn : s.m_segments.back().m_msn - 1;
+}
+
+shared_ptr<const string> DavLiveSegmentStore::getInit(const string & name, const int initSeq) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_streams.find(name);
+    if (it == m_streams.end() || it->second.m_inits.count(initSeq) == 0)
+        return nullptr;
+    return it->second.m_inits.at(initSeq);
+}
+
+shared_ptr<const string> DavLiveSegmentStore::getSegment(const string & name, const int64_t msn) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_streams.find(name);
+    if (it == m_streams.end())
+        return nullptr;
+    const Segment *seg = findSegment(it->second, msn);
+    return seg && seg->m_bComplete ? seg->m_data : nullptr;
+}
+
+shared_ptr<const string> DavLiveSegmentStore::getPart(const string & name, const int64_t msn, const int part) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_streams.find(name);
+    if (it == m_streams.end())
+        return nullptr;
+    const Segment *seg = findSegment(it->second, msn);
+    if (!seg || part < 0 || part >= (int)seg->m_parts.size())
+        return nullptr;
+    return seg->m_parts[part].m_data;
+}
+
+int64_t DavLiveSegmentStore::getSegmentUs(const string & name) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_streams.find(name);
+    return it == m_streams.end() ? 0 : it->second.m_params.m_segmentUs;
+}
+
+} // namespace ff_dynamic
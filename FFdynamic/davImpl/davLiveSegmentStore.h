@@ -0,0 +1,119 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace ff_dynamic {
+using ::std::deque;
+using ::std::map;
+using ::std::shared_ptr;
+using ::std::string;
+using ::std::unique_ptr;
+using ::std::vector;
+
+struct DavLiveStreamParams {
+    int64_t m_segmentUs = 2000000;  /* target segment duration; segments are cut on key frames */
+    int64_t m_partUs = 333333;      /* target partial segment duration */
+    int m_windowSegments = 6;       /* complete segments kept */
+};
+
+/* called once: 0 if the waited part/segment is available, AVERROR(ETIMEDOUT), AVERROR(EINVAL) if it is
+   too far ahead, AVERROR(ENOENT) if the stream is gone or ended before it */
+using DavLiveWaitCallback = std::function<void (const int ret)>;
+
+/* Process wide in memory store of low latency HLS streams: a segmenter publishes the init section,
+   partial segments and segment boundaries of a stream by name, http handlers serve the playlist and
+   media from it. Blocking playlist reload is a wait on (msn, part), completed when it is published;
+   callbacks run on the publisher's thread (or the caller's if available already), without the lock.
+   Expired waits are completed by a sweeper thread at their deadline, even if the stream stalls. */
+class DavLiveSegmentStore {
+public:
+    static DavLiveSegmentStore & getOnlyInstance() {
+        static DavLiveSegmentStore s_instance;
+        return s_instance;
+    }
+
+    /* (re)open a stream; reopening continues its sequence numbers after a discontinuity */
+    int openStream(const string & name, const DavLiveStreamParams & params);
+    /* the stream ends (EXT-X-ENDLIST), still served till reopened or removed */
+    int closeStream(const string & name);
+    int removeStream(const string & name);
+    int setInit(const string & name, const string & data);
+    int addPart(const string & name, const string & data, const int64_t durationUs, const bool bIndependent);
+    /* closes current segment, the next part starts a new one */
+    int endSegment(const string & name);
+
+    /* part < 0 waits for the complete segment 'msn' */
+    int waitFor(const string & name, const int64_t msn, const int part, const int64_t timeoutUs,
+                const DavLiveWaitCallback & callback);
+    int getPlaylist(const string & name, string & playlist);
+    /* init sections are numbered, a reopened stream may come with another one */
+    shared_ptr<const string> getInit(const string & name, const int initSeq);
+    shared_ptr<const string> getSegment(const string & name, const int64_t msn);
+    shared_ptr<const string> getPart(const string & name, const int64_t msn, const int part);
+    int64_t getSegmentUs(const string & name);
+
+private:
+    DavLiveSegmentStore() = default;
+    ~DavLiveSegmentStore();
+    DavLiveSegmentStore(const DavLiveSegmentStore &) = delete;
+    DavLiveSegmentStore & operator= (const DavLiveSegmentStore &) = delete;
+    struct Part {
+        shared_ptr<const string> m_data;
+        int64_t m_durationUs = 0;
+        bool m_bIndependent = false;
+    };
+    struct Segment {
+        int64_t m_msn = 0;
+        int m_initSeq = 0;
+        bool m_bDiscontinuity = false;
+        bool m_bComplete = false;
+        int64_t m_durationUs = 0;
+        vector<Part> m_parts;
+        shared_ptr<const string> m_data; /* once complete */
+    };
+    struct Waiter {
+        string m_name;
+        int64_t m_msn = 0;
+        int m_part = -1;
+        int64_t m_deadline = 0;
+        DavLiveWaitCallback m_callback;
+    };
+    struct Stream {
+        DavLiveStreamParams m_params;
+        int m_initSeq = 0;
+        map<int, shared_ptr<const string>> m_inits; /* the latest, and older ones still in the window */
+        deque<Segment> m_segments;  /* the last one may be in progress */
+        int64_t m_nextMsn = 0;
+        int64_t m_discontinuitySeq = 0;
+        bool m_bDiscontinuity = false;
+        bool m_bEnded = false;
+        int64_t m_maxSegmentUs = 0;
+    };
+    void completeSegment(Stream & s);
+    bool isAvailable(const Stream & s, const int64_t msn, const int part) const;
+    /* the last segment listed in the playlist; the one in progress only has its parts listed */
+    int64_t lastCompleteMsn(const Stream & s) const;
+    /* move out the waits that are done, with their result */
+    void collectDone(vector<std::pair<DavLiveWaitCallback, int>> & done);
+    void complete(vector<std::pair<DavLiveWaitCallback, int>> & done);
+    const Segment *findSegment(const Stream & s, const int64_t msn) const;
+    void sweepLoop();
+
+private:
+    std::mutex m_mutex;
+    map<string, Stream> m_streams;
+    vector<Waiter> m_waiters;
+    std::condition_variable m_sweepCond; /* a wait added, or stop */
+    bool m_bStopSweep = false;
+    unique_ptr<std::thread> m_sweeper;   /* started with the first wait */
+};
+
+} // namespace ff_dynamic
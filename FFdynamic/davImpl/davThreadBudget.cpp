@@ -0,0 +1,80 @@
+#include <thread>
+#include <algorithm>
+#include <glog/logging.h>
+#include "davThreadBudget.h"
+
+namespace ff_dynamic {
+
+static int hardwareCores() {
+    const int cores = (int)std::thread::hardware_concurrency();
+    return cores > 0 ? cores : 1;
+}
+
+DavThreadBudget::DavThreadBudget() : m_coreBudget(hardwareCores()) {
+}
+
+void DavThreadBudget::setCoreBudget(const int cores) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_coreBudget = cores > 0 ? cores : hardwareCores();
+    LOG(INFO) << "[DavThreadBudget] ffmpeg internal thread budget set to " << m_coreBudget;
+}
+
+int DavThreadBudget::getCoreBudget() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_coreBudget;
+}
+
+/* fair share among active users, capped by what is left; the ones opened first may keep more.
+   No preference takes at most half of what is left, so contexts opened later aren't starved */
+int DavThreadBudget::acquire(const void *user, const string & owner, const int desired) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_allocations.find(user);
+    if (it != m_allocations.end()) {
+        m_allocatedThreads -= it->second.m_assigned;
+        m_allocations.erase(it);
+    }
+    const int users = (int)m_allocations.size() + 1;
+    const int fairShare = std::max(1, m_coreBudget / users);
+    const int cap = std::max(1, std::min(fairShare, m_coreBudget - m_allocatedThreads));
+    Allocation allocation;
+    allocation.m_owner = owner;
+    allocation.m_desired = desired;
+    const int autoCap = std::max(1, std::min(cap, (m_coreBudget - m_allocatedThreads) / 2));
+    allocation.m_assigned = desired > 0 ? std::min(desired, cap) : autoCap;
+    m_allocatedThreads += allocation.m_assigned;
+    m_allocations.emplace(user, allocation);
+    LOG(INFO) << "[DavThreadBudget] " << owner << " desired " << desired << ", assigned "
+              << allocation.m_assigned << "; allocated " << m_allocatedThreads << "/" << m_coreBudget
+              << " by " << users << " users";
+    return allocation.m_assigned;
+}
+
+void DavThreadBudget::release(const void *user) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_allocations.find(user);
+    if (it == m_allocations.end())
+        return;
+    m_allocatedThreads -= it->second.m_assigned;
+    m_allocations.erase(it);
+}
+
+map<const void *, DavThreadBudget::Allocation> DavThreadBudget::getAllocations() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_allocations;
+}
+
+int DavThreadBudget::getAllocatedThreads() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_allocatedThreads;
+}
+
+std::ostream & operator<<(std::ostream & os, DavThreadBudget & budget) {
+    const auto allocations = budget.getAllocations();
+    os << "thread budget " << budget.getCoreBudget() << ", allocated " << budget.getAllocatedThreads();
+    for (const auto & a : allocations)
+        os << "\n  " << a.second.m_owner << ": desired " << a.second.m_desired
+           << ", assigned " << a.second.m_assigned;
+    return os;
+}
+
+} // namespace ff_dynamic
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <map>
+#include <mutex>
+#include <string>
+#include <iostream>
+
+namespace ff_dynamic {
+using ::std::map;
+using ::std::string;
+
+/* Process wide budget of ffmpeg internal threads: decoder/encoder thread_count and filter graph nb_threads.
+   Contexts acquire their thread number when opening and release it when closing. Thread number cannot be
+   changed after a context is opened, so the budget only applies to newly opened contexts. */
+class DavThreadBudget {
+public:
+    struct Allocation {
+        string m_owner;     /* normally the logtag of the user */
+        int m_desired = 0;  /* 0 means no preference */
+        int m_assigned = 1;
+    };
+
+    static DavThreadBudget & getOnlyInstance() {
+        static DavThreadBudget s_instance;
+        return s_instance;
+    }
+
+    /* cores shared by all ffmpeg internal threads; <= 0 means hardware concurrency */
+    void setCoreBudget(const int cores);
+    int getCoreBudget();
+    /* return threads assigned to this user, at least 1 (no extra thread); 'desired' 0 gets an even
+       share of what is left, between this user and the ones to come */
+    int acquire(const void *user, const string & owner, const int desired = 0);
+    void release(const void *user);
+    /* current allocation */
+    map<const void *, Allocation> getAllocations();
+    int getAllocatedThreads();
+
+private:
+    DavThreadBudget();
+    DavThreadBudget(const DavThreadBudget &) = delete;
+    DavThreadBudget & operator= (const DavThreadBudget &) = delete;
+    std::mutex m_mutex;
+    int m_coreBudget = 1;
+    int m_allocatedThreads = 0;
+    map<const void *, Allocation> m_allocations;
+};
+
+extern std::ostream & operator<<(std::ostream & os, DavThreadBudget & budget);
+
+} // namespace ff_dynamic
@@ -0,0 +1,183 @@
+#include <algorithm>
+#include <chrono>
+#include <glog/logging.h>
+#include "davUtil.h"
+#include "demuxIo.h"
+
+namespace ff_dynamic {
+
+int DemuxIo::interruptCallback(void *opaque) {
+    DemuxIo *io = static_cast<DemuxIo *>(opaque);
+    if (io->m_bAbort)
+        return 1;
+    const int64_t deadline = io->m_deadline;
+    if (deadline > 0 && av_gettime_relative() > deadline) {
+        io->m_bDeadlineHit = true;
+        return 1;
+    }
+    return 0;
+}
+
+void DemuxIo::attach(AVFormatContext *fmtCtx, const int64_t readTimeoutUs, const int64_t stallThresholdUs) {
+    m_fmtCtx = fmtCtx;
+    m_readTimeoutUs = readTimeoutUs;
+    m_stallThresholdUs = stallThresholdUs;
+    m_bAbort = false; /* may be reattached to a new connection, keeping stats */
+    m_deadline = 0;
+    m_fmtCtx->interrupt_callback.callback = interruptCallback;
+    m_fmtCtx->interrupt_callback.opaque = this;
+}
+
+void DemuxIo::arm(const int64_t timeoutUs) noexcept {
+    m_bDeadlineHit = false;
+    m_deadline = timeoutUs > 0 ? av_gettime_relative() + timeoutUs : 0;
+}
+
+void DemuxIo::disarm() noexcept {
+    m_deadline = 0;
+}
+
+void DemuxIo::abort() noexcept {
+    m_bAbort = true;
+}
+
+int DemuxIo::readFrame(AVPacket *pkt) {
+    arm(m_readTimeoutUs);
+    const int64_t start = av_gettime_relative();
+    int ret = av_read_frame(m_fmtCtx, pkt);
+    const int64_t readUs = av_gettime_relative() - start;
+    disarm();
+    const bool bTimeout = ret < 0 && m_bDeadlineHit;
+    if (bTimeout)
+        ret = AVERROR(ETIMEDOUT);
+
+    std::lock_guard<std::mutex> lock(m_statMutex);
+    m_stat.m_reads++;
+    m_stat.m_maxReadUs = std::max(m_stat.m_maxReadUs, readUs);
+    if (bTimeout)
+        m_stat.m_timeouts++;
+    if (m_stallThresholdUs > 0 && readUs >= m_stallThresholdUs) {
+        m_stat.m_stalls++;
+        m_stat.m_stallUs += readUs;
+        LOG(WARNING) << m_logtag << "read stalled " << readUs / 1000 << "ms" << (bTimeout ? ", timeout" : "");
+    }
+    return ret;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+int DemuxIo::startReadAhead(const size_t maxPackets) {
+    if (m_reader)
+        return 0;
+    m_maxPackets = std::max(maxPackets, (size_t)1);
+    m_bStopReader = false;
+    m_reader.reset(new std::thread(&DemuxIo::readAheadLoop, this));
+    LOG(INFO) << m_logtag << "read ahead started, queue up to " << m_maxPackets << " packets";
+    return 0;
+}
+
+void DemuxIo::stopReadAhead() {
+    if (!m_reader)
+        return;
+    {
+        std::lock_guard<std::mutex> lock(m_queueMutex);
+        m_bStopReader = true;
+    }
+    m_queueCond.notify_all();
+    m_bAbort = true; /* reader may block in io */
+    m_reader->join();
+    m_reader.reset();
+    for (auto & e : m_queue)
+        av_packet_free(&e.m_pkt);
+    m_queue.clear();
+}
+
+void DemuxIo::readAheadLoop() {
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(m_queueMutex);
+            m_queueCond.wait(lock, [this]() {return m_bStopReader || m_queue.size() < m_maxPackets;});
+            if (m_bStopReader)
+                break;
+        }
+        Entry e;
+        e.m_pkt = av_packet_alloc();
+        {
+            std::lock_guard<std::mutex> lock(m_ioMutex);
+            e.m_gen = m_gen;
+            e.m_ret = readFrame(e.m_pkt);
+        }
+        if (e.m_ret == AVERROR(EAGAIN)) {
+            av_packet_free(&e.m_pkt);
+            av_usleep(static_cast<int>(ETimeUs::e5ms));
+            continue;
+        }
+        if (e.m_ret < 0)
+            av_packet_free(&e.m_pkt);
+
+        std::unique_lock<std::mutex> lock(m_queueMutex);
+        if (e.m_gen != m_gen) { /* read before a seek */
+            av_packet_free(&e.m_pkt);
+            continue;
+        }
+        m_queue.emplace_back(e);
+        m_queueCond.notify_all();
+        if (e.m_ret == AVERROR_EOF || (e.m_ret < 0 && m_bAbort)) /* nothing more till a seek */
+            m_queueCond.wait(lock, [this, &e]() {return m_bStopReader || e.m_gen != m_gen;});
+        if (m_bStopReader)
+            break;
+    }
+    LOG(INFO) << m_logtag << "read ahead thread quit";
+}
+
+int DemuxIo::read(AVPacket *pkt, const int64_t waitUs) {
+    if (!m_reader) {
+        std::lock_guard<std::mutex> lock(m_ioMutex);
+        return readFrame(pkt);
+    }
+
+    std::unique_lock<std::mutex> lock(m_queueMutex);
+    if (m_queue.empty()) {
+        const int64_t start = av_gettime_relative();
+        m_queueCond.wait_for(lock, std::chrono::microseconds(waitUs), [this]() {return !m_queue.empty();});
+        std::lock_guard<std::mutex> statLock(m_statMutex);
+        m_stat.m_starves++;
+        m_stat.m_starveUs += av_gettime_relative() - start;
+        if (m_queue.empty())
+            return AVERROR(EAGAIN);
+    }
+    Entry e = m_queue.front();
+    m_queue.pop_front();
+    m_queueCond.notify_all();
+    if (e.m_ret < 0)
+        return e.m_ret;
+    av_packet_move_ref(pkt, e.m_pkt);
+    av_packet_free(&e.m_pkt);
+    return 0;
+}
+
+int DemuxIo::seek(const int streamIndex, const int64_t minTs, const int64_t ts,
+                  const int64_t maxTs, const int flags) {
+    std::lock_guard<std::mutex> ioLock(m_ioMutex);
+    arm(m_readTimeoutUs);
+    int ret = avformat_seek_file(m_fmtCtx, streamIndex, minTs, ts, maxTs, flags);
+    disarm();
+    std::lock_guard<std::mutex> queueLock(m_queueMutex);
+    m_gen++;
+    for (auto & e : m_queue)
+        av_packet_free(&e.m_pkt);
+    m_queue.clear();
+    m_queueCond.notify_all();
+    return ret;
+}
+
+DemuxIoStat DemuxIo::getStat() {
+    std::lock_guard<std::mutex> lock(m_statMutex);
+    return m_stat;
+}
+
+size_t DemuxIo::getQueued() {
+    std::lock_guard<std::mutex> lock(m_queueMutex);
+    return m_queue.size();
+}
+
+} // namespace ff_dynamic
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include "ffmpegHeaders.h"
+
+namespace ff_dynamic {
+using ::std::deque;
+using ::std::string;
+using ::std::unique_ptr;
+
+struct DemuxIoStat {
+    uint64_t m_reads = 0;
+    uint64_t m_timeouts = 0; /* reads aborted by the read deadline */
+    uint64_t m_stalls = 0;   /* reads that blocked longer than the stall threshold */
+    int64_t m_stallUs = 0;   /* total blocking time of those reads */
+    int64_t m_maxReadUs = 0;
+    uint64_t m_starves = 0;  /* consumer found the read ahead queue empty */
+    int64_t m_starveUs = 0;
+};
+
+/* Blocking io of a demuxer's format context: interrupt_callback enforces open/read deadlines and aborts
+   on stop; optionally packets are read ahead on a separate thread into a bounded queue, so a slow source
+   won't block the wave thread and io overlaps downstream processing. Reads and seeks are serialized;
+   packets read ahead before a seek are dropped. */
+class DemuxIo {
+public:
+    explicit DemuxIo(const string & logtag) : m_logtag(logtag) {}
+    ~DemuxIo() {stopReadAhead();}
+    /* install the interrupt callback, before avformat_open_input; timeouts <= 0 for no deadline.
+       Clears a previous abort, so it can be reattached after reconnection */
+    void attach(AVFormatContext *fmtCtx, const int64_t readTimeoutUs, const int64_t stallThresholdUs);
+    /* bound following blocking calls (open, probe) till disarm */
+    void arm(const int64_t timeoutUs) noexcept;
+    void disarm() noexcept;
+    /* abort any blocking io, and all later ones */
+    void abort() noexcept;
+
+    int startReadAhead(const size_t maxPackets);
+    void stopReadAhead();
+    inline bool isReadAhead() const noexcept {return m_reader != nullptr;}
+    /* next packet; from read ahead queue waiting at most 'waitUs' (AVERROR(EAGAIN) if none), or read directly.
+       AVERROR(ETIMEDOUT) if the read deadline passed. A direct read is bounded by the read deadline only, not
+       by 'waitUs': interrupting av_read_frame drops the data it read so far, which breaks the stream. Waits
+       short of a failure need the read ahead thread */
+    int read(AVPacket *pkt, const int64_t waitUs);
+    int seek(const int streamIndex, const int64_t minTs, const int64_t ts, const int64_t maxTs, const int flags);
+    DemuxIoStat getStat();
+    size_t getQueued();
+
+private:
+    static int interruptCallback(void *opaque);
+    int readFrame(AVPacket *pkt); /* hold m_ioMutex */
+    void readAheadLoop();
+
+private:
+    struct Entry {
+        AVPacket *m_pkt = nullptr; /* nullptr for an error */
+        int m_ret = 0;
+        uint64_t m_gen = 0;
+    };
+    string m_logtag;
+    AVFormatContext *m_fmtCtx = nullptr;
+    int64_t m_readTimeoutUs = 0;
+    int64_t m_stallThresholdUs = 0;
+    std::atomic<bool> m_bAbort = ATOMIC_VAR_INIT(false);
+    std::atomic<int64_t> m_deadline = ATOMIC_VAR_INIT(0); /* av_gettime_relative based, 0 for none */
+    std::atomic<bool> m_bDeadlineHit = ATOMIC_VAR_INIT(false);
+
+    std::mutex m_ioMutex; /* av_read_frame and seek */
+    std::mutex m_queueMutex;
+    std::condition_variable m_queueCond;
+    deque<Entry> m_queue;
+    size_t m_maxPackets = 0;
+    std::atomic<uint64_t> m_gen = ATOMIC_VAR_INIT(0); /* bumped by seek, with both locks held */
+    bool m_bStopReader = false;
+    unique_ptr<std::thread> m_reader;
+
+    std::mutex m_statMutex;
+    DemuxIoStat m_stat;
+};
+
+} // namespace ff_dynamic
@@ -1,11 +1,14 @@
+#include <cstdlib>
 #include <iostream>
 #include <iomanip>
+#include <limits>
 #include <memory>
+#include <sstream>
 #include "ffmpegDemux.h"
 
 namespace ff_dynamic {
 /* Limitations:
- 1. Cannot deal with 'nb_program' > 1 (such as mpeg's MPTS)
+ 1. Without DavOptionDemuxPrograms, 'nb_program' > 1 (such as mpeg's MPTS) streams all go out as one program
  2. Won't demux streams other than audio/video, such as subtitle or data
  3. m_outputMediaMap's stream index (key) may not continuous since we skip subtitle or data streams
 */
@@ -22,15 +25,26 @@ const DavRegisterProperties & FFmpegDemux::getRegisterProperties() const noexcep
 }
 
 //////////////////////////////////////////////////////////////////////////////////////////
-int FFmpegDemux::dynamicallyInitialize () {
+int FFmpegDemux::dynamicallyInitialize (const CachedStreamInfo *cached) {
     // NOTE: for demux already initialized , here we just set up the output infos. also ignore 'ctx'
     m_outputMediaMap.clear();
     m_outputTravelStatic.clear();
-    for (unsigned int k=0; k < m_fmtCtx->nb_streams; k++) {
-        const AVStream *st = m_fmtCtx->streams[k];
-        // only deal with audio/video, ignore subtitle or data stream
-        if (st->codecpar->codec_type != AVMEDIA_TYPE_VIDEO && st->codecpar->codec_type != AVMEDIA_TYPE_AUDIO)
-            continue;
+    if (cached) { /* streams seen last time, validated while reading */
+        for (auto & s : cached->m_streams) {
+            m_outputMediaMap.emplace(s.first, s.second->m_mediaType);
+            m_outputTravelStatic.emplace(s.first, s.second);
+            LOG(INFO) << m_logtag << "Demux add one cached stream output: " << s.second;
+        }
+        m_bDynamicallyInitialized = true;
+        return 0;
+    }
+    vector<std::pair<int, int>> streams;
+    int ret = orderStreams(streams);
+    if (ret < 0)
+        return ret;
+    for (auto & s : streams) {
+        const AVStream *st = m_fmtCtx->streams[s.first];
+        const int k = s.second;
         m_outputMediaMap.emplace(k, st->codecpar->codec_type);
         auto outStatic = make_shared<DavTravelStatic>();
         outStatic->m_timebase = st->time_base;
@@ -51,6 +65,7 @@ int FFmpegDemux::dynamicallyInitialize () {
 
 int FFmpegDemux::onConstruct() {
     int ret = 0;
+    m_openStartTime = av_gettime_relative();
     LOG(INFO) << "Starting create FFmpegDemux: " << m_options.dump();
     m_inputUrl = m_options.get(DavOptionInputUrl());
     if (m_inputUrl.size() == 0) {
@@ -61,29 +76,114 @@ int FFmpegDemux::onConstruct() {
     m_options.getBool(DavOptionInputFpsEmulate(), m_bInputFpsEmulate);
     m_options.getInt(DavOptionReconnectRetries(), m_reconnectRetries);
     m_options.getInt(DavOptionRWTimeout(), m_rwTimeoutMs);
+    m_options.getInt("open_timeout_ms", m_openTimeoutMs);
+    m_options.getInt("read_ahead_packets", m_readAheadPackets, AV_DICT_MATCH_CASE, 0);
+    m_options.getInt("stall_threshold_ms", m_stallThresholdMs);
+    m_options.getInt("reconnect_backoff_ms", m_reconnectBackoffMs, AV_DICT_MATCH_CASE, 0);
+    m_options.getInt("reconnect_max_backoff_ms", m_reconnectMaxBackoffMs, AV_DICT_MATCH_CASE, 0);
+    m_inputUrls.push_back(m_inputUrl);
+    std::istringstream backupUrls(m_options.get(DavOptionInputBackupUrls()));
+    for (string url; std::getline(backupUrls, url, '|');)
+        if (!url.empty()) m_inputUrls.push_back(url);
+    m_options.getInt("probe_size", m_probeSize, AV_DICT_MATCH_CASE, 0);
+    m_options.getInt("analyze_duration_ms", m_analyzeDurationMs, AV_DICT_MATCH_CASE, 0);
+    m_options.getBool("stream_info_cache", m_bStreamInfoCache);
+    m_options.getBool("mmap_io", m_bMmapIo);
+    const string programs = m_options.get(DavOptionDemuxPrograms());
+    m_bAllPrograms = programs == "all";
+    std::istringstream programNums(m_bAllPrograms ? "" : programs);
+    for (string num; std::getline(programNums, num, ',');)
+        if (!num.empty()) m_programNums.push_back(atoi(num.c_str()));
+    if (m_bStreamInfoCache && (m_bAllPrograms || m_programNums.size())) {
+        LOG(WARNING) << m_logtag << "stream info cache doesn't work with program selection, disabled";
+        m_bStreamInfoCache = false;
+    }
+    m_streamInfoKey = m_options.get("stream_info_cache_key");
+    if (m_streamInfoKey.empty())
+        m_streamInfoKey = m_inputUrl;
+    m_options.getBool(DavOptionFastJoin(), m_bFastJoin);
+    m_options.getInt("fast_join_max_wait_ms", m_fastJoinMaxWaitMs);
+    double readRange = 0.0; /* seconds, like ffmpeg's -ss/-to; used by segment parallel transcoding */
+    if (m_options.getDouble("read_start", readRange, AV_DICT_MATCH_CASE,
+                            -std::numeric_limits<double>::max()) == 0)
+        m_readStartUs = llrint(readRange * AV_TIME_BASE);
+    if (m_options.getDouble("read_end", readRange, AV_DICT_MATCH_CASE,
+                            -std::numeric_limits<double>::max()) == 0)
+        m_readEndUs = llrint(readRange * AV_TIME_BASE);
 
-    m_fmtCtx = avformat_alloc_context();
-    CHECK(m_fmtCtx != nullptr) << "Fail alloate fmt context";
-
-    hardSettings();
-    ret = avformat_open_input(&m_fmtCtx, m_inputUrl.c_str(), nullptr, m_options.get());
-    if (ret < 0) {
+    av_dict_copy(&m_openOpts, *m_options.get(), 0); /* for reconnection */
+    /* known input starts without probing; fall back to a full probe if it turns out different */
+    CachedStreamInfo cached;
+    const bool bTryCache = m_bStreamInfoCache && StreamInfoCache::instance().get(m_streamInfoKey, cached);
+    if (bTryCache) {
+        ret = openInput(m_inputUrl, m_options.get(), &cached);
+        recordUnusedOpts();
+        if (ret >= 0) {
+            dynamicallyInitialize(&cached);
+            ret = mapStreams(true);
+            if (ret < 0) {
+                LOG(WARNING) << m_logtag << m_inputUrl << " differs from its cached stream info, probe it";
+                closeInput();
+            }
+        }
+        if (ret < 0)
+            StreamInfoCache::instance().evict(m_streamInfoKey);
+        else
+            m_bStreamInfoCached = true;
+        m_bMapPending = ret > 0;
+    }
+    /* fail over to backup urls if the main one cannot be opened */
+    for (m_urlIndex = 0; !m_bStreamInfoCached && m_urlIndex < m_inputUrls.size(); m_urlIndex++) {
+        m_inputUrl = m_inputUrls[m_urlIndex];
+        if (m_urlIndex == 0 && !bTryCache) {
+            ret = openInput(m_inputUrl, m_options.get());
+            recordUnusedOpts();
+        } else {
+            AVDictionary *opts = nullptr;
+            av_dict_copy(&opts, m_openOpts, 0);
+            ret = openInput(m_inputUrl, &opts);
+            av_dict_free(&opts);
+        }
+        if (ret >= 0)
+            break;
         ERRORIT(ret, m_logtag + " Demux open input " + m_inputUrl + " failed");
-        return ret;
     }
-    recordUnusedOpts();
-
-    /* TODO: block time set */
-    ret = avformat_find_stream_info(m_fmtCtx, nullptr);
-    if (ret < 0) {
-        ERRORIT(ret, m_logtag + " Find streams info of " + m_inputUrl + " failed");
+    if (ret < 0)
         return ret;
-    }
+    m_openTime = av_gettime_relative() - m_openStartTime;
+    m_joinStartTime = -1;
 
     /* can setup all output infos in onConstruct */
-    dynamicallyInitialize();
+    if (!m_bStreamInfoCached) {
+        ret = dynamicallyInitialize();
+        if (ret < 0) {
+            ERRORIT(ret, m_logtag + " none of programs " + programs + " found in " + m_inputUrl);
+            return ret;
+        }
+        mapStreams(false);
+        if (m_bStreamInfoCache)
+            StreamInfoCache::instance().put(m_streamInfoKey, m_fmtCtx);
+    }
+    LOG(INFO) << m_logtag << m_inputUrl << " opened in " << m_openTime / 1000 << "ms"
+              << (m_bStreamInfoCached ? " with cached stream info" : "");
 
-    m_streamStartTime.resize(m_fmtCtx->nb_streams, -1);
+    /* per output stream */
+    const size_t outStreams = m_outputMediaMap.empty() ? 0 : m_outputMediaMap.rbegin()->first + 1;
+    m_streamStartTime.resize(outStreams, -1);
+    m_waitKeyFrame.resize(outStreams, false);
+    for (auto & m : m_outputMediaMap)
+        if (m_bFastJoin && m.second == AVMEDIA_TYPE_VIDEO)
+            m_waitKeyFrame[m.first] = true;
+    m_rangeStarted.resize(outStreams, false);
+    m_rangeEnded.resize(outStreams, false);
+    if (m_readStartUs != AV_NOPTS_VALUE) {
+        /* land on the key frame at or before start, rangeFilter drops what is before it */
+        ret = m_io->seek(-1, INT64_MIN, m_readStartUs, m_readStartUs, 0);
+        if (ret < 0) {
+            ERRORIT(ret, m_logtag + " Seek " + m_inputUrl + " to read start failed");
+            return ret;
+        }
+    }
 
     // TODO: save this to log.
     av_dump_format(m_fmtCtx, 1, m_inputUrl.c_str(), 0);
@@ -92,9 +192,8 @@ int FFmpegDemux::onConstruct() {
 }
 
 int FFmpegDemux::onDestruct() {
-    if (m_fmtCtx) {
-        avformat_close_input(&m_fmtCtx);
-    }
+    closeInput();
+    av_dict_free(&m_openOpts);
     INFOIT(DAV_INFO_IMPL_INSTANCE_DESTROY_DONE,
            m_logtag + "General Demux closed: audio read " + std::to_string(m_outPacket[1]) + ", discard " +
            std::to_string(m_discardPacket[1]) + ", video read  " + std::to_string(m_outPacket[0]) +
@@ -102,35 +201,475 @@ int FFmpegDemux::onDestruct() {
     return 0;
 }
 
+int FFmpegDemux::statistics(AVDictionary **stat) {
+    av_dict_set_int(stat, "open_ms", m_openTime / 1000, 0);
+    av_dict_set_int(stat, "first_video_ms", m_firstVideoTime < 0 ? -1 : m_firstVideoTime / 1000, 0);
+    av_dict_set(stat, "fast_join", m_bFastJoin ? "true" : "false", 0);
+    av_dict_set_int(stat, "join_discard_packets", (int64_t)m_joinDiscardPacket, 0);
+    av_dict_set(stat, "join_seeked", m_bJoinSeeked ? "true" : "false", 0);
+    av_dict_set_int(stat, "video_packets", (int64_t)m_outPacket[(int)AVMEDIA_TYPE_VIDEO], 0);
+    av_dict_set_int(stat, "audio_packets", (int64_t)m_outPacket[(int)AVMEDIA_TYPE_AUDIO], 0);
+    av_dict_set(stat, "stream_info_cached", m_bStreamInfoCached ? "true" : "false", 0);
+    av_dict_set(stat, "mmap_io", m_mmapIo ? "true" : "false", 0);
+    av_dict_set_int(stat, "programs", (int64_t)m_selectedPrograms, 0);
+    if (m_bInputFpsEmulate) {
+        const PacingClockStat clock = PacingClock::instance().getStat();
+        av_dict_set_int(stat, "paced_packets", (int64_t)m_pacedPackets, 0);
+        av_dict_set_int(stat, "pace_late_avg_us", m_pacedPackets ? m_paceLateUs / (int64_t)m_pacedPackets : 0, 0);
+        av_dict_set_int(stat, "pace_late_max_us", m_paceMaxLateUs, 0);
+        av_dict_set_int(stat, "pace_reanchors", (int64_t)m_paceReanchors, 0);
+        av_dict_set_int(stat, "pace_clock_late_max_us", clock.m_maxLateUs, 0);
+        av_dict_set_int(stat, "pace_clock_pending", (int64_t)clock.m_pending, 0);
+    }
+    av_dict_set_int(stat, "read_bytes", (int64_t)m_inBytes, 0);
+    av_dict_set_int(stat, "url_index", (int64_t)m_urlIndex, 0);
+    av_dict_set_int(stat, "reconnects", (int64_t)m_reconnects, 0);
+    av_dict_set_int(stat, "reconnect_failures", (int64_t)m_reconnectFails, 0);
+    av_dict_set_int(stat, "param_reinits", (int64_t)m_paramReinits, 0);
+    av_dict_set_int(stat, "outage_ms", m_outageUs / 1000, 0);
+    av_dict_set(stat, "reconnecting", m_bReconnecting ? "true" : "false", 0);
+    if (m_io) {
+        const DemuxIoStat io = m_io->getStat();
+        av_dict_set_int(stat, "read_timeouts", (int64_t)io.m_timeouts, 0);
+        av_dict_set_int(stat, "read_stalls", (int64_t)io.m_stalls, 0);
+        av_dict_set_int(stat, "read_stall_ms", io.m_stallUs / 1000, 0);
+        av_dict_set_int(stat, "max_read_ms", io.m_maxReadUs / 1000, 0);
+        av_dict_set_int(stat, "read_ahead_starves", (int64_t)io.m_starves, 0);
+        av_dict_set_int(stat, "read_ahead_starve_ms", io.m_starveUs / 1000, 0);
+        av_dict_set_int(stat, "read_ahead_queued", (int64_t)m_io->getQueued(), 0);
+    }
+    return 0;
+}
+
 int FFmpegDemux::hardSettings() {
     // m_fmtCtx->flags |= AVFMT_FLAG_NONBLOCK; // won't block input
     if (LIBAVFORMAT_VERSION_MAJOR < 59)
         m_fmtCtx->flags |= AVFMT_FLAG_KEEP_SIDE_DATA;
-    // TODO set timeout
-    //m_fmtCtx->interrupt_callback.callback = interrupt_cb;
-    //m_fmtCtx->interrupt_callback.opaque = (void*)this;
+    /* probe budgets, ffmpeg's 'probesize'/'analyzeduration' in avdict still take precedence */
+    if (m_probeSize > 0)
+        m_fmtCtx->probesize = m_probeSize;
+    if (m_analyzeDurationMs > 0)
+        m_fmtCtx->max_analyze_duration = m_analyzeDurationMs * 1000LL;
+    return 0;
+}
+
+/* Audio/video streams to output, as (stream index, output index) in output order. With programs selected,
+   the n-th stream of the p-th program outputs as 'p * DavDemuxProgramStride + n' (a stream shared by
+   programs goes with the first); others are discarded in the demuxer, mpegts drops their pids unparsed. */
+int FFmpegDemux::orderStreams(vector<std::pair<int, int>> & streams) {
+    streams.clear();
+    auto isAudioVideo = [this](const int k) {
+        const AVMediaType type = m_fmtCtx->streams[k]->codecpar->codec_type;
+        return type == AVMEDIA_TYPE_VIDEO || type == AVMEDIA_TYPE_AUDIO;
+    };
+    if (!m_bAllPrograms && m_programNums.empty()) {
+        for (unsigned int k = 0; k < m_fmtCtx->nb_streams; k++)
+            if (isAudioVideo(k))
+                streams.emplace_back(k, k);
+        return 0;
+    }
+
+    vector<AVProgram *> programs;
+    for (unsigned int p = 0; m_bAllPrograms && p < m_fmtCtx->nb_programs; p++)
+        if (m_fmtCtx->programs[p]->nb_stream_indexes > 0)
+            programs.push_back(m_fmtCtx->programs[p]);
+    for (auto num : m_programNums) {
+        AVProgram *program = nullptr;
+        for (unsigned int p = 0; p < m_fmtCtx->nb_programs && !program; p++)
+            if (m_fmtCtx->programs[p]->id == num)
+                program = m_fmtCtx->programs[p];
+        LOG_IF(WARNING, !program) << m_logtag << m_inputUrl << " has no program " << num;
+        if (program)
+            programs.push_back(program);
+    }
+    for (unsigned int p = 0; p < m_fmtCtx->nb_programs; p++)
+        m_fmtCtx->programs[p]->discard = AVDISCARD_ALL;
+    vector<bool> selected(m_fmtCtx->nb_streams, false);
+    for (size_t p = 0; p < programs.size(); p++) {
+        programs[p]->discard = AVDISCARD_DEFAULT;
+        int n = 0;
+        for (unsigned int s = 0; s < programs[p]->nb_stream_indexes && n < DavDemuxProgramStride; s++) {
+            const int k = programs[p]->stream_index[s];
+            if (selected[k] || !isAudioVideo(k))
+                continue;
+            selected[k] = true;
+            streams.emplace_back(k, (int)p * DavDemuxProgramStride + n++);
+        }
+    }
+    for (unsigned int k = 0; k < m_fmtCtx->nb_streams; k++)
+        if (!selected[k])
+            m_fmtCtx->streams[k]->discard = AVDISCARD_ALL;
+    m_selectedPrograms = programs.size();
+    return streams.empty() ? AVERROR_STREAM_NOT_FOUND : 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////
+// [connection: open, close, reconnect]
+int FFmpegDemux::openInput(const string & url, AVDictionary **opts, const CachedStreamInfo *cached) {
+    m_fmtCtx = avformat_alloc_context();
+    CHECK(m_fmtCtx != nullptr) << "Fail alloate fmt context";
+    hardSettings();
+    if (!m_io)
+        m_io.reset(new DemuxIo(m_logtag));
+    m_io->attach(m_fmtCtx, m_rwTimeoutMs * 1000LL, m_stallThresholdMs * 1000LL);
+    const string localPath = m_bMmapIo ? MmapIo::localPath(url) : "";
+    if (localPath.size()) {
+        m_mmapIo.reset(new MmapIo(m_logtag));
+        int ret = m_mmapIo->open(localPath);
+        if (ret >= 0) {
+            m_fmtCtx->pb = m_mmapIo->getAVIO();
+        } else {
+            LOG(WARNING) << m_logtag << "mmap " << localPath << " failed, use file protocol: " << davMsg2str(ret);
+            m_mmapIo.reset();
+        }
+    }
+    m_io->arm(m_openTimeoutMs * 1000LL); /* open and probe together */
+    /* known format skips format probing; streams found by reading the header are enough to start */
+    auto iformat = cached && cached->m_formatName.size() ? av_find_input_format(cached->m_formatName.c_str()) : nullptr;
+    int ret = avformat_open_input(&m_fmtCtx, url.c_str(), iformat, opts);
+    if (ret < 0) { /* m_fmtCtx is freed, custom io is not */
+        m_io->disarm();
+        m_mmapIo.reset();
+        return ret;
+    }
+    if (cached) {
+        m_io->disarm();
+        return 0;
+    }
+    ret = avformat_find_stream_info(m_fmtCtx, nullptr);
+    m_io->disarm();
+    if (ret < 0) {
+        LOG(WARNING) << m_logtag << "find streams info of " << url << " failed";
+        closeInput();
+    }
+    return ret;
+}
+
+void FFmpegDemux::closeInput() {
+    if (m_io) { /* reader thread uses m_fmtCtx */
+        m_io->abort();
+        m_io->stopReadAhead();
+    }
+    if (m_fmtCtx)
+        avformat_close_input(&m_fmtCtx);
+    m_mmapIo.reset(); /* after the format context using it */
+}
+
+static bool isSameCodecParams(const AVCodecParameters *a, const AVCodecParameters *b) {
+    if (a->extradata_size != b->extradata_size ||
+        (a->extradata_size > 0 && memcmp(a->extradata, b->extradata, a->extradata_size) != 0))
+        return false;
+    if (a->codec_type == AVMEDIA_TYPE_VIDEO)
+        return a->width == b->width && a->height == b->height && a->format == b->format;
+    return a->sample_rate == b->sample_rate && a->format == b->format;
+}
+
+/* Output streams keep their index and travel static over reconnections, so downstream stays connected.
+   A new connection must bring the same audio/video streams (the i-th video/audio stream goes to the i-th
+   video/audio output, same codecs); changed codec parameters go to decoders as new extradata, they reinit
+   themselves. 'bLazy' is for cached stream info: streams may show up later, only codecs are checked. */
+int FFmpegDemux::mapStreams(const bool bLazy) {
+    map<int, vector<int>> outIndexes; /* by media type */
+    for (auto & m : m_outputMediaMap)
+        outIndexes[(int)m.second].push_back(m.first);
+    map<int, size_t> mapped;
+    m_streamMap.assign(m_fmtCtx->nb_streams, -1);
+    m_mappedStreams = m_fmtCtx->nb_streams;
+    if (m_outputMediaMap.size() && m_newExtradata.size() <= (size_t)m_outputMediaMap.rbegin()->first)
+        m_newExtradata.resize(m_outputMediaMap.rbegin()->first + 1, false);
+    vector<std::pair<int, int>> streams; /* selected ones, in output order */
+    int ret = orderStreams(streams);
+    if (ret < 0)
+        return bLazy ? 1 : AVERROR_INPUT_CHANGED;
+    for (auto & s : streams) {
+        const int k = s.first;
+        AVStream *st = m_fmtCtx->streams[k];
+        AVCodecParameters *par = st->codecpar;
+        const auto & outs = outIndexes[(int)par->codec_type];
+        size_t & n = mapped[(int)par->codec_type];
+        if (n >= outs.size())
+            return AVERROR_INPUT_CHANGED;
+        const int out = outs[n++];
+        const auto & outStatic = m_outputTravelStatic.at(out);
+        const AVCodecParameters *outPar = outStatic->m_codecpar.get();
+        if (par->codec_type != outPar->codec_type || par->codec_id != outPar->codec_id)
+            return AVERROR_INPUT_CHANGED;
+        m_streamMap[k] = out;
+        if (bLazy || isSameCodecParams(par, outPar))
+            continue;
+        /* keep output timebase, timestamps are converted to it */
+        auto newStatic = make_shared<DavTravelStatic>();
+        newStatic->m_timebase = outStatic->m_timebase;
+        if (par->codec_type == AVMEDIA_TYPE_VIDEO) {
+            AVRational framerate = st->avg_frame_rate.num != 0 ? st->avg_frame_rate : st->r_frame_rate;
+            newStatic->setupVideoStatic(par, outStatic->m_timebase, framerate);
+        } else {
+            newStatic->setupAudioStatic(par, outStatic->m_timebase);
+        }
+        LOG(INFO) << m_logtag << "stream " << out << " parameters changed: " << newStatic;
+        m_outputTravelStatic[out] = newStatic;
+        m_newExtradata[out] = par->extradata_size > 0;
+        m_paramReinits++;
+    }
+    for (auto & o : outIndexes)
+        if (mapped[o.first] < o.second.size())
+            return bLazy ? 1 : AVERROR_INPUT_CHANGED;
+    return 0;
+}
+
+/* connection's packet to output stream: index, timebase, and timestamps continuing the last connection */
+int FFmpegDemux::mapPacket(AVPacket *pkt) {
+    if (m_bMapPending && m_fmtCtx->nb_streams != m_mappedStreams) { /* cached streams showing up */
+        int ret = mapStreams(true);
+        if (ret < 0)
+            return ret;
+        m_bMapPending = ret > 0;
+    }
+    const int idx = pkt->stream_index;
+    if (idx >= (int)m_streamMap.size() || m_streamMap[idx] < 0)
+        return 1;
+    const int out = m_streamMap[idx];
+    const AVStream *st = m_fmtCtx->streams[idx];
+    const AVRational outTb = m_outputTravelStatic.at(out)->m_timebase;
+    if (m_tsOffsetUs == AV_NOPTS_VALUE) { /* first packet after a reconnection */
+        if (pkt->dts == AV_NOPTS_VALUE)
+            return 1;
+        const int64_t dtsUs = av_rescale_q(pkt->dts, st->time_base, AV_TIME_BASE_Q);
+        m_tsOffsetUs = m_lastEndUs == AV_NOPTS_VALUE ? 0 : m_lastEndUs - dtsUs;
+        LOG(INFO) << m_logtag << m_inputUrl << " timestamps continue with offset " << m_tsOffsetUs << "us";
+    }
+    av_packet_rescale_ts(pkt, st->time_base, outTb);
+    if (m_tsOffsetUs != 0) {
+        const int64_t offset = av_rescale_q(m_tsOffsetUs, AV_TIME_BASE_Q, outTb);
+        if (pkt->pts != AV_NOPTS_VALUE)
+            pkt->pts += offset;
+        if (pkt->dts != AV_NOPTS_VALUE)
+            pkt->dts += offset;
+    }
+    if (m_newExtradata[out]) {
+        uint8_t *sd = av_packet_new_side_data(pkt, AV_PKT_DATA_NEW_EXTRADATA, st->codecpar->extradata_size);
+        if (sd)
+            memcpy(sd, st->codecpar->extradata, st->codecpar->extradata_size);
+        m_newExtradata[out] = false;
+    }
+    pkt->stream_index = out;
+    if (pkt->dts != AV_NOPTS_VALUE) {
+        const int64_t endUs = av_rescale_q(pkt->dts + std::max(pkt->duration, (int64_t)1), outTb, AV_TIME_BASE_Q);
+        m_lastEndUs = m_lastEndUs == AV_NOPTS_VALUE ? endUs : std::max(m_lastEndUs, endUs);
+    }
+    return 0;
+}
+
+int FFmpegDemux::startReconnect(const int err) {
+    if (m_reconnectRetries == 0 || m_readStartUs != AV_NOPTS_VALUE || m_readEndUs != AV_NOPTS_VALUE)
+        return err;
+    LOG(WARNING) << m_logtag << m_inputUrl << " input lost (" << davMsg2str(err) << "), reconnecting";
+    closeInput();
+    m_bReconnecting = true;
+    m_reconnectAttempt = 0;
+    m_outageStart = av_gettime_relative();
+    m_nextReconnectTime = m_outageStart;
+    return AVERROR(EAGAIN);
+}
+
+int FFmpegDemux::tryReconnect() {
+    const int64_t now = av_gettime_relative();
+    if (now < m_nextReconnectTime) { /* return in time, so wave's stop won't wait */
+        av_usleep(std::min(m_nextReconnectTime - now, (int64_t)100000));
+        return AVERROR(EAGAIN);
+    }
+    if (m_reconnectRetries > 0 && m_reconnectAttempt >= m_reconnectRetries) {
+        m_bReconnecting = false;
+        ERRORIT(AVERROR_EOF, m_logtag + m_inputUrl + " reconnect failed after " +
+                std::to_string(m_reconnectAttempt) + " attempts, input ends");
+        return AVERROR_EOF;
+    }
+
+    const size_t urlIndex = (m_urlIndex + m_reconnectAttempt) % m_inputUrls.size();
+    const string & url = m_inputUrls[urlIndex];
+    m_reconnectAttempt++;
+    AVDictionary *opts = nullptr;
+    av_dict_copy(&opts, m_openOpts, 0);
+    int ret = openInput(url, &opts);
+    av_dict_free(&opts);
+    if (ret >= 0) {
+        ret = mapStreams();
+        if (ret < 0) {
+            LOG(WARNING) << m_logtag << url << " streams differ from the ones already output, cannot use it";
+            closeInput();
+        }
+    }
+    if (ret < 0) {
+        m_reconnectFails++;
+        /* every url once right away, then back off round by round */
+        const int round = m_reconnectAttempt / (int)m_inputUrls.size();
+        const int64_t backoffMs = round == 0 ? 0 :
+            std::min((int64_t)m_reconnectBackoffMs << std::min(round - 1, 16), (int64_t)m_reconnectMaxBackoffMs);
+        m_nextReconnectTime = av_gettime_relative() + backoffMs * 1000;
+        LOG(WARNING) << m_logtag << "reconnect " << url << " attempt " << m_reconnectAttempt << " failed ("
+                     << davMsg2str(ret) << "), next in " << backoffMs << "ms";
+        return AVERROR(EAGAIN);
+    }
+
+    m_urlIndex = urlIndex;
+    m_inputUrl = url;
+    m_bReconnecting = false;
+    m_reconnects++;
+    const int64_t outage = av_gettime_relative() - m_outageStart;
+    m_outageUs += outage;
+    m_tsOffsetUs = AV_NOPTS_VALUE;
+    std::fill(m_streamStartTime.begin(), m_streamStartTime.end(), -1);
+    m_paceAnchorTs = AV_NOPTS_VALUE; /* outage is not to be caught up */
+    m_joinStartTime = -1;
+    m_bKeyFrameRequested = false;
+    for (auto & m : m_outputMediaMap)
+        if (m_bFastJoin && m.second == AVMEDIA_TYPE_VIDEO)
+            m_waitKeyFrame[m.first] = true;
+    LOG(INFO) << m_logtag << "reconnected to " << url << " after " << outage / 1000 << "ms";
+    return 0;
+}
+
+int FFmpegDemux::fastJoinFilter(DavProcCtx & ctx, AVPacket *pkt) {
+    if (!m_waitKeyFrame[pkt->stream_index])
+        return 0;
+    /* the wait budget starts with the first packet, a slow open doesn't use it up */
+    if (m_joinStartTime < 0)
+        m_joinStartTime = av_gettime_relative();
+    const int64_t waitTime = av_gettime_relative() - m_joinStartTime;
+    if ((pkt->flags & AV_PKT_FLAG_KEY) || waitTime > m_fastJoinMaxWaitMs * 1000LL) {
+        m_waitKeyFrame[pkt->stream_index] = false;
+        LOG_IF(WARNING, !(pkt->flags & AV_PKT_FLAG_KEY))
+            << m_logtag << m_inputUrl << " stream " << pkt->stream_index << " no key frame in "
+            << m_fastJoinMaxWaitMs << "ms, stop waiting";
+        return 0;
+    }
+
+    /* seekable input jumps to the next key frame instead of reading through the gop */
+    if (!m_bJoinSeeked && m_reconnects == 0 && !m_bStreamInfoCached && m_selectedPrograms == 0 &&
+        m_fmtCtx->pb && (m_fmtCtx->pb->seekable & AVIO_SEEKABLE_NORMAL)) {
+        m_bJoinSeeked = true;
+        const int64_t ts = pkt->dts + 1;
+        int ret = m_io->seek(pkt->stream_index, ts, ts, INT64_MAX, 0);
+        if (ret < 0)
+            LOG(WARNING) << m_logtag << m_inputUrl << " fast join seek failed, drop till key frame: "
+                         << davMsg2str(ret);
+        else
+            LOG(INFO) << m_logtag << m_inputUrl << " fast join seek to key frame after dts " << pkt->dts;
+        return 1;
+    }
+
+    /* live input: ask the source for a key frame, reaches an encoder only if it subscribed to us */
+    if (!m_bKeyFrameRequested) {
+        m_bKeyFrameRequested = true;
+        auto e = make_shared<DavEventKeyFrameRequest>();
+        e->getAddress().setFromStreamIndex(pkt->stream_index);
+        ctx.m_pubEvents.emplace_back(e);
+    }
+    return 1;
+}
+
+int FFmpegDemux::rangeFilter(const AVPacket *pkt) {
+    const int idx = pkt->stream_index;
+    const bool bVideo = m_outputMediaMap.at(idx) == AVMEDIA_TYPE_VIDEO;
+    const bool bKey = pkt->flags & AV_PKT_FLAG_KEY;
+    const int64_t ts = av_rescale_q(pkt->pts != AV_NOPTS_VALUE ? pkt->pts : pkt->dts,
+                                    m_outputTravelStatic.at(idx)->m_timebase, AV_TIME_BASE_Q);
+
+    /* video ends at the next range's first key frame, what is before it in decode order belongs to us */
+    if (m_readEndUs != AV_NOPTS_VALUE && !m_rangeEnded[idx] && ts >= m_readEndUs && (!bVideo || bKey))
+        m_rangeEnded[idx] = true;
+    if (m_rangeEnded[idx]) {
+        for (auto & m : m_outputMediaMap)
+            if (!m_rangeEnded[m.first])
+                return 1;
+        return AVERROR_EOF;
+    }
+    if (m_readStartUs != AV_NOPTS_VALUE) {
+        if (bVideo && !m_rangeStarted[idx]) {
+            if (!bKey || ts < m_readStartUs)
+                return 1;
+            m_rangeStarted[idx] = true;
+        }
+        if (ts < m_readStartUs) /* leading pictures of the start key frame are previous range's */
+            return 1;
+    }
+    return 0;
+}
+
+/* input fps emulation: packets are released at their dts pace (all streams share one anchor) on the
+   process wide PacingClock. Re-anchor at start, after reconnection, or if timestamps jump */
+static constexpr int64_t s_paceMaxDriftUs = 1000000;
+
+int64_t FFmpegDemux::paceDeadline(const AVPacket *pkt) {
+    const int64_t now = av_gettime_relative();
+    const int64_t ts = av_rescale_q(pkt->dts, m_outputTravelStatic.at(pkt->stream_index)->m_timebase,
+                                    AV_TIME_BASE_Q);
+    if (m_paceAnchorTs != AV_NOPTS_VALUE) {
+        const int64_t deadline = m_paceAnchorTime + ts - m_paceAnchorTs;
+        if (std::abs(deadline - now) <= s_paceMaxDriftUs)
+            return deadline;
+        m_paceReanchors++;
+        LOG(WARNING) << m_logtag << m_inputUrl << " pacing off by " << (deadline - now) / 1000
+                     << "ms (timestamp jump or overload), re-anchor";
+    }
+    m_paceAnchorTs = ts;
+    m_paceAnchorTime = now;
+    return now;
+}
+
+int FFmpegDemux::paceWait() {
+    int64_t lateUs = 0;
+    /* bounded wait, so wave's stop won't wait for a far deadline */
+    int ret = PacingClock::instance().waitUntil(m_paceDeadline, 100000, lateUs);
+    if (ret < 0)
+        return ret;
+    m_pacedPackets++;
+    m_paceLateUs += lateUs;
+    m_paceMaxLateUs = std::max(m_paceMaxLateUs, lateUs);
     return 0;
 }
 
 int FFmpegDemux::onProcess(DavProcCtx & ctx) {
+    if (m_pacingBuf) { /* read already, not released yet */
+        int ret = paceWait();
+        if (ret < 0)
+            return ret;
+        ctx.m_outBufs.push_back(m_pacingBuf);
+        m_pacingBuf.reset();
+        return 0;
+    }
     auto outBuf = make_shared<DavProcBuf>();
     AVPacket *pkt = outBuf->mkAVPacket();
     CHECK(pkt != nullptr);
     av_init_packet(pkt);
     int ret = 0;
+    if (m_bReconnecting) {
+        ret = tryReconnect();
+        if (ret < 0)
+            return ret;
+    }
+    if (m_readAheadPackets > 0 && !m_io->isReadAhead())
+        m_io->startReadAhead(m_readAheadPackets);
     do {
-        ret = av_read_frame(m_fmtCtx, pkt);
+        /* read ahead returns in time, so wave's stop won't wait for slow inputs; direct reads wait till data
+           or RWTimeout, see DemuxIo::read */
+        ret = m_io->read(pkt, 100000);
         if (ret < 0) {
+            if (ret == AVERROR(EAGAIN) && m_io->isReadAhead())
+                return ret;
             if (ret == AVERROR(EAGAIN)) {
                 // TODO:  stat this event
                 ERRORIT(ret, m_logtag + m_inputUrl + " demux read return EAGAIN");
                 continue;
             }
+            if (startReconnect(ret) == AVERROR(EAGAIN)) {
+                av_packet_unref(pkt);
+                return AVERROR(EAGAIN);
+            }
             if (ret == AVERROR_EOF) {
                 INFOIT(ret, m_logtag + m_inputUrl + " demux read eof");
                 return ret;
             }
-            /* TODO: restart read input, add logic here */
             ERRORIT(ret, m_logtag + m_inputUrl + " av_read_fream fail");
             ctx.m_implErr = m_implErr;
             ctx.m_outputTimes = 0;
@@ -138,13 +677,19 @@ int FFmpegDemux::onProcess(DavProcCtx & ctx) {
         }
 
         m_inBytes += pkt->size;
-        auto pktType = m_fmtCtx->streams[pkt->stream_index]->codecpar->codec_type;
-        if (pktType == AVMEDIA_TYPE_AUDIO || pktType == AVMEDIA_TYPE_VIDEO)
-            m_outPacket[(int)pktType]++;
-        else { // ignore non audio/video packet
+        ret = mapPacket(pkt);
+        if (ret < 0) { /* only cached stream info may not match what is read */
+            av_packet_unref(pkt);
+            StreamInfoCache::instance().evict(m_streamInfoKey);
+            ERRORIT(ret, m_logtag + m_inputUrl + " streams differ from cached stream info, input ends");
+            return AVERROR_EOF;
+        }
+        if (ret > 0) { // ignore non audio/video packet
             av_packet_unref(pkt);
             continue;
         }
+        auto pktType = m_outputMediaMap.at(pkt->stream_index);
+        m_outPacket[(int)pktType]++;
 
         if (pkt->dts == AV_NOPTS_VALUE) { // TODO: just throw away ?
             m_discardPacket[(int)pktType]++;
@@ -157,6 +702,37 @@ int FFmpegDemux::onProcess(DavProcCtx & ctx) {
             continue;
         }
 
+        if (m_readStartUs != AV_NOPTS_VALUE || m_readEndUs != AV_NOPTS_VALUE) {
+            ret = rangeFilter(pkt);
+            if (ret == AVERROR_EOF) {
+                av_packet_unref(pkt);
+                INFOIT(ret, m_logtag + m_inputUrl + " demux read range end");
+                return ret;
+            }
+            if (ret > 0) {
+                m_discardPacket[(int)pktType]++;
+                m_discardBytes += pkt->size;
+                av_packet_unref(pkt);
+                continue;
+            }
+        }
+
+        if (pktType == AVMEDIA_TYPE_VIDEO) {
+            if (fastJoinFilter(ctx, pkt) > 0) {
+                m_discardPacket[(int)pktType]++;
+                m_discardBytes += pkt->size;
+                m_joinDiscardPacket++;
+                av_packet_unref(pkt);
+                continue;
+            }
+            if (m_firstVideoTime < 0) {
+                m_firstVideoTime = av_gettime_relative() - m_openStartTime;
+                LOG(INFO) << m_logtag << m_inputUrl << " first video packet after " << m_firstVideoTime / 1000
+                          << "ms (open " << m_openTime / 1000 << "ms), join discard " << m_joinDiscardPacket
+                          << (m_bJoinSeeked ? ", seeked" : "");
+            }
+        }
+
         if (m_streamStartTime[pkt->stream_index] == -1) {
             m_streamStartTime[pkt->stream_index] = av_gettime_relative();
             LOG(INFO) << m_logtag << m_inputUrl + " stream " << pkt->stream_index
@@ -169,29 +745,26 @@ int FFmpegDemux::onProcess(DavProcCtx & ctx) {
     } while(true);
 
     /* TODO: check side_data for dynamic change, then set to m_travelDynamic; */
-    /* TODO: not accurate for some cases */
-    const auto & st = m_fmtCtx->streams[pkt->stream_index];
+    const bool bVideo = m_outputMediaMap.at(pkt->stream_index) == AVMEDIA_TYPE_VIDEO;
     int64_t timeNow = av_gettime_relative();
     int64_t timeDiff = timeNow - m_streamStartTime[pkt->stream_index];
-    if (m_bInputFpsEmulate && st->codecpar->codec_type == AVMEDIA_TYPE_VIDEO) {
-        /* TODO: avi container won't set start_time  */
-        if (st->start_time != AV_NOPTS_VALUE && pkt->pts != AV_NOPTS_VALUE &&
-            (pkt->pts - st->start_time > 0)) {
-            const int64_t streamDiff = av_rescale_q(pkt->pts - st->start_time, st->time_base, AV_TIME_BASE_Q);
-            if (streamDiff - timeDiff > 2000)
-                av_usleep(streamDiff - timeDiff - 1000);
-        }
-    }
-
-    ctx.m_outBufs.push_back(outBuf);
-    LOG_IF(INFO, timeNow - m_lastLogTime >= 4*AV_TIME_BASE &&
-           (st->codecpar->codec_type == AVMEDIA_TYPE_VIDEO))
+    LOG_IF(INFO, timeNow - m_lastLogTime >= 4*AV_TIME_BASE && bVideo)
         << m_logtag << " output video " << m_outPacket[(int)AVMEDIA_TYPE_VIDEO] << ", output audio "
         << m_outPacket[(int)AVMEDIA_TYPE_AUDIO] << ", this pkt size " << pkt->size << " pts " << pkt->pts
         << ", dst " << pkt->dts << ", fps " << std::setprecision(3)
         << (m_outPacket[(int)AVMEDIA_TYPE_VIDEO] * AV_TIME_BASE * 1.0 / timeDiff) << ", "
         << (m_lastLogTime = timeNow);
 
+    if (m_bInputFpsEmulate) {
+        m_paceDeadline = paceDeadline(pkt);
+        ret = paceWait();
+        if (ret < 0) {
+            m_pacingBuf = outBuf;
+            return ret;
+        }
+    }
+    ctx.m_outBufs.push_back(outBuf);
+
     /* ctx.m_expect not needed, default is eDavProcExpectNothing */
     return 0;
 }
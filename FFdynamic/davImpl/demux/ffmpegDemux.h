@@ -5,6 +5,10 @@
 #include "davDict.h"
 #include "davImpl.h"
 #include "davImplTravel.h"
+#include "demuxIo.h"
+#include "streamInfoCache.h"
+#include "mmapIo.h"
+#include "pacingClock.h"
 
 namespace ff_dynamic {
 
@@ -18,27 +22,109 @@ public:
 private:
     FFmpegDemux(const FFmpegDemux &) = delete;
     FFmpegDemux & operator= (const FFmpegDemux &) = delete;
-    int dynamicallyInitialize();
+    int dynamicallyInitialize(const CachedStreamInfo *cached = nullptr);
     virtual int onConstruct();
     virtual int onDestruct();
     virtual int onProcess(DavProcCtx & ctx);
     virtual int onDynamicallyInitializeViaTravelStatic(DavProcCtx & ctx) {return 0;}
     virtual int onProcessTravelDynamic(DavProcCtx & ctx) {return 0;}
     virtual const DavRegisterProperties & getRegisterProperties() const noexcept;
+    virtual int statistics(AVDictionary **stat);
 
 private: // helpers
     int hardSettings();
+    /* fast join: > 0 if the packet should be dropped (or it is consumed by a seek) */
+    int fastJoinFilter(DavProcCtx & ctx, AVPacket *pkt);
+    /* read range: > 0 if the packet is out of range, AVERROR_EOF if all streams passed the end */
+    int rangeFilter(const AVPacket *pkt);
+    /* connection */
+    int openInput(const string & url, AVDictionary **opts, const CachedStreamInfo *cached = nullptr);
+    void closeInput();
+    int orderStreams(vector<std::pair<int, int>> & streams);
+    int mapStreams(const bool bLazy); /* > 0 if lazy and some streams not seen yet */
+    int mapPacket(AVPacket *pkt); /* > 0 if not output, < 0 if streams don't match */
+    int startReconnect(const int err); /* AVERROR(EAGAIN) if reconnecting, or 'err' back */
+    int tryReconnect();
+    /* input fps emulation */
+    int64_t paceDeadline(const AVPacket *pkt);
+    int paceWait(); /* AVERROR(EAGAIN) if m_paceDeadline not reached in time */
 
 private:
     AVFormatContext *m_fmtCtx = nullptr;
     string m_inputUrl;
     int m_reconnectRetries = 0;
-    int m_rwTimeoutMs = 5000; /* default use 5s */
+    /* io deadlines and read ahead are opt-in: listening inputs may wait for a publisher as long as it takes */
+    int m_rwTimeoutMs = 0;     /* 0 for no deadline */
+    int m_openTimeoutMs = 0;
+    int m_readAheadPackets = 0; /* 0 reads on wave's thread */
+    int m_stallThresholdMs = 200;
+    unique_ptr<DemuxIo> m_io;
+
+    /* probing: budgets (0 for ffmpeg's defaults), stream info of a known input skips it */
+    int m_probeSize = 0;
+    int m_analyzeDurationMs = 0;
+    bool m_bStreamInfoCache = false;
+    string m_streamInfoKey; /* input url if not given */
+    bool m_bStreamInfoCached = false;
+    bool m_bMapPending = false; /* cached streams not all seen yet */
+    unsigned int m_mappedStreams = 0;
+    bool m_bMmapIo = false; /* local files read through a memory map */
+    /* multi program (MPTS): selected programs' streams only */
+    bool m_bAllPrograms = false;
+    vector<int> m_programNums;
+    size_t m_selectedPrograms = 0;
+    unique_ptr<MmapIo> m_mmapIo;
+
+    /* reconnect and fail over; output streams stay the same, connections map to them */
+    vector<string> m_inputUrls; /* main url then backups */
+    size_t m_urlIndex = 0;
+    AVDictionary *m_openOpts = nullptr;
+    int m_reconnectBackoffMs = 500;
+    int m_reconnectMaxBackoffMs = 8000;
+    bool m_bReconnecting = false;
+    int m_reconnectAttempt = 0;
+    int64_t m_nextReconnectTime = 0;
+    int64_t m_outageStart = 0;
+    vector<int> m_streamMap;     /* connection's stream index -> output stream index, -1 for not output */
+    vector<bool> m_newExtradata; /* per output stream, pending for its next packet */
+    int64_t m_tsOffsetUs = 0;    /* AV_NOPTS_VALUE till the first packet after a reconnection */
+    int64_t m_lastEndUs = AV_NOPTS_VALUE; /* output timeline */
+    uint64_t m_reconnects = 0;
+    uint64_t m_reconnectFails = 0;
+    uint64_t m_paramReinits = 0;
+    int64_t m_outageUs = 0;
 
     bool m_bInputFpsEmulate = false;
     vector<int64_t> m_streamStartTime;
+    int64_t m_paceAnchorTs = AV_NOPTS_VALUE; /* output timeline, us */
+    int64_t m_paceAnchorTime = 0;
+    int64_t m_paceDeadline = 0;
+    shared_ptr<DavProcBuf> m_pacingBuf; /* waiting for its release */
+    uint64_t m_pacedPackets = 0;
+    int64_t m_paceLateUs = 0;
+    int64_t m_paceMaxLateUs = 0;
+    uint64_t m_paceReanchors = 0;
     int64_t m_lastLogTime = -1;
 
+    /* fast join */
+    bool m_bFastJoin = false;
+    int m_fastJoinMaxWaitMs = 5000; /* give up waiting key frame after this, just pass through */
+    vector<bool> m_waitKeyFrame;    /* per stream, only video streams wait */
+    bool m_bJoinSeeked = false;
+    bool m_bKeyFrameRequested = false;
+    uint64_t m_joinDiscardPacket = 0;
+    /* join time, relative to open start */
+    int64_t m_openStartTime = -1;
+    int64_t m_joinStartTime = -1; /* first packet after open or reconnect */
+    int64_t m_openTime = -1;
+    int64_t m_firstVideoTime = -1;
+
+    /* read range, in AV_TIME_BASE_Q of streams' timestamps. video starts/ends at key frames */
+    int64_t m_readStartUs = AV_NOPTS_VALUE;
+    int64_t m_readEndUs = AV_NOPTS_VALUE;
+    vector<bool> m_rangeStarted;
+    vector<bool> m_rangeEnded;
+
     // only stat for audio & video, no other streams
     uint64_t m_inBytes = 0;
     uint64_t m_discardBytes = 0;
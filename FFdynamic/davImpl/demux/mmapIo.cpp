@@ -0,0 +1,107 @@
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <glog/logging.h>
+#include "mmapIo.h"
+
+namespace ff_dynamic {
+
+constexpr size_t MmapIo::s_prefetchBytes;
+
+string MmapIo::localPath(const string & url) {
+    if (url.compare(0, 5, "file:") == 0)
+        return url.substr(5);
+    /* 'proto:' prefixed urls, stdin ('-') and pipes are not plain files */
+    const size_t colon = url.find(':');
+    if (url.empty() || url == "-" || (colon != string::npos && url.find('/') > colon))
+        return "";
+    return url;
+}
+
+int MmapIo::open(const string & path, const int bufSize) {
+    close();
+    const int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return AVERROR(errno);
+    struct stat st;
+    if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode) || st.st_size <= 0) {
+        ::close(fd);
+        return AVERROR(EINVAL);
+    }
+    void *data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd); /* mapping holds the file */
+    if (data == MAP_FAILED)
+        return AVERROR(errno);
+    m_data = static_cast<uint8_t *>(data);
+    m_size = st.st_size;
+    m_pos = 0;
+    m_prefetchEnd = 0;
+    madvise(m_data, m_size, MADV_SEQUENTIAL);
+
+    uint8_t *buf = static_cast<uint8_t *>(av_malloc(bufSize));
+    if (buf)
+        m_avio = avio_alloc_context(buf, bufSize, 0, this, readPacket, nullptr, seek);
+    if (!m_avio) {
+        av_free(buf);
+        close();
+        return AVERROR(ENOMEM);
+    }
+    LOG(INFO) << m_logtag << "mmap io on " << path << ", " << m_size << " bytes";
+    return 0;
+}
+
+void MmapIo::close() {
+    if (m_avio) {
+        av_freep(&m_avio->buffer);
+        avio_context_free(&m_avio);
+    }
+    if (m_data) {
+        munmap(m_data, m_size);
+        m_data = nullptr;
+    }
+    m_size = 0;
+}
+
+void MmapIo::prefetch() {
+    if (m_pos + s_prefetchBytes / 2 < m_prefetchEnd)
+        return;
+    static const size_t pageSize = sysconf(_SC_PAGESIZE);
+    const size_t start = m_pos / pageSize * pageSize;
+    const size_t end = std::min(m_pos + s_prefetchBytes, m_size);
+    if (end > start)
+        madvise(m_data + start, end - start, MADV_WILLNEED);
+    m_prefetchEnd = end;
+}
+
+int MmapIo::readPacket(void *opaque, uint8_t *buf, int bufSize) {
+    MmapIo *io = static_cast<MmapIo *>(opaque);
+    if (io->m_pos >= io->m_size)
+        return AVERROR_EOF;
+    io->prefetch();
+    const size_t n = std::min((size_t)bufSize, io->m_size - io->m_pos);
+    memcpy(buf, io->m_data + io->m_pos, n);
+    io->m_pos += n;
+    return (int)n;
+}
+
+int64_t MmapIo::seek(void *opaque, int64_t offset, int whence) {
+    MmapIo *io = static_cast<MmapIo *>(opaque);
+    int64_t pos = 0;
+    switch (whence & ~AVSEEK_FORCE) {
+    case AVSEEK_SIZE: return (int64_t)io->m_size;
+    case SEEK_SET: pos = offset; break;
+    case SEEK_CUR: pos = (int64_t)io->m_pos + offset; break;
+    case SEEK_END: pos = (int64_t)io->m_size + offset; break;
+    default: return AVERROR(EINVAL);
+    }
+    if (pos < 0 || pos > (int64_t)io->m_size)
+        return AVERROR(EINVAL);
+    io->m_pos = pos;
+    io->m_prefetchEnd = 0; /* prefetch from the new position */
+    return pos;
+}
+
+} // namespace ff_dynamic
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <string>
+#include "ffmpegHeaders.h"
+
+namespace ff_dynamic {
+using ::std::string;
+
+/* AVIOContext reading a local file through a read only memory map: no syscall per buffer refill, the
+   kernel reads ahead (sequential hint plus a prefetch window ahead of the read position); seekable. */
+class MmapIo {
+public:
+    explicit MmapIo(const string & logtag) : m_logtag(logtag) {}
+    ~MmapIo() {close();}
+    int open(const string & path, const int bufSize = 256 * 1024);
+    void close();
+    /* set it to AVFormatContext's pb before avformat_open_input; owned by this object */
+    inline AVIOContext *getAVIO() const noexcept {return m_avio;}
+    /* file path of a local file url ("path" or "file:path"), empty for others */
+    static string localPath(const string & url);
+
+private:
+    MmapIo(const MmapIo &) = delete;
+    MmapIo & operator=(const MmapIo &) = delete;
+    static int readPacket(void *opaque, uint8_t *buf, int bufSize);
+    static int64_t seek(void *opaque, int64_t offset, int whence);
+    void prefetch();
+
+private:
+    static constexpr size_t s_prefetchBytes = 8 * 1024 * 1024;
+    string m_logtag;
+    uint8_t *m_data = nullptr;
+    size_t m_size = 0;
+    size_t m_pos = 0;
+    size_t m_prefetchEnd = 0; /* advised up to here */
+    AVIOContext *m_avio = nullptr;
+};
+
+} // namespace ff_dynamic
@@ -0,0 +1,94 @@
+#include <algorithm>
+#include <chrono>
+#include <glog/logging.h>
+#include "davUtil.h"
+#include "pacingClock.h"
+
+namespace ff_dynamic {
+
+PacingClock & PacingClock::instance() {
+    static PacingClock s_clock;
+    return s_clock;
+}
+
+PacingClock::~PacingClock() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_bQuit = true;
+    }
+    m_timerCond.notify_all();
+    if (m_timer)
+        m_timer->join();
+}
+
+int PacingClock::waitUntil(const int64_t deadline, const int64_t maxWaitUs, int64_t & lateUs) {
+    const int64_t now = av_gettime_relative();
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (deadline <= now) { /* already due, no need to go through the timer */
+        lateUs = now - deadline;
+        m_stat.m_releases++;
+        m_stat.m_lateUs += lateUs;
+        m_stat.m_maxLateUs = std::max(m_stat.m_maxLateUs, lateUs);
+        return 0;
+    }
+    if (!m_timer)
+        m_timer.reset(new std::thread(&PacingClock::timerLoop, this));
+
+    auto waiter = std::make_shared<Waiter>();
+    waiter->m_deadline = deadline;
+    const bool bEarliest = m_deadlines.empty() || deadline < m_deadlines.top()->m_deadline;
+    m_deadlines.push(waiter);
+    if (bEarliest)
+        m_timerCond.notify_one();
+    waiter->m_cond.wait_for(lock, std::chrono::microseconds(maxWaitUs), [&waiter]() {return waiter->m_bReleased;});
+    if (!waiter->m_bReleased) {
+        waiter->m_bCancelled = true;
+        return AVERROR(EAGAIN);
+    }
+    lateUs = waiter->m_releaseTime - deadline;
+    return 0;
+}
+
+void PacingClock::timerLoop() {
+    LOG(INFO) << "[PacingClock] timer thread started";
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (!m_bQuit) {
+        while (m_deadlines.size() && m_deadlines.top()->m_bCancelled)
+            m_deadlines.pop();
+        if (m_deadlines.empty()) {
+            m_timerCond.wait(lock);
+            continue;
+        }
+        const int64_t now = av_gettime_relative();
+        const int64_t deadline = m_deadlines.top()->m_deadline;
+        if (deadline > now) {
+            m_timerCond.wait_until(lock, std::chrono::steady_clock::now() +
+                                   std::chrono::microseconds(deadline - now));
+            continue; /* due, or an earlier one came in */
+        }
+        /* release all due ones */
+        while (m_deadlines.size() && m_deadlines.top()->m_deadline <= now) {
+            auto waiter = m_deadlines.top();
+            m_deadlines.pop();
+            if (waiter->m_bCancelled)
+                continue;
+            waiter->m_bReleased = true;
+            waiter->m_releaseTime = av_gettime_relative();
+            const int64_t lateUs = waiter->m_releaseTime - waiter->m_deadline;
+            m_stat.m_releases++;
+            m_stat.m_lateUs += lateUs;
+            m_stat.m_maxLateUs = std::max(m_stat.m_maxLateUs, lateUs);
+            waiter->m_cond.notify_one();
+        }
+    }
+    LOG(INFO) << "[PacingClock] timer thread quit";
+}
+
+PacingClockStat PacingClock::getStat() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    PacingClockStat stat = m_stat;
+    stat.m_pending = m_deadlines.size();
+    return stat;
+}
+
+} // namespace ff_dynamic
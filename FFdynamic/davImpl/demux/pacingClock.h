@@ -0,0 +1,62 @@
+#pragma once
+
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+#include "ffmpegHeaders.h"
+
+namespace ff_dynamic {
+using ::std::shared_ptr;
+using ::std::vector;
+
+struct PacingClockStat {
+    uint64_t m_releases = 0;  /* waits released at their deadlines */
+    int64_t m_lateUs = 0;     /* total release delay after deadlines */
+    int64_t m_maxLateUs = 0;
+    size_t m_pending = 0;     /* deadlines waiting in the heap now */
+};
+
+/* Process wide pacing of emulated live inputs: one timer thread keeps every input's next release time
+   in a min heap and wakes exactly the waiter whose deadline is due, so pacing doesn't depend on how
+   each input's thread happens to be scheduled by sleeps. Deadlines are absolute (av_gettime_relative
+   clock), computed from an anchor by callers, so errors don't accumulate. */
+class PacingClock {
+public:
+    static PacingClock & instance();
+    ~PacingClock();
+    /* block till 'deadline' is released, at most 'maxWaitUs': 0 if released ('lateUs' set),
+       AVERROR(EAGAIN) if still not due; wait again with the same deadline then */
+    int waitUntil(const int64_t deadline, const int64_t maxWaitUs, int64_t & lateUs);
+    PacingClockStat getStat();
+
+private:
+    PacingClock() = default;
+    PacingClock(const PacingClock &) = delete;
+    PacingClock & operator=(const PacingClock &) = delete;
+    void timerLoop();
+
+private:
+    struct Waiter {
+        int64_t m_deadline = 0;
+        bool m_bReleased = false;
+        bool m_bCancelled = false; /* waiter gave up, entry skipped when popped */
+        int64_t m_releaseTime = 0;
+        std::condition_variable m_cond;
+    };
+    struct LaterFirst {
+        bool operator()(const shared_ptr<Waiter> & a, const shared_ptr<Waiter> & b) const {
+            return a->m_deadline > b->m_deadline;
+        }
+    };
+    std::mutex m_mutex;
+    std::condition_variable m_timerCond; /* earlier deadline pushed, or quit */
+    std::priority_queue<shared_ptr<Waiter>, vector<shared_ptr<Waiter>>, LaterFirst> m_deadlines;
+    std::unique_ptr<std::thread> m_timer;
+    bool m_bQuit = false;
+    PacingClockStat m_stat;
+};
+
+} // namespace ff_dynamic
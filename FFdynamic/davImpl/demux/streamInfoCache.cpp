@@ -0,0 +1,68 @@
+#include <glog/logging.h>
+#include "davUtil.h"
+#include "streamInfoCache.h"
+
+namespace ff_dynamic {
+
+constexpr size_t StreamInfoCache::s_maxEntries;
+
+StreamInfoCache & StreamInfoCache::instance() {
+    static StreamInfoCache s_cache;
+    return s_cache;
+}
+
+bool StreamInfoCache::get(const string & key, CachedStreamInfo & info) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_entries.find(key);
+    if (it == m_entries.end())
+        return false;
+    info.m_formatName = it->second.m_formatName;
+    info.m_updateTime = it->second.m_updateTime;
+    info.m_streams.clear();
+    for (auto & s : it->second.m_streams) /* codecpar is shared, never modified */
+        info.m_streams.emplace(s.first, std::make_shared<DavTravelStatic>(*s.second));
+    return true;
+}
+
+int StreamInfoCache::put(const string & key, const AVFormatContext *fmtCtx) {
+    CachedStreamInfo info;
+    if (fmtCtx->iformat && fmtCtx->iformat->name) {
+        info.m_formatName = fmtCtx->iformat->name;
+        info.m_formatName = info.m_formatName.substr(0, info.m_formatName.find(','));
+    }
+    for (unsigned int k = 0; k < fmtCtx->nb_streams; k++) {
+        AVStream *st = fmtCtx->streams[k];
+        auto s = std::make_shared<DavTravelStatic>();
+        if (st->codecpar->codec_type == AVMEDIA_TYPE_VIDEO) {
+            AVRational framerate = st->avg_frame_rate.num != 0 ? st->avg_frame_rate : st->r_frame_rate;
+            s->setupVideoStatic(st->codecpar, st->time_base, framerate);
+        } else if (st->codecpar->codec_type == AVMEDIA_TYPE_AUDIO) {
+            s->setupAudioStatic(st->codecpar, st->time_base);
+        } else {
+            continue;
+        }
+        info.m_streams.emplace(k, s);
+    }
+    if (info.m_streams.empty())
+        return 0;
+    info.m_updateTime = av_gettime_relative();
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_entries.count(key) == 0 && m_entries.size() >= s_maxEntries) {
+        auto oldest = m_entries.begin();
+        for (auto it = m_entries.begin(); it != m_entries.end(); it++)
+            if (it->second.m_updateTime < oldest->second.m_updateTime)
+                oldest = it;
+        m_entries.erase(oldest);
+    }
+    m_entries[key] = info;
+    return 0;
+}
+
+void StreamInfoCache::evict(const string & key) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_entries.erase(key))
+        LOG(INFO) << "stream info of " << key << " evicted";
+}
+
+} // namespace ff_dynamic
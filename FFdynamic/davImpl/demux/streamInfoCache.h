@@ -0,0 +1,44 @@
+#pragma once
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include "ffmpegHeaders.h"
+#include "davImplTravel.h"
+
+namespace ff_dynamic {
+using ::std::map;
+using ::std::shared_ptr;
+using ::std::string;
+
+/* what a full probe found for an input: its format and audio/video streams (by stream index) */
+struct CachedStreamInfo {
+    string m_formatName; /* short name for av_find_input_format */
+    map<int, shared_ptr<DavTravelStatic>> m_streams;
+    int64_t m_updateTime = 0;
+};
+
+/* Process wide stream info of inputs seen before, keyed by url or a caller's key. A demux with a hit skips
+   format probing and avformat_find_stream_info, outputs cached streams right away and validates them
+   against the packets it reads; a mismatch evicts the entry. */
+class StreamInfoCache {
+public:
+    static StreamInfoCache & instance();
+    /* copies of cached travel statics, false if no entry */
+    bool get(const string & key, CachedStreamInfo & info);
+    int put(const string & key, const AVFormatContext *fmtCtx);
+    void evict(const string & key);
+
+private:
+    StreamInfoCache() = default;
+    StreamInfoCache(const StreamInfoCache &) = delete;
+    StreamInfoCache & operator=(const StreamInfoCache &) = delete;
+
+private:
+    static constexpr size_t s_maxEntries = 256; /* oldest updated goes first */
+    std::mutex m_mutex;
+    map<string, CachedStreamInfo> m_entries;
+};
+
+} // namespace ff_dynamic
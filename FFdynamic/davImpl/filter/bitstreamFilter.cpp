@@ -0,0 +1,165 @@
+#include "bitstreamFilter.h"
+
+namespace ff_dynamic {
+//////////////////////////////////////////////////////////////////////////////////////////
+// [Register - auto, ffmpeg]
+static DavImplRegister s_bsfReg(
+    DavWaveClassBitstreamFilter(), vector<string>({"auto", "ffmpeg"}), {},
+    [](const DavWaveOption &options) -> unique_ptr<DavImpl> {
+        unique_ptr<DavImpl> p(new BitstreamFilter(options));
+        return p;
+    });
+
+const DavRegisterProperties &BitstreamFilter::getRegisterProperties() const noexcept {
+    return s_bsfReg.m_properties;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////
+/* exact match against AVOutputFormat.name */
+static bool fmtIn(const string &fmt, const vector<string> &names) {
+    for (auto &n : names)
+        if (fmt == n) return true;
+    return false;
+}
+
+string BitstreamFilter::autoSelectBsf(const AVCodecParameters *codecpar,
+                                      const string &targetFmt) {
+    if (!codecpar) return "null";
+    /* length prefixed (avcC/hvcC) extradata starts with version 1, annexb with start code */
+    const bool bLengthPrefixed =
+        codecpar->extradata_size > 0 && codecpar->extradata[0] == 1;
+    const bool bAnnexbTarget = fmtIn(targetFmt, {"mpegts", "hls", "h264", "hevc", "rtp_mpegts"});
+    if (codecpar->codec_id == AV_CODEC_ID_H264 && bLengthPrefixed && bAnnexbTarget)
+        return "h264_mp4toannexb";
+    if (codecpar->codec_id == AV_CODEC_ID_HEVC && bLengthPrefixed && bAnnexbTarget)
+        return "hevc_mp4toannexb";
+    /* adts aac carries no AudioSpecificConfig in extradata */
+    if (codecpar->codec_id == AV_CODEC_ID_AAC && codecpar->extradata_size == 0 &&
+        fmtIn(targetFmt, {"mp4", "mov", "ipod", "ismv", "f4v", "flv", "matroska"}))
+        return "aac_adtstoasc";
+    return "null";
+}
+
+string BitstreamFilter::targetFormatName() const {
+    const string containerFmt = m_options.get(DavOptionContainerFmt());
+    const string outputUrl = m_options.get(DavOptionOutputUrl());
+    AVOutputFormat *fmt = av_guess_format(containerFmt.empty() ? nullptr : containerFmt.c_str(),
+                                          outputUrl.empty() ? nullptr : outputUrl.c_str(),
+                                          nullptr);
+    return fmt ? fmt->name : "";
+}
+
+int BitstreamFilter::onDynamicallyInitializeViaTravelStatic(DavProcCtx &ctx) {
+    if (m_bsfCtx) onDestruct();
+
+    CHECK(m_inputTravelStatic.size() == ctx.m_froms.size() && ctx.m_froms.size() == 1);
+    auto in = m_inputTravelStatic.at(ctx.m_froms[0]);
+    if (!in || !in->m_codecpar) {
+        ERRORIT(DAV_ERROR_TRAVEL_STATIC_INVALID_CODECPAR,
+                m_logtag + "bitstream filter requires codecpar from its peer");
+        return DAV_ERROR_TRAVEL_STATIC_INVALID_CODECPAR;
+    }
+
+    string bsfDesc = m_options.get(DavOptionBitstreamFilter(), "auto");
+    if (bsfDesc == "auto") bsfDesc = autoSelectBsf(in->m_codecpar.get(), targetFormatName());
+    m_bsfDesc = bsfDesc;
+
+    int ret = av_bsf_list_parse_str(m_bsfDesc.c_str(), &m_bsfCtx);
+    if (ret < 0) {
+        ERRORIT(ret, m_logtag + "invalid bitstream filter " + m_bsfDesc);
+        return ret;
+    }
+    ret = avcodec_parameters_copy(m_bsfCtx->par_in, in->m_codecpar.get());
+    if (ret < 0) {
+        ERRORIT(ret, m_logtag + "copy codecpar to bitstream filter fail");
+        return ret;
+    }
+    m_bsfCtx->time_base_in = in->m_timebase;
+    ret = av_bsf_init(m_bsfCtx);
+    if (ret < 0) {
+        ERRORIT(ret, m_logtag + "bitstream filter init fail: " + m_bsfDesc);
+        return ret;
+    }
+
+    m_timestampMgr.clear();
+    m_outputTravelStatic.clear();
+    auto out = make_shared<DavTravelStatic>();
+    if (in->m_mediaType == AVMEDIA_TYPE_VIDEO)
+        out->setupVideoStatic(m_bsfCtx->par_out, m_bsfCtx->time_base_out, in->m_framerate,
+                              in->m_hwFramesCtx);
+    else
+        out->setupAudioStatic(m_bsfCtx->par_out, m_bsfCtx->time_base_out);
+    /* packets go to the filter in their own timebase; the filter outputs time_base_out */
+    m_timestampMgr.insert(std::make_pair(
+        ctx.m_froms[0], DavImplTimestamp(in->m_timebase, in->m_timebase)));
+    m_outputTravelStatic.emplace(std::make_pair(IMPL_SINGLE_OUTPUT_STREAM_INDEX, out));
+    m_outputMediaMap[IMPL_SINGLE_OUTPUT_STREAM_INDEX] = in->m_mediaType;
+
+    m_bDynamicallyInitialized = true;
+    LOG(INFO) << m_logtag << "bitstream filter '" << m_bsfDesc << "' ready.\nin static: " << *in
+              << ", \nout: " << *out;
+    return 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////
+int BitstreamFilter::onConstruct() {
+    LOG(INFO) << m_logtag << "will init after receive first packet, initial opts: "
+              << m_options.dump();
+    /* media type is known after the first packet's travel static */
+    m_outputMediaMap.insert(
+        std::make_pair(IMPL_SINGLE_OUTPUT_STREAM_INDEX, AVMEDIA_TYPE_UNKNOWN));
+    return 0;
+}
+
+int BitstreamFilter::onDestruct() {
+    if (m_bsfCtx) av_bsf_free(&m_bsfCtx);
+    return 0;
+}
+
+int BitstreamFilter::onProcess(DavProcCtx &ctx) {
+    ctx.m_expect.m_expectOrder = {EDavExpect::eDavExpectAnyOne};
+    if (!m_bsfCtx || !ctx.m_inBuf) return 0;
+
+    auto pkt = ctx.m_inRefPkt;
+    if (!pkt) {
+        LOG(INFO) << m_logtag << "bitstream filter receive flush packet";
+        ctx.m_bInputFlush = true;
+    } else {
+        m_inPackets++;
+    }
+    /* the filter takes the packet's reference, pkt is left blank */
+    int ret = av_bsf_send_packet(m_bsfCtx, pkt);
+    if (ret < 0) {
+        ERRORIT(ret, m_logtag + "bitstream filter send packet fail, drop it");
+        return 0;
+    }
+
+    do {
+        auto outBuf = make_shared<DavProcBuf>();
+        outBuf->m_travelStatic = m_outputTravelStatic.at(IMPL_SINGLE_OUTPUT_STREAM_INDEX);
+        AVPacket *outPkt = outBuf->mkAVPacket();
+        CHECK(outPkt != nullptr);
+        ret = av_bsf_receive_packet(m_bsfCtx, outPkt);
+        if (ret >= 0) {
+            ctx.m_outBufs.push_back(outBuf);
+            m_outPackets++;
+            continue;
+        } else if (ret == AVERROR_EOF) {
+            INFOIT(ret, m_logtag + "bitstream filter fully flushed, end process");
+            return ret;
+        } else if (ret != AVERROR(EAGAIN)) {
+            ERRORIT(ret, m_logtag + "bitstream filter receive packet fail");
+        }
+        break;
+    } while (true);
+    return 0;
+}
+
+int BitstreamFilter::statistics(AVDictionary **stat) {
+    av_dict_set(stat, "bsf", m_bsfDesc.c_str(), 0);
+    av_dict_set_int(stat, "in_packets", (int64_t)m_inPackets, 0);
+    av_dict_set_int(stat, "out_packets", (int64_t)m_outPackets, 0);
+    return 0;
+}
+
+}  // namespace ff_dynamic
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <string>
+#include "davImpl.h"
+#include "ffmpegHeaders.h"
+
+namespace ff_dynamic {
+using ::std::string;
+
+/* Packet in, packet out: runs ffmpeg bitstream filters (h264_mp4toannexb, aac_adtstoasc, ...)
+   on one compressed stream, so demuxed data could go to a muxer without transcoding.
+   Filter chain from 'DavOptionBitstreamFilter'; 'auto' (default) selects it by codec and
+   target container (DavOptionContainerFmt or guessed from DavOptionOutputUrl) */
+class BitstreamFilter : public DavImpl {
+   public:
+    BitstreamFilter(const DavWaveOption &options) : DavImpl(options) {
+        implDefaultInstantiate();
+    }
+    virtual ~BitstreamFilter() { onDestruct(); }
+
+   public:
+    static string autoSelectBsf(const AVCodecParameters *codecpar, const string &targetFmt);
+
+   private:
+    BitstreamFilter(const BitstreamFilter &) = delete;
+    BitstreamFilter &operator=(const BitstreamFilter &) = delete;
+    virtual int onConstruct();
+    virtual int onDestruct();
+    virtual int onProcess(DavProcCtx &ctx);
+    virtual int onDynamicallyInitializeViaTravelStatic(DavProcCtx &ctx);
+    virtual int onProcessTravelDynamic(DavProcCtx &ctx) { return 0; }
+    virtual const DavRegisterProperties &getRegisterProperties() const noexcept;
+    virtual int statistics(AVDictionary **stat);
+
+   private:
+    string targetFormatName() const;
+
+   private:
+    AVBSFContext *m_bsfCtx = nullptr;
+    string m_bsfDesc;
+    uint64_t m_inPackets = 0;
+    uint64_t m_outPackets = 0;
+};
+
+}  // namespace ff_dynamic
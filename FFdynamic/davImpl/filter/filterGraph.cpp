@@ -2,6 +2,7 @@
 #include <glog/logging.h>
 //
 #include "filterGraph.h"
+#include "davThreadBudget.h"
 
 namespace ff_dynamic {
 
@@ -51,6 +52,8 @@ int FilterGraph::initFilter(const FilterGraphParams &fgp) {
         ret = AVERROR(ENOMEM);
         return ret;
     }
+    m_filterGraph->nb_threads =
+        DavThreadBudget::getOnlyInstance().acquire(this, m_logtag, m_fgp.m_nbThreads);
 
     ret = prepareBufferSrc();
     if (ret < 0) {
@@ -105,6 +108,7 @@ int FilterGraph::close() {
     if (m_filterGraph) {
         avfilter_graph_free(&m_filterGraph);  // related filters will be set null
     }
+    DavThreadBudget::getOnlyInstance().release(this);
     // release anyway
     avfilter_inout_free(&m_inputs);
     avfilter_inout_free(&m_outputs);
@@ -26,6 +26,8 @@ struct FilterGraphParams {
     shared_ptr<AVBufferSinkParams> m_bufsinkParams;
     shared_ptr<AVABufferSinkParams> m_abufsinkParams;
     string m_filterDesc;
+    /* desired graph nb_threads; 0 means no preference. actual number is decided by DavThreadBudget */
+    int m_nbThreads = 0;
     string m_logtag;
 };
 
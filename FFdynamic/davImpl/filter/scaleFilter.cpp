@@ -73,7 +73,9 @@ int ScaleFilter::initScaleFilter(const ScaleFilterParams &sfp) {
     }
 
     string filterDesc;
-    if (m_sfp.m_inFramerate < m_sfp.m_outFramerate) {
+    if (!m_sfp.m_bFpsScale) {
+        filterDesc = scaleDesc.str();
+    } else if (m_sfp.m_inFramerate < m_sfp.m_outFramerate) {
         filterDesc = scaleDesc.str() + ", " + fpsConvertDesc.str();
     } else {
         filterDesc = fpsConvertDesc.str() + ", " + scaleDesc.str();
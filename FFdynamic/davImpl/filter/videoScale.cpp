@@ -0,0 +1,144 @@
+#include "videoScale.h"
+
+namespace ff_dynamic {
+//////////////////////////////////////////////////////////////////////////////////////////
+// [Register - scale]
+static DavImplRegister s_videoScaleReg(
+    DavWaveClassVideoFilter(), vector<string>({"scale"}), {},
+    [](const DavWaveOption &options) -> unique_ptr<DavImpl> {
+        unique_ptr<DavImpl> p(new VideoScale(options));
+        return p;
+    });
+
+const DavRegisterProperties &VideoScale::getRegisterProperties() const noexcept {
+    return s_videoScaleReg.m_properties;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////
+int VideoScale::onDynamicallyInitializeViaTravelStatic(DavProcCtx &ctx) {
+    if (m_scaleFilter) onDestruct();
+
+    CHECK(m_inputTravelStatic.size() == ctx.m_froms.size() && ctx.m_froms.size() == 1);
+    auto in = m_inputTravelStatic.at(ctx.m_froms[0]);
+    if (!in || (!in->m_codecpar && (in->m_pixfmt == AV_PIX_FMT_NONE))) {
+        ERRORIT(DAV_ERROR_TRAVEL_STATIC_INVALID_CODECPAR,
+                m_logtag + "video scale cannot get valid travel static codecpar or videopar");
+        return DAV_ERROR_TRAVEL_STATIC_INVALID_CODECPAR;
+    }
+
+    int outWidth = 0;
+    int outHeight = 0;
+    int ret = m_options.getVideoSize(outWidth, outHeight);
+    if (ret < 0 || outWidth <= 0 || outHeight <= 0) {
+        ERRORIT(DAV_ERROR_IMPL_DYNAMIC_INIT, m_logtag + "video scale needs a valid 'video_size'");
+        return DAV_ERROR_IMPL_DYNAMIC_INIT;
+    }
+
+    if (in->m_codecpar) {
+        m_sfp.m_inFormat = (enum AVPixelFormat)in->m_codecpar->format;
+        m_sfp.m_inWidth = in->m_codecpar->width;
+        m_sfp.m_inHeight = in->m_codecpar->height;
+        m_sfp.m_inSar = in->m_codecpar->sample_aspect_ratio;
+    } else {
+        m_sfp.m_inFormat = in->m_pixfmt;
+        m_sfp.m_inWidth = in->m_width;
+        m_sfp.m_inHeight = in->m_height;
+        m_sfp.m_inSar = in->m_sar;
+    }
+    if (m_sfp.m_inSar.num == 0) m_sfp.m_inSar = {1, 1};
+    m_sfp.m_inTimebase = in->m_timebase;
+    m_sfp.m_inFramerate = in->m_framerate;
+    m_sfp.m_outWidth = outWidth;
+    m_sfp.m_outHeight = outHeight;
+    m_sfp.m_outTimebase = in->m_timebase;
+    m_sfp.m_outFramerate = in->m_framerate;
+    m_sfp.m_hwFramesCtx = in->m_hwFramesCtx;
+    m_sfp.m_bFpsScale = false; /* spatial only, timestamps pass through */
+    m_sfp.m_logtag = appendLogTag(m_logtag, "-ScaleFilter");
+
+    m_scaleFilter = new ScaleFilter();
+    CHECK(m_scaleFilter != nullptr);
+    ret = m_scaleFilter->initScaleFilter(m_sfp);
+    if (ret < 0) {
+        ERRORIT(ret, m_logtag + "video scale's filter init failed");
+        return ret;
+    }
+
+    /* keep display aspect ratio */
+    const AVRational outSar = av_mul_q(
+        AVRational{outHeight * m_sfp.m_inWidth, outWidth * m_sfp.m_inHeight}, m_sfp.m_inSar);
+    m_timestampMgr.clear();
+    m_outputTravelStatic.clear();
+    auto out = make_shared<DavTravelStatic>();
+    out->setupVideoStatic(m_sfp.m_inFormat, outWidth, outHeight, in->m_timebase,
+                          in->m_framerate, outSar, in->m_hwFramesCtx);
+    m_timestampMgr.insert(std::make_pair(
+        ctx.m_froms[0], DavImplTimestamp(in->m_timebase, out->m_timebase)));
+    m_outputTravelStatic.emplace(std::make_pair(IMPL_SINGLE_OUTPUT_STREAM_INDEX, out));
+
+    m_bDynamicallyInitialized = true;
+    LOG(INFO) << m_logtag << "dynamically create VideoScale done.\nin static: " << *in
+              << ", \nout: " << *out;
+    return 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////
+int VideoScale::onConstruct() {
+    LOG(INFO) << m_logtag << "will init after receive first frame, initial opts: "
+              << m_options.dump();
+    m_outputMediaMap.insert(
+        std::make_pair(IMPL_SINGLE_OUTPUT_STREAM_INDEX, AVMEDIA_TYPE_VIDEO));
+    return 0;
+}
+
+int VideoScale::onDestruct() {
+    if (m_scaleFilter) {
+        m_scaleFilter->close();
+        delete m_scaleFilter;
+        m_scaleFilter = nullptr;
+    }
+    return 0;
+}
+
+int VideoScale::onProcess(DavProcCtx &ctx) {
+    ctx.m_expect.m_expectOrder = {EDavExpect::eDavExpectAnyOne};
+    if (!m_scaleFilter || !ctx.m_inBuf) return 0;
+
+    auto inFrame = ctx.m_inRefFrame;
+    if (!inFrame) {
+        LOG(INFO) << m_logtag << "video scale reciving flush frame";
+        ctx.m_bInputFlush = true;
+    }
+    int ret = m_scaleFilter->sendFrame(inFrame);
+    if (ret < 0 && ret != AVERROR_EOF && ret != AVERROR(EAGAIN))
+        ERRORIT(ret, m_logtag + "video scale send frame failed");
+
+    vector<shared_ptr<AVFrame>> scaledFrames;
+    ret = m_scaleFilter->receiveFrames(scaledFrames);
+    for (auto &f : scaledFrames) {
+        if (!f) /* flush marker from filter graph */
+            continue;
+        auto outBuf = make_shared<DavProcBuf>();
+        outBuf->m_travelStatic = m_outputTravelStatic.at(IMPL_SINGLE_OUTPUT_STREAM_INDEX);
+        AVFrame *frame = outBuf->mkAVFrame();
+        CHECK(frame != nullptr);
+        if (av_frame_ref(frame, f.get()) < 0)
+            continue;
+        ctx.m_outBufs.push_back(outBuf);
+        m_outFrames++;
+    }
+    if (ret == AVERROR_EOF) {
+        INFOIT(ret, m_logtag + "video scale fully flushed, end process");
+        return ret;
+    }
+    return 0;
+}
+
+int VideoScale::statistics(AVDictionary **stat) {
+    av_dict_set_int(stat, "output_width", m_sfp.m_outWidth, 0);
+    av_dict_set_int(stat, "output_height", m_sfp.m_outHeight, 0);
+    av_dict_set_int(stat, "output_frames", (int64_t)m_outFrames, 0);
+    return 0;
+}
+
+}  // namespace ff_dynamic
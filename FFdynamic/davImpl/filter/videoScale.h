@@ -0,0 +1,36 @@
+#pragma once
+
+#include "davImpl.h"
+#include "ffmpegHeaders.h"
+#include "scaleFilter.h"
+
+namespace ff_dynamic {
+
+/* Standalone video scale wave (impl type 'scale' of video filter category).
+   Output size is taken from 'video_size'; frame rate and pixel format are kept.
+   Used for cascade scaling, such as abr ladders */
+class VideoScale : public DavImpl {
+   public:
+    VideoScale(const DavWaveOption &options) : DavImpl(options) {
+        implDefaultInstantiate();
+    }
+    virtual ~VideoScale() { onDestruct(); }
+
+   private:
+    VideoScale(const VideoScale &) = delete;
+    VideoScale &operator=(const VideoScale &) = delete;
+    virtual int onConstruct();
+    virtual int onDestruct();
+    virtual int onProcess(DavProcCtx &ctx);
+    virtual int onDynamicallyInitializeViaTravelStatic(DavProcCtx &ctx);
+    virtual int onProcessTravelDynamic(DavProcCtx &ctx) { return 0; }
+    virtual const DavRegisterProperties &getRegisterProperties() const noexcept;
+    virtual int statistics(AVDictionary **stat);
+
+   private:
+    ScaleFilter *m_scaleFilter = nullptr;
+    ScaleFilterParams m_sfp;
+    uint64_t m_outFrames = 0;
+};
+
+}  // namespace ff_dynamic
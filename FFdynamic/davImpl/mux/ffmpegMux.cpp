@@ -1,4 +1,5 @@
 #include <math.h>
+#include <algorithm>
 #include <utility>
 #include "ffmpegMux.h"
 
@@ -39,7 +40,11 @@ int FFmpegMux::onDynamicallyInitializeViaTravelStatic(DavProcCtx & ctx) {
         onDestruct();
     m_timestampMgr.clear();
     m_muxStreamsMap.clear();
-    const string outFmt = m_options.get(DavOptionContainerFmt());
+    string outFmt = m_options.get(DavOptionContainerFmt());
+    if (!m_liveName.empty() && outFmt != "mp4") { /* the segmenter cuts fragmented mp4 */
+        LOG_IF(WARNING, !outFmt.empty()) << m_logtag << "memhls output ignores container format " << outFmt;
+        outFmt = "mp4";
+    }
     LOG(INFO) << m_logtag << "open Muxer options: " << m_options.dump();
     int ret = avformat_alloc_output_context2(&m_fmtCtx, nullptr,
                                              outFmt.empty() ? nullptr : outFmt.c_str(), m_outputUrl.c_str());
@@ -55,22 +60,19 @@ int FFmpegMux::onDynamicallyInitializeViaTravelStatic(DavProcCtx & ctx) {
         m_muxStreamsMap.insert(std::make_pair(s.first, st));
     }
 
-    /* TODO: avio options */
-    if (!(m_fmtCtx->oformat->flags & AVFMT_NOFILE)) {
-        ret = avio_open2(&m_fmtCtx->pb, m_outputUrl.c_str(), AVIO_FLAG_WRITE, nullptr, nullptr);
-        if (ret < 0) {
-            ERRORIT(ret, "Could not open output file " + m_outputUrl);
-            return ret;
-        }
-    }
-
-    /* write header: TODO: may add header options */
-    ret = avformat_write_header(m_fmtCtx, nullptr);
-    if (ret < 0) {
-        ERRORIT(ret, m_logtag + "failed to write header " + m_outputUrl);
+    ret = openOutput();
+    if (ret < 0)
         return ret;
-    }
     av_dump_format(m_fmtCtx, 0, m_outputUrl.c_str(), 1);
+    if (m_bAsyncWrite)
+        m_writer.reset(new MuxWriter(m_logtag, m_fmtCtx, m_writeQueueBytes, m_overflowPolicy,
+                                     [this](AVPacket *pkt) {return writePacket(pkt);},
+                                     [this]() {
+                                         if (m_tee)
+                                             m_tee->flush();
+                                         else if (m_fmtCtx->pb)
+                                             avio_flush(m_fmtCtx->pb);
+                                     }));
 
     /* set timestamp info after write header, no outputTravelStatic needed */
     for (auto & s : m_inputTravelStatic) {
@@ -78,6 +80,8 @@ int FFmpegMux::onDynamicallyInitializeViaTravelStatic(DavProcCtx & ctx) {
         m_timestampMgr.insert(std::make_pair(s.first, DavImplTimestamp(s.second->m_timebase, st->time_base)));
         LOG(INFO) << m_logtag << "stream " << st->index << " final timebase " << st->time_base;
     }
+    if (m_bGopPrime)
+        primeFromGopCache(ctx);
 
     /* write cache data out */
     auto cacheDataSize = m_preInitCacheInBufs.size();
@@ -87,12 +91,16 @@ int FFmpegMux::onDynamicallyInitializeViaTravelStatic(DavProcCtx & ctx) {
         CHECK(pkt != nullptr);
         /* cache buffer haven't scale its timestamp yet */
         ret = m_timestampMgr.at(buf->getAddress()).packetRescaleTs(pkt);
-        if (ret < 0) {// non-monotonic
-            LOG(WARNING) << m_logtag << " non-monotonic packet in";
-            continue; // TODO!
+        if (ret < 0) { /* non-monotonic, drop it */
+            LOG(WARNING) << m_logtag << "drop non-monotonic cached packet of " << buf->getAddress();
+            av_packet_free(&pkt);
+            m_preInitCacheInBufs.pop_front();
+            m_outputDiscardCount++;
+            ret = 0;
+            continue;
         }
         pkt->stream_index = m_muxStreamsMap.at(buf->getAddress())->index;
-        ret = av_interleaved_write_frame(m_fmtCtx, pkt);
+        ret = writePacket(pkt);
         av_packet_free(&pkt);
         m_preInitCacheInBufs.pop_front();
         if (ret < 0) {
@@ -101,6 +109,8 @@ int FFmpegMux::onDynamicallyInitializeViaTravelStatic(DavProcCtx & ctx) {
         }
     }
 
+    if (m_writer)
+        m_writer->start(); /* format context is the writer's from now on, till the trailer */
     m_bDynamicallyInitialized = true;
     LOG(INFO) << m_logtag << "open FFmpeg mux done. write header and cached " << cacheDataSize
               << " packets to " << m_outputUrl;
@@ -114,11 +124,59 @@ int FFmpegMux::onConstruct() {
         ERRORIT(DAV_ERROR_DICT_MISS_OUTPUTURL, m_logtag + "mux missing output url");
         return DAV_ERROR_DICT_MISS_OUTPUTURL;
     }
+    const string teeUrls = m_options.get(DavOptionTeeOutputUrls());
+    size_t start = 0;
+    while (start < teeUrls.size()) {
+        const size_t end = std::min(teeUrls.find('|', start), teeUrls.size());
+        if (end > start)
+            m_teeUrls.emplace_back(teeUrls.substr(start, end - start));
+        start = end + 1;
+    }
+    int teeWriteTimeoutMs = (int)(m_teeWriteTimeoutUs / 1000);
+    m_options.getInt("tee_write_timeout_ms", teeWriteTimeoutMs, AV_DICT_MATCH_CASE, 0);
+    m_teeWriteTimeoutUs = teeWriteTimeoutMs * 1000LL;
+    if (m_outputUrl.compare(0, 9, "memhls://") == 0) {
+        m_liveName = m_outputUrl.substr(9);
+        int segmentMs = (int)(m_liveParams.m_segmentUs / 1000);
+        int partMs = (int)(m_liveParams.m_partUs / 1000);
+        m_options.getInt("llhls_segment_ms", segmentMs, AV_DICT_MATCH_CASE, 100);
+        m_options.getInt("llhls_part_ms", partMs, AV_DICT_MATCH_CASE, 20);
+        m_options.getInt("llhls_window", m_liveParams.m_windowSegments, AV_DICT_MATCH_CASE, 2);
+        m_liveParams.m_segmentUs = segmentMs * 1000LL;
+        m_liveParams.m_partUs = std::min(partMs, segmentMs) * 1000LL;
+        if (m_liveName.empty() || m_teeUrls.size()) {
+            ERRORIT(AVERROR(EINVAL), m_logtag + "memhls output needs a name, and can't be teed: " + m_outputUrl);
+            return AVERROR(EINVAL);
+        }
+    }
+    m_options.getInt("throughput_report_ms", m_throughputReportMs);
+    m_options.getBool("async_write", m_bAsyncWrite);
+    m_options.getBool("gop_prime", m_bGopPrime);
+    int writeQueueKB = 8 * 1024;
+    m_options.getInt("write_queue_kb", writeQueueKB, AV_DICT_MATCH_CASE, 1);
+    m_writeQueueBytes = (size_t)writeQueueKB * 1024;
+    const string overflow = m_options.get("write_overflow");
+    if (!overflow.empty() && MuxWriter::parsePolicy(overflow, m_overflowPolicy) < 0) {
+        ERRORIT(AVERROR(EINVAL), m_logtag + "unknown write_overflow policy " + overflow + " (block, drop, fail)");
+        return AVERROR(EINVAL);
+    }
     LOG(INFO) << m_logtag << "will open after receive all stream info, initial opts: " << m_options.dump();
     return 0;
 }
 
 int FFmpegMux::onDestruct() {
+    if (m_writer) { /* stopped before the format context goes */
+        m_writer->stop();
+        m_writer.reset();
+    }
+    if (m_live) { /* releases its in memory io */
+        m_live->close();
+        m_live.reset();
+    }
+    if (m_tee) { /* releases the main context's io and the other formats' contexts */
+        m_tee->close();
+        m_tee.reset();
+    }
     if (m_fmtCtx) {
         if (m_fmtCtx->pb)
             avio_close(m_fmtCtx->pb);
@@ -143,7 +201,24 @@ int FFmpegMux::onProcess(DavProcCtx & ctx) {
     else
         pkt->stream_index = m_muxStreamsMap.at(ctx.m_inBuf->getAddress())->index;
 
-    int ret = av_interleaved_write_frame(m_fmtCtx, pkt);
+    /* write takes the packet's ownership, so keep what throughput report needs */
+    const int64_t pktBytes = pkt ? pkt->size : 0;
+    int64_t pktDts = AV_NOPTS_VALUE;
+    if (pkt && pkt->dts != AV_NOPTS_VALUE)
+        pktDts = av_rescale_q(pkt->dts, m_fmtCtx->streams[pkt->stream_index]->time_base, AV_TIME_BASE_Q);
+    const int64_t writeStart = av_gettime_relative();
+    int ret = m_writer ? asyncWrite(pkt) : writePacket(pkt);
+    int64_t busyUs = av_gettime_relative() - writeStart;
+    if (m_writer) { /* writer thread's busy time tells how the output link keeps up */
+        const int64_t writerBusyUs = m_writer->getStat().m_busyUs;
+        busyUs = writerBusyUs - m_writerBusyUs;
+        m_writerBusyUs = writerBusyUs;
+    }
+    updateThroughput(ctx, pktBytes, pktDts, busyUs);
+    if (ret > 0) { /* dropped by overflow policy */
+        m_outputDiscardCount++;
+        return 0;
+    }
     if (ret < 0) {
         m_outputDiscardCount++;
         // TODO: potential bug here: if pkt == null (flush packet), we shouldn't return here.
@@ -151,7 +226,17 @@ int FFmpegMux::onProcess(DavProcCtx & ctx) {
         return ret;
     }
     if (ctx.m_bInputFlush && ctx.m_froms.size() == 1) {
-        av_write_trailer(m_fmtCtx);
+        if (m_writer) {
+            ret = m_writer->finish();
+            if (ret < 0)
+                ERRORIT(ret, m_logtag + m_outputUrl + " async write failed before trailer");
+        }
+        if (m_tee)
+            m_tee->writeTrailer();
+        else if (m_live)
+            m_live->writeTrailer();
+        else
+            av_write_trailer(m_fmtCtx);
         ret = AVERROR_EOF;
         LOG(INFO) << m_logtag << (m_logtag + m_outputUrl + " end process, write file trailer done");
     }
@@ -161,7 +246,209 @@ int FFmpegMux::onProcess(DavProcCtx & ctx) {
     return ret;
 }
 
+int FFmpegMux::openOutput() {
+    int ret = 0;
+    if (!m_liveName.empty()) {
+        m_live.reset(new LiveSegmenter(m_logtag, m_liveName, m_liveParams));
+        ret = m_live->open(m_fmtCtx);
+        if (ret >= 0)
+            ret = m_live->writeHeader();
+        if (ret < 0)
+            ERRORIT(ret, m_logtag + "could not open live segmenter of " + m_outputUrl);
+        return ret;
+    }
+    if (m_teeUrls.size()) {
+        m_tee.reset(new MuxTee(m_logtag, m_teeWriteTimeoutUs));
+        ret = m_tee->open(m_fmtCtx, m_outputUrl, m_teeUrls);
+        if (ret < 0) {
+            ERRORIT(ret, m_logtag + "could not open tee output of " + m_outputUrl);
+            return ret;
+        }
+        ret = m_tee->writeHeader();
+        if (ret < 0)
+            ERRORIT(ret, m_logtag + "failed to write header to all tee destinations of " + m_outputUrl);
+        return ret;
+    }
+
+    /* TODO: avio options */
+    if (!(m_fmtCtx->oformat->flags & AVFMT_NOFILE)) {
+        ret = avio_open2(&m_fmtCtx->pb, m_outputUrl.c_str(), AVIO_FLAG_WRITE, nullptr, nullptr);
+        if (ret < 0) {
+            ERRORIT(ret, "Could not open output file " + m_outputUrl);
+            return ret;
+        }
+    }
+
+    /* write header: TODO: may add header options */
+    ret = avformat_write_header(m_fmtCtx, nullptr);
+    if (ret < 0)
+        ERRORIT(ret, m_logtag + "failed to write header " + m_outputUrl);
+    return ret;
+}
+
+/* A muxer connected to running encoders gets packets from somewhere in a gop. Write the cached packets
+   before its first ones, from the latest video key frame, and other streams' from that time on */
+int FFmpegMux::primeFromGopCache(DavProcCtx & ctx) {
+    map<DavProcFrom, int64_t> firstDts;
+    for (auto & buf : m_preInitCacheInBufs) {
+        const AVPacket *pkt = buf->getAVPacket();
+        if (pkt && pkt->dts != AV_NOPTS_VALUE && firstDts.count(buf->getAddress()) == 0)
+            firstDts.emplace(buf->getAddress(), pkt->dts);
+    }
+    const AVPacket *inPkt = ctx.m_inBuf ? ctx.m_inBuf->getAVPacket() : nullptr;
+    if (inPkt && inPkt->dts != AV_NOPTS_VALUE && firstDts.count(ctx.m_inBuf->getAddress()) == 0)
+        firstDts.emplace(ctx.m_inBuf->getAddress(), inPkt->dts);
+
+    auto & cache = DavGopCache::getOnlyInstance();
+    map<DavProcFrom, vector<AVPacket *>> primers;
+    int64_t startUs = AV_NOPTS_VALUE;
+    for (auto & f : firstDts) {
+        if (m_inputTravelStatic.at(f.first)->m_codecpar->codec_type != AVMEDIA_TYPE_VIDEO)
+            continue;
+        int64_t gopStartUs = AV_NOPTS_VALUE;
+        if (cache.getGop(f.first, f.second, primers[f.first], gopStartUs) >= 0)
+            startUs = startUs == AV_NOPTS_VALUE ? gopStartUs : std::min(startUs, gopStartUs);
+    }
+    if (startUs == AV_NOPTS_VALUE)
+        return 0; /* no video gop to start with, nothing else helps */
+    for (auto & f : firstDts)
+        if (m_inputTravelStatic.at(f.first)->m_codecpar->codec_type != AVMEDIA_TYPE_VIDEO)
+            cache.getSince(f.first, startUs, f.second, primers[f.first]);
+
+    /* rescale stream by stream, then write interleaved by dts: not every output interleaves itself
+       (memhls cuts parts on what arrives) */
+    vector<std::pair<int64_t, AVPacket *>> ordered;
+    for (auto & p : primers) {
+        for (auto pkt : p.second) {
+            if (m_timestampMgr.at(p.first).packetRescaleTs(pkt) < 0 || pkt->dts == AV_NOPTS_VALUE) {
+                av_packet_free(&pkt);
+                continue;
+            }
+            auto st = m_muxStreamsMap.at(p.first);
+            pkt->stream_index = st->index;
+            ordered.emplace_back(av_rescale_q(pkt->dts, st->time_base, AV_TIME_BASE_Q), pkt);
+        }
+    }
+    std::stable_sort(ordered.begin(), ordered.end(),
+                     [](const std::pair<int64_t, AVPacket *> & a, const std::pair<int64_t, AVPacket *> & b) {
+                         return a.first < b.first;});
+    int ret = 0;
+    for (auto & o : ordered) {
+        if (ret >= 0) {
+            ret = writePacket(o.second);
+            m_primedCount++;
+        }
+        av_packet_free(&o.second);
+    }
+    if (ret < 0)
+        LOG(WARNING) << m_logtag << "write cached gop failed: " << davMsg2str(ret);
+    LOG(INFO) << m_logtag << "primed with " << m_primedCount << " cached packets from " << startUs << "us";
+    return ret;
+}
+
+/* takes the packet, as av_interleaved_write_frame; a tee fails only when all its destinations failed */
+int FFmpegMux::writePacket(AVPacket *pkt) {
+    if (m_tee)
+        return m_tee->write(pkt);
+    if (m_live)
+        return m_live->write(pkt);
+    return av_interleaved_write_frame(m_fmtCtx, pkt);
+}
+
+/* queue to the writer thread: 0 queued, > 0 dropped. Flush packets of inputs other than the last
+   are skipped, av_write_trailer flushes the interleaving queue */
+int FFmpegMux::asyncWrite(AVPacket *pkt) {
+    if (!pkt)
+        return 0;
+    AVPacket *queuePkt = av_packet_alloc();
+    if (!queuePkt)
+        return AVERROR(ENOMEM);
+    av_packet_move_ref(queuePkt, pkt);
+    int ret = m_writer->write(queuePkt);
+    if (ret == AVERROR(ENOBUFS)) { /* 'fail' policy */
+        ERRORIT(ret, m_logtag + m_outputUrl + " write queue overflow, output fails");
+        return AVERROR_EOF; /* ends this output only */
+    }
+    return ret;
+}
+
+int FFmpegMux::statistics(AVDictionary **stat) {
+    av_dict_set_int(stat, "output_packets", (int64_t)m_outputCount, 0);
+    av_dict_set_int(stat, "discard_packets", (int64_t)m_outputDiscardCount, 0);
+    av_dict_set_int(stat, "gop_primed_packets", (int64_t)m_primedCount, 0);
+    if (m_writer) {
+        const MuxWriterStat w = m_writer->getStat();
+        av_dict_set_int(stat, "write_packets", (int64_t)w.m_writes, 0);
+        av_dict_set_int(stat, "write_batches", (int64_t)w.m_batches, 0);
+        av_dict_set_int(stat, "write_latency_avg_us", w.m_writes ? w.m_latencyUs / (int64_t)w.m_writes : 0, 0);
+        av_dict_set_int(stat, "write_latency_max_us", w.m_maxLatencyUs, 0);
+        av_dict_set_int(stat, "write_busy_ms", w.m_busyUs / 1000, 0);
+        av_dict_set_int(stat, "write_blocked_ms", w.m_blockUs / 1000, 0);
+        av_dict_set_int(stat, "write_dropped", (int64_t)w.m_drops, 0);
+        av_dict_set_int(stat, "write_dropped_bytes", (int64_t)w.m_dropBytes, 0);
+        av_dict_set_int(stat, "write_queued_bytes", (int64_t)w.m_queuedBytes, 0);
+        av_dict_set_int(stat, "write_queued_max_bytes", (int64_t)w.m_maxQueuedBytes, 0);
+    }
+    if (m_live) {
+        av_dict_set_int(stat, "llhls_segments", (int64_t)m_live->getSegments(), 0);
+        av_dict_set_int(stat, "llhls_parts", (int64_t)m_live->getParts(), 0);
+        av_dict_set_int(stat, "llhls_bytes", (int64_t)m_live->getBytes(), 0);
+    }
+    if (m_tee) {
+        const vector<MuxTeeDestStat> dests = m_tee->getStat();
+        for (size_t k = 0; k < dests.size(); k++) {
+            const string prefix = "tee_" + std::to_string(k) + "_";
+            av_dict_set(stat, (prefix + "url").c_str(), dests[k].m_url.c_str(), 0);
+            av_dict_set_int(stat, (prefix + "failed").c_str(), dests[k].m_bFailed ? 1 : 0, 0);
+            av_dict_set_int(stat, (prefix + "bytes").c_str(), (int64_t)dests[k].m_bytes, 0);
+            av_dict_set_int(stat, (prefix + "write_max_us").c_str(), dests[k].m_maxWriteUs, 0);
+        }
+    }
+    return 0;
+}
+
 //////////////////////////////////////////////////////////////////////////////////////////
+int FFmpegMux::updateThroughput(DavProcCtx & ctx, const int64_t bytes, const int64_t dts, const int64_t busyUs) {
+    if (m_throughputReportMs <= 0)
+        return 0;
+    auto & t = m_throughput;
+    const int64_t now = av_gettime_relative();
+    if (t.m_startTime == AV_NOPTS_VALUE)
+        t.m_startTime = now;
+    t.m_bytes += bytes;
+    t.m_busyUs += busyUs;
+    if (dts != AV_NOPTS_VALUE) {
+        if (t.m_startDts == AV_NOPTS_VALUE)
+            t.m_startDts = dts;
+        t.m_lastDts = t.m_lastDts == AV_NOPTS_VALUE ? dts : std::max(t.m_lastDts, dts);
+    }
+    const int64_t intervalUs = now - t.m_startTime;
+    if (intervalUs < m_throughputReportMs * 1000LL)
+        return 0;
+
+    auto e = make_shared<DavEventMuxThroughput>();
+    e->m_outputUrl = m_outputUrl;
+    e->m_intervalUs = intervalUs;
+    if (t.m_startDts != AV_NOPTS_VALUE)
+        e->m_mediaDurationUs = std::max(t.m_lastDts - t.m_startDts, (int64_t)0);
+    e->m_writeBusyUs = t.m_busyUs;
+    e->m_bytesWritten = t.m_bytes;
+    e->m_writeBitrate = t.m_bytes * 8 * 1000000 / intervalUs;
+    /* live input comes in at media speed, writing slower than that piles up before mux */
+    t.m_backlogUs = std::max(t.m_backlogUs + t.m_busyUs - e->m_mediaDurationUs, (int64_t)0);
+    e->m_backlogUs = t.m_backlogUs;
+    e->getAddress().setFromStreamIndex(IMPL_SINGLE_OUTPUT_STREAM_INDEX);
+    ctx.m_pubEvents.emplace_back(e);
+    LOG_EVERY_N(INFO, 30) << m_logtag << "write " << e->m_writeBitrate << "bps, busy " << e->m_writeBusyUs
+                          << "us for media " << e->m_mediaDurationUs << "us, backlog " << e->m_backlogUs << "us";
+
+    t.m_startTime = now;
+    t.m_startDts = t.m_lastDts;
+    t.m_bytes = 0;
+    t.m_busyUs = 0;
+    return 0;
+}
+
 int FFmpegMux::muxMetaDataSettings() {
     av_dict_set(&m_fmtCtx->metadata, "encoder", "ff_dynamic", 0);
     av_dict_set(&m_fmtCtx->metadata, "encoded_by", "ff_dynamic", 0);
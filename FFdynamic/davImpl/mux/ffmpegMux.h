@@ -3,6 +3,10 @@
 #include <map>
 #include "ffmpegHeaders.h"
 #include "davImpl.h"
+#include "davGopCache.h"
+#include "muxWriter.h"
+#include "muxTee.h"
+#include "liveSegmenter.h"
 
 namespace ff_dynamic {
 using ::std::map;
@@ -12,7 +16,11 @@ public:
     FFmpegMux(const DavWaveOption & options) : DavImpl(options) {
         implDefaultInstantiate();
     }
-    virtual ~FFmpegMux () {onDestruct();}
+    virtual ~FFmpegMux () {
+        onDestruct();
+        if (!m_liveName.empty()) /* kept over re-initialization, not after the muxer is gone */
+            DavLiveSegmentStore::getOnlyInstance().removeStream(m_liveName);
+    }
 
 private:
     FFmpegMux(FFmpegMux const &) = delete;
@@ -23,11 +31,17 @@ private:
     virtual int onDynamicallyInitializeViaTravelStatic(DavProcCtx & ctx);
     virtual int onProcessTravelDynamic(DavProcCtx & ctx) {return 0;}
     virtual const DavRegisterProperties & getRegisterProperties() const noexcept;
+    virtual int statistics(AVDictionary **stat);
 
 private:
     int dynamicallyInitialize(DavProcCtx & ctx);
     AVStream* addOneStream(const DavTravelStatic & travelStatic);
     int muxMetaDataSettings();
+    int updateThroughput(DavProcCtx & ctx, const int64_t bytes, const int64_t dts, const int64_t busyUs);
+    int asyncWrite(AVPacket *pkt);
+    int writePacket(AVPacket *pkt);
+    int openOutput();
+    int primeFromGopCache(DavProcCtx & ctx);
 
 private:
     string m_outputUrl;
@@ -36,7 +50,34 @@ private:
     vector<int> m_inPacketCount;
     uint64_t m_outputCount = 0;
     uint64_t m_outputDiscardCount = 0;
+    bool m_bGopPrime = true; /* start from encoders' cached gop, if they keep one (DavOptionGopCacheKB) */
+    uint64_t m_primedCount = 0;
     map<DavProcFrom, AVStream *> m_muxStreamsMap;
+    /* throughput report, for encoders adapting to the output link */
+    struct ThroughputReport {
+        int64_t m_startTime = AV_NOPTS_VALUE;
+        int64_t m_startDts = AV_NOPTS_VALUE; /* in AV_TIME_BASE_Q */
+        int64_t m_lastDts = AV_NOPTS_VALUE;
+        int64_t m_bytes = 0;
+        int64_t m_busyUs = 0;
+        int64_t m_backlogUs = 0;
+    };
+    int m_throughputReportMs = 1000; /* 0 disables report */
+    ThroughputReport m_throughput;
+    /* async writer stage: packets are written by a dedicated io thread */
+    bool m_bAsyncWrite = false;
+    size_t m_writeQueueBytes = 0;
+    EMuxOverflowPolicy m_overflowPolicy = EMuxOverflowPolicy::eBlock;
+    unique_ptr<MuxWriter> m_writer;
+    int64_t m_writerBusyUs = 0;
+    /* tee output: more destinations of the same output, see DavOptionTeeOutputUrls */
+    vector<string> m_teeUrls;
+    int64_t m_teeWriteTimeoutUs = 5000000;
+    unique_ptr<MuxTee> m_tee;
+    /* "memhls://<name>" output: low latency hls kept in DavLiveSegmentStore */
+    string m_liveName;
+    DavLiveStreamParams m_liveParams;
+    unique_ptr<LiveSegmenter> m_live;
 };
 
 } // namespace ff_dynamic
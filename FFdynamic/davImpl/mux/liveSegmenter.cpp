@@ -0,0 +1,145 @@
+#include <string.h>
+#include <algorithm>
+#include <glog/logging.h>
+#include "davUtil.h"
+#include "liveSegmenter.h"
+
+namespace ff_dynamic {
+
+static const int s_ioBufSize = 64 * 1024;
+
+int LiveSegmenter::ioWrite(void *opaque, uint8_t *buf, int size) {
+    LiveSegmenter *s = static_cast<LiveSegmenter *>(opaque);
+    s->m_pending.append(reinterpret_cast<const char *>(buf), size);
+    return size;
+}
+
+int LiveSegmenter::open(AVFormatContext *fmtCtx) {
+    close();
+    m_fmtCtx = fmtCtx;
+    if (strcmp(m_fmtCtx->oformat->name, "mp4") && strcmp(m_fmtCtx->oformat->name, "mov")) {
+        LOG(ERROR) << m_logtag << "live segmenter needs mp4 output, not " << m_fmtCtx->oformat->name;
+        return AVERROR(EINVAL);
+    }
+    m_cutStream = 0;
+    for (unsigned int k = 0; k < m_fmtCtx->nb_streams; k++) {
+        if (m_fmtCtx->streams[k]->codecpar->codec_type == AVMEDIA_TYPE_VIDEO) {
+            m_cutStream = (int)k;
+            break;
+        }
+    }
+    uint8_t *buf = static_cast<uint8_t *>(av_malloc(s_ioBufSize));
+    m_pb = buf ? avio_alloc_context(buf, s_ioBufSize, 1, this, nullptr, ioWrite, nullptr) : nullptr;
+    if (!m_pb) {
+        av_free(buf);
+        return AVERROR(ENOMEM);
+    }
+    m_fmtCtx->pb = m_pb;
+    m_fmtCtx->flags |= AVFMT_FLAG_CUSTOM_IO;
+    return DavLiveSegmentStore::getOnlyInstance().openStream(m_name, m_params);
+}
+
+int LiveSegmenter::writeHeader() {
+    AVDictionary *opts = nullptr;
+    /* moov up front with no samples, every fragment flushed by us; tfdt based, self contained fragments */
+    av_dict_set(&opts, "movflags", "frag_custom+empty_moov+default_base_moof", 0);
+    int ret = avformat_write_header(m_fmtCtx, &opts);
+    av_dict_free(&opts);
+    if (ret < 0)
+        return ret;
+    avio_flush(m_pb);
+    DavLiveSegmentStore::getOnlyInstance().setInit(m_name, m_pending);
+    LOG(INFO) << m_logtag << "live stream " << m_name << " init section " << m_pending.size() << " bytes";
+    m_pending.clear();
+    m_bStreamOpen = true;
+    return 0;
+}
+
+int LiveSegmenter::cutPart(const int64_t endUs, const bool bEndSegment) {
+    auto & store = DavLiveSegmentStore::getOnlyInstance();
+    if (m_bPartHasData) {
+        int ret = av_write_frame(m_fmtCtx, nullptr); /* frag_custom: flush a fragment */
+        avio_flush(m_pb);
+        if (ret < 0)
+            return ret;
+        store.addPart(m_name, m_pending, std::max(endUs - m_partStartUs, (int64_t)0), m_bPartIndependent);
+        m_bytes += m_pending.size();
+        m_parts++;
+        m_pending.clear();
+        m_bPartHasData = false;
+    }
+    m_partStartUs = endUs;
+    if (bEndSegment) {
+        store.endSegment(m_name);
+        m_segments++;
+        m_segmentStartUs = endUs;
+    }
+    return 0;
+}
+
+int LiveSegmenter::write(AVPacket *pkt) {
+    if (!pkt) /* fragments are cut by us, nothing interleaved to flush */
+        return 0;
+    int ret = 0;
+    const AVStream *st = m_fmtCtx->streams[pkt->stream_index];
+    const int64_t ts = pkt->dts != AV_NOPTS_VALUE ? pkt->dts : pkt->pts;
+    if (pkt->stream_index == m_cutStream && ts != AV_NOPTS_VALUE) {
+        const int64_t nowUs = av_rescale_q(ts, st->time_base, AV_TIME_BASE_Q);
+        if (m_lastUs != AV_NOPTS_VALUE && nowUs > m_lastUs)
+            m_frameUs = nowUs - m_lastUs;
+        m_lastUs = nowUs;
+        if (m_partStartUs == AV_NOPTS_VALUE) {
+            m_partStartUs = nowUs;
+            m_segmentStartUs = nowUs;
+        }
+        const bool bKey = (pkt->flags & AV_PKT_FLAG_KEY) != 0;
+        if (m_bPartHasData) {
+            /* segments on key frames; parts end before this frame would take them over the part target */
+            if (bKey && nowUs - m_segmentStartUs >= m_params.m_segmentUs)
+                ret = cutPart(nowUs, true);
+            else if (nowUs - m_partStartUs + m_frameUs > m_params.m_partUs)
+                ret = cutPart(nowUs, false);
+            if (ret < 0) {
+                LOG(ERROR) << m_logtag << "live stream " << m_name << " cut fragment failed: " << davMsg2str(ret);
+                av_packet_unref(pkt);
+                return ret;
+            }
+        }
+        if (!m_bPartHasData)
+            m_bPartIndependent = bKey;
+    }
+    ret = av_write_frame(m_fmtCtx, pkt);
+    av_packet_unref(pkt);
+    if (ret >= 0)
+        m_bPartHasData = true;
+    return ret;
+}
+
+int LiveSegmenter::writeTrailer() {
+    if (!m_bStreamOpen)
+        return 0;
+    int ret = cutPart(m_lastUs == AV_NOPTS_VALUE ? 0 : m_lastUs + m_frameUs, true);
+    av_write_trailer(m_fmtCtx);
+    m_pending.clear(); /* index boxes after the last fragment, not for streaming */
+    DavLiveSegmentStore::getOnlyInstance().closeStream(m_name);
+    m_bStreamOpen = false;
+    LOG(INFO) << m_logtag << "live stream " << m_name << " ended, " << m_segments << " segments, "
+              << m_parts << " parts, " << m_bytes << " bytes";
+    return ret;
+}
+
+void LiveSegmenter::close() {
+    if (m_bStreamOpen) { /* not ended by a trailer, players see the end anyway */
+        DavLiveSegmentStore::getOnlyInstance().closeStream(m_name);
+        m_bStreamOpen = false;
+    }
+    if (m_fmtCtx)
+        m_fmtCtx->pb = nullptr;
+    m_fmtCtx = nullptr;
+    if (m_pb) {
+        av_freep(&m_pb->buffer);
+        avio_context_free(&m_pb);
+    }
+}
+
+} // namespace ff_dynamic
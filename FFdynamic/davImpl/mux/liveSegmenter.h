@@ -0,0 +1,58 @@
+#pragma once
+
+#include <atomic>
+#include <string>
+#include "ffmpegHeaders.h"
+#include "davLiveSegmentStore.h"
+
+namespace ff_dynamic {
+using ::std::string;
+
+/* Fragmented mp4 (CMAF style) low latency HLS segmenter writing to DavLiveSegmentStore instead of files.
+   The mp4 muxer writes into memory (frag_custom); a fragment is cut as a partial segment at every part
+   target duration, and a segment ends on the first key frame after the segment target duration. Cuts
+   follow the first video stream (or the first stream if no video). */
+class LiveSegmenter {
+public:
+    LiveSegmenter(const string & logtag, const string & name, const DavLiveStreamParams & params)
+        : m_logtag(logtag), m_name(name), m_params(params) {}
+    ~LiveSegmenter() {close();}
+    /* 'fmtCtx' (owned by caller) is an mp4 context with streams added; takes its io */
+    int open(AVFormatContext *fmtCtx);
+    int writeHeader();
+    /* takes the packet, in its stream's timebase; packets should come interleaved */
+    int write(AVPacket *pkt);
+    /* flush the last part and end the stream */
+    int writeTrailer();
+    void close();
+    inline uint64_t getSegments() const noexcept {return m_segments;}
+    inline uint64_t getParts() const noexcept {return m_parts;}
+    inline uint64_t getBytes() const noexcept {return m_bytes;}
+
+private:
+    LiveSegmenter(const LiveSegmenter &) = delete;
+    LiveSegmenter & operator=(const LiveSegmenter &) = delete;
+    static int ioWrite(void *opaque, uint8_t *buf, int size);
+    int cutPart(const int64_t endUs, const bool bEndSegment);
+
+private:
+    string m_logtag;
+    string m_name;
+    DavLiveStreamParams m_params;
+    AVFormatContext *m_fmtCtx = nullptr;
+    AVIOContext *m_pb = nullptr;
+    int m_cutStream = 0;
+    string m_pending;                        /* muxed, not published yet */
+    bool m_bStreamOpen = false;
+    int64_t m_partStartUs = AV_NOPTS_VALUE;  /* of the cut stream, AV_TIME_BASE_Q */
+    int64_t m_segmentStartUs = AV_NOPTS_VALUE;
+    int64_t m_lastUs = AV_NOPTS_VALUE;
+    int64_t m_frameUs = 0;                   /* last frame interval of the cut stream */
+    bool m_bPartIndependent = false;
+    bool m_bPartHasData = false;
+    std::atomic<uint64_t> m_segments = ATOMIC_VAR_INIT(0); /* read by statistics, maybe from another thread */
+    std::atomic<uint64_t> m_parts = ATOMIC_VAR_INIT(0);
+    std::atomic<uint64_t> m_bytes = ATOMIC_VAR_INIT(0);
+};
+
+} // namespace ff_dynamic
@@ -0,0 +1,240 @@
+#include <algorithm>
+#include <glog/logging.h>
+#include "davUtil.h"
+#include "muxTee.h"
+
+namespace ff_dynamic {
+
+static const int s_fanoutBufSize = 32 * 1024;
+
+int MuxTee::destInterrupt(void *opaque) {
+    const Dest *d = static_cast<const Dest *>(opaque);
+    const int64_t deadline = d->m_deadline;
+    return deadline > 0 && av_gettime_relative() > deadline ? 1 : 0;
+}
+
+MuxTee::Group::~Group() {
+    if (m_ctx)
+        m_ctx->pb = nullptr; /* fan out io is ours */
+    if (m_fanout) {
+        av_freep(&m_fanout->buffer);
+        avio_context_free(&m_fanout);
+    }
+    for (auto & d : m_dests)
+        avio_closep(&d->m_pb);
+    if (m_bOwnCtx)
+        avformat_free_context(m_ctx);
+}
+
+int MuxTee::addDest(const string & format, const string & url) {
+    Group *group = nullptr;
+    for (auto & g : m_groups)
+        if (g->m_format == format)
+            group = g.get();
+    if (!group) {
+        unique_ptr<Group> g(new Group);
+        g->m_tee = this;
+        g->m_format = format;
+        g->m_bOwnCtx = true; /* freed with g on any failure below */
+        int ret = avformat_alloc_output_context2(&g->m_ctx, nullptr, format.c_str(), url.c_str());
+        if (ret < 0) {
+            LOG(ERROR) << m_logtag << "tee format " << format << " of " << url << " failed: " << davMsg2str(ret);
+            return ret;
+        }
+        for (unsigned int k = 0; k < m_mainCtx->nb_streams; k++) {
+            AVStream *st = avformat_new_stream(g->m_ctx, nullptr);
+            if (!st)
+                return AVERROR(ENOMEM);
+            st->time_base = m_mainCtx->streams[k]->time_base;
+            avcodec_parameters_copy(st->codecpar, m_mainCtx->streams[k]->codecpar);
+            st->codecpar->codec_tag = 0; /* may not be valid for this container */
+        }
+        group = g.get();
+        m_groups.emplace_back(std::move(g));
+    }
+
+    unique_ptr<Dest> d(new Dest);
+    d->m_stat.m_url = url;
+    d->m_stat.m_format = format;
+    AVIOInterruptCB cb = {destInterrupt, d.get()};
+    d->m_deadline = m_writeTimeoutUs > 0 ? av_gettime_relative() + m_writeTimeoutUs : 0;
+    int ret = avio_open2(&d->m_pb, url.c_str(), AVIO_FLAG_WRITE, &cb, nullptr);
+    d->m_deadline = 0;
+    if (ret < 0) {
+        LOG(ERROR) << m_logtag << "tee open " << url << " failed: " << davMsg2str(ret);
+        d->m_stat.m_bFailed = true;
+    }
+    group->m_dests.emplace_back(std::move(d));
+    return 0;
+}
+
+int MuxTee::open(AVFormatContext *mainCtx, const string & mainUrl, const vector<string> & teeUrls) {
+    close();
+    m_mainCtx = mainCtx;
+    unique_ptr<Group> mainGroup(new Group);
+    mainGroup->m_tee = this;
+    mainGroup->m_format = mainCtx->oformat->name;
+    mainGroup->m_ctx = mainCtx;
+    m_groups.emplace_back(std::move(mainGroup));
+
+    int ret = addDest(m_groups[0]->m_format, mainUrl);
+    for (size_t k = 0; ret >= 0 && k < teeUrls.size(); k++) {
+        string format = m_groups[0]->m_format;
+        string url = teeUrls[k];
+        if (url.compare(0, 3, "[f=") == 0 && url.find(']') != string::npos) {
+            format = url.substr(3, url.find(']') - 3);
+            url = url.substr(url.find(']') + 1);
+        }
+        ret = addDest(format, url);
+    }
+    if (ret < 0)
+        return ret;
+
+    for (auto & g : m_groups) {
+        if (g->m_ctx->oformat->flags & AVFMT_NOFILE) {
+            LOG(ERROR) << m_logtag << g->m_format << " writes files itself, can't tee";
+            return AVERROR(EINVAL);
+        }
+        uint8_t *buf = static_cast<uint8_t *>(av_malloc(s_fanoutBufSize));
+        g->m_fanout = buf ? avio_alloc_context(buf, s_fanoutBufSize, 1, g.get(), nullptr, fanoutWrite, nullptr) : nullptr;
+        if (!g->m_fanout) {
+            av_free(buf);
+            return AVERROR(ENOMEM);
+        }
+        g->m_ctx->pb = g->m_fanout;
+        g->m_ctx->flags |= AVFMT_FLAG_CUSTOM_IO;
+        if (!isAlive(*g))
+            g->m_bFailed = true;
+        LOG(INFO) << m_logtag << "tee group " << g->m_format << " with " << g->m_dests.size() << " destinations";
+    }
+    for (auto & g : m_groups)
+        if (!g->m_bFailed)
+            return 0;
+    return AVERROR(EIO);
+}
+
+bool MuxTee::isAlive(const Group & g) const {
+    for (auto & d : g.m_dests)
+        if (!d->m_stat.m_bFailed)
+            return true;
+    return false;
+}
+
+void MuxTee::failDest(Group & g, Dest & d, const int err, const string & reason) {
+    LOG(ERROR) << m_logtag << "tee destination " << d.m_stat.m_url << " " << reason << ": " << davMsg2str(err)
+               << ", dropped";
+    {
+        std::lock_guard<std::mutex> lock(m_statMutex);
+        d.m_stat.m_bFailed = true;
+    }
+    avio_closep(&d.m_pb);
+    if (!isAlive(g))
+        g.m_bFailed = true;
+}
+
+int MuxTee::fanoutWrite(void *opaque, uint8_t *buf, int size) {
+    Group *g = static_cast<Group *>(opaque);
+    MuxTee *tee = g->m_tee;
+    for (auto & d : g->m_dests) {
+        if (d->m_stat.m_bFailed)
+            continue;
+        const int64_t start = av_gettime_relative();
+        d->m_deadline = tee->m_writeTimeoutUs > 0 ? start + tee->m_writeTimeoutUs : 0;
+        avio_write(d->m_pb, buf, size);
+        avio_flush(d->m_pb); /* keep destinations in lockstep, and errors per write */
+        d->m_deadline = 0;
+        const int64_t writeUs = av_gettime_relative() - start;
+        if (d->m_pb->error < 0) {
+            tee->failDest(*g, *d, d->m_pb->error,
+                          tee->m_writeTimeoutUs > 0 && writeUs >= tee->m_writeTimeoutUs ? "write timeout" : "write failed");
+            continue;
+        }
+        std::lock_guard<std::mutex> lock(tee->m_statMutex);
+        d->m_stat.m_maxWriteUs = std::max(d->m_stat.m_maxWriteUs, writeUs);
+        d->m_stat.m_bytes += size;
+    }
+    return g->m_bFailed ? AVERROR(EIO) : size;
+}
+
+int MuxTee::writeHeader() {
+    int ret = AVERROR(EIO);
+    for (auto & g : m_groups) {
+        if (g->m_bFailed)
+            continue;
+        int r = avformat_write_header(g->m_ctx, nullptr);
+        if (r < 0) {
+            LOG(ERROR) << m_logtag << "tee group " << g->m_format << " write header failed: " << davMsg2str(r);
+            g->m_bFailed = true;
+            continue;
+        }
+        ret = 0;
+    }
+    return ret;
+}
+
+int MuxTee::write(AVPacket *pkt) {
+    int ret = AVERROR(EIO);
+    /* main group last, it takes the packet; nullptr flushes interleaving queues */
+    for (size_t k = m_groups.size(); k-- > 0;) {
+        Group & g = *m_groups[k];
+        if (g.m_bFailed)
+            continue;
+        AVPacket *p = pkt;
+        if (k > 0 && pkt) {
+            p = av_packet_clone(pkt);
+            if (!p) {
+                av_packet_unref(pkt);
+                return AVERROR(ENOMEM);
+            }
+            av_packet_rescale_ts(p, m_mainCtx->streams[pkt->stream_index]->time_base,
+                                 g.m_ctx->streams[pkt->stream_index]->time_base);
+        }
+        int r = av_interleaved_write_frame(g.m_ctx, p);
+        if (k > 0 && pkt)
+            av_packet_free(&p);
+        if (r < 0 && !g.m_bFailed) { /* not an io error, like what a single mux reports */
+            LOG(WARNING) << m_logtag << "tee group " << g.m_format << " write failed: " << davMsg2str(r);
+            ret = ret < 0 ? r : ret;
+            continue;
+        }
+        if (r >= 0)
+            ret = 0;
+    }
+    if (pkt && m_groups.size() && m_groups[0]->m_bFailed)
+        av_packet_unref(pkt);
+    return ret;
+}
+
+void MuxTee::flush() {
+    for (auto & g : m_groups)
+        if (!g->m_bFailed)
+            avio_flush(g->m_ctx->pb);
+}
+
+int MuxTee::writeTrailer() {
+    int ret = AVERROR(EIO);
+    for (auto & g : m_groups) {
+        if (g->m_bFailed)
+            continue;
+        if (av_write_trailer(g->m_ctx) >= 0 && !g->m_bFailed)
+            ret = 0;
+        avio_flush(g->m_ctx->pb);
+    }
+    return ret;
+}
+
+void MuxTee::close() {
+    m_groups.clear();
+    m_mainCtx = nullptr;
+}
+
+vector<MuxTeeDestStat> MuxTee::getStat() {
+    std::lock_guard<std::mutex> lock(m_statMutex);
+    vector<MuxTeeDestStat> stat;
+    for (auto & g : m_groups)
+        for (auto & d : g->m_dests)
+            stat.push_back(d->m_stat);
+    return stat;
+}
+
+} // namespace ff_dynamic
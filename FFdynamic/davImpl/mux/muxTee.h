@@ -0,0 +1,77 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "ffmpegHeaders.h"
+
+namespace ff_dynamic {
+using ::std::string;
+using ::std::unique_ptr;
+using ::std::vector;
+
+struct MuxTeeDestStat {
+    string m_url;
+    string m_format;
+    bool m_bFailed = false;
+    uint64_t m_bytes = 0;
+    int64_t m_maxWriteUs = 0;
+};
+
+/* One mux, many destinations. Destinations are grouped by container format: a group's format context
+   interleaves and serializes once, its io fans the bytes out to every destination of the group. A
+   destination whose write fails or blocks longer than the write timeout is closed and dropped, the
+   others go on; the output fails only when all destinations failed. Fan out io is not seekable, so
+   formats needing seek back (e.g. plain mp4) should be written fragmented. */
+class MuxTee {
+public:
+    MuxTee(const string & logtag, const int64_t writeTimeoutUs) : m_logtag(logtag), m_writeTimeoutUs(writeTimeoutUs) {}
+    ~MuxTee() {close();}
+    /* 'mainCtx' (owned by caller, streams added) writes to 'mainUrl'; 'teeUrls' are "url" for main's format,
+       or "[f=format]url". Other formats get their own context, with the same streams */
+    int open(AVFormatContext *mainCtx, const string & mainUrl, const vector<string> & teeUrls);
+    int writeHeader();
+    /* takes the packet, in main context's stream timebase */
+    int write(AVPacket *pkt);
+    void flush();
+    int writeTrailer();
+    void close();
+    /* may be called from another thread than the writing one */
+    vector<MuxTeeDestStat> getStat();
+
+private:
+    MuxTee(const MuxTee &) = delete;
+    MuxTee & operator=(const MuxTee &) = delete;
+    struct Dest {
+        MuxTeeDestStat m_stat;
+        AVIOContext *m_pb = nullptr;
+        std::atomic<int64_t> m_deadline = ATOMIC_VAR_INIT(0);
+    };
+    struct Group {
+        MuxTee *m_tee = nullptr;
+        string m_format;
+        AVFormatContext *m_ctx = nullptr;
+        bool m_bOwnCtx = false;
+        AVIOContext *m_fanout = nullptr;
+        vector<unique_ptr<Dest>> m_dests;
+        bool m_bFailed = false;
+        /* closes the destinations, frees the fan out io and an owned context */
+        ~Group();
+    };
+    static int fanoutWrite(void *opaque, uint8_t *buf, int size);
+    static int destInterrupt(void *opaque);
+    void failDest(Group & g, Dest & d, const int err, const string & reason);
+    bool isAlive(const Group & g) const;
+    int addDest(const string & format, const string & url);
+
+private:
+    string m_logtag;
+    int64_t m_writeTimeoutUs = 0;
+    AVFormatContext *m_mainCtx = nullptr;
+    vector<unique_ptr<Group>> m_groups; /* the first is main context's */
+    std::mutex m_statMutex;
+};
+
+} // namespace ff_dynamic
@@ -0,0 +1,180 @@
+#include <algorithm>
+#include <glog/logging.h>
+#include "davUtil.h"
+#include "muxWriter.h"
+
+namespace ff_dynamic {
+
+MuxWriter::MuxWriter(const string & logtag, AVFormatContext *fmtCtx, const size_t maxBytes,
+                     const EMuxOverflowPolicy policy, const MuxWriteFunc & write, const MuxFlushFunc & flush)
+    : m_logtag(logtag), m_fmtCtx(fmtCtx), m_write(write), m_flush(flush),
+      m_maxBytes(std::max(maxBytes, (size_t)1)), m_policy(policy) {
+    for (unsigned int k = 0; k < m_fmtCtx->nb_streams; k++)
+        if (m_fmtCtx->streams[k]->codecpar->codec_type == AVMEDIA_TYPE_VIDEO)
+            m_bHasVideo = true;
+}
+
+int MuxWriter::parsePolicy(const string & name, EMuxOverflowPolicy & policy) {
+    if (name == "block")
+        policy = EMuxOverflowPolicy::eBlock;
+    else if (name == "drop")
+        policy = EMuxOverflowPolicy::eDropToKeyFrame;
+    else if (name == "fail")
+        policy = EMuxOverflowPolicy::eFail;
+    else
+        return AVERROR(EINVAL);
+    return 0;
+}
+
+int MuxWriter::start() {
+    if (m_writer)
+        return 0;
+    m_fmtCtx->flush_packets = 0; /* flushed once per batch */
+    m_writer.reset(new std::thread(&MuxWriter::writeLoop, this));
+    LOG(INFO) << m_logtag << "async writer started, queue up to " << m_maxBytes << " bytes";
+    return 0;
+}
+
+int MuxWriter::write(AVPacket *pkt) {
+    const size_t size = pkt->size;
+    const bool bVideo = m_fmtCtx->streams[pkt->stream_index]->codecpar->codec_type == AVMEDIA_TYPE_VIDEO;
+    std::unique_lock<std::mutex> lock(m_mutex);
+    /* an empty queue always takes one, however large */
+    auto fits = [this, size]() {return m_queuedBytes == 0 || m_queuedBytes + size <= m_maxBytes;};
+    if (!fits() && m_policy == EMuxOverflowPolicy::eBlock && !m_bWriterQuit) {
+        const int64_t start = av_gettime_relative();
+        m_spaceCond.wait(lock, [this, &fits]() {return fits() || m_bWriterQuit;});
+        m_stat.m_blockUs += av_gettime_relative() - start;
+    }
+    if (m_err < 0 || m_bWriterQuit) {
+        av_packet_free(&pkt);
+        return m_err < 0 ? m_err : AVERROR_EXIT;
+    }
+
+    bool bDrop = false;
+    if (!fits()) {
+        if (m_policy == EMuxOverflowPolicy::eFail) {
+            m_err = AVERROR(ENOBUFS);
+            clearQueue();
+            m_queueCond.notify_all();
+            av_packet_free(&pkt);
+            return m_err;
+        }
+        bDrop = true;
+        if (bVideo || !m_bHasVideo)
+            m_bDropping = true;
+    } else if (m_bDropping && (bVideo || !m_bHasVideo)) {
+        /* resume on a key frame, once the writer caught up half of the queue */
+        if ((pkt->flags & AV_PKT_FLAG_KEY) && m_queuedBytes <= m_maxBytes / 2)
+            m_bDropping = false;
+        else
+            bDrop = true;
+    }
+    if (bDrop) {
+        LOG_IF(WARNING, m_stat.m_drops % 100 == 0) << m_logtag << "write queue full (" << m_queuedBytes
+                                                   << " bytes), dropped " << m_stat.m_drops + 1;
+        m_stat.m_drops++;
+        m_stat.m_dropBytes += size;
+        av_packet_free(&pkt);
+        return 1;
+    }
+
+    Entry e;
+    e.m_pkt = pkt;
+    e.m_queueTime = av_gettime_relative();
+    m_queue.emplace_back(e);
+    m_queuedBytes += size;
+    m_stat.m_maxQueuedBytes = std::max(m_stat.m_maxQueuedBytes, m_queuedBytes);
+    m_queueCond.notify_one();
+    return 0;
+}
+
+void MuxWriter::writeLoop() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (true) {
+        m_queueCond.wait(lock, [this]() {return m_bStop || m_bFinish || m_err < 0 || m_queue.size();});
+        if (m_bStop || m_err < 0 || (m_bFinish && m_queue.empty()))
+            break;
+        deque<Entry> batch;
+        batch.swap(m_queue);
+        lock.unlock();
+
+        int ret = 0;
+        size_t batchBytes = 0;
+        int64_t maxLatencyUs = 0;
+        int64_t latencyUs = 0;
+        const int64_t start = av_gettime_relative();
+        for (auto & e : batch) {
+            batchBytes += e.m_pkt->size;
+            if (ret >= 0)
+                ret = m_write(e.m_pkt);
+            av_packet_free(&e.m_pkt);
+            const int64_t latency = av_gettime_relative() - e.m_queueTime;
+            latencyUs += latency;
+            maxLatencyUs = std::max(maxLatencyUs, latency);
+        }
+        if (ret >= 0)
+            m_flush();
+        const int64_t busyUs = av_gettime_relative() - start;
+
+        lock.lock();
+        m_queuedBytes -= batchBytes;
+        m_stat.m_writes += batch.size();
+        m_stat.m_batches++;
+        m_stat.m_latencyUs += latencyUs;
+        m_stat.m_maxLatencyUs = std::max(m_stat.m_maxLatencyUs, maxLatencyUs);
+        m_stat.m_busyUs += busyUs;
+        if (ret < 0 && m_err == 0) {
+            m_err = ret;
+            LOG(ERROR) << m_logtag << "async write failed: " << davMsg2str(ret);
+        }
+        m_spaceCond.notify_all();
+    }
+    clearQueue();
+    m_bWriterQuit = true;
+    m_spaceCond.notify_all();
+    LOG(INFO) << m_logtag << "async writer quit, written " << m_stat.m_writes << " packets in "
+              << m_stat.m_batches << " batches, dropped " << m_stat.m_drops;
+}
+
+void MuxWriter::clearQueue() {
+    for (auto & e : m_queue) {
+        m_queuedBytes -= e.m_pkt->size;
+        av_packet_free(&e.m_pkt);
+    }
+    m_queue.clear();
+}
+
+int MuxWriter::finish() {
+    if (!m_writer)
+        return m_err;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_bFinish = true;
+    }
+    m_queueCond.notify_all();
+    m_writer->join();
+    m_writer.reset();
+    return m_err;
+}
+
+void MuxWriter::stop() {
+    if (!m_writer)
+        return;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_bStop = true;
+    }
+    m_queueCond.notify_all();
+    m_writer->join();
+    m_writer.reset();
+}
+
+MuxWriterStat MuxWriter::getStat() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    MuxWriterStat stat = m_stat;
+    stat.m_queuedBytes = m_queuedBytes;
+    return stat;
+}
+
+} // namespace ff_dynamic
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include "ffmpegHeaders.h"
+
+namespace ff_dynamic {
+using ::std::deque;
+using ::std::string;
+using ::std::unique_ptr;
+using MuxWriteFunc = std::function<int (AVPacket *)>;
+using MuxFlushFunc = std::function<void ()>;
+
+/* what to do with a packet that doesn't fit the write queue */
+enum class EMuxOverflowPolicy {
+    eBlock,           /* wait for the writer, backs up into encoders as sync writing does */
+    eDropToKeyFrame,  /* drop it; video keeps dropping till a key frame fits */
+    eFail             /* the output fails */
+};
+
+struct MuxWriterStat {
+    uint64_t m_writes = 0;
+    uint64_t m_batches = 0;
+    uint64_t m_drops = 0;
+    uint64_t m_dropBytes = 0;
+    int64_t m_latencyUs = 0;    /* total of queued to written, per packet */
+    int64_t m_maxLatencyUs = 0;
+    int64_t m_busyUs = 0;       /* writer thread's time in writing */
+    int64_t m_blockUs = 0;      /* producer's time waiting for queue space */
+    size_t m_queuedBytes = 0;
+    size_t m_maxQueuedBytes = 0;
+};
+
+/* Writer stage of a muxer: packets are queued (bounded by bytes) and a dedicated thread writes them
+   ('write' takes the packet, as av_interleaved_write_frame) in batches, calling 'flush' once per batch.
+   Between start and finish/stop the format context belongs to the writer thread; header and trailer are
+   written by the owner outside of that. */
+class MuxWriter {
+public:
+    MuxWriter(const string & logtag, AVFormatContext *fmtCtx, const size_t maxBytes,
+              const EMuxOverflowPolicy policy, const MuxWriteFunc & write, const MuxFlushFunc & flush);
+    ~MuxWriter() {stop();}
+    int start();
+    /* takes the packet: 0 queued, 1 dropped by policy, < 0 the output failed (write error or overflow) */
+    int write(AVPacket *pkt);
+    /* write out all queued and stop the thread; the last write error if any */
+    int finish();
+    /* stop the thread, queued packets are discarded */
+    void stop();
+    MuxWriterStat getStat();
+    static int parsePolicy(const string & name, EMuxOverflowPolicy & policy);
+
+private:
+    MuxWriter(const MuxWriter &) = delete;
+    MuxWriter & operator=(const MuxWriter &) = delete;
+    void writeLoop();
+    void clearQueue(); /* hold m_mutex */
+
+private:
+    struct Entry {
+        AVPacket *m_pkt = nullptr;
+        int64_t m_queueTime = 0;
+    };
+    string m_logtag;
+    AVFormatContext *m_fmtCtx = nullptr;
+    MuxWriteFunc m_write;
+    MuxFlushFunc m_flush;
+    size_t m_maxBytes = 0;
+    EMuxOverflowPolicy m_policy = EMuxOverflowPolicy::eBlock;
+    bool m_bHasVideo = false;
+    bool m_bDropping = false; /* video dropping till a key frame */
+
+    std::mutex m_mutex;
+    std::condition_variable m_queueCond; /* packets in, or finish/stop */
+    std::condition_variable m_spaceCond; /* batch written, or writer quit */
+    deque<Entry> m_queue;
+    size_t m_queuedBytes = 0;            /* queued plus being written */
+    bool m_bFinish = false;
+    bool m_bStop = false;
+    bool m_bWriterQuit = false;
+    int m_err = 0;
+    unique_ptr<std::thread> m_writer;
+    MuxWriterStat m_stat;
+};
+
+} // namespace ff_dynamic
@@ -2,6 +2,7 @@
 
 #include "davImplTravel.h"
 #include "davProcCtx.h"
+#include "davThreadBudget.h"
 
 namespace ff_dynamic {
 //// Register ////
@@ -17,6 +18,133 @@ const DavRegisterProperties &FFmpegVideoDecode::getRegisterProperties() const no
 }
 
 /////////////////////
+static int decodeThreadPolicyFromStr(const string & str, EDavDecodeThreadPolicy & policy) {
+    if (str == "auto")
+        policy = EDavDecodeThreadPolicy::eAuto;
+    else if (str == "frame")
+        policy = EDavDecodeThreadPolicy::eFrame;
+    else if (str == "slice")
+        policy = EDavDecodeThreadPolicy::eSlice;
+    else if (str == "lowlatency")
+        policy = EDavDecodeThreadPolicy::eLowLatency;
+    else
+        return AVERROR(EINVAL);
+    return 0;
+}
+
+static const char *decodeThreadPolicyToStr(const EDavDecodeThreadPolicy policy) {
+    switch (policy) {
+    case EDavDecodeThreadPolicy::eAuto: return "auto";
+    case EDavDecodeThreadPolicy::eFrame: return "frame";
+    case EDavDecodeThreadPolicy::eSlice: return "slice";
+    case EDavDecodeThreadPolicy::eLowLatency: return "lowlatency";
+    }
+    return "unknown";
+}
+
+/* small streams do not benefit from more threads; many of them run in one process */
+static int decodeThreadsByResolution(const int width, const int height) {
+    const int64_t pixels = (int64_t)width * height;
+    if (pixels <= 0)
+        return 0; /* unknown, let ffmpeg decide */
+    if (pixels <= 640 * 480)
+        return 1;
+    if (pixels <= 1280 * 720)
+        return 2;
+    if (pixels <= 1920 * 1080)
+        return 4;
+    return 8;
+}
+
+/* set thread_count/thread_type before open; explicit 'threads'/'thread_type' in options take precedence */
+int FFmpegVideoDecode::applyThreadPolicy(const AVCodec *dec, const AVCodecParameters *codecpar) {
+    const bool bFrameThreads = dec->capabilities & AV_CODEC_CAP_FRAME_THREADS;
+    const bool bSliceThreads = dec->capabilities & AV_CODEC_CAP_SLICE_THREADS;
+    int threads = decodeThreadsByResolution(codecpar->width, codecpar->height);
+    int threadType = 0;
+    switch (m_threadPolicy) {
+    case EDavDecodeThreadPolicy::eAuto:
+        threadType = bFrameThreads ? FF_THREAD_FRAME : (bSliceThreads ? FF_THREAD_SLICE : 0);
+        break;
+    case EDavDecodeThreadPolicy::eFrame:
+        threadType = bFrameThreads ? FF_THREAD_FRAME : 0;
+        break;
+    case EDavDecodeThreadPolicy::eSlice:
+        threadType = bSliceThreads ? FF_THREAD_SLICE : 0;
+        break;
+    case EDavDecodeThreadPolicy::eLowLatency:
+        /* frame threading delays output by thread_count - 1 frames */
+        threadType = bSliceThreads ? FF_THREAD_SLICE : 0;
+        m_decCtx->flags |= AV_CODEC_FLAG_LOW_DELAY;
+        break;
+    }
+    if (threadType == 0)
+        threads = 1;
+    /* explicit 'threads' setting is out of the process wide budget */
+    if (m_options.get("threads").empty())
+        m_decCtx->thread_count = DavThreadBudget::getOnlyInstance().acquire(this, m_logtag, threads);
+    if (threadType != 0 && m_options.get("thread_type").empty())
+        m_decCtx->thread_type = threadType;
+    return 0;
+}
+
+static const char *discardToStr(const enum AVDiscard discard) {
+    switch (discard) {
+    case AVDISCARD_NONE: return "none";
+    case AVDISCARD_DEFAULT: return "default";
+    case AVDISCARD_NONREF: return "nonref";
+    case AVDISCARD_BIDIR: return "bidir";
+    case AVDISCARD_NONINTRA: return "nonintra";
+    case AVDISCARD_NONKEY: return "nonkey";
+    case AVDISCARD_ALL: return "all";
+    }
+    return "unknown";
+}
+
+/* keyframes only if they alone are frequent enough, else drop non-reference frames if half
+   the rate is enough; both keep the remaining frames exact. Deblocking is skipped only when
+   no consumer needs reference exact frames */
+int FFmpegVideoDecode::applyFrameDemand() {
+    const auto & demand = m_frameDemand.getCombined();
+    enum AVDiscard skipFrame = AVDISCARD_DEFAULT;
+    enum AVDiscard skipLoopFilter = AVDISCARD_DEFAULT;
+    if (!demand.isDense()) {
+        const auto & out = m_outputTravelStatic.at(IMPL_SINGLE_OUTPUT_STREAM_INDEX);
+        const double fps = out->m_framerate.num > 0 ? av_q2d(out->m_framerate) : 0.0;
+        const double keyFps = m_keyIntervalUs > 0 ? 1000000.0 / m_keyIntervalUs : 0.0;
+        if (keyFps > 0.0 && demand.m_fps <= keyFps)
+            skipFrame = AVDISCARD_NONKEY;
+        else if (fps > 0.0 && demand.m_fps <= fps / 2)
+            skipFrame = AVDISCARD_NONREF;
+        if (!demand.m_bReferenceExact)
+            skipLoopFilter = AVDISCARD_ALL;
+    }
+    m_appliedKeyIntervalUs = m_keyIntervalUs;
+    if (m_decCtx->skip_frame == skipFrame && m_decCtx->skip_loop_filter == skipLoopFilter)
+        return 0;
+    LOG(INFO) << m_logtag << "consumers demand " << (demand.isDense() ? "every frame" :
+                                                      std::to_string(demand.m_fps) + " fps")
+              << ", skip_frame " << discardToStr(skipFrame)
+              << ", skip_loop_filter " << discardToStr(skipLoopFilter);
+    m_decCtx->skip_frame = skipFrame;
+    m_decCtx->skip_loop_filter = skipLoopFilter;
+    return 0;
+}
+
+int FFmpegVideoDecode::trackKeyFrameInterval(const AVPacket *pkt) {
+    if (!(pkt->flags & AV_PKT_FLAG_KEY))
+        return 0;
+    const int64_t ts = pkt->pts != AV_NOPTS_VALUE ? pkt->pts : pkt->dts;
+    if (ts == AV_NOPTS_VALUE)
+        return 0;
+    if (m_lastKeyPts != AV_NOPTS_VALUE && ts > m_lastKeyPts) {
+        const auto & tb = m_outputTravelStatic.at(IMPL_SINGLE_OUTPUT_STREAM_INDEX)->m_timebase;
+        m_keyIntervalUs = av_rescale_q(ts - m_lastKeyPts, tb, AV_TIME_BASE_Q);
+    }
+    m_lastKeyPts = ts;
+    return 0;
+}
+
 // after got the first input, retrieve the travel static info to do the initialize
 int FFmpegVideoDecode::dynamicallyInitialize(const AVCodecParameters *codecpar) {
     int ret = 0;
@@ -39,13 +167,16 @@ int FFmpegVideoDecode::dynamicallyInitialize(const AVCodecParameters *codecpar)
         ERRORIT(ret, m_logtag + "codecpar to context fail");
         return ret;
     }
+    applyThreadPolicy(dec, codecpar);
 
     if ((ret = avcodec_open2(m_decCtx, dec, m_options.get())) < 0) {
         ERRORIT(ret, m_logtag + "decode open fail");
         return ret;
     }
     recordUnusedOpts();
-    LOG(INFO) << m_logtag << "create VideoDecode done.";
+    LOG(INFO) << m_logtag << "create VideoDecode done. thread policy "
+              << decodeThreadPolicyToStr(m_threadPolicy) << ", threads " << m_decCtx->thread_count
+              << ", active thread type " << m_decCtx->active_thread_type;
     return 0;
 }
 
@@ -89,8 +220,18 @@ int FFmpegVideoDecode::onDynamicallyInitializeViaTravelStatic(DavProcCtx &ctx) {
 // [construct - destruct - process]
 
 int FFmpegVideoDecode::onConstruct() {
+    const string threadPolicy = m_options.get(DavOptionDecodeThreadPolicy());
+    if (!threadPolicy.empty() && decodeThreadPolicyFromStr(threadPolicy, m_threadPolicy) < 0)
+        LOG(WARNING) << m_logtag << "unknown decode thread policy " << threadPolicy << ", use auto";
     LOG(INFO) << m_logtag << "will open after receive first packet. 'FFmpegVideoDecode': "
               << m_options.dump();
+    /* sparse consumers subscribed by this decoder declare their frame demand */
+    std::function<int (const DavEventFrameDemand &)> f =
+        [this] (const DavEventFrameDemand & e) {m_frameDemand.update(e); return 0;};
+    m_implEvent.registerEvent(f);
+    std::function<int (const DavStopPubEvent &)> s =
+        [this] (const DavStopPubEvent & e) {m_frameDemand.remove(e.getAddress().m_from); return 0;};
+    m_implEvent.registerEvent(s);
     m_outputMediaMap.insert(
         std::make_pair(IMPL_SINGLE_OUTPUT_STREAM_INDEX, AVMEDIA_TYPE_VIDEO));
     return 0;
@@ -98,6 +239,7 @@ int FFmpegVideoDecode::onConstruct() {
 
 int FFmpegVideoDecode::onDestruct() {
     if (m_decCtx) avcodec_free_context(&m_decCtx);
+    DavThreadBudget::getOnlyInstance().release(this);
     LOG(INFO) << m_logtag << "FFmpeg VideoDecode destruct";
     return 0;
 }
@@ -111,7 +253,13 @@ int FFmpegVideoDecode::onProcess(DavProcCtx &ctx) {
     if (!pkt) {
         LOG(INFO) << "video decoding receive flush packet " << (*ctx.m_inBuf);
         ctx.m_bInputFlush = true;
+    } else {
+        trackKeyFrameInterval(pkt);
     }
+    DavFrameDemand::Demand demand;
+    if (m_frameDemand.combine(ctx.m_tos, demand) ||
+        (!demand.isDense() && m_appliedKeyIntervalUs != m_keyIntervalUs))
+        applyFrameDemand();
 
     ret = avcodec_send_packet(m_decCtx, pkt);
     if (ret < 0 && ret != AVERROR_EOF) {
@@ -128,6 +276,7 @@ int FFmpegVideoDecode::onProcess(DavProcCtx &ctx) {
         ret = avcodec_receive_frame(m_decCtx, frame);
         if (ret >= 0) {
             ctx.m_outBufs.push_back(outBuf);
+            m_outFrames++;
             if (frame->best_effort_timestamp != AV_NOPTS_VALUE)
                 frame->pts = frame->best_effort_timestamp;
             // TODO: if there is dynamic travel info, should only set to one outBuf
@@ -142,4 +291,20 @@ int FFmpegVideoDecode::onProcess(DavProcCtx &ctx) {
 
     return 0;
 }
+
+int FFmpegVideoDecode::statistics(AVDictionary **stat) {
+    av_dict_set(stat, "thread_policy", decodeThreadPolicyToStr(m_threadPolicy), 0);
+    if (m_decCtx) {
+        const int threadType = m_decCtx->active_thread_type;
+        av_dict_set_int(stat, "thread_count", m_decCtx->thread_count, 0);
+        av_dict_set(stat, "thread_type", threadType & FF_THREAD_FRAME ? "frame" :
+                    (threadType & FF_THREAD_SLICE ? "slice" : "none"), 0);
+    }
+    if (m_decCtx) {
+        av_dict_set(stat, "skip_frame", discardToStr(m_decCtx->skip_frame), 0);
+        av_dict_set(stat, "skip_loop_filter", discardToStr(m_decCtx->skip_loop_filter), 0);
+    }
+    av_dict_set_int(stat, "output_frames", (int64_t)m_outFrames, 0);
+    return 0;
+}
 }  // namespace ff_dynamic
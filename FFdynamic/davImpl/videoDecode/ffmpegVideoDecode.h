@@ -2,9 +2,19 @@
 
 #include "ffmpegHeaders.h"
 #include "davImpl.h"
+#include "davFrameDemand.h"
 
 namespace ff_dynamic {
 
+/* auto: pick thread number by resolution, frame threading if supported;
+   frame/slice: force the thread type; lowlatency: slice threading only, no frame delay */
+enum class EDavDecodeThreadPolicy {
+    eAuto = 0,
+    eFrame = 1,
+    eSlice = 2,
+    eLowLatency = 3
+};
+
 class FFmpegVideoDecode : public DavImpl {
 public:
     FFmpegVideoDecode(const DavWaveOption & options) : DavImpl(options) {
@@ -21,11 +31,22 @@ private:
     virtual int onDynamicallyInitializeViaTravelStatic(DavProcCtx & ctx);
     virtual int onProcessTravelDynamic(DavProcCtx & ctx) {return 0;}
     virtual const DavRegisterProperties & getRegisterProperties() const noexcept;
+    virtual int statistics(AVDictionary **stat);
     int dynamicallyInitialize(const AVCodecParameters *codecpar);
+    int applyThreadPolicy(const AVCodec *dec, const AVCodecParameters *codecpar);
+    int applyFrameDemand();
+    int trackKeyFrameInterval(const AVPacket *pkt);
 
 private:
     AVCodecContext *m_decCtx = nullptr;
     uint64_t m_discardFrames = 0;
+    uint64_t m_outFrames = 0;
+    EDavDecodeThreadPolicy m_threadPolicy = EDavDecodeThreadPolicy::eAuto;
+    /* skip frames when all consumers are sparse */
+    DavFrameDemand m_frameDemand;
+    int64_t m_lastKeyPts = AV_NOPTS_VALUE; /* in output timebase */
+    int64_t m_keyIntervalUs = 0;           /* latest observed, 0 if unknown yet */
+    int64_t m_appliedKeyIntervalUs = 0;
 };
 
 } //namespace ff_dynamic
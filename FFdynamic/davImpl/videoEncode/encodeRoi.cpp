@@ -0,0 +1,160 @@
+#include <algorithm>
+#include "encodeRoi.h"
+
+namespace ff_dynamic {
+
+int EncodeRoiTracker::addDetection(const ObjDetectEvent & event) {
+    if (event.m_detectOrClassify != "detect")
+        return 0;
+    Detection d;
+    d.m_bTimed = event.m_timebase.num > 0 && event.m_timebase.den > 0;
+    if (d.m_bTimed)
+        d.m_pts = av_rescale_q(event.m_framePts, event.m_timebase, AV_TIME_BASE_Q);
+    d.m_bNormalized = event.m_frameWidth > 0 && event.m_frameHeight > 0;
+    const double fw = d.m_bNormalized ? event.m_frameWidth : 1.0;
+    const double fh = d.m_bNormalized ? event.m_frameHeight : 1.0;
+    for (auto & r : event.m_results) {
+        if (r.m_confidence < m_params.m_minConfidence || r.m_rect.w <= 0 || r.m_rect.h <= 0)
+            continue;
+        if (m_params.m_classes.size() && m_params.m_classes.count(r.m_className) == 0)
+            continue;
+        RoiBox b;
+        b.m_className = r.m_className;
+        b.m_x = r.m_rect.x / fw;
+        b.m_y = r.m_rect.y / fh;
+        b.m_w = r.m_rect.w / fw;
+        b.m_h = r.m_rect.h / fh;
+        d.m_boxes.emplace_back(b);
+    }
+
+    /* detectors run on their own pace, results may come out of order */
+    if (m_detections.size() && d.m_bTimed && m_detections.back().m_bTimed &&
+        d.m_pts <= m_detections.back().m_pts)
+        return 0;
+    m_detections.emplace_back(d);
+    while (m_detections.size() > 2)
+        m_detections.pop_front();
+    return 0;
+}
+
+double EncodeRoiTracker::overlap(const RoiBox & a, const RoiBox & b) {
+    const double w = std::min(a.m_x + a.m_w, b.m_x + b.m_w) - std::max(a.m_x, b.m_x);
+    const double h = std::min(a.m_y + a.m_h, b.m_y + b.m_h) - std::max(a.m_y, b.m_y);
+    if (w <= 0 || h <= 0)
+        return 0.0;
+    const double inter = w * h;
+    return inter / (a.m_w * a.m_h + b.m_w * b.m_h - inter);
+}
+
+int EncodeRoiTracker::interpolate(const int64_t framePts, vector<RoiBox> & boxes, bool & bNormalized) const {
+    const auto & last = m_detections.back();
+    bNormalized = last.m_bNormalized;
+    if (!last.m_bTimed || framePts == AV_NOPTS_VALUE) {
+        boxes = last.m_boxes; /* no timing, hold the latest */
+        return 0;
+    }
+    if (framePts - last.m_pts > m_params.m_holdUs)
+        return 0;
+    if (m_detections.size() < 2 || !m_detections.front().m_bTimed ||
+        m_detections.front().m_bNormalized != last.m_bNormalized) {
+        boxes = last.m_boxes;
+        return 0;
+    }
+
+    const auto & prev = m_detections.front();
+    const double interval = (double)(last.m_pts - prev.m_pts);
+    /* before prev: prev as is; after last: extrapolate up to one more interval */
+    const double t = av_clipd((framePts - prev.m_pts) / interval, 0.0, 2.0);
+    vector<bool> prevMatched(prev.m_boxes.size(), false);
+    for (auto & l : last.m_boxes) {
+        int best = -1;
+        double bestOverlap = 0.0;
+        for (size_t k = 0; k < prev.m_boxes.size(); k++) {
+            if (prevMatched[k] || prev.m_boxes[k].m_className != l.m_className)
+                continue;
+            const double o = overlap(prev.m_boxes[k], l);
+            if (o > bestOverlap) {
+                bestOverlap = o;
+                best = (int)k;
+            }
+        }
+        if (best < 0) { /* newly appeared */
+            if (t >= 1.0)
+                boxes.emplace_back(l);
+            continue;
+        }
+        prevMatched[best] = true;
+        const auto & p = prev.m_boxes[best];
+        RoiBox b;
+        b.m_className = l.m_className;
+        b.m_x = p.m_x + (l.m_x - p.m_x) * t;
+        b.m_y = p.m_y + (l.m_y - p.m_y) * t;
+        b.m_w = p.m_w + (l.m_w - p.m_w) * t;
+        b.m_h = p.m_h + (l.m_h - p.m_h) * t;
+        boxes.emplace_back(b);
+    }
+    /* gone in the last detection, still there before it */
+    for (size_t k = 0; k < prev.m_boxes.size(); k++)
+        if (!prevMatched[k] && t < 1.0)
+            boxes.emplace_back(prev.m_boxes[k]);
+    return 0;
+}
+
+int EncodeRoiTracker::attachRegions(AVFrame *frame, const AVRational & frameTimebase) {
+    if (!frame || m_detections.empty())
+        return 0;
+    int64_t framePts = AV_NOPTS_VALUE;
+    if (frame->pts != AV_NOPTS_VALUE)
+        framePts = av_rescale_q(frame->pts, frameTimebase, AV_TIME_BASE_Q);
+    vector<RoiBox> boxes;
+    bool bNormalized = false;
+    interpolate(framePts, boxes, bNormalized);
+    if (boxes.empty())
+        return 0;
+
+    const bool bBackground = m_params.m_backgroundQoffset != 0.0;
+    const size_t num = boxes.size() + (bBackground ? 1 : 0);
+    AVFrameSideData *sd = av_frame_new_side_data(frame, AV_FRAME_DATA_REGIONS_OF_INTEREST,
+                                                 num * sizeof(AVRegionOfInterest));
+    if (!sd)
+        return AVERROR(ENOMEM);
+    /* the earlier region in the array takes precedence where regions overlap */
+    AVRegionOfInterest *rois = reinterpret_cast<AVRegionOfInterest *>(sd->data);
+    size_t n = 0;
+    /* normalized boxes go to this frame's size, which may differ from detector's (scaled) */
+    for (auto & b : boxes) {
+        const double sx = bNormalized ? frame->width : 1.0;
+        const double sy = bNormalized ? frame->height : 1.0;
+        const int left = av_clip((int)(b.m_x * sx), 0, frame->width);
+        const int top = av_clip((int)(b.m_y * sy), 0, frame->height);
+        const int right = av_clip((int)((b.m_x + b.m_w) * sx), 0, frame->width);
+        const int bottom = av_clip((int)((b.m_y + b.m_h) * sy), 0, frame->height);
+        if (right <= left || bottom <= top)
+            continue;
+        rois[n].self_size = sizeof(AVRegionOfInterest);
+        rois[n].left = left;
+        rois[n].top = top;
+        rois[n].right = right;
+        rois[n].bottom = bottom;
+        rois[n].qoffset = av_d2q(m_params.m_roiQoffset, 100);
+        n++;
+    }
+    if (bBackground) {
+        rois[n].self_size = sizeof(AVRegionOfInterest);
+        rois[n].left = 0;
+        rois[n].top = 0;
+        rois[n].right = frame->width;
+        rois[n].bottom = frame->height;
+        rois[n].qoffset = av_d2q(m_params.m_backgroundQoffset, 100);
+        n++;
+    }
+    if (n == 0 || (bBackground && n == 1)) {
+        av_frame_remove_side_data(frame, AV_FRAME_DATA_REGIONS_OF_INTEREST);
+        return 0;
+    }
+    sd->size = n * sizeof(AVRegionOfInterest);
+    m_attachedFrames++;
+    return 0;
+}
+
+} // namespace ff_dynamic
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <deque>
+#include <set>
+#include <string>
+#include <vector>
+#include "ffmpegHeaders.h"
+#include "davPeerEvent.h"
+
+namespace ff_dynamic {
+using ::std::deque;
+using ::std::set;
+using ::std::string;
+using ::std::vector;
+
+struct EncodeRoiParams {
+    double m_roiQoffset = -0.3;       /* [-1, 1], negative for better quality on detected objects */
+    double m_backgroundQoffset = 0.0; /* [-1, 1], positive de-emphasizes the rest; 0 leaves it alone */
+    double m_minConfidence = 0.5;
+    int64_t m_holdUs = 1000000;       /* detections older than this are dropped */
+    set<string> m_classes;            /* empty for all classes */
+};
+
+/* Keep the latest two detections and derive per frame regions of interest from them:
+   boxes are matched by class and overlap, then interpolated (or extrapolated by at most
+   one detection interval) to the frame's timestamp. */
+class EncodeRoiTracker {
+public:
+    explicit EncodeRoiTracker(const EncodeRoiParams & params) : m_params(params) {}
+    int addDetection(const ObjDetectEvent & event);
+    /* attach AV_FRAME_DATA_REGIONS_OF_INTEREST; frame's pts is in 'frameTimebase' */
+    int attachRegions(AVFrame *frame, const AVRational & frameTimebase);
+    inline uint64_t getAttachedFrames() const noexcept {return m_attachedFrames;}
+
+private:
+    struct RoiBox {
+        string m_className;
+        double m_x = 0.0; /* normalized to detection frame size, or pixels if size unknown */
+        double m_y = 0.0;
+        double m_w = 0.0;
+        double m_h = 0.0;
+    };
+    struct Detection {
+        int64_t m_pts = AV_NOPTS_VALUE; /* AV_TIME_BASE_Q */
+        bool m_bTimed = false;          /* false if detector's timebase unknown */
+        bool m_bNormalized = false;     /* false if detector's frame size unknown */
+        vector<RoiBox> m_boxes;
+    };
+    static double overlap(const RoiBox & a, const RoiBox & b);
+    int interpolate(const int64_t framePts, vector<RoiBox> & boxes, bool & bNormalized) const;
+
+private:
+    EncodeRoiParams m_params;
+    deque<Detection> m_detections; /* at most two, older first */
+    uint64_t m_attachedFrames = 0;
+};
+
+} // namespace ff_dynamic
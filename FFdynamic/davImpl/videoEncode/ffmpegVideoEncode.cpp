@@ -1,4 +1,7 @@
+#include <algorithm>
+#include <sstream>
 #include "ffmpegVideoEncode.h"
+#include "davThreadBudget.h"
 
 namespace ff_dynamic {
 //////////////////////////////////////////////////////////////////////////////////////////
@@ -14,8 +17,84 @@ const DavRegisterProperties &FFmpegVideoEncode::getRegisterProperties() const no
     return s_videoEncodeReg.m_properties;
 }
 
+static int encodeProfileFromStr(const string &str, EDavEncodeProfile &profile) {
+    if (str == "default")
+        profile = EDavEncodeProfile::eDefault;
+    else if (str == "interactive")
+        profile = EDavEncodeProfile::eInteractive;
+    else if (str == "broadcast")
+        profile = EDavEncodeProfile::eBroadcast;
+    else if (str == "offline")
+        profile = EDavEncodeProfile::eOffline;
+    else
+        return AVERROR(EINVAL);
+    return 0;
+}
+
+static const char *encodeProfileToStr(const EDavEncodeProfile profile) {
+    switch (profile) {
+        case EDavEncodeProfile::eDefault: return "default";
+        case EDavEncodeProfile::eInteractive: return "interactive";
+        case EDavEncodeProfile::eBroadcast: return "broadcast";
+        case EDavEncodeProfile::eOffline: return "offline";
+    }
+    return "unknown";
+}
+
+struct EncodeProfileSetting {
+    int m_lookahead;
+    int m_bframes;   /* -1: codec default */
+    bool m_bSliceThreads;
+    int m_vbvMs;     /* vbv buffer duration, 0: no vbv */
+    bool m_bZeroLatency;
+};
+
+static EncodeProfileSetting encodeProfileSetting(const EDavEncodeProfile profile) {
+    switch (profile) {
+        case EDavEncodeProfile::eInteractive: return {0, 0, true, 100, true};
+        case EDavEncodeProfile::eBroadcast: return {20, 2, false, 1000, false};
+        case EDavEncodeProfile::eOffline: return {60, 3, false, 0, false};
+        case EDavEncodeProfile::eDefault: break;
+    }
+    return {4, -1, false, 0, false};
+}
+
 ////////////////////////////////////
 //  [initialization]
+/* fill codec options from the profile; options already set by user are kept */
+int FFmpegVideoEncode::applyEncodeProfile(const AVCodec *enc) {
+    const string encName = enc->name;
+    const bool bX26x = encName == "libx264" || encName == "libx265";
+    const bool bNvenc = encName.find("nvenc") != string::npos;
+    const EncodeProfileSetting s = encodeProfileSetting(m_profile);
+
+    m_options.setInt("rc-lookahead", s.m_lookahead);
+    if (s.m_bframes >= 0) m_options.setInt("bf", s.m_bframes);
+    if (m_profile != EDavEncodeProfile::eDefault)
+        m_options.set("thread_type", s.m_bSliceThreads ? "slice" : "frame");
+    if (s.m_bZeroLatency) {
+        if (bX26x) m_options.set("tune", "zerolatency");
+        if (bNvenc) {
+            m_options.set("zerolatency", "1");
+            m_options.set("delay", "0");
+        }
+    }
+    /* 'b' may carry suffixes (such as 4000k), let AVOption parse it */
+    const string b = m_options.get("b");
+    if (s.m_vbvMs > 0 && !b.empty() && av_opt_set(m_encCtx, "b", b.c_str(), 0) >= 0 &&
+        m_encCtx->bit_rate > 0) {
+        m_options.set("maxrate", std::to_string(m_encCtx->bit_rate));
+        m_options.set("bufsize", std::to_string(m_encCtx->bit_rate * s.m_vbvMs / 1000));
+    }
+
+    /* frames held inside the encoder before the first packet comes out; b-frames are added
+       after open, when the codec's own defaults are known */
+    int lookahead = 0;
+    m_options.getInt("rc-lookahead", lookahead);
+    m_expectedDelayFrames = std::max(lookahead, 0);
+    return 0;
+}
+
 // please refers to "init_output_stream_encode", real staffs
 int FFmpegVideoEncode::dynamicallyInitialize(const DavTravelStatic &in) {
     int ret = 0;
@@ -71,12 +150,111 @@ int FFmpegVideoEncode::dynamicallyInitialize(const DavTravelStatic &in) {
 
     /* allow forced idr. overwrite if exist */
     m_options.set("forced-idr", "1", 0);
-    m_options.set("rc-lookahead", "4", 0);
+    applyEncodeProfile(enc);
+    const bool bSliceThreads = m_options.get("thread_type") == "slice";
+    /* explicit 'threads' setting is out of the process wide budget */
+    if (m_options.get("threads").empty())
+        m_encCtx->thread_count = DavThreadBudget::getOnlyInstance().acquire(this, m_logtag, 0);
     if ((ret = avcodec_open2(m_encCtx, enc, m_options.get())) < 0) {
         ERRORIT(ret, m_logtag + " encode open fail");
         return ret;
     }
     recordUnusedOpts();
+    /* 'bf' or the codec's default (such as x264 presets) */
+    m_expectedDelayFrames += std::max(std::max(m_encCtx->max_b_frames, m_encCtx->has_b_frames), 0);
+    /* frame threading pipelines one frame per extra thread */
+    if (!bSliceThreads && m_encCtx->thread_count > 1)
+        m_expectedDelayFrames += m_encCtx->thread_count - 1;
+    LOG(INFO) << m_logtag << "encode profile " << encodeProfileToStr(m_profile)
+              << ", expected encoder delay " << m_expectedDelayFrames << " frames";
+    setupBitrateAdapt(enc);
+    return 0;
+}
+
+/* encoders that pick up bit_rate/rc_max_rate/rc_buffer_size changes between frames */
+static bool isBitrateReconfigurable(const string &encName) {
+    return encName == "libx264" || encName == "h264_nvenc" || encName == "hevc_nvenc";
+}
+
+int FFmpegVideoEncode::setupBitrateAdapt(const AVCodec *enc) {
+    int minBitrate = 0;
+    m_options.getInt(DavOptionBitrateAdaptMin(), minBitrate);
+    if (minBitrate <= 0)
+        return 0;
+    if (!isBitrateReconfigurable(enc->name)) {
+        LOG(WARNING) << m_logtag << enc->name << " cannot change bitrate while encoding, no adaptation";
+        return 0;
+    }
+    if (m_encCtx->bit_rate <= 0) {
+        LOG(WARNING) << m_logtag << "bitrate adaptation needs a target bitrate ('b'), no adaptation";
+        return 0;
+    }
+    int maxBitrate = 0;
+    m_options.getInt(DavOptionBitrateAdaptMax(), maxBitrate);
+    m_adaptMaxBitrate = maxBitrate > 0 ? maxBitrate : m_encCtx->bit_rate;
+    m_adaptMinBitrate = std::min((int64_t)minBitrate, m_adaptMaxBitrate);
+    m_adaptBitrate = m_encCtx->bit_rate;
+    m_bBitrateAdapt = true;
+    LOG(INFO) << m_logtag << "bitrate adaptation in [" << m_adaptMinBitrate << ", "
+              << m_adaptMaxBitrate << "], start from " << m_adaptBitrate;
+    return 0;
+}
+
+int FFmpegVideoEncode::applyAdaptBitrate(const int64_t bitrate) {
+    /* keep vbv proportional to the target */
+    const double scale = (double)bitrate / m_encCtx->bit_rate;
+    m_encCtx->bit_rate = bitrate;
+    if (m_encCtx->rc_max_rate > 0)
+        m_encCtx->rc_max_rate = (int64_t)(m_encCtx->rc_max_rate * scale);
+    if (m_encCtx->rc_buffer_size > 0)
+        m_encCtx->rc_buffer_size = (int)(m_encCtx->rc_buffer_size * scale);
+    LOG(INFO) << m_logtag << "bitrate adapt " << m_adaptBitrate << " -> " << bitrate;
+    m_adaptBitrate = bitrate;
+    m_bitrateChanges++;
+    return 0;
+}
+
+/* worst muxer drives the rate: back off fast on congestion, probe up slowly when all are calm */
+int FFmpegVideoEncode::processMuxThroughput(const DavEventMuxThroughput &event) {
+    if (!m_bBitrateAdapt || !m_encCtx)
+        return 0;
+    auto &load = m_muxLoads[event.getAddress().m_from];
+    load.m_busyRatio = event.m_mediaDurationUs > 0 ?
+        (double)event.m_writeBusyUs / event.m_mediaDurationUs : 0.0;
+    load.m_bBacklogGrow = event.m_backlogUs > load.m_backlogUs;
+    load.m_backlogUs = event.m_backlogUs;
+
+    double worstBusyRatio = 0.0;
+    bool bBacklogGrow = false;
+    for (auto &l : m_muxLoads) {
+        worstBusyRatio = std::max(worstBusyRatio, l.second.m_busyRatio);
+        bBacklogGrow = bBacklogGrow || l.second.m_bBacklogGrow;
+    }
+
+    int64_t target = m_adaptBitrate;
+    if (bBacklogGrow || worstBusyRatio > 0.8) {
+        target = m_adaptBitrate * 85 / 100;
+        m_adaptCalmReports = 0;
+    } else if (worstBusyRatio < 0.5) {
+        if (++m_adaptCalmReports >= 3) {
+            target = m_adaptBitrate * 105 / 100;
+            m_adaptCalmReports = 0;
+        }
+    } else {
+        m_adaptCalmReports = 0;
+    }
+    target = av_clip64(target, m_adaptMinBitrate, m_adaptMaxBitrate);
+    if (target != m_adaptBitrate)
+        applyAdaptBitrate(target);
+    return 0;
+}
+
+int FFmpegVideoEncode::processObjDetect(const ObjDetectEvent &event) {
+    return m_roiTracker->addDetection(event);
+}
+
+int FFmpegVideoEncode::processMuxStop(const DavStopPubEvent &event) {
+    m_muxLoads.erase(event.getAddress().m_from);
     return 0;
 }
 
@@ -171,32 +349,71 @@ int FFmpegVideoEncode::onDynamicallyInitializeViaTravelStatic(DavProcCtx &ctx) {
 ////////////////////////////////////
 //  [event process]
 /* it is caller's responsibility to avoid racing between event process and data process */
-// int FFmpegVideoEncode::keyFrameRequest(const DavEvent & event) {
-//    m_bForcedKeyFrame = true;
-//    return 0;
-//}
+int FFmpegVideoEncode::keyFrameRequest(const DavDynaEventVideoKeyFrameRequest &event) {
+    m_bForcedKeyFrame = true;
+    m_keyFrameRequests++;
+    return 0;
+}
+
+/* from a fast joining demux reading our output */
+int FFmpegVideoEncode::processKeyFrameRequest(const DavEventKeyFrameRequest &event) {
+    LOG(INFO) << m_logtag << "key frame requested by a joining input";
+    m_bForcedKeyFrame = true;
+    m_keyFrameRequests++;
+    return 0;
+}
 
 ////////////////////////////////////
 //  [construct - destruct - process]
 
 int FFmpegVideoEncode::onConstruct() {
+    const string profile = m_options.get(DavOptionEncodeProfile());
+    if (!profile.empty() && encodeProfileFromStr(profile, m_profile) < 0)
+        LOG(WARNING) << m_logtag << "unknown encode profile " << profile << ", use default";
     LOG(INFO) << m_logtag << "will open after receive first frame, initial opts: "
               << m_options.dump();
     m_outputMediaMap.insert(
         std::make_pair(IMPL_SINGLE_OUTPUT_STREAM_INDEX, AVMEDIA_TYPE_VIDEO));
     /* register events */
-    // int registerEvent(const type_index typeIndex, function<int (const DavEvent &)> & f)
-    // {
-    // store a call to a member function
-    // std::function<void(const Foo&, int)> f_add_display = &Foo::print_add;
-    // type_index iFrameRequest = type_index(typeid(DavEventVideoIFrameRequest));
-    // LOG(INFO) << typeid(DavEventVideoIFrameRequest).name() << " & " <<
-    // typeid(AVCodecContext).name(); m_implEvent.registerEvent(iFrameRequest, );
+    std::function<int(const DavEventMuxThroughput &)> f =
+        [this](const DavEventMuxThroughput &e) { return processMuxThroughput(e); };
+    m_implEvent.registerEvent(f);
+    std::function<int(const DavStopPubEvent &)> s =
+        [this](const DavStopPubEvent &e) { return processMuxStop(e); };
+    m_implEvent.registerEvent(s);
+    std::function<int(const ObjDetectEvent &)> d =
+        [this](const ObjDetectEvent &e) { return processObjDetect(e); };
+    m_implEvent.registerEvent(d);
+    std::function<int(const DavDynaEventVideoKeyFrameRequest &)> k =
+        [this](const DavDynaEventVideoKeyFrameRequest &e) { return keyFrameRequest(e); };
+    m_implEvent.registerEvent(k);
+    std::function<int(const DavEventKeyFrameRequest &)> j =
+        [this](const DavEventKeyFrameRequest &e) { return processKeyFrameRequest(e); };
+    m_implEvent.registerEvent(j);
+    EncodeRoiParams rp;
+    m_options.getDouble("roi_qoffset", rp.m_roiQoffset, AV_DICT_MATCH_CASE, -1.0, 1.0);
+    m_options.getDouble("roi_background_qoffset", rp.m_backgroundQoffset, AV_DICT_MATCH_CASE, -1.0, 1.0);
+    m_options.getDouble("roi_min_confidence", rp.m_minConfidence, AV_DICT_MATCH_CASE, 0.0, 1.0);
+    int roiHoldMs = 1000;
+    m_options.getInt("roi_hold_ms", roiHoldMs);
+    rp.m_holdUs = roiHoldMs * 1000LL;
+    std::istringstream classes(m_options.get("roi_classes")); /* comma separated */
+    for (string c; std::getline(classes, c, ',');)
+        if (!c.empty()) rp.m_classes.insert(c);
+    m_roiTracker.reset(new EncodeRoiTracker(rp));
+    /* ours, not the codec's: keep them out of avcodec_open2 and its unused options */
+    vector<string> roiKeys;
+    AVDictionaryEntry *e = nullptr;
+    while ((e = av_dict_get(*m_options.get(), "roi_", e, AV_DICT_IGNORE_SUFFIX)))
+        roiKeys.emplace_back(e->key);
+    for (auto & k : roiKeys)
+        av_dict_set(m_options.get(), k.c_str(), nullptr, 0);
     return 0;
 }
 
 int FFmpegVideoEncode::onDestruct() {
     if (m_encCtx) avcodec_free_context(&m_encCtx);
+    DavThreadBudget::getOnlyInstance().release(this);
     ERRORIT(0, m_logtag + "FFmpeg VideoEncode Destruct");
     return 0;
 }
@@ -260,8 +477,11 @@ int FFmpegVideoEncode::onProcess(DavProcCtx &ctx) {
     }
 
     for (size_t k = 0; k < encodeFrames.size(); k++) {
-        if (m_bForcedKeyFrame) /* key frame set */
+        if (m_bForcedKeyFrame && encodeFrames[k]) /* key frame set */
             encodeFrames[k]->pict_type = AV_PICTURE_TYPE_I;
+        if (encodeFrames[k] && !av_frame_get_side_data(encodeFrames[k].get(),
+                                                       AV_FRAME_DATA_REGIONS_OF_INTEREST))
+            m_roiTracker->attachRegions(encodeFrames[k].get(), m_encCtx->time_base);
         ret = avcodec_send_frame(m_encCtx, encodeFrames[k].get());
         if (ret == AVERROR_EOF) {
             ERRORIT(ret,
@@ -285,4 +505,23 @@ int FFmpegVideoEncode::onProcess(DavProcCtx &ctx) {
     return receiveEncodeFrames(ctx);
 }
 
+int FFmpegVideoEncode::statistics(AVDictionary **stat) {
+    av_dict_set(stat, "encode_profile", encodeProfileToStr(m_profile), 0);
+    av_dict_set_int(stat, "expected_delay_frames", m_expectedDelayFrames, 0);
+    if (m_encCtx) {
+        av_dict_set_int(stat, "thread_count", m_encCtx->thread_count, 0);
+        av_dict_set_int(stat, "max_b_frames", m_encCtx->max_b_frames, 0);
+    }
+    if (m_bBitrateAdapt) {
+        av_dict_set_int(stat, "adapt_bitrate", m_adaptBitrate, 0);
+        av_dict_set_int(stat, "bitrate_changes", (int64_t)m_bitrateChanges, 0);
+    }
+    if (m_roiTracker && m_roiTracker->getAttachedFrames() > 0)
+        av_dict_set_int(stat, "roi_frames", (int64_t)m_roiTracker->getAttachedFrames(), 0);
+    av_dict_set_int(stat, "encode_frames", (int64_t)m_encodeFrames, 0);
+    av_dict_set_int(stat, "discard_frames", (int64_t)m_discardFrames, 0);
+    av_dict_set_int(stat, "key_frame_requests", (int64_t)m_keyFrameRequests, 0);
+    return 0;
+}
+
 }  // namespace ff_dynamic
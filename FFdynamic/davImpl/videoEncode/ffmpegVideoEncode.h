@@ -1,11 +1,25 @@
 #pragma once
 
+#include <map>
 #include "davImpl.h"
 #include "ffmpegHeaders.h"
 #include "scaleFilter.h"
+#include "encodeRoi.h"
 
 namespace ff_dynamic {
 
+/* eDefault: lookahead 4, codec defaults otherwise;
+   eInteractive: no lookahead, no b-frames, slice threads, tight vbv, zerolatency tune;
+   eBroadcast: short lookahead, few b-frames, frame threads, cbr-like vbv;
+   eOffline: long lookahead, more b-frames, frame threads, no vbv.
+   Explicitly set encoder options always win over the profile */
+enum class EDavEncodeProfile {
+    eDefault = 0,
+    eInteractive = 1,
+    eBroadcast = 2,
+    eOffline = 3
+};
+
 class FFmpegVideoEncode : public DavImpl {
    public:
     FFmpegVideoEncode(const DavWaveOption &options) : DavImpl(options) {
@@ -22,13 +36,21 @@ class FFmpegVideoEncode : public DavImpl {
     virtual int onDynamicallyInitializeViaTravelStatic(DavProcCtx &ctx);
     virtual int onProcessTravelDynamic(DavProcCtx &ctx) { return 0; }
     virtual const DavRegisterProperties &getRegisterProperties() const noexcept;
+    virtual int statistics(AVDictionary **stat);
 
     int dynamicallyInitialize(const DavTravelStatic &in);
+    int applyEncodeProfile(const AVCodec *enc);
     int setupScaleFilter(const DavTravelStatic &in, const DavTravelStatic &out);
     int receiveEncodeFrames(DavProcCtx &ctx);
 
    private: /* event process */
-    // int keyFrameRequest(const KeyFrameRequestEvent & event);
+    int keyFrameRequest(const DavDynaEventVideoKeyFrameRequest &event);
+    int processKeyFrameRequest(const DavEventKeyFrameRequest &event);
+    int processMuxThroughput(const DavEventMuxThroughput &event);
+    int processMuxStop(const DavStopPubEvent &event);
+    int processObjDetect(const ObjDetectEvent &event);
+    int setupBitrateAdapt(const AVCodec *enc);
+    int applyAdaptBitrate(const int64_t bitrate);
 
    private:
     AVCodecContext *m_encCtx = nullptr;
@@ -36,7 +58,25 @@ class FFmpegVideoEncode : public DavImpl {
     ScaleFilterParams m_sfp;
     uint64_t m_encodeFrames = 0;
     uint64_t m_discardFrames = 0;
+    uint64_t m_keyFrameRequests = 0;
     bool m_bForcedKeyFrame = false;
+    EDavEncodeProfile m_profile = EDavEncodeProfile::eDefault;
+    int m_expectedDelayFrames = 0;
+    /* congestion driven bitrate adaptation, fed by subscribed muxers */
+    struct MuxLoad {
+        double m_busyRatio = 0.0; /* write time / media time */
+        int64_t m_backlogUs = 0;
+        bool m_bBacklogGrow = false;
+    };
+    std::map<const DavProc *, MuxLoad> m_muxLoads; /* stop event comes with another stream index */
+    bool m_bBitrateAdapt = false;
+    int64_t m_adaptMinBitrate = 0;
+    int64_t m_adaptMaxBitrate = 0;
+    int64_t m_adaptBitrate = 0;
+    int m_adaptCalmReports = 0;
+    uint64_t m_bitrateChanges = 0;
+    /* regions of interest from subscribed object detectors */
+    unique_ptr<EncodeRoiTracker> m_roiTracker;
 };
 
 }  // namespace ff_dynamic
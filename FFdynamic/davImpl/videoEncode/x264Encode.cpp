@@ -1,284 +1,431 @@
-#include "ffmpegVideoEncode.h"
+#include <cstring>
+#include <sstream>
+#include "x264Encode.h"
+#include "davThreadBudget.h"
 
 namespace ff_dynamic {
+//////////////////////////////////////////////////////////////////////////////////////////
+// [Register - x264]
+static DavImplRegister s_x264EncodeReg(
+    DavWaveClassVideoEncode(), vector<string>({"x264"}), {},
+    [](const DavWaveOption &options) -> unique_ptr<DavImpl> {
+        unique_ptr<DavImpl> p(new X264Encode(options));
+        return p;
+    });
 
-////////////////////////////////////
-//  [initialization]
-// please refers to "init_output_stream_encode", real staffs
-int FFmpegVideoEncode::dynamicallyInitialize(const DavImplTravel::TravelStatic & in) {
-    int ret = 0;
-    LOG(INFO) << m_logtag << "open real ffmpeg VideoEncode: " << m_options.dump();
-    const string encName = m_options.get(DavOptionCodecName());
-    AVCodec *enc = avcodec_find_encoder_by_name(encName.c_str());
-    if (!enc) {
-        INFOIT(DAV_ERROR_IMPL_CODEC_NOT_FOUND,
-              m_logtag + encName + " video encode name not found, use h264 as default");
-        enc = avcodec_find_encoder_by_name("libx264");
-        if (!enc) {
-            ERRORIT(DAV_ERROR_IMPL_CODEC_NOT_FOUND,
-                  m_logtag + "default libx264 encoder not found, create ffmpeg video encoder fail");
-            return DAV_ERROR_IMPL_CODEC_NOT_FOUND;
-        }
+const DavRegisterProperties &X264Encode::getRegisterProperties() const noexcept {
+    return s_x264EncodeReg.m_properties;
+}
+
+static int pixfmtToX264Csp(enum AVPixelFormat pixfmt) {
+    switch (pixfmt) {
+        case AV_PIX_FMT_YUV420P:
+        case AV_PIX_FMT_YUVJ420P:
+            return X264_CSP_I420;
+        case AV_PIX_FMT_NV12:
+            return X264_CSP_NV12;
+        case AV_PIX_FMT_YUV422P:
+        case AV_PIX_FMT_YUVJ422P:
+            return X264_CSP_I422;
+        case AV_PIX_FMT_YUV444P:
+        case AV_PIX_FMT_YUVJ444P:
+            return X264_CSP_I444;
+        default:
+            break;
     }
+    return -1;
+}
 
-    m_encCtx = avcodec_alloc_context3(enc);
-    CHECK(m_encCtx != nullptr) << (m_logtag + " fail alloate encode context");
-    // m_encCtx->flags |= AV_CODEC_FLAG_GLOBAL_HEADER; /* TODO: always output this one ?*/
+static int x264CspPlanes(int csp) { return csp == X264_CSP_NV12 ? 2 : 3; }
 
-    /* before open, some other parameters need be set */
-    /* calculate encode aspect ratio */
-    /* policy: change encode aspect ratio to keep display aspect ratio and without padding */
-    int outWidth = 0;
-    int outHeight = 0;
-    ret = m_options.getVideoSize(outWidth, outHeight);
-    if (ret < 0) {
-        ERRORIT(DAV_ERROR_IMPL_DYNAMIC_INIT, "Cannot get encoder output WxH");
+////////////////////////////////////
+//  [initialization]
+int X264Encode::setupParams(const DavTravelStatic &in, const AVRational &timebase) {
+    const string preset = m_options.get("preset", "veryfast");
+    bool bZeroLatency = false;
+    m_options.getBool("zerolatency", bZeroLatency);
+    string tune = m_options.get("tune");
+    if (bZeroLatency && tune.find("zerolatency") == string::npos)
+        tune = tune.empty() ? "zerolatency" : tune + ",zerolatency";
+    if (x264_param_default_preset(&m_param, preset.c_str(), tune.empty() ? nullptr : tune.c_str()) < 0) {
+        ERRORIT(DAV_ERROR_IMPL_DYNAMIC_INIT, m_logtag + "invalid x264 preset/tune " + preset + "/" + tune);
         return DAV_ERROR_IMPL_DYNAMIC_INIT;
     }
-    AVRational outSar = av_mul_q(AVRational{outHeight * in.m_width, outWidth * in.m_height}, in.m_sar);
-    AVRational setSar = {0, 1};
-    ret = m_options.getAVRational("sar", setSar);
-    if (ret == 0 && setSar != outSar) {
-        LOG(WARNING) << m_logtag << "set sar is not right, use sar " << outSar
-                     << " instead of setting one " << setSar << ". in " << in.m_width << "x"
-                     << in.m_height << ", out " << outWidth << "x" << outHeight;
+
+    m_param.i_csp = m_csp;
+    m_param.i_width = m_outWidth;
+    m_param.i_height = m_outHeight;
+    m_param.vui.i_sar_width = m_outSar.num;
+    m_param.vui.i_sar_height = m_outSar.den;
+    m_param.i_fps_num = m_framerate.num;
+    m_param.i_fps_den = m_framerate.den;
+    m_param.i_timebase_num = timebase.num;
+    m_param.i_timebase_den = timebase.den;
+    m_param.b_vfr_input = 1;
+    /* in-band sps/pps for live; global headers are exported as extradata as well */
+    m_param.b_repeat_headers = 1;
+    m_param.b_annexb = 1;
+    m_param.i_log_level = X264_LOG_WARNING;
+    if (in.m_pixfmt == AV_PIX_FMT_YUVJ420P || in.m_pixfmt == AV_PIX_FMT_YUVJ422P ||
+        in.m_pixfmt == AV_PIX_FMT_YUVJ444P)
+        m_param.vui.b_fullrange = 1;
+
+    /* rate control: crf wins over bitrate */
+    int crf = -1;
+    int bitrate = 0;
+    if (m_options.getInt("crf", crf, AV_DICT_MATCH_CASE, 0, 51) == 0) {
+        m_param.rc.i_rc_method = X264_RC_CRF;
+        m_param.rc.f_rf_constant = (float)crf;
+    } else if (m_options.getInt("b", bitrate) == 0 && bitrate > 0) {
+        m_param.rc.i_rc_method = X264_RC_ABR;
+        m_param.rc.i_bitrate = bitrate / 1000;
+        m_param.rc.i_vbv_max_bitrate = bitrate / 1000;
+        m_param.rc.i_vbv_buffer_size = bitrate / 1000;
     }
-    m_options.setAVRational("sar", outSar, 0); /* overwrite sar setting */
+    int gop = 0;
+    if (m_options.getInt("g", gop) == 0 && gop > 0)
+        m_param.i_keyint_max = gop;
+    int keyintMin = 0;
+    if (m_options.getInt("keyint_min", keyintMin) == 0 && keyintMin > 0)
+        m_param.i_keyint_min = keyintMin;
+    int scThreshold = 0;
+    if (m_options.getInt("sc_threshold", scThreshold) == 0)
+        m_param.i_scenecut_threshold = scThreshold;
+    int bframes = 0;
+    if (m_options.getInt("bf", bframes) == 0 && bframes >= 0)
+        m_param.i_bframe = bframes;
 
-    /* framerate */
-    AVRational fps = {0, 1};
-    ret = m_options.getAVRational("framerate", fps);
-    if (fps.num != 0)
-        m_encCtx->framerate = fps;
-    else if (in.m_framerate.num != 0)
-        m_encCtx->framerate = in.m_framerate;
+    /* threading: explicit 'threads' is out of the process wide budget */
+    bool bSlicedThreads = false;
+    m_options.getBool("sliced_threads", bSlicedThreads);
+    m_param.b_sliced_threads = bSlicedThreads ? 1 : m_param.b_sliced_threads;
+    int threads = 0;
+    if (m_options.getInt("threads", threads) == 0 && threads >= 0)
+        m_param.i_threads = threads;
     else
-        m_encCtx->framerate = {25, 1};
+        m_param.i_threads = DavThreadBudget::getOnlyInstance().acquire(this, m_logtag, 0);
 
-    /* allow forced idr. overwrite if exist */
-    m_options.set("forced-idr", "1", 0);
-    if ((ret = avcodec_open2(m_encCtx, enc, m_options.get())) < 0) {
-        ERRORIT(ret, m_logtag + " encode open fail");
-        return ret;
+    m_options.getBool("intra_refresh", m_bIntraRefresh);
+    m_param.b_intra_refresh = m_bIntraRefresh ? 1 : 0;
+
+    /* raw x264 params last, they could overwrite everything above */
+    const string x264Params = m_options.get("x264-params");
+    if (!x264Params.empty()) {
+        std::istringstream iss(x264Params);
+        string kv;
+        while (std::getline(iss, kv, ':')) {
+            const size_t pos = kv.find('=');
+            const string key = kv.substr(0, pos);
+            const string val = pos == string::npos ? "1" : kv.substr(pos + 1);
+            if (x264_param_parse(&m_param, key.c_str(), val.c_str()) < 0)
+                LOG(WARNING) << m_logtag << "ignore invalid x264 param " << kv;
+        }
+    }
+
+    const string profile = m_options.get("profile");
+    if (!profile.empty() && x264_param_apply_profile(&m_param, profile.c_str()) < 0) {
+        ERRORIT(DAV_ERROR_IMPL_DYNAMIC_INIT, m_logtag + "invalid x264 profile " + profile);
+        return DAV_ERROR_IMPL_DYNAMIC_INIT;
     }
-    recordUnusedOpts();
-    INFOIT(DAV_INFO_IMPL_INSTANCE_CREATE_DONE, m_logtag + " create VideoEncode done");
     return 0;
 }
 
-int FFmpegVideoEncode::
-setupScaleFilter(const DavImplTravel::TravelStatic & in, const DavImplTravel::TravelStatic & out) {
-    int ret = 0;
+int X264Encode::setupScaleFilter(const DavTravelStatic &in) {
     if (m_scaleFilter) {
         delete m_scaleFilter;
         m_scaleFilter = nullptr;
     }
-
-    if (in.m_codecpar) {
-        m_sfp.m_inFormat = (enum AVPixelFormat) in.m_codecpar->format;
-        m_sfp.m_inWidth = in.m_codecpar->width;
-        m_sfp.m_inHeight = in.m_codecpar->height;
-        m_sfp.m_inSar = in.m_codecpar->sample_aspect_ratio;
-    }
-    else {
-        m_sfp.m_inFormat = (enum AVPixelFormat) in.m_pixfmt;
-        m_sfp.m_inWidth = in.m_width;
-        m_sfp.m_inHeight = in.m_height;
-        m_sfp.m_inSar = in.m_sar;
-    }
-    // !! be note: use out timebase, incoming frame already converts its timestamp to encoder's timebase
-    m_sfp.m_inTimebase = out.m_timebase;
-    m_sfp.m_inFramerate = in.m_framerate;
-
-    // output and other settings
-    m_sfp.m_outWidth = out.m_codecpar->width;
-    m_sfp.m_outHeight = out.m_codecpar->height;
-    m_sfp.m_outTimebase = out.m_timebase;
-    m_sfp.m_outFramerate = out.m_framerate;
-    m_sfp.m_hwFramesCtx = out.m_hwFramesCtx;
-    m_sfp.m_bFpsScale = true;
+    m_sfp.m_inFormat = in.m_pixfmt;
+    m_sfp.m_inWidth = in.m_width;
+    m_sfp.m_inHeight = in.m_height;
+    m_sfp.m_inSar = in.m_sar.num == 0 ? AVRational{1, 1} : in.m_sar;
+    m_sfp.m_inTimebase = in.m_timebase;
+    m_sfp.m_inFramerate = m_framerate;
+    m_sfp.m_outWidth = m_outWidth;
+    m_sfp.m_outHeight = m_outHeight;
+    m_sfp.m_outTimebase = in.m_timebase;
+    m_sfp.m_outFramerate = m_framerate;
+    m_sfp.m_bFpsScale = false; /* x264 takes vfr input */
     m_sfp.m_logtag = appendLogTag(m_logtag, "-ScaleFilter");
 
     m_scaleFilter = new ScaleFilter();
     CHECK(m_scaleFilter != nullptr);
-    ret = m_scaleFilter->initScaleFilter(m_sfp);
+    int ret = m_scaleFilter->initScaleFilter(m_sfp);
     if (ret < 0) {
-        ERRORIT(ret, "encode's scale filter init failed");
+        ERRORIT(ret, m_logtag + "x264 encode's scale filter init failed");
         return ret;
     }
     return 0;
 }
 
-int FFmpegVideoEncode::onDynamicallyInitializeViaTravelStatic(DavProcCtx & ctx) {
-    int ret = 0;
-    if (m_encCtx)
-        onDestruct();
+int X264Encode::setupOutputCodecpar(AVCodecParameters *codecpar) {
+    codecpar->codec_type = AVMEDIA_TYPE_VIDEO;
+    codecpar->codec_id = AV_CODEC_ID_H264;
+    codecpar->width = m_outWidth;
+    codecpar->height = m_outHeight;
+    codecpar->format = AV_PIX_FMT_YUV420P;
+    if (m_csp == X264_CSP_I422) codecpar->format = AV_PIX_FMT_YUV422P;
+    if (m_csp == X264_CSP_I444) codecpar->format = AV_PIX_FMT_YUV444P;
+    codecpar->sample_aspect_ratio = m_outSar;
+    codecpar->bit_rate = (int64_t)m_param.rc.i_bitrate * 1000;
+    codecpar->video_delay = m_param.i_bframe ? 1 : 0;
 
-    CHECK(m_inputTravelStatic.size() == ctx.m_froms.size() && ctx.m_froms.size() == 1);
-    DavImplTravel::TravelStatic & in = m_inputTravelStatic.at(ctx.m_froms[0]);
-    if (!in.m_codecpar && (in.m_pixfmt == AV_PIX_FMT_NONE)) {
-        ERRORIT(DAV_ERROR_TRAVEL_STATIC_INVALID_CODECPAR,
-                m_logtag + "video encode cannot get valid codecpar or videopar");
-        return DAV_ERROR_TRAVEL_STATIC_INVALID_CODECPAR;
+    /* sps/pps as extradata, muxers (flv, mp4) need it before the first packet */
+    x264_nal_t *nals = nullptr;
+    int nalNum = 0;
+    int size = x264_encoder_headers(m_enc, &nals, &nalNum);
+    if (size <= 0) {
+        ERRORIT(DAV_ERROR_IMPL_DYNAMIC_INIT, m_logtag + "fail to get x264 headers");
+        return DAV_ERROR_IMPL_DYNAMIC_INIT;
+    }
+    int extraSize = 0;
+    for (int k = 0; k < nalNum; k++)
+        if (nals[k].i_type != NAL_SEI) extraSize += nals[k].i_payload;
+    codecpar->extradata = (uint8_t *)av_mallocz(extraSize + AV_INPUT_BUFFER_PADDING_SIZE);
+    CHECK(codecpar->extradata != nullptr);
+    codecpar->extradata_size = extraSize;
+    uint8_t *p = codecpar->extradata;
+    for (int k = 0; k < nalNum; k++) {
+        if (nals[k].i_type == NAL_SEI) continue;
+        memcpy(p, nals[k].p_payload, nals[k].i_payload);
+        p += nals[k].i_payload;
     }
+    return 0;
+}
 
-    /* this is crucial: if some fields no set via options (such as width, height, framerate, etc..),
-       use values from inTravelstatic */
-    in.mergeVideoTravelStaticToDict(m_options);
+int X264Encode::onDynamicallyInitializeViaTravelStatic(DavProcCtx &ctx) {
+    if (m_enc) onDestruct();
 
-    // 2. let's open the encoder
-    ret = dynamicallyInitialize(in);
-    if (ret < 0)
-        return ret;
+    CHECK(m_inputTravelStatic.size() == ctx.m_froms.size() && ctx.m_froms.size() == 1);
+    auto in = m_inputTravelStatic.at(ctx.m_froms[0]);
+    if (!in || in->m_pixfmt == AV_PIX_FMT_NONE) {
+        ERRORIT(DAV_ERROR_TRAVEL_STATIC_INVALID_VIDEOPAR,
+                m_logtag + "x264 encode requires raw video travel static");
+        return DAV_ERROR_TRAVEL_STATIC_INVALID_VIDEOPAR;
+    }
+    m_csp = pixfmtToX264Csp(in->m_pixfmt);
+    if (m_csp < 0) {
+        ERRORIT(DAV_ERROR_IMPL_DYNAMIC_INIT, m_logtag + "x264 encode doesn't support pixel format " +
+                string(av_get_pix_fmt_name(in->m_pixfmt)));
+        return DAV_ERROR_IMPL_DYNAMIC_INIT;
+    }
+    in->mergeVideoDavTravelStaticToDict(m_options);
+    int ret = m_options.getVideoSize(m_outWidth, m_outHeight);
+    if (ret < 0) {
+        ERRORIT(DAV_ERROR_IMPL_DYNAMIC_INIT, m_logtag + "Cannot get encoder output WxH");
+        return DAV_ERROR_IMPL_DYNAMIC_INIT;
+    }
+    /* keep display aspect ratio, same policy as ffmpeg video encode */
+    const AVRational inSar = in->m_sar.num == 0 ? AVRational{1, 1} : in->m_sar;
+    m_outSar = av_mul_q(AVRational{m_outHeight * in->m_width, m_outWidth * in->m_height}, inSar);
+    AVRational fps = {0, 1};
+    m_options.getAVRational("framerate", fps);
+    m_framerate = fps.num != 0 ? fps : (in->m_framerate.num != 0 ? in->m_framerate : AVRational{25, 1});
+
+    /* frames keep their incoming timebase */
+    const AVRational timebase = in->m_timebase;
+    ret = setupParams(*in, timebase);
+    if (ret < 0) return ret;
+    m_enc = x264_encoder_open(&m_param);
+    if (!m_enc) {
+        ERRORIT(DAV_ERROR_IMPL_DYNAMIC_INIT, m_logtag + "x264 encoder open fail");
+        return DAV_ERROR_IMPL_DYNAMIC_INIT;
+    }
+    /* x264 may adjust params (threads, etc.) */
+    x264_encoder_parameters(m_enc, &m_param);
 
-    // 3. ok then, set output infos
     m_timestampMgr.clear();
     m_outputTravelStatic.clear();
+    shared_ptr<AVCodecParameters> codecpar(avcodec_parameters_alloc(),
+                                           [](AVCodecParameters *p) { avcodec_parameters_free(&p); });
+    ret = setupOutputCodecpar(codecpar.get());
+    if (ret < 0) return ret;
+    auto out = make_shared<DavTravelStatic>();
+    out->setupVideoStatic(codecpar.get(), timebase, m_framerate, nullptr);
+    m_timestampMgr.insert(std::make_pair(ctx.m_froms[0], DavImplTimestamp(in->m_timebase, timebase)));
+    m_outputTravelStatic.emplace(std::make_pair(IMPL_SINGLE_OUTPUT_STREAM_INDEX, out));
 
-    // TODO: hwFramesctx
-    DavImplTravel::TravelStatic out;
-    out.setupVideoStatic(m_encCtx, m_encCtx->time_base, m_encCtx->framerate, nullptr);
-    m_timestampMgr.insert(std::make_pair(ctx.m_froms[0], DavImplTimestamp(in.m_timebase, out.m_timebase)));
-    m_outputTravelStatic.insert(std::make_pair(IMPL_SINGLE_OUTPUT_STREAM_INDEX, out));
-
-    // 4. set scaleFilter (do this setup after encoder open)
-    if (in.m_width != out.m_width || in.m_height != out.m_height) {
-        ret = setupScaleFilter(in, out);
-        if (ret < 0)
-            return ret;
-    } else {
-        LOG(INFO) << m_logtag << "no scale filter needed";
+    if (in->m_width != m_outWidth || in->m_height != m_outHeight) {
+        ret = setupScaleFilter(*in);
+        if (ret < 0) return ret;
     }
 
     m_bDynamicallyInitialized = true;
-    LOG(INFO) << m_logtag << "dynamically create VideoEncode done.\nin static: " << in << ", \nout: " << out;
+    LOG(INFO) << m_logtag << "dynamically create X264Encode done. threads " << m_param.i_threads
+              << (m_param.b_sliced_threads ? " (sliced)" : "") << ", intra refresh "
+              << m_param.b_intra_refresh << ", bframes " << m_param.i_bframe << "\nin static: " << *in
+              << ", \nout: " << *out;
     return 0;
 }
 
 ////////////////////////////////////
 //  [event process]
 /* it is caller's responsibility to avoid racing between event process and data process */
-//int FFmpegVideoEncode::keyFrameRequest(const DavEvent & event) {
-//    m_bForcedKeyFrame = true;
-//    return 0;
-//}
+int X264Encode::keyFrameRequest(const DavDynaEventVideoKeyFrameRequest &event) {
+    m_bForcedKeyFrame = true;
+    m_bForceIdr = m_bForceIdr || event.m_bForceIdr;
+    m_keyFrameRequests++;
+    return 0;
+}
+
+/* from a fast joining demux reading our output */
+int X264Encode::processKeyFrameRequest(const DavEventKeyFrameRequest &event) {
+    LOG(INFO) << m_logtag << "key frame requested by a joining input";
+    m_bForcedKeyFrame = true;
+    m_bForceIdr = m_bForceIdr || event.m_bForceIdr;
+    m_keyFrameRequests++;
+    return 0;
+}
 
 ////////////////////////////////////
 //  [construct - destruct - process]
+int X264Encode::onConstruct() {
+    LOG(INFO) << m_logtag << "will open after receive first frame, initial opts: "
+              << m_options.dump();
+    m_outputMediaMap.insert(
+        std::make_pair(IMPL_SINGLE_OUTPUT_STREAM_INDEX, AVMEDIA_TYPE_VIDEO));
+    std::function<int(const DavDynaEventVideoKeyFrameRequest &)> f =
+        [this](const DavDynaEventVideoKeyFrameRequest &e) { return keyFrameRequest(e); };
+    m_implEvent.registerEvent(f);
+    std::function<int(const DavEventKeyFrameRequest &)> j =
+        [this](const DavEventKeyFrameRequest &e) { return processKeyFrameRequest(e); };
+    m_implEvent.registerEvent(j);
+    return 0;
+}
 
-int FFmpegVideoEncode::onConstruct() {
-    LOG(INFO) << m_logtag << "will open after receive first frame, initial opts: " << m_options.dump() ;
-    m_outputMediaMap.insert(std::make_pair(IMPL_SINGLE_OUTPUT_STREAM_INDEX, AVMEDIA_TYPE_VIDEO));
-    /* register events */
-    //int registerEvent(const type_index typeIndex, function<int (const DavEvent &)> & f) {
-    // store a call to a member function
-    // std::function<void(const Foo&, int)> f_add_display = &Foo::print_add;
-    //type_index iFrameRequest = type_index(typeid(DavEventVideoIFrameRequest));
-    //LOG(INFO) << typeid(DavEventVideoIFrameRequest).name() << " & " << typeid(AVCodecContext).name();
-    //m_implEvent.registerEvent(iFrameRequest, );
+int X264Encode::onDestruct() {
+    if (m_enc) {
+        x264_encoder_close(m_enc);
+        m_enc = nullptr;
+    }
+    if (m_scaleFilter) {
+        m_scaleFilter->close();
+        delete m_scaleFilter;
+        m_scaleFilter = nullptr;
+    }
+    DavThreadBudget::getOnlyInstance().release(this);
+    LOG(INFO) << m_logtag << "X264 Encode Destruct";
     return 0;
 }
 
-int FFmpegVideoEncode::onDestruct() {
-    if (m_encCtx)
-        avcodec_free_context(&m_encCtx);
-    ERRORIT(0, m_logtag + "FFmpeg VideoEncode Destruct");
+int X264Encode::outputNals(DavProcCtx &ctx, x264_nal_t *nals, int nalNum,
+                           const x264_picture_t &picOut) {
+    int size = 0;
+    for (int k = 0; k < nalNum; k++) size += nals[k].i_payload;
+    if (size <= 0) return 0;
+
+    auto outBuf = make_shared<DavProcBuf>();
+    outBuf->m_travelStatic = m_outputTravelStatic.at(IMPL_SINGLE_OUTPUT_STREAM_INDEX);
+    AVPacket *pkt = outBuf->mkAVPacket();
+    CHECK(pkt != nullptr);
+    int ret = av_new_packet(pkt, size);
+    if (ret < 0) {
+        ERRORIT(ret, m_logtag + "alloc x264 output packet fail");
+        return ret;
+    }
+    /* nal payloads of one encode call are contiguous in x264's buffer */
+    memcpy(pkt->data, nals[0].p_payload, size);
+    pkt->pts = picOut.i_pts;
+    pkt->dts = picOut.i_dts;
+    if (picOut.b_keyframe) pkt->flags |= AV_PKT_FLAG_KEY;
+    ctx.m_outBufs.push_back(outBuf);
+    m_encodeFrames++;
     return 0;
 }
 
-int FFmpegVideoEncode::receiveEncodeFrames(DavProcCtx & ctx) {
-    int ret = 0;
-    do {
-        auto outBuf = make_shared<DavProcBuf>();
-        outBuf->m_travel.m_static = m_outputTravelStatic.at(IMPL_SINGLE_OUTPUT_STREAM_INDEX);
-        AVPacket *pkt = outBuf->mkAVPacket();
-        CHECK(pkt != nullptr);
-        av_init_packet(pkt);
-        ret = avcodec_receive_packet(m_encCtx, pkt);
-        if (ret >= 0) {
-            ctx.m_outBufs.push_back(outBuf);
-            // TODO: if there is dynamic travel info, should only set to one outBuf
-            continue;
-        }
-        else if (ret == AVERROR_EOF) {
-            INFOIT(ret, m_logtag + "video encode fully flushed");
-        }
-        else if (ret < 0 && ret != AVERROR(EAGAIN)) {
-            ERRORIT(ret, "video decode failed when receive frame");
-            m_discardFrames++;
+int X264Encode::encodeOneFrame(DavProcCtx &ctx, const AVFrame *frame) {
+    x264_picture_t picIn;
+    x264_picture_t picOut;
+    x264_picture_init(&picIn);
+    x264_picture_init(&picOut);
+    x264_nal_t *nals = nullptr;
+    int nalNum = 0;
+
+    if (!frame) { /* flush delayed frames */
+        while (x264_encoder_delayed_frames(m_enc) > 0) {
+            int ret = x264_encoder_encode(m_enc, &nals, &nalNum, nullptr, &picOut);
+            if (ret < 0) break;
+            outputNals(ctx, nals, nalNum, picOut);
         }
-        break;
-    } while (true);
+        return AVERROR_EOF;
+    }
 
-    return ret;
+    /* zero copy: x264 reads the decoded planes in place */
+    picIn.img.i_csp = m_csp;
+    picIn.img.i_plane = x264CspPlanes(m_csp);
+    for (int k = 0; k < picIn.img.i_plane; k++) {
+        picIn.img.plane[k] = frame->data[k];
+        picIn.img.i_stride[k] = frame->linesize[k];
+    }
+    picIn.i_pts = frame->pts;
+    picIn.i_type = X264_TYPE_AUTO;
+    if (m_bForcedKeyFrame) {
+        /* with intra refresh, a refresh wave instead of a big idr */
+        if (m_bIntraRefresh && !m_bForceIdr)
+            x264_encoder_intra_refresh(m_enc);
+        else
+            picIn.i_type = m_bForceIdr ? X264_TYPE_IDR : X264_TYPE_KEYFRAME;
+        m_bForcedKeyFrame = false;
+        m_bForceIdr = false;
+    }
+
+    int ret = x264_encoder_encode(m_enc, &nals, &nalNum, &picIn, &picOut);
+    if (ret < 0) {
+        m_discardFrames++;
+        ERRORIT(DAV_ERROR_IMPL_PROCESS, m_logtag + "x264 encode frame fail");
+        return 0;
+    }
+    return outputNals(ctx, nals, nalNum, picOut);
 }
 
-int FFmpegVideoEncode::onProcess(DavProcCtx & ctx) {
+int X264Encode::onProcess(DavProcCtx &ctx) {
     ctx.m_expect.m_expectOrder = {EDavExpect::eDavExpectAnyOne};
-    if (!m_encCtx)
-        return 0;
+    if (!m_enc) return 0;
     if (!ctx.m_inBuf) {
-        ERRORIT(DAV_ERROR_IMPL_UNEXPECT_EMPTY_INBUF,  "video encode should always has input");
+        ERRORIT(DAV_ERROR_IMPL_UNEXPECT_EMPTY_INBUF, "video encode should always has input");
         return DAV_ERROR_IMPL_UNEXPECT_EMPTY_INBUF;
     }
 
-    int ret = 0;
-    // when upper do flush will output an empty frame
     auto inFrame = ctx.m_inRefFrame;
     if (!inFrame) {
-        LOG(INFO) << m_logtag << "video encode reciving flush frame";
+        LOG(INFO) << m_logtag << "x264 encode reciving flush frame";
         ctx.m_bInputFlush = true;
     }
 
-    vector<shared_ptr<AVFrame>> encodeFrames;
-    if (m_scaleFilter) {
-        ret = m_scaleFilter->sendFrame(inFrame);
-        if (ret < 0 && ret != AVERROR_EOF) {
-            ERRORIT(ret, "encode's scale filter send frame failed");
-            m_discardFrames++;
-        }
-        // receive scaled frames
-        ret = m_scaleFilter->receiveFrames(encodeFrames);
-        if (ret == AVERROR_EOF)
-            encodeFrames.push_back(shared_ptr<AVFrame>()); /* frame flush to encoder */
-    } else {
-        shared_ptr<AVFrame> inSharedFrame(inFrame, [](AVFrame *p) {return;});
-        encodeFrames.push_back(inSharedFrame);
+    if (!m_scaleFilter) {
+        int ret = encodeOneFrame(ctx, inFrame);
+        if (ret == AVERROR_EOF) INFOIT(ret, m_logtag + "x264 encode fully flushed");
+        return ret;
     }
 
-    for (size_t k = 0; k < encodeFrames.size(); k++) {
-        if (m_bForcedKeyFrame) /* key frame set */
-            encodeFrames[k]->pict_type = AV_PICTURE_TYPE_I;
-        ret = avcodec_send_frame(m_encCtx, encodeFrames[k].get());
-        if (ret == AVERROR_EOF) {
-            ERRORIT(ret, "video encode failed, send frames after flush frame. Try receive packet anyway");
-            m_bForcedKeyFrame = false;
-            break;
-        }
-        else if (ret == AVERROR(EAGAIN)) {
-            // in this case, should receive and then send again
-            ret = receiveEncodeFrames(ctx);
-            if (ret != AVERROR_EOF)
-                k--;
-        }
-        else if (ret < 0) {
-            ERRORIT(ret, "video encode failed when send frame");
-            m_discardFrames++;
-            continue;
-        }
-        if (m_bForcedKeyFrame) /* only ok after send_frame ok*/
-            m_bForcedKeyFrame = false;
+    int ret = m_scaleFilter->sendFrame(inFrame);
+    if (ret < 0 && ret != AVERROR_EOF) {
+        ERRORIT(ret, m_logtag + "x264 encode's scale filter send frame failed");
+        m_discardFrames++;
+    }
+    vector<shared_ptr<AVFrame>> scaledFrames;
+    ret = m_scaleFilter->receiveFrames(scaledFrames);
+    for (auto &f : scaledFrames)
+        if (f) encodeOneFrame(ctx, f.get());
+    if (ret == AVERROR_EOF) {
+        ret = encodeOneFrame(ctx, nullptr);
+        INFOIT(ret, m_logtag + "x264 encode fully flushed");
+        return ret;
     }
+    return 0;
+}
 
-    /* receive it */
-    return receiveEncodeFrames(ctx);
+int X264Encode::statistics(AVDictionary **stat) {
+    av_dict_set_int(stat, "encode_frames", (int64_t)m_encodeFrames, 0);
+    av_dict_set_int(stat, "discard_frames", (int64_t)m_discardFrames, 0);
+    av_dict_set_int(stat, "key_frame_requests", (int64_t)m_keyFrameRequests, 0);
+    if (m_enc) {
+        av_dict_set_int(stat, "threads", m_param.i_threads, 0);
+        av_dict_set_int(stat, "sliced_threads", m_param.b_sliced_threads, 0);
+        av_dict_set_int(stat, "intra_refresh", m_param.b_intra_refresh, 0);
+        av_dict_set_int(stat, "delayed_frames", x264_encoder_delayed_frames(m_enc), 0);
+    }
+    return 0;
 }
 
-///////////////////////////////////////
-// [Register - auto, ffmpegVideoEncode]
-DavImplRegister g_videoEncodeReg(DavWaveClassVideoEncode(),vector<string>({"auto", "ffmpeg"}),
-                                 [](const DavWaveOption & options) -> unique_ptr<DavImpl> {
-                                     unique_ptr<FFmpegVideoEncode> p(new FFmpegVideoEncode(options));
-                                     return p;
-                                 });
-} // namespace
+}  // namespace ff_dynamic
@@ -1,38 +1,67 @@
- #pragma once
+#pragma once
 
-#include "ffmpegHeaders.h"
+#include <cstdint>
 #include "davImpl.h"
+#include "davDynamicEvent.h"
+#include "ffmpegHeaders.h"
+#include "scaleFilter.h"
+extern "C" {
 #include "x264.h"
+}
 
 namespace ff_dynamic {
 
+/* Native libx264 encoder (impl type 'x264' of video encode category).
+   Decoded planes are handed to x264_picture_t directly (no intermediate AVFrame copy or
+   option-string round trip). Options (AVDictionary keys):
+     preset/tune/profile, b (bps), crf, g, bf, threads,
+     zerolatency (bool), intra_refresh (bool), sliced_threads (bool),
+     x264-params (key=value:key=value, applied last) */
 class X264Encode : public DavImpl {
-public:
-    X264Encode(const DavWaveOption & options) : DavImpl(options) {
+   public:
+    X264Encode(const DavWaveOption &options) : DavImpl(options) {
         implDefaultInstantiate();
     }
-    virtual ~X264Encode() {onDestruct();}
+    virtual ~X264Encode() { onDestruct(); }
 
-private: /* data process */
+   private: /* data process */
     X264Encode(const X264Encode &) = delete;
-    X264Encode & operator= (const X264Encode &) = delete;
+    X264Encode &operator=(const X264Encode &) = delete;
     virtual int onConstruct();
     virtual int onDestruct();
-    virtual int onProcess(DavProcCtx & ctx);
-    virtual int onDynamicallyInitializeViaTravelStatic(DavProcCtx & ctx);
-    virtual int onProcessTravelDynamic(DavProcCtx & ctx) {return 0;}
-    int dynamicallyInitialize(const DavImplTravel::TravelStatic & in);
-    int setupScaleFilter(const DavImplTravel::TravelStatic & in, const DavImplTravel::TravelStatic & out);
-    int receiveEncodeFrames(DavProcCtx & ctx);
+    virtual int onProcess(DavProcCtx &ctx);
+    virtual int onDynamicallyInitializeViaTravelStatic(DavProcCtx &ctx);
+    virtual int onProcessTravelDynamic(DavProcCtx &ctx) { return 0; }
+    virtual const DavRegisterProperties &getRegisterProperties() const noexcept;
+    virtual int statistics(AVDictionary **stat);
+
+    int setupParams(const DavTravelStatic &in, const AVRational &timebase);
+    int setupScaleFilter(const DavTravelStatic &in);
+    int setupOutputCodecpar(AVCodecParameters *codecpar);
+    int encodeOneFrame(DavProcCtx &ctx, const AVFrame *frame);
+    int outputNals(DavProcCtx &ctx, x264_nal_t *nals, int nalNum, const x264_picture_t &picOut);
 
-private: /* event process */
+   private: /* event process */
+    int keyFrameRequest(const DavDynaEventVideoKeyFrameRequest &event);
+    int processKeyFrameRequest(const DavEventKeyFrameRequest &event);
 
-private:
-    AVCodecContext *m_encCtx = nullptr;
+   private:
+    x264_t *m_enc = nullptr;
+    x264_param_t m_param;
+    int m_csp = X264_CSP_I420;
+    int m_outWidth = 0;
+    int m_outHeight = 0;
+    AVRational m_outSar = {1, 1};
+    AVRational m_framerate = {25, 1};
+    bool m_bIntraRefresh = false;
     ScaleFilter *m_scaleFilter = nullptr;
     ScaleFilterParams m_sfp;
+    uint64_t m_encodeFrames = 0;
     uint64_t m_discardFrames = 0;
+    uint64_t m_keyFrameRequests = 0;
+    /* set from event process, consumed by data process */
     bool m_bForcedKeyFrame = false;
+    bool m_bForceIdr = false;
 };
 
-} //namespace ff_dynamic
+}  // namespace ff_dynamic
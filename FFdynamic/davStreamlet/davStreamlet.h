@@ -19,12 +19,18 @@ using ::std::shared_ptr;
 using ::std::unique_ptr;
 
 //////////////////////////////////////////////////////////////////////////////////////////
-/* options that used to create a streamlet; Right now, only this one */
+/* options that used to create a streamlet */
 struct DavOptionBufLimitNum : public DavOption {
     DavOptionBufLimitNum() :
         DavOption(type_index(typeid(*this)), type_index(typeid(int)), "StreamletBufLimitNum") {}
 };
 
+/* bytes (in KB) of the latest gop each bitstream output keeps for late joining muxers; shared encode only */
+struct DavOptionGopCacheKB : public DavOption {
+    DavOptionGopCacheKB() :
+        DavOption(type_index(typeid(*this)), type_index(typeid(int)), "StreamletGopCacheKB") {}
+};
+
 using DavStreamletOption = DavDict;
 
 //////////////////////////////////////////////////////////////////////////////////////////
@@ -64,6 +70,27 @@ struct DavDefaultOutputStreamletTag : public DavStreamletTag {
     explicit DavDefaultOutputStreamletTag(const string & streamletName)
         : DavStreamletTag(streamletName, type_index(typeid(DavDefaultOutputStreamletTag))) {}
 };
+/* encoders shared by output streamlets which have identical encode settings */
+struct DavSharedEncodeStreamletTag : public DavStreamletTag {
+    DavSharedEncodeStreamletTag()
+        : DavStreamletTag("SharedEncodeStreamlet", type_index(typeid(DavSharedEncodeStreamletTag))) {}
+    explicit DavSharedEncodeStreamletTag(const string & streamletName)
+        : DavStreamletTag(streamletName, type_index(typeid(DavSharedEncodeStreamletTag))) {}
+};
+/* one decode feeding several scaled encodes (adaptive bitrate renditions) */
+struct DavAbrLadderStreamletTag : public DavStreamletTag {
+    DavAbrLadderStreamletTag()
+        : DavStreamletTag("AbrLadderStreamlet", type_index(typeid(DavAbrLadderStreamletTag))) {}
+    explicit DavAbrLadderStreamletTag(const string & streamletName)
+        : DavStreamletTag(streamletName, type_index(typeid(DavAbrLadderStreamletTag))) {}
+};
+/* demuxed packets to muxers without transcoding */
+struct DavPassthroughStreamletTag : public DavStreamletTag {
+    DavPassthroughStreamletTag()
+        : DavStreamletTag("PassthroughStreamlet", type_index(typeid(DavPassthroughStreamletTag))) {}
+    explicit DavPassthroughStreamletTag(const string & streamletName)
+        : DavStreamletTag(streamletName, type_index(typeid(DavPassthroughStreamletTag))) {}
+};
 struct DavMixStreamletTag : public DavStreamletTag {
     DavMixStreamletTag(): DavStreamletTag("MixStreamlet", type_index(typeid(DavMixStreamletTag))) {}
     explicit DavMixStreamletTag(const string & streamletName)
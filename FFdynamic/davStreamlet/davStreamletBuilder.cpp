@@ -1,5 +1,6 @@
 #include <algorithm>
 #include <limits>
+#include <map>
 #include "davStreamletBuilder.h"
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -192,14 +193,452 @@ DavDefaultOutputStreamletBuilder::build(const vector<DavWaveOption> & waveOption
     } else if (audioEncodes.size() > 0) {
         streamlet->addOneInAudioRawEntry(audioEncodes[0]);
     }
+    const bool bBitrateAdapt = isBitrateAdaptEnabled(waveOptions);
     for (auto & m : muxers) {
         DavWave::connect(videoEncode.get(), m.get());
         if (audioEncodes.size() > 0)
             DavWave::connect(audioEncodes[0].get(), m.get());
+        if (bBitrateAdapt) /* muxer's throughput report drives encoder's bitrate */
+            DavWave::subscribe(m.get(), videoEncode.get());
     }
     return streamlet;
 }
 
+////////////////////////////////////////////////////////////////////////////////
+shared_ptr<DavStreamlet>
+DavSharedEncodeStreamletBuilder::build(const vector<DavWaveOption> & waveOptions,
+                                       const DavStreamletTag & streamletTag,
+                                       const DavStreamletOption & streamletOptions) {
+    auto streamlet = createStreamlet(waveOptions, streamletTag, streamletOptions);
+    if (!streamlet)
+        return streamlet;
+
+    auto preVideoFilters = streamlet->getWavesByCategory(DavWaveClassVideoFilter());
+    auto preAudioFilters = streamlet->getWavesByCategory(DavWaveClassAudioFilter());
+    auto videoEncodes = streamlet->getWavesByCategory(DavWaveClassVideoEncode());
+    auto audioEncodes = streamlet->getWavesByCategory(DavWaveClassAudioEncode());
+    CHECK(preVideoFilters.size() <= 1 && preAudioFilters.size() <= 1)
+        << m_logtag << "shared encode streamlet cannot have audio/video filters more than 1";
+    CHECK(videoEncodes.size() <= 1 && audioEncodes.size() <= 1 && videoEncodes.size() + audioEncodes.size() > 0)
+        << m_logtag << "shared encode streamlet must have (0 or 1 video) and (0 or 1 audio) encoder"
+        << audioEncodes.size() << " | " << videoEncodes.size();
+
+    if (videoEncodes.size() > 0) {
+        if (preVideoFilters.size()) {
+            streamlet->addOneInVideoRawEntry(preVideoFilters[0]);
+            DavWave::connect(preVideoFilters[0].get(), videoEncodes[0].get());
+        } else {
+            streamlet->addOneInVideoRawEntry(videoEncodes[0]);
+        }
+        streamlet->addOneOutVideoBitstreamEntry(videoEncodes[0]);
+    }
+    if (audioEncodes.size() > 0) {
+        if (preAudioFilters.size()) {
+            streamlet->addOneInAudioRawEntry(preAudioFilters[0]);
+            DavWave::connect(preAudioFilters[0].get(), audioEncodes[0].get());
+        } else {
+            streamlet->addOneInAudioRawEntry(audioEncodes[0]);
+        }
+        streamlet->addOneOutAudioBitstreamEntry(audioEncodes[0]);
+    }
+    /* muxers join and leave a shared encode, a new one starts from the cached gop */
+    int gopCacheKB = 0;
+    streamletOptions.getInt(DavOptionGopCacheKB(), gopCacheKB);
+    if (gopCacheKB > 0) {
+        for (auto & e : videoEncodes)
+            e->setGopCache((size_t)gopCacheKB * 1024);
+        for (auto & e : audioEncodes)
+            e->setGopCache((size_t)gopCacheKB * 1024);
+    }
+    return streamlet;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+shared_ptr<DavStreamlet>
+DavMuxOutputStreamletBuilder::build(const vector<DavWaveOption> & waveOptions,
+                                    const DavStreamletTag & streamletTag,
+                                    const DavStreamletOption & streamletOptions) {
+    auto streamlet = createStreamlet(waveOptions, streamletTag, streamletOptions);
+    if (!streamlet)
+        return streamlet;
+
+    auto muxers = streamlet->getWavesByCategory(DavWaveClassMux());
+    CHECK(muxers.size() > 0 && muxers.size() == streamlet->getWaves().size())
+        << m_logtag << "mux output streamlet should only have muxers (at least one)";
+    for (auto & m : muxers) {
+        streamlet->addOneInVideoBitstreamEntry(m);
+        streamlet->addOneInAudioBitstreamEntry(m);
+    }
+    return streamlet;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+static bool isEncodePartOption(const DavWaveOption & o) {
+    DavWaveClassCategory category((DavWaveClassNotACategory()));
+    o.getCategory(DavOptionClassCategory(), category);
+    return (category == DavWaveClassVideoEncode() || category == DavWaveClassAudioEncode() ||
+            category == DavWaveClassVideoFilter() || category == DavWaveClassAudioFilter());
+}
+
+string encodeSettingKey(const vector<DavWaveOption> & waveOptions) {
+    string key;
+    for (auto & o : waveOptions) {
+        if (!isEncodePartOption(o))
+            continue;
+        /* maps are ordered; AVDictionary is not, sort it. logtag differs per wave, skip it */
+        for (auto & c : o.getCategoryOptions())
+            key += c.first.name() + "=" + c.second.name() + ";";
+        for (auto & d : o.getDavOptions())
+            if (!(d.first == DavOptionLogtag()))
+                key += d.first.name() + "=" + d.second + ";";
+        std::map<string, string> avdict;
+        AVDictionaryEntry *t = nullptr;
+        while ((t = av_dict_get(o.get(), "", t, AV_DICT_IGNORE_SUFFIX)))
+            avdict.emplace(t->key, t->value);
+        for (auto & a : avdict)
+            key += a.first + "=" + a.second + ";";
+        key += "|";
+    }
+    return key;
+}
+
+int splitEncodeMuxOptions(const vector<DavWaveOption> & waveOptions,
+                          vector<DavWaveOption> & encodeOptions, vector<DavWaveOption> & muxOptions) {
+    encodeOptions.clear();
+    muxOptions.clear();
+    for (auto & o : waveOptions) {
+        if (isEncodePartOption(o))
+            encodeOptions.emplace_back(o);
+        else
+            muxOptions.emplace_back(o);
+    }
+    return 0;
+}
+
+bool isBitrateAdaptEnabled(const vector<DavWaveOption> & waveOptions) {
+    for (auto & o : waveOptions) {
+        DavWaveClassCategory category((DavWaveClassNotACategory()));
+        o.getCategory(DavOptionClassCategory(), category);
+        if (category == DavWaveClassVideoEncode() && !o.get(DavOptionBitrateAdaptMin()).empty())
+            return true;
+    }
+    return false;
+}
+
+int connectEncodeToMuxers(DavStreamlet & encodeStreamlet, DavStreamlet & muxStreamlet,
+                          const bool bBitrateAdapt) {
+    auto muxers = muxStreamlet.getWavesByCategory(DavWaveClassMux());
+    for (auto & m : muxers) {
+        for (auto & v : encodeStreamlet.getOutVideoBitstreamEntries()) {
+            DavWave::connect(v.get(), m.get());
+            if (bBitrateAdapt)
+                DavWave::subscribe(m.get(), v.get());
+        }
+        for (auto & a : encodeStreamlet.getOutAudioBitstreamEntries())
+            DavWave::connect(a.get(), m.get());
+    }
+    return 0;
+}
+
+int disconnectEncodeFromMuxers(DavStreamlet & encodeStreamlet, DavStreamlet & muxStreamlet,
+                               const bool bBitrateAdapt) {
+    auto muxers = muxStreamlet.getWavesByCategory(DavWaveClassMux());
+    for (auto & m : muxers) {
+        for (auto & v : encodeStreamlet.getOutVideoBitstreamEntries()) {
+            DavWave::disconnect(v.get(), m.get());
+            if (bBitrateAdapt)
+                DavWave::unSubscribe(m.get(), v.get());
+        }
+        for (auto & a : encodeStreamlet.getOutAudioBitstreamEntries())
+            DavWave::disconnect(a.get(), m.get());
+    }
+    return 0;
+}
+
+int subscribeKeyFrameRequests(DavStreamlet & inputStreamlet, DavStreamlet & encodeStreamlet) {
+    auto demuxers = inputStreamlet.getWavesByCategory(DavWaveClassDemux());
+    auto videoEncodes = encodeStreamlet.getWavesByCategory(DavWaveClassVideoEncode());
+    for (auto & d : demuxers)
+        for (auto & v : videoEncodes)
+            DavWave::subscribe(d.get(), v.get());
+    return (int)(demuxers.size() * videoEncodes.size());
+}
+
+int unsubscribeKeyFrameRequests(DavStreamlet & inputStreamlet, DavStreamlet & encodeStreamlet) {
+    auto demuxers = inputStreamlet.getWavesByCategory(DavWaveClassDemux());
+    auto videoEncodes = encodeStreamlet.getWavesByCategory(DavWaveClassVideoEncode());
+    for (auto & d : demuxers)
+        for (auto & v : videoEncodes)
+            DavWave::unSubscribe(d.get(), v.get());
+    return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+static const int kDefaultAbrGopSize = 60;
+
+/* rungs of one category (scalers or video encodes) in wave options order must be strictly descending
+   in size: the cascade scales each rung from the previous one, and two same sized rungs are duplicates */
+static int checkAbrRungOrder(const vector<DavWaveOption> & waveOptions, const DavWaveClassCategory & rungCategory,
+                             string & detail) {
+    int64_t prevArea = std::numeric_limits<int64_t>::max();
+    int k = 0;
+    for (auto & o : waveOptions) {
+        DavWaveClassCategory category((DavWaveClassNotACategory()));
+        o.getCategory(DavOptionClassCategory(), category);
+        if (!(category == rungCategory))
+            continue;
+        int width = 0;
+        int height = 0;
+        if (o.getVideoSize(width, height) < 0 || width <= 0 || height <= 0) {
+            detail = "abr ladder " + rungCategory.name() + " rung " + std::to_string(k) + " has no video size";
+            return AVERROR(EINVAL);
+        }
+        const int64_t area = (int64_t)width * height;
+        if (area >= prevArea) {
+            detail = "abr ladder " + rungCategory.name() + " rung " + std::to_string(k) + " (" +
+                std::to_string(width) + "x" + std::to_string(height) + ") " +
+                (area == prevArea ? "duplicates the previous rung" : "is larger than the previous rung");
+            return AVERROR(EINVAL);
+        }
+        prevArea = area;
+        k++;
+    }
+    return 0;
+}
+
+shared_ptr<DavStreamlet>
+DavAbrLadderStreamletBuilder::build(const vector<DavWaveOption> & waveOptions,
+                                    const DavStreamletTag & streamletTag,
+                                    const DavStreamletOption & streamletOptions) {
+    string detail;
+    if (checkAbrRungOrder(waveOptions, DavWaveClassVideoFilter(), detail) < 0 ||
+        checkAbrRungOrder(waveOptions, DavWaveClassVideoEncode(), detail) < 0) {
+        m_buildInfo.setInfo(AVERROR(EINVAL), detail);
+        LOG(ERROR) << m_logtag << m_buildInfo;
+        return nullptr;
+    }
+
+    /* gop alignment: every rung uses the first video encode's gop and framerate */
+    vector<DavWaveOption> alignedOptions(waveOptions);
+    int gopSize = 0;
+    string framerate;
+    for (auto & o : alignedOptions) {
+        DavWaveClassCategory category((DavWaveClassNotACategory()));
+        o.getCategory(DavOptionClassCategory(), category);
+        if (!(category == DavWaveClassVideoEncode()))
+            continue;
+        if (gopSize == 0) {
+            if (o.getInt("g", gopSize) < 0 || gopSize <= 0)
+                gopSize = kDefaultAbrGopSize;
+            framerate = o.get("framerate");
+        }
+        o.setInt("g", gopSize, 0);
+        o.setInt("keyint_min", gopSize, 0);
+        o.setInt("sc_threshold", 0, 0);
+        if (!framerate.empty())
+            o.set("framerate", framerate, 0);
+    }
+
+    auto streamlet = createStreamlet(alignedOptions, streamletTag, streamletOptions);
+    if (!streamlet)
+        return streamlet;
+
+    auto demuxers = streamlet->getWavesByCategory(DavWaveClassDemux());
+    auto videoDecoders = streamlet->getWavesByCategory(DavWaveClassVideoDecode());
+    auto audioDecoders = streamlet->getWavesByCategory(DavWaveClassAudioDecode());
+    auto scalers = streamlet->getWavesByCategory(DavWaveClassVideoFilter());
+    auto videoEncodes = streamlet->getWavesByCategory(DavWaveClassVideoEncode());
+    auto audioEncodes = streamlet->getWavesByCategory(DavWaveClassAudioEncode());
+    auto muxers = streamlet->getWavesByCategory(DavWaveClassMux());
+    CHECK(demuxers.size() == 1 && videoDecoders.size() == 1 && audioDecoders.size() <= 1)
+        << m_logtag << "abr ladder must have 1 demuxer, 1 video decoder and (0 or 1) audio decoder";
+    CHECK(videoEncodes.size() > 0 && scalers.size() == videoEncodes.size() &&
+          muxers.size() == videoEncodes.size())
+        << m_logtag << "abr ladder needs one scaler, one video encode and one muxer per rung: "
+        << scalers.size() << " | " << videoEncodes.size() << " | " << muxers.size();
+    CHECK(audioEncodes.size() <= 1 && audioEncodes.size() == audioDecoders.size())
+        << m_logtag << "abr ladder audio decode/encode should be both 0 or both 1";
+
+    /* decode the first video / audio streams only once */
+    auto & demux = demuxers[0];
+    bool bVideoConnected = false;
+    bool bAudioConnected = false;
+    for (auto & outMedia : demux->getOutputMediaMap()) {
+        if (outMedia.second == AVMEDIA_TYPE_VIDEO && !bVideoConnected) {
+            DavWave::connect(demux.get(), videoDecoders[0].get(), outMedia.first);
+            bVideoConnected = true;
+        } else if (outMedia.second == AVMEDIA_TYPE_AUDIO && !bAudioConnected && audioDecoders.size()) {
+            DavWave::connect(demux.get(), audioDecoders[0].get(), outMedia.first);
+            bAudioConnected = true;
+        }
+    }
+    CHECK(bVideoConnected) << m_logtag << "abr ladder input has no video stream";
+
+    /* cascade: decode -> rung 0 scale -> rung 1 scale -> ... */
+    for (size_t k = 0; k < scalers.size(); k++) {
+        DavWave::connect((k == 0 ? videoDecoders[0] : scalers[k-1]).get(), scalers[k].get());
+        DavWave::connect(scalers[k].get(), videoEncodes[k].get());
+        DavWave::connect(videoEncodes[k].get(), muxers[k].get());
+        streamlet->addOneOutVideoBitstreamEntry(videoEncodes[k]);
+    }
+    if (audioEncodes.size() > 0) {
+        if (bAudioConnected)
+            DavWave::connect(audioDecoders[0].get(), audioEncodes[0].get());
+        for (auto & m : muxers)
+            DavWave::connect(audioEncodes[0].get(), m.get());
+        streamlet->addOneOutAudioBitstreamEntry(audioEncodes[0]);
+    }
+    LOG(INFO) << m_logtag << "abr ladder with " << videoEncodes.size() << " renditions, gop " << gopSize
+              << (audioEncodes.size() ? ", shared audio encode" : ", no audio");
+    return streamlet;
+}
+
+int mkAbrLadderWaveOptions(const string & inputUrl, vector<DavAbrRung> rungs,
+                           vector<DavWaveOption> & waveOptions, const int gopSize, const bool bWithAudio) {
+    if (rungs.size() == 0)
+        return AVERROR(EINVAL);
+    std::sort(rungs.begin(), rungs.end(), [](const DavAbrRung & l, const DavAbrRung & r) {
+            return (int64_t)l.m_width * l.m_height > (int64_t)r.m_width * r.m_height;});
+    for (size_t k = 1; k < rungs.size(); k++) /* same sized rungs are duplicates */
+        if ((int64_t)rungs[k].m_width * rungs[k].m_height == (int64_t)rungs[k-1].m_width * rungs[k-1].m_height)
+            return AVERROR(EINVAL);
+
+    waveOptions.clear();
+    DavWaveOption demuxOption((DavWaveClassDemux()));
+    demuxOption.set(DavOptionInputUrl(), inputUrl);
+    waveOptions.emplace_back(demuxOption);
+    waveOptions.emplace_back(DavWaveOption((DavWaveClassVideoDecode())));
+    if (bWithAudio)
+        waveOptions.emplace_back(DavWaveOption((DavWaveClassAudioDecode())));
+
+    for (size_t k = 0; k < rungs.size(); k++) {
+        const auto & r = rungs[k];
+        if (r.m_width <= 0 || r.m_height <= 0 || r.m_outputUrl.empty())
+            return AVERROR(EINVAL);
+        DavWaveOption scaleOption(DavWaveClassVideoFilter(), "scale");
+        scaleOption.setVideoSize(r.m_width, r.m_height);
+        waveOptions.emplace_back(scaleOption);
+    }
+    for (size_t k = 0; k < rungs.size(); k++) {
+        const auto & r = rungs[k];
+        DavWaveOption videoEncodeOption((DavWaveClassVideoEncode()));
+        videoEncodeOption.setVideoSize(r.m_width, r.m_height);
+        if (r.m_bitrate > 0)
+            videoEncodeOption.setInt("b", r.m_bitrate);
+        videoEncodeOption.setInt("g", gopSize > 0 ? gopSize : kDefaultAbrGopSize);
+        waveOptions.emplace_back(videoEncodeOption);
+    }
+    if (bWithAudio)
+        waveOptions.emplace_back(DavWaveOption((DavWaveClassAudioEncode())));
+    for (size_t k = 0; k < rungs.size(); k++) {
+        DavWaveOption muxOption((DavWaveClassMux()));
+        muxOption.set(DavOptionOutputUrl(), rungs[k].m_outputUrl);
+        waveOptions.emplace_back(muxOption);
+    }
+    return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+shared_ptr<DavStreamlet>
+DavPassthroughStreamletBuilder::build(const vector<DavWaveOption> & waveOptions,
+                                      const DavStreamletTag & streamletTag,
+                                      const DavStreamletOption & streamletOptions) {
+    auto streamlet = createStreamlet(waveOptions, streamletTag, streamletOptions);
+    if (!streamlet)
+        return streamlet;
+
+    auto demuxers = streamlet->getWavesByCategory(DavWaveClassDemux());
+    auto bsfs = streamlet->getWavesByCategory(DavWaveClassBitstreamFilter());
+    auto muxers = streamlet->getWavesByCategory(DavWaveClassMux());
+    CHECK(demuxers.size() == 1 && muxers.size() > 0)
+        << m_logtag << "passthrough streamlet must have exactly 1 demuxer and at least 1 muxer";
+
+    /* relayed streams: first video, then first audio */
+    auto & demux = demuxers[0];
+    int videoIndex = -1;
+    int audioIndex = -1;
+    for (auto & outMedia : demux->getOutputMediaMap()) {
+        if (outMedia.second == AVMEDIA_TYPE_VIDEO && videoIndex < 0)
+            videoIndex = outMedia.first;
+        else if (outMedia.second == AVMEDIA_TYPE_AUDIO && audioIndex < 0)
+            audioIndex = outMedia.first;
+    }
+    vector<std::pair<int, AVMediaType>> relayStreams;
+    if (videoIndex >= 0)
+        relayStreams.emplace_back(videoIndex, AVMEDIA_TYPE_VIDEO);
+    if (audioIndex >= 0)
+        relayStreams.emplace_back(audioIndex, AVMEDIA_TYPE_AUDIO);
+    const size_t bsfPerMux = bsfs.size() / muxers.size();
+    if (relayStreams.size() == 0 || bsfs.size() % muxers.size() != 0) {
+        const string detail = relayStreams.size() == 0 ? "passthrough input has no audio/video stream" :
+            "passthrough bitstream filters should be none or the same number per muxer";
+        m_buildInfo.setInfo(AVERROR(EINVAL), detail);
+        LOG(ERROR) << m_logtag << m_buildInfo << ": " << bsfs.size() << " bsfs, " << muxers.size() << " muxers";
+        streamlet.reset();
+        return streamlet;
+    }
+    /* filters prepared for fewer streams (e.g. options made without audio): relay only those, video first */
+    if (bsfPerMux > 0 && relayStreams.size() > bsfPerMux) {
+        LOG(WARNING) << m_logtag << "only " << bsfPerMux << " bitstream filters per muxer, relay "
+                     << bsfPerMux << " of " << relayStreams.size() << " streams";
+        relayStreams.resize(bsfPerMux);
+    }
+
+    vector<shared_ptr<DavWave>> usedBsfs;
+    for (size_t m = 0; m < muxers.size(); m++) {
+        for (size_t s = 0; s < relayStreams.size(); s++) {
+            const int streamIndex = relayStreams[s].first;
+            const bool bVideo = relayStreams[s].second == AVMEDIA_TYPE_VIDEO;
+            if (bsfs.size() == 0) {
+                DavWave::connect(demux.get(), muxers[m].get(), streamIndex);
+                continue;
+            }
+            /* video takes slot 0 and audio slot 1 even if the input has no video */
+            auto & bsf = bsfs[m * bsfPerMux + (bVideo ? 0 : std::min(bsfPerMux - 1, (size_t)1))];
+            DavWave::connect(demux.get(), bsf.get(), streamIndex);
+            DavWave::connect(bsf.get(), muxers[m].get());
+            usedBsfs.push_back(bsf);
+            if (bVideo)
+                streamlet->addOneOutVideoBitstreamEntry(bsf);
+            else
+                streamlet->addOneOutAudioBitstreamEntry(bsf);
+        }
+    }
+    /* drop filters prepared for a stream the input doesn't have; they would never get data nor stop */
+    auto & waves = streamlet->getWaves();
+    waves.erase(std::remove_if(waves.begin(), waves.end(), [&bsfs, &usedBsfs](const shared_ptr<DavWave> & w) {
+                return std::count(bsfs.begin(), bsfs.end(), w) > 0 &&
+                    std::count(usedBsfs.begin(), usedBsfs.end(), w) == 0;}), waves.end());
+    LOG(INFO) << m_logtag << "passthrough " << relayStreams.size() << " streams to " << muxers.size()
+              << " muxers, with " << bsfs.size() << " bitstream filters";
+    return streamlet;
+}
+
+int mkPassthroughWaveOptions(const string & inputUrl, const vector<string> & outputUrls,
+                             vector<DavWaveOption> & waveOptions, const bool bWithAudio) {
+    if (outputUrls.size() == 0)
+        return AVERROR(EINVAL);
+    waveOptions.clear();
+    DavWaveOption demuxOption((DavWaveClassDemux()));
+    demuxOption.set(DavOptionInputUrl(), inputUrl);
+    waveOptions.emplace_back(demuxOption);
+    for (auto & url : outputUrls) {
+        const int bsfNum = bWithAudio ? 2 : 1;
+        for (int k = 0; k < bsfNum; k++) {
+            DavWaveOption bsfOption((DavWaveClassBitstreamFilter()));
+            bsfOption.set(DavOptionBitstreamFilter(), "auto");
+            bsfOption.set(DavOptionOutputUrl(), url);
+            waveOptions.emplace_back(bsfOption);
+        }
+    }
+    for (auto & url : outputUrls) {
+        DavWaveOption muxOption((DavWaveClassMux()));
+        muxOption.set(DavOptionOutputUrl(), url);
+        waveOptions.emplace_back(muxOption);
+    }
+    return 0;
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 shared_ptr<DavStreamlet>
 DavSingleWaveStreamletBuilder::build(const vector<DavWaveOption> & waveOptions,
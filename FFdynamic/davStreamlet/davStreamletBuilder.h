@@ -25,6 +25,9 @@ public:
     string m_logtag {"[StreamletBuilder] "};
 };
 
+/* Demux outputs connect to decoders in stream index order, each decoder is an out entry. With
+   DavOptionDemuxPrograms that is program by program: e.g. one video and one audio decoder per program
+   make the k-th video/audio entries the k-th program's */
 class DavDefaultInputStreamletBuilder : public DavStreamletBuilder {
 public:
     virtual shared_ptr<DavStreamlet> build(const vector<DavWaveOption> & waveOptions,
@@ -39,6 +42,23 @@ public:
                                            const DavStreamletOption & streamletOptions = DavStreamletOption());
 };
 
+/* Encoders (and optional pre-encode filters) only: raw in, bitstream out. Several outputs with identical
+   encode settings share one of this, each output is a DavMuxOutputStreamletBuilder's streamlet */
+class DavSharedEncodeStreamletBuilder : public DavStreamletBuilder {
+public:
+    virtual shared_ptr<DavStreamlet> build(const vector<DavWaveOption> & waveOptions,
+                                           const DavStreamletTag & streamletTag = DavSharedEncodeStreamletTag(),
+                                           const DavStreamletOption & streamletOptions = DavStreamletOption());
+};
+
+/* Muxers only, fed by a shared encode streamlet via 'connectEncodeToMuxers' */
+class DavMuxOutputStreamletBuilder : public DavStreamletBuilder {
+public:
+    virtual shared_ptr<DavStreamlet> build(const vector<DavWaveOption> & waveOptions,
+                                           const DavStreamletTag & streamletTag = DavDefaultOutputStreamletTag(),
+                                           const DavStreamletOption & streamletOptions = DavStreamletOption());
+};
+
 class DavMixStreamletBuilder : public DavStreamletBuilder {
 public:
     virtual shared_ptr<DavStreamlet> build(const vector<DavWaveOption> & waveOptions,
@@ -46,6 +66,29 @@ public:
                                            const DavStreamletOption & streamletOptions = DavStreamletOption());
 };
 
+/* ABR ladder: demux -> decode once -> cascade scale (each rung scaled from the previous, larger one)
+   -> per rung video encode -> per rung muxer; the only audio encode is shared by all muxers.
+   Wave options order matters: video filters, video encodes and muxers are rungs in descending size;
+   build fails with EINVAL (in m_buildInfo) on rungs out of order or of the same size.
+   All video encodes are forced to the same gop (g, keyint_min, no scene cut) so renditions switch cleanly */
+class DavAbrLadderStreamletBuilder : public DavStreamletBuilder {
+public:
+    virtual shared_ptr<DavStreamlet> build(const vector<DavWaveOption> & waveOptions,
+                                           const DavStreamletTag & streamletTag = DavAbrLadderStreamletTag(),
+                                           const DavStreamletOption & streamletOptions = DavStreamletOption());
+};
+
+/* Passthrough (no transcode): demux -> [bitstream filter] -> muxers.
+   The first video and first audio streams of the input are relayed. Bitstream filters are optional:
+   either none (packets go to muxers directly) or one per (muxer, relayed stream), ordered by muxer,
+   then video before audio, since the needed filter depends on each muxer's container */
+class DavPassthroughStreamletBuilder : public DavStreamletBuilder {
+public:
+    virtual shared_ptr<DavStreamlet> build(const vector<DavWaveOption> & waveOptions,
+                                           const DavStreamletTag & streamletTag = DavPassthroughStreamletTag(),
+                                           const DavStreamletOption & streamletOptions = DavStreamletOption());
+};
+
 class DavSingleWaveStreamletBuilder : public DavStreamletBuilder {
 public:
     virtual shared_ptr<DavStreamlet> build(const vector<DavWaveOption> & waveOptions,
@@ -53,4 +96,39 @@ public:
                                            const DavStreamletOption & streamletOptions = DavStreamletOption());
 };
 
+/* helpers for abr ladder */
+struct DavAbrRung {
+    int m_width = 0;
+    int m_height = 0;
+    int m_bitrate = 0; /* bits per second */
+    string m_outputUrl;
+};
+/* wave options for DavAbrLadderStreamletBuilder; rungs are sorted by size (descending), same sized ones
+   are rejected */
+extern int mkAbrLadderWaveOptions(const string & inputUrl, vector<DavAbrRung> rungs,
+                                  vector<DavWaveOption> & waveOptions, const int gopSize = 60,
+                                  const bool bWithAudio = true);
+
+/* wave options for DavPassthroughStreamletBuilder, with 'auto' bitstream filters per output */
+extern int mkPassthroughWaveOptions(const string & inputUrl, const vector<string> & outputUrls,
+                                    vector<DavWaveOption> & waveOptions, const bool bWithAudio = true);
+
+/* helpers for sharing encoders among outputs */
+/* canonical string of encode and pre-encode filter settings; outputs with the same key could share encoders */
+extern string encodeSettingKey(const vector<DavWaveOption> & waveOptions);
+/* split output wave options to encode part (encoders and filters) and mux part */
+extern int splitEncodeMuxOptions(const vector<DavWaveOption> & waveOptions,
+                                 vector<DavWaveOption> & encodeOptions, vector<DavWaveOption> & muxOptions);
+/* whether video encode option asks for congestion driven bitrate adaptation (DavOptionBitrateAdaptMin) */
+extern bool isBitrateAdaptEnabled(const vector<DavWaveOption> & waveOptions);
+/* every encoder's bitstream goes to every muxer; with bitrate adapt, video encoder subscribes muxers' throughput */
+extern int connectEncodeToMuxers(DavStreamlet & encodeStreamlet, DavStreamlet & muxStreamlet,
+                                 const bool bBitrateAdapt = false);
+extern int disconnectEncodeFromMuxers(DavStreamlet & encodeStreamlet, DavStreamlet & muxStreamlet,
+                                      const bool bBitrateAdapt = false);
+/* input streamlet reads what the encode streamlet produces (e.g. republished in the same process):
+   video encoders subscribe the demuxers, so a fast joining demux's key frame request reaches them */
+extern int subscribeKeyFrameRequests(DavStreamlet & inputStreamlet, DavStreamlet & encodeStreamlet);
+extern int unsubscribeKeyFrameRequests(DavStreamlet & inputStreamlet, DavStreamlet & encodeStreamlet);
+
 } // namespace ff_dynamic
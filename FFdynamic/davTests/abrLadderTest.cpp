@@ -0,0 +1,155 @@
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <utility>
+
+#include <glog/logging.h>
+#include "ffmpegHeaders.h"
+#include "davStreamletBuilder.h"
+#include "davStreamlet.h"
+#include "testCommon.h"
+
+using std::string;
+using std::vector;
+using namespace test_common;
+using namespace ff_dynamic;
+
+/* DavAbrLadderStreamletBuilder on a local file:
+   1. rungs out of order or of the same size are rejected, with EINVAL in the builder's m_buildInfo;
+   2. a three rung ladder, given unordered to mkAbrLadderWaveOptions, builds one scaler, video encode,
+      muxer and out video entry per rung, largest first;
+   3. after running a few seconds, each rung's output file has its rung's video size. */
+
+static int g_failures = 0;
+static void check(const bool bOk, const string & what) {
+    LOG(INFO) << (bOk ? "ok     " : "FAILED ") << what;
+    if (!bOk)
+        g_failures++;
+}
+
+static const vector<DavAbrRung> g_rungs = {
+    {640, 360, 800000, "test-abr-360.flv"},
+    {1280, 720, 2000000, "test-abr-720.flv"},
+    {320, 180, 300000, "test-abr-180.flv"},
+};
+
+/* index of the k-th wave option of the category */
+static int optionIndex(const vector<DavWaveOption> & waveOptions, const DavWaveClassCategory & category,
+                       const int k) {
+    int n = 0;
+    for (size_t i = 0; i < waveOptions.size(); i++) {
+        DavWaveClassCategory c((DavWaveClassNotACategory()));
+        waveOptions[i].getCategory(DavOptionClassCategory(), c);
+        if (c == category && n++ == k)
+            return static_cast<int>(i);
+    }
+    return -1;
+}
+
+/* video size of the first video stream of a written file */
+static int outputVideoSize(const string & url, int & width, int & height) {
+    AVFormatContext *fmtCtx = nullptr;
+    int ret = avformat_open_input(&fmtCtx, url.c_str(), nullptr, nullptr);
+    if (ret < 0 || (ret = avformat_find_stream_info(fmtCtx, nullptr)) < 0) {
+        avformat_close_input(&fmtCtx);
+        return ret;
+    }
+    ret = av_find_best_stream(fmtCtx, AVMEDIA_TYPE_VIDEO, -1, -1, nullptr, 0);
+    if (ret >= 0) {
+        width = fmtCtx->streams[ret]->codecpar->width;
+        height = fmtCtx->streams[ret]->codecpar->height;
+        ret = 0;
+    }
+    avformat_close_input(&fmtCtx);
+    return ret;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+static int testRejected(const string & url) {
+    vector<DavWaveOption> waveOptions;
+    CHECK(mkAbrLadderWaveOptions(url, g_rungs, waveOptions) >= 0) << "fail to make abr wave options";
+
+    /* the two largest scalers swapped */
+    vector<DavWaveOption> unordered(waveOptions);
+    std::swap(unordered[optionIndex(unordered, DavWaveClassVideoFilter(), 0)],
+              unordered[optionIndex(unordered, DavWaveClassVideoFilter(), 1)]);
+    DavAbrLadderStreamletBuilder unorderedBuilder;
+    check(unorderedBuilder.build(unordered) == nullptr &&
+          unorderedBuilder.m_buildInfo.m_msgCode == AVERROR(EINVAL), "unordered scalers rejected");
+
+    /* the last video encode as large as the one before */
+    vector<DavWaveOption> duplicated(waveOptions);
+    duplicated[optionIndex(duplicated, DavWaveClassVideoEncode(), 2)].setVideoSize(640, 360);
+    DavAbrLadderStreamletBuilder duplicatedBuilder;
+    check(duplicatedBuilder.build(duplicated) == nullptr &&
+          duplicatedBuilder.m_buildInfo.m_msgCode == AVERROR(EINVAL), "duplicated video encode rejected");
+
+    vector<DavAbrRung> sameSize(g_rungs);
+    sameSize[2].m_width = 640;
+    sameSize[2].m_height = 360;
+    check(mkAbrLadderWaveOptions(url, sameSize, waveOptions) == AVERROR(EINVAL),
+          "same sized rungs rejected by mkAbrLadderWaveOptions");
+    return 0;
+}
+
+static int testLadder(const string & url) {
+    vector<DavWaveOption> waveOptions;
+    CHECK(mkAbrLadderWaveOptions(url, g_rungs, waveOptions) >= 0) << "fail to make abr wave options";
+    DavAbrLadderStreamletBuilder builder;
+    auto streamlet = builder.build(waveOptions);
+    check(streamlet != nullptr, "three rung ladder built");
+    if (!streamlet)
+        return AVERROR(EINVAL);
+
+    const size_t rungs = g_rungs.size();
+    auto videoEncodes = streamlet->getWavesByCategory(DavWaveClassVideoEncode());
+    auto muxers = streamlet->getWavesByCategory(DavWaveClassMux());
+    check(streamlet->getWavesByCategory(DavWaveClassVideoFilter()).size() == rungs &&
+          videoEncodes.size() == rungs && muxers.size() == rungs,
+          "one scaler, video encode and muxer per rung");
+    check(streamlet->getOutVideoBitstreamEntries().size() == rungs, "one out video entry per rung");
+
+    /* run till every rung has some output */
+    DavRiver river({streamlet});
+    river.start();
+    const int64_t start = av_gettime_relative();
+    bool bAllOutput = false;
+    while (!g_bExit && !bAllOutput && av_gettime_relative() - start < 10 * AV_TIME_BASE) {
+        usleep(static_cast<int>(ETimeUs::e100ms));
+        bAllOutput = true;
+        for (auto & m : muxers)
+            bAllOutput = bAllOutput && waveStat(m, "output_packets") > 50;
+    }
+    river.stop();
+    river.clear();
+    check(bAllOutput, "every rung has output");
+
+    /* largest first: 720p, 360p, 180p */
+    const vector<std::pair<int, int>> sizes = {{1280, 720}, {640, 360}, {320, 180}};
+    const vector<string> urls = {"test-abr-720.flv", "test-abr-360.flv", "test-abr-180.flv"};
+    for (size_t k = 0; k < rungs; k++) {
+        int width = 0;
+        int height = 0;
+        const int ret = outputVideoSize(urls[k], width, height);
+        check(ret == 0 && width == sizes[k].first && height == sizes[k].second,
+              "rung " + std::to_string(k) + " output " + urls[k] + " is " + std::to_string(width) + "x" +
+              std::to_string(height));
+    }
+    return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+int main(int argc, char **argv) {
+    testInit(argv[0]);
+    if (argc != 2) {
+        LOG(ERROR) << "Usage: abrLadderTest inputFile";
+        return -1;
+    }
+    const string inputUrl(argv[1]);
+    testRejected(inputUrl);
+    testLadder(inputUrl);
+    LOG(INFO) << "abr ladder test " << (g_failures ? "failed" : "passed") << ", " << g_failures << " failures";
+    return g_failures ? -1 : 0;
+}
@@ -0,0 +1,94 @@
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <iomanip>
+#include "testCommon.h"
+
+using namespace test_common;
+
+/* Demux throughput of local files, default file protocol vs mmap io. Each run demuxes a whole file with
+   an unconnected demuxer. With 'cold', the file's page cache is dropped before every run, so the numbers
+   include disk reads; otherwise the first run warms the cache and later runs measure cpu cost only. */
+
+struct RunResult {
+    double m_seconds = 0.0;
+    int64_t m_bytes = 0;
+    int64_t m_packets = 0;
+};
+
+static int dropPageCache(const string & path) {
+    const int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return AVERROR(errno);
+    fdatasync(fd);
+    const int ret = posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    close(fd);
+    return ret == 0 ? 0 : AVERROR(ret);
+}
+
+static int demuxOnce(const string & inputUrl, const bool bMmap, RunResult & result) {
+    DavWaveOption demuxOption((DavWaveClassDemux()));
+    demuxOption.set(DavOptionInputUrl(), inputUrl);
+    demuxOption.setBool("mmap_io", bMmap);
+    auto demux = std::make_shared<DavWave>(demuxOption);
+    if (demux->hasErr()) {
+        LOG(ERROR) << "create demux failed: " << demux->getErr();
+        return demux->getErr().m_msgCode;
+    }
+
+    const int64_t start = av_gettime_relative();
+    demux->start();
+    while (!demux->isStopped() && !g_bExit)
+        usleep(static_cast<int>(ETimeUs::e5ms));
+    result.m_seconds = (av_gettime_relative() - start) / (double)AV_TIME_BASE;
+
+    AVDictionary *stat = nullptr;
+    demux->statistics(&stat);
+    auto getStat = [stat](const char *key) -> int64_t {
+        auto e = av_dict_get(stat, key, nullptr, 0);
+        return e ? strtoll(e->value, nullptr, 10) : 0;
+    };
+    result.m_bytes = getStat("read_bytes");
+    result.m_packets = getStat("video_packets") + getStat("audio_packets");
+    av_dict_free(&stat);
+    demux->stop();
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    testInit(argv[0]);
+    if (argc < 2) {
+        LOG(ERROR) << "Usage: demuxBenchmark inputFile [rounds] [cold]";
+        return -1;
+    }
+    const string inputUrl(argv[1]);
+    const int rounds = argc > 2 ? std::max(atoi(argv[2]), 1) : 3;
+    const bool bCold = argc > 3 && string(argv[3]) == "cold";
+    FLAGS_stderrthreshold = 1; /* keep per packet logs out of the timing */
+
+    RunResult total[2];
+    for (int r = 0; r < rounds && !g_bExit; r++) {
+        /* alternate the order, so neither mode always runs on a cache the other warmed */
+        for (int m = 0; m < 2 && !g_bExit; m++) {
+            const bool bMmap = (r + m) % 2 == 1;
+            if (bCold)
+                dropPageCache(inputUrl);
+            RunResult result;
+            if (demuxOnce(inputUrl, bMmap, result) < 0)
+                return -1;
+            LOG(WARNING) << "round " << r << (bMmap ? " mmap: " : " file: ") << std::fixed
+                         << std::setprecision(3) << result.m_seconds << "s, "
+                         << result.m_bytes / result.m_seconds / (1024 * 1024) << " MB/s, "
+                         << (int64_t)(result.m_packets / result.m_seconds) << " packets/s";
+            total[bMmap].m_seconds += result.m_seconds;
+            total[bMmap].m_bytes += result.m_bytes;
+            total[bMmap].m_packets += result.m_packets;
+        }
+    }
+    for (int m = 0; m < 2; m++)
+        LOG(WARNING) << (m ? "mmap" : "file") << (bCold ? " (cold)" : " (warm)") << " average: "
+                     << std::fixed << std::setprecision(1)
+                     << total[m].m_bytes / total[m].m_seconds / (1024 * 1024) << " MB/s, "
+                     << (int64_t)(total[m].m_packets / total[m].m_seconds) << " packets/s";
+    return 0;
+}
@@ -0,0 +1,198 @@
+#include <stdio.h>
+#include <unistd.h>
+
+#include <string>
+#include <atomic>
+#include <algorithm>
+
+#include <glog/logging.h>
+#include "ffmpegHeaders.h"
+#include "demuxIo.h"
+#include "testCommon.h"
+
+using std::string;
+using namespace test_common;
+using namespace ff_dynamic;
+
+/* DemuxIo over a slow source: a local file read through custom io which, some time after reading goes
+   live, holds a read for a while (a hiccup) or forever (a stall), waking up on the format context's
+   interrupt callback as network protocols do:
+   1. a stalled source: the read fails with AVERROR(ETIMEDOUT) at the read deadline, not later;
+   2. a hiccup shorter than the deadline, packets consumed at a steady pace: read directly, one read blocks
+      for the whole hiccup; with read ahead, the queued packets cover it and no read waits long. */
+
+static int g_failures = 0;
+static void check(const bool bOk, const string & what) {
+    LOG(INFO) << (bOk ? "ok     " : "FAILED ") << what;
+    if (!bOk)
+        g_failures++;
+}
+
+struct SlowSource {
+    FILE *m_file = nullptr;
+    AVFormatContext *m_fmtCtx = nullptr; /* for its interrupt callback */
+    std::atomic<int64_t> m_liveStart = ATOMIC_VAR_INIT(0); /* 0 till opened, probed and consumed */
+    int64_t m_holdAfterUs = 0; /* of live reading */
+    int64_t m_holdUs = -1;     /* < 0 holds forever */
+    std::atomic<bool> m_bHeld = ATOMIC_VAR_INIT(false);
+};
+
+static int slowRead(void *opaque, uint8_t *buf, int size) {
+    SlowSource *s = static_cast<SlowSource *>(opaque);
+    const int64_t liveStart = s->m_liveStart;
+    if (liveStart > 0 && !s->m_bHeld && av_gettime_relative() - liveStart >= s->m_holdAfterUs) {
+        s->m_bHeld = true;
+        const int64_t end = av_gettime_relative() + s->m_holdUs;
+        while (s->m_holdUs < 0 || av_gettime_relative() < end) {
+            const AVIOInterruptCB & cb = s->m_fmtCtx->interrupt_callback;
+            if (cb.callback && cb.callback(cb.opaque))
+                return AVERROR_EXIT;
+            av_usleep(static_cast<int>(ETimeUs::e5ms));
+        }
+    }
+    const size_t n = fread(buf, 1, size, s->m_file);
+    return n == 0 ? AVERROR_EOF : static_cast<int>(n);
+}
+
+static int64_t slowSeek(void *opaque, int64_t offset, int whence) {
+    SlowSource *s = static_cast<SlowSource *>(opaque);
+    if (whence == AVSEEK_SIZE) {
+        const long cur = ftell(s->m_file);
+        fseek(s->m_file, 0, SEEK_END);
+        const long size = ftell(s->m_file);
+        fseek(s->m_file, cur, SEEK_SET);
+        return size;
+    }
+    return fseek(s->m_file, offset, whence & ~AVSEEK_FORCE) == 0 ? ftell(s->m_file) : AVERROR(EIO);
+}
+
+/* a demuxer's format context over the slow source, opened and probed before the source goes live */
+class SlowDemux {
+public:
+    SlowDemux(const string & url, const int64_t readTimeoutUs, const int64_t holdAfterUs, const int64_t holdUs)
+        : m_io("[SlowDemux] ") {
+        m_source.m_file = fopen(url.c_str(), "rb");
+        m_source.m_holdAfterUs = holdAfterUs;
+        m_source.m_holdUs = holdUs;
+        m_fmtCtx = avformat_alloc_context();
+        uint8_t *buf = static_cast<uint8_t *>(av_malloc(4096));
+        m_pb = avio_alloc_context(buf, 4096, 0, &m_source, slowRead, nullptr, slowSeek);
+        if (!m_source.m_file || !m_fmtCtx || !m_pb)
+            return;
+        m_fmtCtx->pb = m_pb;
+        m_source.m_fmtCtx = m_fmtCtx;
+        m_io.attach(m_fmtCtx, readTimeoutUs, 100000);
+        if (avformat_open_input(&m_fmtCtx, "", nullptr, nullptr) < 0)
+            return; /* m_fmtCtx freed */
+        if (avformat_find_stream_info(m_fmtCtx, nullptr) < 0)
+            return;
+        m_bOpened = true;
+    }
+    ~SlowDemux() {
+        m_io.abort();
+        m_io.stopReadAhead();
+        avformat_close_input(&m_fmtCtx);
+        if (m_pb)
+            av_freep(&m_pb->buffer);
+        avio_context_free(&m_pb);
+        if (m_source.m_file)
+            fclose(m_source.m_file);
+    }
+    inline bool isOpened() const {return m_bOpened;}
+    inline void goLive() {m_source.m_liveStart = av_gettime_relative();}
+    inline DemuxIo & io() {return m_io;}
+    inline bool isHeld() const {return m_source.m_bHeld;}
+
+private:
+    SlowSource m_source;
+    AVFormatContext *m_fmtCtx = nullptr;
+    AVIOContext *m_pb = nullptr;
+    DemuxIo m_io;
+    bool m_bOpened = false;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+static int testStall(const string & url) {
+    SlowDemux demux(url, 300000, 0, -1);
+    if (!demux.isOpened()) {
+        LOG(ERROR) << "fail to open " << url;
+        return AVERROR(EINVAL);
+    }
+    demux.goLive();
+    AVPacket *pkt = av_packet_alloc();
+    int ret = 0;
+    int64_t lastReadUs = 0;
+    while (ret >= 0) {
+        const int64_t start = av_gettime_relative();
+        ret = demux.io().read(pkt, 0);
+        lastReadUs = av_gettime_relative() - start;
+        av_packet_unref(pkt);
+    }
+    av_packet_free(&pkt);
+    check(ret == AVERROR(ETIMEDOUT), "stalled read fails with timeout: " + davMsg2str(ret));
+    check(lastReadUs >= 250000 && lastReadUs < 1000000,
+          "stalled read gives up at the 300ms deadline, after " + std::to_string(lastReadUs / 1000) + "ms");
+    check(demux.io().getStat().m_timeouts == 1, "one read timeout counted");
+    return 0;
+}
+
+/* consume 200 packets, one per 5ms; the longest a read kept the consumer waiting */
+static int64_t consumePaced(SlowDemux & demux, int & packets) {
+    demux.goLive();
+    AVPacket *pkt = av_packet_alloc();
+    int64_t maxWaitUs = 0;
+    for (packets = 0; packets < 200; packets++) {
+        const int64_t start = av_gettime_relative();
+        int ret = 0;
+        do { /* read ahead returns EAGAIN while its queue is empty */
+            ret = demux.io().read(pkt, 100000);
+        } while (ret == AVERROR(EAGAIN));
+        if (packets >= 10) /* the queue fills up at first */
+            maxWaitUs = std::max(maxWaitUs, av_gettime_relative() - start);
+        av_packet_unref(pkt);
+        if (ret < 0)
+            break;
+        usleep(5000);
+    }
+    av_packet_free(&pkt);
+    return maxWaitUs;
+}
+
+static int testHiccup(const string & url) {
+    /* hiccup 500ms into reading, when the read ahead queue has filled up */
+    SlowDemux direct(url, 1000000, 500000, 300000);
+    SlowDemux ahead(url, 1000000, 500000, 300000);
+    if (!direct.isOpened() || !ahead.isOpened()) {
+        LOG(ERROR) << "fail to open " << url;
+        return AVERROR(EINVAL);
+    }
+    int directPackets = 0;
+    const int64_t directWaitUs = consumePaced(direct, directPackets);
+    ahead.io().startReadAhead(128); /* 128 packets are well over 300ms, at 5ms each */
+    int aheadPackets = 0;
+    const int64_t aheadWaitUs = consumePaced(ahead, aheadPackets);
+
+    check(direct.isHeld() && ahead.isHeld(), "both sources had their hiccup");
+    check(directPackets == 200 && aheadPackets == 200, "200 packets read in both modes");
+    check(directWaitUs >= 250000, "direct read blocks for the hiccup, " +
+          std::to_string(directWaitUs / 1000) + "ms");
+    check(aheadWaitUs < 100000, "read ahead covers the hiccup, longest wait " +
+          std::to_string(aheadWaitUs / 1000) + "ms");
+    const DemuxIoStat stat = ahead.io().getStat();
+    check(stat.m_timeouts == 0 && stat.m_stalls >= 1, "hiccup counted as a stall, not a timeout");
+    return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+int main(int argc, char **argv) {
+    testInit(argv[0]);
+    if (argc != 2) {
+        LOG(ERROR) << "Usage: demuxIoTest inputFile";
+        return -1;
+    }
+    const string inputUrl(argv[1]);
+    if (testStall(inputUrl) < 0 || testHiccup(inputUrl) < 0)
+        return -1;
+    LOG(INFO) << "demux io test " << (g_failures ? "failed" : "passed") << ", " << g_failures << " failures";
+    return g_failures ? -1 : 0;
+}
@@ -0,0 +1,243 @@
+#include <unistd.h>
+
+#include <string>
+#include <cstdlib>
+#include <vector>
+#include <memory>
+#include <algorithm>
+
+#include <glog/logging.h>
+#include "ffmpegHeaders.h"
+#include "davGopCache.h"
+#include "davStreamletBuilder.h"
+#include "davStreamlet.h"
+#include "testCommon.h"
+
+using std::string;
+using std::vector;
+using std::make_shared;
+using namespace test_common;
+using namespace ff_dynamic;
+
+/* DavGopCache from a local file:
+   1. the cache alone, fed with the file's packets: the latest gop comes back from its key frame, a gop
+      over the byte budget is not kept, all key streams (audio) keep a window bounded by bytes, and
+      remove() drops a producer's streams;
+   2. file -> decode -> shared encode (gop cache on, 10s gop) -> muxer; a second muxer joins a few seconds
+      later, mid gop, and should start with the cached key frame instead of waiting for the next one. */
+
+static int g_failures = 0;
+static void check(const bool bOk, const string & what) {
+    LOG(INFO) << (bOk ? "ok     " : "FAILED ") << what;
+    if (!bOk)
+        g_failures++;
+}
+
+static void freePackets(vector<AVPacket *> & pkts) {
+    for (auto & p : pkts)
+        av_packet_free(&p);
+    pkts.clear();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/* producers are only compared as addresses, never called */
+static char g_videoProducer;
+static char g_smallProducer;
+static char g_audioProducer;
+
+static void putPacket(const AVPacket *pkt, const AVRational & timebase, char *producer, const size_t maxBytes) {
+    DavProcBuf buf;
+    buf.mkAVPacket(av_packet_clone(pkt));
+    buf.setAddress(DavProcFrom(reinterpret_cast<DavProc *>(producer), 0));
+    buf.m_travelStatic = make_shared<DavTravelStatic>();
+    buf.m_travelStatic->m_timebase = timebase;
+    DavGopCache::getOnlyInstance().put(buf, maxBytes);
+}
+
+static int testCacheAlone(const string & url) {
+    AVFormatContext *fmtCtx = nullptr;
+    int ret = avformat_open_input(&fmtCtx, url.c_str(), nullptr, nullptr);
+    if (ret < 0 || (ret = avformat_find_stream_info(fmtCtx, nullptr)) < 0) {
+        LOG(ERROR) << "open " << url << " failed: " << davMsg2str(ret);
+        avformat_close_input(&fmtCtx);
+        return ret;
+    }
+    const int videoIndex = av_find_best_stream(fmtCtx, AVMEDIA_TYPE_VIDEO, -1, -1, nullptr, 0);
+    const int audioIndex = av_find_best_stream(fmtCtx, AVMEDIA_TYPE_AUDIO, -1, -1, nullptr, 0);
+    if (videoIndex < 0) {
+        avformat_close_input(&fmtCtx);
+        return videoIndex;
+    }
+    const AVRational videoTimebase = fmtCtx->streams[videoIndex]->time_base;
+    const size_t bigBytes = 64 << 20;
+    auto & cache = DavGopCache::getOnlyInstance();
+    const DavProcFrom videoFrom(reinterpret_cast<DavProc *>(&g_videoProducer), 0);
+    const DavProcFrom smallFrom(reinterpret_cast<DavProc *>(&g_smallProducer), 0);
+    const DavProcFrom audioFrom(reinterpret_cast<DavProc *>(&g_audioProducer), 0);
+
+    /* read into the second gop, a few packets past its key frame */
+    AVPacket *pkt = av_packet_alloc();
+    int keyFrames = 0;
+    int64_t lastKeyDts = AV_NOPTS_VALUE;
+    size_t sinceKey = 0;
+    size_t gopBytes = 0;
+    size_t smallBytes = 0; /* budget of the small producer: the first key frame only */
+    bool bFirstGopKept = true;
+    vector<AVPacket *> pkts;
+    int64_t startUs = AV_NOPTS_VALUE;
+    size_t audioBytes = 0;
+    size_t audioPackets = 0;
+    int64_t lastAudioDts = AV_NOPTS_VALUE;
+    while (av_read_frame(fmtCtx, pkt) >= 0) {
+        if (pkt->stream_index == audioIndex && pkt->dts != AV_NOPTS_VALUE) {
+            putPacket(pkt, fmtCtx->streams[audioIndex]->time_base, &g_audioProducer, 4096);
+            audioBytes += pkt->size;
+            audioPackets++;
+            lastAudioDts = pkt->dts;
+        }
+        if (pkt->stream_index != videoIndex || pkt->dts == AV_NOPTS_VALUE) {
+            av_packet_unref(pkt);
+            continue;
+        }
+        if (pkt->flags & AV_PKT_FLAG_KEY) {
+            keyFrames++;
+            if (keyFrames == 1)
+                smallBytes = pkt->size + 1;
+            if (keyFrames == 2) { /* the whole first gop went through the small producer */
+                bFirstGopKept = cache.getGop(smallFrom, INT64_MAX, pkts, startUs) == 0;
+                freePackets(pkts);
+            }
+            lastKeyDts = pkt->dts;
+            sinceKey = 0;
+            gopBytes = 0;
+        }
+        sinceKey++;
+        gopBytes += pkt->size;
+        putPacket(pkt, videoTimebase, &g_videoProducer, bigBytes);
+        if (keyFrames >= 1)
+            putPacket(pkt, videoTimebase, &g_smallProducer, smallBytes);
+        av_packet_unref(pkt);
+        if (keyFrames >= 2 && sinceKey >= 5)
+            break;
+    }
+    av_packet_free(&pkt);
+    avformat_close_input(&fmtCtx);
+    if (keyFrames < 2 || sinceKey < 5) {
+        LOG(ERROR) << url << " needs at least two video gops";
+        return AVERROR_INVALIDDATA;
+    }
+
+    /* latest gop, from its key frame */
+    ret = cache.getGop(videoFrom, INT64_MAX, pkts, startUs);
+    check(ret == 0 && pkts.size() == sinceKey, "latest gop cached, " + std::to_string(pkts.size()) +
+          " of " + std::to_string(sinceKey) + " packets");
+    check(pkts.size() && (pkts[0]->flags & AV_PKT_FLAG_KEY) && pkts[0]->dts == lastKeyDts,
+          "gop starts at the latest key frame");
+    check(startUs == av_rescale_q(lastKeyDts, videoTimebase, AV_TIME_BASE_Q), "gop start time");
+    freePackets(pkts);
+    /* a consumer whose first live packet is the key frame needs nothing from the cache */
+    check(cache.getGop(videoFrom, lastKeyDts, pkts, startUs) == AVERROR(ENOENT) && pkts.empty(),
+          "nothing before the gop's own key frame");
+
+    /* byte budget: a gop is dropped once it grows over, the next key frame starts over */
+    check(!bFirstGopKept, "gop over the byte budget not kept");
+    ret = cache.getGop(smallFrom, INT64_MAX, pkts, startUs);
+    check(gopBytes > smallBytes ? ret == AVERROR(ENOENT) : (ret == 0 && pkts.size() == sinceKey),
+          "next gop cached again while within the budget");
+    freePackets(pkts);
+
+    /* all key streams keep a window bounded by bytes */
+    if (audioPackets > 0) {
+        ret = cache.getSince(audioFrom, INT64_MIN, INT64_MAX, pkts);
+        size_t keptBytes = 0;
+        for (auto p : pkts)
+            keptBytes += p->size;
+        check(ret == 0 && pkts.size() > 0 && (keptBytes <= 4096 || pkts.size() == 1) &&
+              (audioBytes <= 4096 || pkts.size() < audioPackets) && pkts.back()->dts == lastAudioDts,
+              "audio window within 4096 bytes, " + std::to_string(pkts.size()) + " of " +
+              std::to_string(audioPackets) + " packets kept");
+        freePackets(pkts);
+    }
+
+    /* a producer gone */
+    cache.remove(reinterpret_cast<DavProc *>(&g_videoProducer));
+    check(cache.getGop(videoFrom, INT64_MAX, pkts, startUs) == AVERROR(ENOENT) && pkts.empty(),
+          "removed producer has no gop");
+    check(audioPackets == 0 || (cache.getSince(audioFrom, INT64_MIN, INT64_MAX, pkts) == 0 && pkts.size() > 0),
+          "other producers kept");
+    freePackets(pkts);
+    cache.remove(reinterpret_cast<DavProc *>(&g_smallProducer));
+    cache.remove(reinterpret_cast<DavProc *>(&g_audioProducer));
+    return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/* first video packet of a written file */
+static int firstVideoPacket(const string & url, bool & bKey) {
+    AVFormatContext *fmtCtx = nullptr;
+    int ret = avformat_open_input(&fmtCtx, url.c_str(), nullptr, nullptr);
+    if (ret < 0 || (ret = avformat_find_stream_info(fmtCtx, nullptr)) < 0) {
+        avformat_close_input(&fmtCtx);
+        return ret;
+    }
+    AVPacket *pkt = av_packet_alloc();
+    ret = AVERROR_STREAM_NOT_FOUND;
+    while (av_read_frame(fmtCtx, pkt) >= 0) {
+        const bool bVideo = fmtCtx->streams[pkt->stream_index]->codecpar->codec_type == AVMEDIA_TYPE_VIDEO;
+        bKey = pkt->flags & AV_PKT_FLAG_KEY;
+        av_packet_unref(pkt);
+        if (bVideo) {
+            ret = 0;
+            break;
+        }
+    }
+    av_packet_free(&pkt);
+    avformat_close_input(&fmtCtx);
+    return ret;
+}
+
+static int testLateMuxer(const string & url, const int joinAfter) {
+    DavStreamletOption encodeSo;
+    encodeSo.setInt(DavOptionGopCacheKB(), 8192);
+    LiveEncodeChain chain;
+    CHECK(buildLiveEncodeChain(url, chain, encodeSo) >= 0) << "fail to build the source chain";
+    auto firstStreamlet = buildEncodeMuxer(chain, "test-gop-cache-first.flv", "first");
+    CHECK(firstStreamlet != nullptr) << "fail to build the first muxer";
+    DavRiver river({chain.m_input, chain.m_encode, firstStreamlet});
+    river.start();
+
+    /* join mid gop, then run long enough for the late muxer to have some output, not for a new gop */
+    sleep(joinAfter);
+    const string lateUrl = "test-gop-cache-late.flv";
+    auto lateStreamlet = buildEncodeMuxer(chain, lateUrl, "late");
+    CHECK(lateStreamlet != nullptr) << "fail to build the late muxer";
+    river.add(lateStreamlet);
+    lateStreamlet->start();
+    sleep(2);
+    auto lateMux = lateStreamlet->getWavesByCategory(DavWaveClassMux())[0];
+    const int64_t primed = waveStat(lateMux, "gop_primed_packets");
+    river.stop();
+    river.clear();
+
+    check(primed > 0, "late muxer primed with " + std::to_string(primed) + " cached packets");
+    bool bKey = false;
+    const int ret = firstVideoPacket(lateUrl, bKey);
+    check(ret == 0 && bKey, "late muxer's output starts with a key frame");
+    return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+int main(int argc, char **argv) {
+    testInit(argv[0]);
+    if (argc < 2 || argc > 3) {
+        LOG(ERROR) << "Usage: gopCacheTest inputFile [joinAfterSeconds]";
+        return -1;
+    }
+    const string inputUrl(argv[1]);
+    const int joinAfter = argc > 2 ? std::max(atoi(argv[2]), 1) : 3;
+    if (testCacheAlone(inputUrl) < 0)
+        return -1;
+    testLateMuxer(inputUrl, joinAfter);
+    LOG(INFO) << "gop cache test " << (g_failures ? "failed" : "passed") << ", " << g_failures << " failures";
+    return g_failures ? -1 : 0;
+}
@@ -0,0 +1,81 @@
+#include <unistd.h>
+
+#include <string>
+#include <cstdlib>
+#include <memory>
+#include <algorithm>
+
+#include <glog/logging.h>
+#include "ffmpegHeaders.h"
+#include "davStreamletBuilder.h"
+#include "davStreamlet.h"
+#include "testCommon.h"
+
+using std::string;
+using namespace test_common;
+using namespace ff_dynamic;
+
+/* A fast joining input which reads another output of the same process asks that output's encoder
+   for a key frame, instead of waiting for the rest of a long gop:
+   1. file -> decode -> shared encode (10s gop) -> mpegts over udp to localhost;
+   2. after a few seconds, mid gop, a fast join passthrough reads the udp stream back, its demuxer
+      subscribed by the encoder (subscribeKeyFrameRequests);
+   3. pass if the encoder gets the request and the joining input sees video well before the gop ends. */
+
+int main(int argc, char **argv) {
+    testInit(argv[0]);
+    if (argc < 2 || argc > 4) {
+        LOG(ERROR) << "Usage: keyFrameRequestTest inputFile [joinAfterSeconds] [udpPort]";
+        return -1;
+    }
+    const string inputUrl(argv[1]);
+    const int joinAfter = argc > 2 ? std::max(atoi(argv[2]), 1) : 3;
+    const string loopUrl = "udp://127.0.0.1:" + string(argc > 3 ? argv[3] : "23456") + "?pkt_size=1316";
+
+    /* 1. source chain, paced as live */
+    LiveEncodeChain chain;
+    CHECK(buildLiveEncodeChain(inputUrl, chain) >= 0) << "fail to build the source chain";
+    auto muxStreamlet = buildEncodeMuxer(chain, loopUrl, "loop", "mpegts");
+    CHECK(muxStreamlet != nullptr) << "fail to build the udp output";
+    DavRiver river({chain.m_input, chain.m_encode, muxStreamlet});
+    river.start();
+
+    /* 2. join mid gop; open blocks till the udp stream is probed */
+    sleep(joinAfter);
+    DavWaveOption joinDemuxOption((DavWaveClassDemux()));
+    joinDemuxOption.set(DavOptionInputUrl(), loopUrl);
+    joinDemuxOption.set(DavOptionFastJoin(), "true");
+    /* parameter sets only come with key frames; don't let probing wait for one */
+    joinDemuxOption.setInt("analyze_duration_ms", 500);
+    DavWaveOption joinMuxOption((DavWaveClassMux()));
+    joinMuxOption.set(DavOptionOutputUrl(), "test-key-frame-request.ts");
+    DavPassthroughStreamletBuilder joinBuilder;
+    auto joinStreamlet = joinBuilder.build({joinDemuxOption, joinMuxOption}, DavDefaultInputStreamletTag("join"));
+    CHECK(joinStreamlet != nullptr) << "fail to build the joining input";
+    const int subscribed = subscribeKeyFrameRequests(*joinStreamlet, *chain.m_encode);
+    river.add(joinStreamlet);
+    joinStreamlet->start();
+
+    /* 3. wait for the joining input's first video */
+    auto videoEncode = chain.m_encode->getWavesByCategory(DavWaveClassVideoEncode())[0];
+    auto joinDemux = joinStreamlet->getWavesByCategory(DavWaveClassDemux())[0];
+    const int64_t joinStart = av_gettime_relative();
+    int64_t firstVideoMs = -1; /* since open */
+    while (!g_bExit && av_gettime_relative() - joinStart < 8 * AV_TIME_BASE) {
+        firstVideoMs = waveStat(joinDemux, "first_video_ms");
+        if (firstVideoMs >= 0)
+            break;
+        usleep(static_cast<int>(ETimeUs::e100ms));
+    }
+    const int64_t waitMs = firstVideoMs < 0 ? -1 : firstVideoMs - waveStat(joinDemux, "open_ms");
+    const int64_t requests = waveStat(videoEncode, "key_frame_requests");
+    river.stop();
+    river.clear();
+
+    /* without the request, the next key frame is up to 10s away */
+    const bool bPass = subscribed > 0 && requests > 0 && waitMs >= 0 && waitMs < 2000;
+    LOG(INFO) << "key frame request test " << (bPass ? "passed" : "failed") << ": subscriptions " << subscribed
+              << ", encoder got " << requests << " requests, joining input's first video "
+              << waitMs << "ms after open";
+    return bPass ? 0 : -1;
+}
@@ -0,0 +1,370 @@
+#include <unistd.h>
+
+#include <string>
+#include <cstdint>
+#include <cstdlib>
+#include <vector>
+#include <memory>
+#include <algorithm>
+
+#include <glog/logging.h>
+#include "ffmpegHeaders.h"
+#include "davStreamletBuilder.h"
+#include "davStreamlet.h"
+#include "testCommon.h"
+
+using std::string;
+using std::vector;
+using std::shared_ptr;
+using std::unique_ptr;
+using namespace test_common;
+using namespace ff_dynamic;
+
+/* Segment parallel file transcoding:
+   1. probe key frames which split the input into N ranges of about the same duration;
+   2. every range runs its own demux -> video decode -> video encode -> mux chain, all at the same time.
+      audio is cheap, it is transcoded once by another chain (no encoder priming at every boundary);
+   3. concatenate video segments and audio into the output without re-encoding, restoring timestamps.
+   Limitation: open gop's leading pictures of a split key frame are lost (one gop's worth at most). */
+
+////////////////////////////////////////////////////////////////////////////////
+struct ProbeInfo {
+    vector<int64_t> m_keyFrames; /* first key frame, then split points; pts in AV_TIME_BASE_Q */
+    int64_t m_firstAudioPts = AV_NOPTS_VALUE; /* AV_TIME_BASE_Q */
+    bool m_bHasAudio = false;
+};
+
+static int openInput(const string & url, AVFormatContext **fmtCtx) {
+    int ret = avformat_open_input(fmtCtx, url.c_str(), nullptr, nullptr);
+    if (ret < 0)
+        return ret;
+    ret = avformat_find_stream_info(*fmtCtx, nullptr);
+    if (ret < 0)
+        avformat_close_input(fmtCtx);
+    return ret;
+}
+
+static int probeSegments(const string & url, const int segmentNum, ProbeInfo & info) {
+    AVFormatContext *fmtCtx = nullptr;
+    int ret = openInput(url, &fmtCtx);
+    if (ret < 0)
+        return ret;
+    const int videoIndex = av_find_best_stream(fmtCtx, AVMEDIA_TYPE_VIDEO, -1, -1, nullptr, 0);
+    const int audioIndex = av_find_best_stream(fmtCtx, AVMEDIA_TYPE_AUDIO, -1, -1, nullptr, 0);
+    if (videoIndex < 0) {
+        avformat_close_input(&fmtCtx);
+        return videoIndex;
+    }
+    info.m_bHasAudio = audioIndex >= 0;
+
+    AVPacket *pkt = av_packet_alloc();
+    /* read till the next video key frame; also pick up audio's first pts on the way */
+    auto nextKeyFrame = [&](int64_t & keyFrame, const bool bWaitAudio) -> int {
+        keyFrame = AV_NOPTS_VALUE;
+        int r = 0;
+        while ((r = av_read_frame(fmtCtx, pkt)) >= 0) {
+            const AVStream *st = fmtCtx->streams[pkt->stream_index];
+            const int64_t ts = pkt->pts != AV_NOPTS_VALUE ? pkt->pts : pkt->dts;
+            if (ts != AV_NOPTS_VALUE) {
+                if (pkt->stream_index == audioIndex && info.m_firstAudioPts == AV_NOPTS_VALUE)
+                    info.m_firstAudioPts = av_rescale_q(ts, st->time_base, AV_TIME_BASE_Q);
+                if (pkt->stream_index == videoIndex && (pkt->flags & AV_PKT_FLAG_KEY) &&
+                    keyFrame == AV_NOPTS_VALUE)
+                    keyFrame = av_rescale_q(ts, st->time_base, AV_TIME_BASE_Q);
+            }
+            av_packet_unref(pkt);
+            if (keyFrame != AV_NOPTS_VALUE &&
+                (!bWaitAudio || !info.m_bHasAudio || info.m_firstAudioPts != AV_NOPTS_VALUE))
+                return 0;
+        }
+        return r;
+    };
+
+    int64_t keyFrame = AV_NOPTS_VALUE;
+    ret = nextKeyFrame(keyFrame, true);
+    if (ret >= 0)
+        info.m_keyFrames.push_back(keyFrame);
+    const int64_t duration = fmtCtx->duration;
+    for (int k = 1; ret >= 0 && k < segmentNum && duration > 0; k++) {
+        /* the key frame at or before the even split point */
+        const int64_t target = info.m_keyFrames[0] + duration * k / segmentNum;
+        if (av_seek_frame(fmtCtx, -1, target, AVSEEK_FLAG_BACKWARD) < 0) {
+            LOG(WARNING) << "input is not seekable, fall back to " << info.m_keyFrames.size() << " segments";
+            break;
+        }
+        if (nextKeyFrame(keyFrame, false) < 0)
+            break;
+        if (keyFrame > info.m_keyFrames.back()) /* long gops may land on the same key frame */
+            info.m_keyFrames.push_back(keyFrame);
+    }
+    av_packet_free(&pkt);
+    avformat_close_input(&fmtCtx);
+    return info.m_keyFrames.empty() ? AVERROR_INVALIDDATA : 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/* demux -> decode -> encode -> mux of one media type, connected in options' order */
+class ChainStreamletBuilder : public DavStreamletBuilder {
+public:
+    explicit ChainStreamletBuilder(const AVMediaType mediaType) : m_mediaType(mediaType) {}
+    virtual shared_ptr<DavStreamlet> build(const vector<DavWaveOption> & waveOptions,
+                                           const DavStreamletTag & streamletTag = DavUnknownStreamletTag(),
+                                           const DavStreamletOption & streamletOptions = DavStreamletOption()) {
+        auto streamlet = createStreamlet(waveOptions, streamletTag, streamletOptions);
+        if (!streamlet)
+            return streamlet;
+        auto & waves = streamlet->getWaves();
+        CHECK(waves.size() == 4) << m_logtag << "chain should be demux, decode, encode and mux";
+        int streamIndex = -1;
+        for (auto & m : waves[0]->getOutputMediaMap())
+            if (m.second == m_mediaType) {
+                streamIndex = m.first;
+                break;
+            }
+        if (streamIndex < 0) {
+            LOG(ERROR) << m_logtag << "input has no " << av_get_media_type_string(m_mediaType) << " stream";
+            return {};
+        }
+        DavWave::connect(waves[0].get(), waves[1].get(), streamIndex);
+        for (size_t k = 1; k + 1 < waves.size(); k++)
+            DavWave::connect(waves[k].get(), waves[k+1].get());
+        return streamlet;
+    }
+
+private:
+    AVMediaType m_mediaType;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+/* packets of one output stream from a series of files, each file shifted to its start position */
+struct ConcatSource {
+    ConcatSource() : m_pkt(av_packet_alloc()) {}
+    ~ConcatSource() {
+        if (m_fmtCtx)
+            avformat_close_input(&m_fmtCtx);
+        av_packet_free(&m_pkt);
+    }
+    inline const AVStream *stream() const {return m_fmtCtx->streams[0];}
+
+    /* next packet to m_pkt, AVERROR_EOF after the last file */
+    int peek() {
+        if (m_bReady)
+            return 0;
+        do {
+            if (!m_fmtCtx) {
+                if (m_cur >= m_urls.size())
+                    return AVERROR_EOF;
+                int ret = openInput(m_urls[m_cur], &m_fmtCtx);
+                if (ret < 0)
+                    return ret;
+                m_offset = AV_NOPTS_VALUE;
+                m_cur++;
+            }
+            int ret = av_read_frame(m_fmtCtx, m_pkt);
+            if (ret == AVERROR_EOF) {
+                avformat_close_input(&m_fmtCtx);
+                continue;
+            }
+            if (ret < 0)
+                return ret;
+            if (m_pkt->pts == AV_NOPTS_VALUE) {
+                av_packet_unref(m_pkt);
+                continue;
+            }
+            /* file's first packet: segment's key frame or the first audio packet; muxers may have shifted
+               them (avoid negative timestamps), so put them back to where they were in the input */
+            const AVRational tb = stream()->time_base;
+            if (m_offset == AV_NOPTS_VALUE) {
+                int64_t start = av_rescale_q(m_startPts[m_cur - 1], AV_TIME_BASE_Q, tb);
+                if (stream()->codecpar->codec_type == AVMEDIA_TYPE_AUDIO)  /* encoder priming */
+                    start -= av_rescale_q(stream()->codecpar->initial_padding,
+                                          {1, stream()->codecpar->sample_rate}, tb);
+                m_offset = start - m_pkt->pts;
+            }
+            m_pkt->pts += m_offset;
+            if (m_pkt->dts != AV_NOPTS_VALUE)
+                m_pkt->dts += m_offset;
+            m_bReady = true;
+            return 0;
+        } while (true);
+    }
+
+    vector<string> m_urls;
+    vector<int64_t> m_startPts; /* AV_TIME_BASE_Q */
+    size_t m_cur = 0;
+    AVFormatContext *m_fmtCtx = nullptr;
+    int64_t m_offset = AV_NOPTS_VALUE; /* current file's shift, in its timebase */
+    AVPacket *m_pkt = nullptr;
+    bool m_bReady = false;
+    int64_t m_lastDts = AV_NOPTS_VALUE; /* output stream's timebase */
+};
+
+static int concatSegments(vector<unique_ptr<ConcatSource>> & sources, const string & outputUrl) {
+    AVFormatContext *outCtx = nullptr;
+    int ret = avformat_alloc_output_context2(&outCtx, nullptr, nullptr, outputUrl.c_str());
+    if (ret < 0)
+        return ret;
+    for (auto & s : sources) {
+        ret = s->peek();
+        if (ret < 0)
+            break;
+        AVStream *st = avformat_new_stream(outCtx, nullptr);
+        CHECK(st != nullptr);
+        avcodec_parameters_copy(st->codecpar, s->stream()->codecpar);
+        st->codecpar->codec_tag = 0;
+        st->time_base = s->stream()->time_base;
+    }
+    if (ret >= 0 && !(outCtx->oformat->flags & AVFMT_NOFILE))
+        ret = avio_open2(&outCtx->pb, outputUrl.c_str(), AVIO_FLAG_WRITE, nullptr, nullptr);
+    if (ret >= 0)
+        ret = avformat_write_header(outCtx, nullptr);
+    if (ret < 0) {
+        LOG(ERROR) << "fail to create concat output " << outputUrl << ": " << davMsg2str(ret);
+        if (outCtx->pb)
+            avio_closep(&outCtx->pb);
+        avformat_free_context(outCtx);
+        return ret;
+    }
+
+    uint64_t outPackets = 0;
+    do { /* write in dts order, so interleaving won't queue up a whole segment */
+        int pick = -1;
+        for (size_t k = 0; k < sources.size(); k++) {
+            if (!sources[k]->m_bReady)
+                continue;
+            const AVPacket *a = sources[k]->m_pkt;
+            const int64_t ta = a->dts != AV_NOPTS_VALUE ? a->dts : a->pts;
+            if (pick >= 0) {
+                const AVPacket *b = sources[pick]->m_pkt;
+                const int64_t tb = b->dts != AV_NOPTS_VALUE ? b->dts : b->pts;
+                if (av_compare_ts(ta, sources[k]->stream()->time_base,
+                                  tb, sources[pick]->stream()->time_base) >= 0)
+                    continue;
+            }
+            pick = (int)k;
+        }
+        if (pick < 0)
+            break;
+
+        auto & s = sources[pick];
+        AVPacket *pkt = s->m_pkt;
+        av_packet_rescale_ts(pkt, s->stream()->time_base, outCtx->streams[pick]->time_base);
+        pkt->stream_index = pick;
+        pkt->pos = -1;
+        /* segments are encoded with the same settings, so the reorder delay matches at boundaries;
+           only rounding could leave dts equal */
+        if (s->m_lastDts != AV_NOPTS_VALUE && pkt->dts != AV_NOPTS_VALUE && pkt->dts <= s->m_lastDts) {
+            LOG_IF(WARNING, pkt->dts + 1 > pkt->pts)
+                << "stream " << pick << " dts " << pkt->dts << " not increasing at " << s->m_cur - 1;
+            pkt->dts = s->m_lastDts + 1;
+            pkt->pts = std::max(pkt->pts, pkt->dts);
+        }
+        if (pkt->dts != AV_NOPTS_VALUE)
+            s->m_lastDts = pkt->dts;
+        ret = av_interleaved_write_frame(outCtx, pkt);
+        s->m_bReady = false;
+        if (ret < 0) {
+            LOG(ERROR) << "concat write packet failed: " << davMsg2str(ret);
+            break;
+        }
+        outPackets++;
+        ret = s->peek();
+        if (ret < 0 && ret != AVERROR_EOF) {
+            LOG(ERROR) << "concat read " << s->m_urls[s->m_cur - 1] << " failed: " << davMsg2str(ret);
+            break;
+        }
+        ret = 0;
+    } while (true);
+
+    av_write_trailer(outCtx);
+    if (!(outCtx->oformat->flags & AVFMT_NOFILE))
+        avio_closep(&outCtx->pb);
+    avformat_free_context(outCtx);
+    LOG(INFO) << "concat done, " << outPackets << " packets written to " << outputUrl;
+    return ret;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+int main(int argc, char **argv) {
+    testInit(argv[0]);
+    if (argc < 2 || argc > 4) {
+        LOG(ERROR) << "Usage: parallelTranscode inputUrl [segmentNum] [outputUrl]";
+        return -1;
+    }
+    const string inputUrl(argv[1]);
+    const int cores = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    const int segmentNum = argc > 2 ? std::max(atoi(argv[2]), 1) : std::max(cores / 4, 1);
+    const string outputUrl(argc > 3 ? argv[3] : "test-parallel-transcode.ts");
+
+    // 1. split points
+    ProbeInfo info;
+    int ret = probeSegments(inputUrl, segmentNum, info);
+    if (ret < 0) {
+        LOG(ERROR) << "probe " << inputUrl << " failed: " << davMsg2str(ret);
+        return -1;
+    }
+    const auto & keyFrames = info.m_keyFrames;
+    LOG(INFO) << "transcode " << inputUrl << " in " << keyFrames.size() << " segments";
+
+    // 2. one chain per segment, plus one for audio
+    DavRiver river;
+    vector<unique_ptr<ConcatSource>> sources;
+    sources.emplace_back(new ConcatSource);
+    ChainStreamletBuilder videoBuilder(AVMEDIA_TYPE_VIDEO);
+    for (size_t k = 0; k < keyFrames.size(); k++) {
+        DavWaveOption demuxOption((DavWaveClassDemux()));
+        demuxOption.set(DavOptionInputUrl(), inputUrl);
+        if (k > 0)
+            demuxOption.set("read_start", std::to_string(keyFrames[k] / (double)AV_TIME_BASE));
+        if (k + 1 < keyFrames.size())
+            demuxOption.set("read_end", std::to_string(keyFrames[k+1] / (double)AV_TIME_BASE));
+        DavWaveOption videoDecodeOption((DavWaveClassVideoDecode()));
+        DavWaveOption videoEncodeOption((DavWaveClassVideoEncode()));
+        videoEncodeOption.set(DavOptionEncodeProfile(), "offline");
+        DavWaveOption muxOption((DavWaveClassMux()));
+        const string segmentUrl = "test-parallel-segment-" + std::to_string(k) + ".nut";
+        muxOption.set(DavOptionOutputUrl(), segmentUrl);
+
+        auto streamlet = videoBuilder.build({demuxOption, videoDecodeOption, videoEncodeOption, muxOption},
+                                            DavUnknownStreamletTag("segment_" + std::to_string(k)));
+        CHECK(streamlet != nullptr) << "fail to build segment " << k;
+        river.add(streamlet);
+        sources[0]->m_urls.push_back(segmentUrl);
+        sources[0]->m_startPts.push_back(keyFrames[k]);
+    }
+    if (info.m_bHasAudio) {
+        DavWaveOption demuxOption((DavWaveClassDemux()));
+        demuxOption.set(DavOptionInputUrl(), inputUrl);
+        DavWaveOption audioDecodeOption((DavWaveClassAudioDecode()));
+        DavWaveOption audioEncodeOption((DavWaveClassAudioEncode()));
+        DavWaveOption muxOption((DavWaveClassMux()));
+        const string audioUrl = "test-parallel-audio.nut";
+        muxOption.set(DavOptionOutputUrl(), audioUrl);
+        ChainStreamletBuilder audioBuilder(AVMEDIA_TYPE_AUDIO);
+        auto streamlet = audioBuilder.build({demuxOption, audioDecodeOption, audioEncodeOption, muxOption},
+                                            DavUnknownStreamletTag("audio"));
+        CHECK(streamlet != nullptr) << "fail to build audio transcode";
+        river.add(streamlet);
+        sources.emplace_back(new ConcatSource);
+        sources[1]->m_urls.push_back(audioUrl);
+        sources[1]->m_startPts.push_back(info.m_firstAudioPts);
+    }
+
+    const int64_t startTime = av_gettime_relative();
+    river.start();
+    testRun(river);
+    river.stop();
+    river.clear();
+    if (g_bExit) {
+        LOG(WARNING) << "transcode failed or interrupted, segments are not concatenated";
+        return -1;
+    }
+    const int64_t transcodeTime = av_gettime_relative() - startTime;
+
+    // 3. lossless concatenation
+    ret = concatSegments(sources, outputUrl);
+    LOG(INFO) << "parallel transcode " << (ret < 0 ? "failed" : "done") << ": " << keyFrames.size()
+              << " segments, transcode " << transcodeTime / 1000 << "ms, concat "
+              << (av_gettime_relative() - startTime - transcodeTime) / 1000 << "ms";
+    return ret < 0 ? -1 : 0;
+}
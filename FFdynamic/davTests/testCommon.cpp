@@ -1,4 +1,5 @@
 #include "testCommon.h"
+#include <cstdlib>
 
 using namespace ff_dynamic;
 
@@ -26,4 +27,56 @@ int testInit(const string& logtag) {
     return 0;
 }
 
+int64_t waveStat(const shared_ptr<DavWave> & wave, const string & key) {
+    AVDictionary *stat = nullptr;
+    wave->statistics(&stat);
+    AVDictionaryEntry *e = av_dict_get(stat, key.c_str(), nullptr, AV_DICT_MATCH_CASE);
+    const int64_t val = e ? strtoll(e->value, nullptr, 10) : -1;
+    av_dict_free(&stat);
+    return val;
+}
+
+int buildLiveEncodeChain(const string & inputUrl, LiveEncodeChain & chain, const DavStreamletOption & encodeSo) {
+    DavWaveOption demuxOption((DavWaveClassDemux()));
+    demuxOption.set(DavOptionInputUrl(), inputUrl);
+    demuxOption.set(DavOptionInputFpsEmulate(), "true");
+    DavWaveOption videoDecodeOption((DavWaveClassVideoDecode()));
+    DavWaveOption videoEncodeOption((DavWaveClassVideoEncode()));
+    videoEncodeOption.setVideoSize(640, 360);
+    videoEncodeOption.setAVRational("framerate", {25, 1});
+    videoEncodeOption.setInt("g", 250);
+    videoEncodeOption.set(DavOptionEncodeProfile(), "interactive");
+
+    DavDefaultInputStreamletBuilder inputBuilder;
+    DavSharedEncodeStreamletBuilder encodeBuilder;
+    chain.m_input = inputBuilder.build({demuxOption, videoDecodeOption}, DavDefaultInputStreamletTag("source"));
+    if (!chain.m_input) {
+        LOG(ERROR) << "fail to build input of " << inputUrl << ", " << inputBuilder.m_buildInfo;
+        return AVERROR(EINVAL);
+    }
+    chain.m_encode = encodeBuilder.build({videoEncodeOption}, DavSharedEncodeStreamletTag("encode"), encodeSo);
+    if (!chain.m_encode) {
+        LOG(ERROR) << "fail to build shared encode, " << encodeBuilder.m_buildInfo;
+        return AVERROR(EINVAL);
+    }
+    chain.m_input >> chain.m_encode;
+    return 0;
+}
+
+shared_ptr<DavStreamlet> buildEncodeMuxer(LiveEncodeChain & chain, const string & outputUrl,
+                                          const string & tagName, const string & containerFmt) {
+    DavWaveOption muxOption((DavWaveClassMux()));
+    muxOption.set(DavOptionOutputUrl(), outputUrl);
+    if (!containerFmt.empty())
+        muxOption.set(DavOptionContainerFmt(), containerFmt);
+    DavMuxOutputStreamletBuilder muxBuilder;
+    auto muxStreamlet = muxBuilder.build({muxOption}, DavDefaultOutputStreamletTag(tagName));
+    if (!muxStreamlet) {
+        LOG(ERROR) << "fail to build muxer of " << outputUrl << ", " << muxBuilder.m_buildInfo;
+        return nullptr;
+    }
+    connectEncodeToMuxers(*chain.m_encode, *muxStreamlet);
+    return muxStreamlet;
+}
+
 }  // namespace test_common
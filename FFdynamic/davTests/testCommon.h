@@ -12,15 +12,32 @@
 #include "davWave.h"
 #include "davMessager.h"
 #include "davStreamlet.h"
+#include "davStreamletBuilder.h"
 
 namespace test_common {
 using ::std::string;
+using ::std::shared_ptr;
 using namespace ff_dynamic;
 using namespace global_sighandle;
 
 extern std::atomic<bool> g_bExit;
 extern int testInit(const string & logtag);
 
+/* integer statistic of a wave; -1 if not reported */
+extern int64_t waveStat(const shared_ptr<DavWave> & wave, const string & key);
+
+/* live encode source: file paced as live -> decode -> shared encode (640x360, 25fps, 10s gop,
+   interactive profile). Connect muxers with 'buildEncodeMuxer' */
+struct LiveEncodeChain {
+    shared_ptr<DavStreamlet> m_input;
+    shared_ptr<DavStreamlet> m_encode;
+};
+extern int buildLiveEncodeChain(const string & inputUrl, LiveEncodeChain & chain,
+                                const DavStreamletOption & encodeSo = DavStreamletOption());
+/* a mux output streamlet fed by the chain's encoders; empty container format guesses it from the url */
+extern shared_ptr<DavStreamlet> buildEncodeMuxer(LiveEncodeChain & chain, const string & outputUrl,
+                                                 const string & tagName, const string & containerFmt = "");
+
 template<typename T>
 int testRun(T & t) {
     LOG(INFO) << "-- Start river process";
@@ -1,7 +1,31 @@
 #include "audioResample.h"
 
+#include <algorithm>
+#include <cstring>
+
 namespace ff_dynamic {
 
+int audioResampleQualityFromStr(const string & str, EAudioResampleQuality & quality) {
+    if (str == "fast")
+        quality = EAudioResampleQuality::eFast;
+    else if (str == "balanced")
+        quality = EAudioResampleQuality::eBalanced;
+    else if (str == "high")
+        quality = EAudioResampleQuality::eHigh;
+    else
+        return AVERROR(EINVAL);
+    return 0;
+}
+
+string audioResampleQualityToStr(const EAudioResampleQuality quality) {
+    switch (quality) {
+    case EAudioResampleQuality::eFast: return "fast";
+    case EAudioResampleQuality::eBalanced: return "balanced";
+    case EAudioResampleQuality::eHigh: return "high";
+    }
+    return "unknown";
+}
+
 std::ostream & operator<<(std::ostream & os, const AudioResampleParams & arp) {
     const char *srcFmtStr = av_get_sample_fmt_name(arp.m_srcFmt);
     const char *dstFmtStr = av_get_sample_fmt_name(arp.m_dstFmt);
@@ -11,10 +35,82 @@ std::ostream & operator<<(std::ostream & os, const AudioResampleParams & arp) {
        << "SRC: layout " << arp.m_srcLayout << ", channels "<< srcChannels
        << ", samplerate " << arp.m_srcSamplerate << ", fmt " << srcFmtStr
        << "\nDST: layout " << arp.m_dstLayout << ", channels " << dstChannels
-       << ", samplerate " << arp.m_dstSamplerate << ", fmt " << dstFmtStr;
+       << ", samplerate " << arp.m_dstSamplerate << ", fmt " << dstFmtStr
+       << "\nquality " << audioResampleQualityToStr(arp.m_quality);
     return os;
 }
 
+////////////////////////////////////
+// [audio ring buffer]
+int AudioRingBuffer::init(enum AVSampleFormat fmt, const int channels, const int capacity) {
+    release();
+    if (channels <= 0 || capacity <= 0)
+        return AVERROR(EINVAL);
+    const int planeNum = av_sample_fmt_is_planar(fmt) ? channels : 1;
+    m_sampleBytes = av_get_bytes_per_sample(fmt) * (av_sample_fmt_is_planar(fmt) ? 1 : channels);
+    m_capacity = capacity;
+    for (int k=0; k < planeNum; k++) {
+        uint8_t *plane = (uint8_t *)av_malloc((size_t)m_capacity * m_sampleBytes);
+        if (!plane) {
+            release();
+            return AVERROR(ENOMEM);
+        }
+        m_planes.push_back(plane);
+    }
+    return 0;
+}
+
+void AudioRingBuffer::release() {
+    for (auto & p : m_planes)
+        av_freep(&p);
+    m_planes.clear();
+    m_capacity = 0;
+    m_readPos = 0;
+    m_size = 0;
+}
+
+int AudioRingBuffer::write(const uint8_t * const *data, const int nbSamples) {
+    if (nbSamples <= 0)
+        return 0;
+    if (nbSamples > space())
+        return AVERROR(ENOSPC);
+    const int writePos = (m_readPos + m_size) % m_capacity;
+    const int first = std::min(nbSamples, m_capacity - writePos);
+    for (size_t k=0; k < m_planes.size(); k++) {
+        memcpy(m_planes[k] + writePos * m_sampleBytes, data[k], first * m_sampleBytes);
+        if (nbSamples > first)
+            memcpy(m_planes[k], data[k] + first * m_sampleBytes, (nbSamples - first) * m_sampleBytes);
+    }
+    m_size += nbSamples;
+    return nbSamples;
+}
+
+int AudioRingBuffer::read(uint8_t * const *data, const int nbSamples) {
+    const int readNum = std::min(nbSamples, m_size);
+    if (readNum <= 0)
+        return 0;
+    const int first = std::min(readNum, m_capacity - m_readPos);
+    for (size_t k=0; k < m_planes.size(); k++) {
+        memcpy(data[k], m_planes[k] + m_readPos * m_sampleBytes, first * m_sampleBytes);
+        if (readNum > first)
+            memcpy(data[k] + first * m_sampleBytes, m_planes[k], (readNum - first) * m_sampleBytes);
+    }
+    return drain(readNum);
+}
+
+int AudioRingBuffer::drain(const int nbSamples) {
+    const int drainNum = std::min(nbSamples, m_size);
+    if (drainNum <= 0)
+        return 0;
+    m_readPos = (m_readPos + drainNum) % m_capacity;
+    m_size -= drainNum;
+    if (m_size == 0)
+        m_readPos = 0;
+    return drainNum;
+}
+
+////////////////////////////////////
+// [audio resample]
 int AudioResample::initResampler(const AudioResampleParams & arp) {
     int ret = 0;
     m_arp = arp;
@@ -22,8 +118,12 @@ int AudioResample::initResampler(const AudioResampleParams & arp) {
     /* fifo of output sample format */
     m_srcChannels = av_get_channel_layout_nb_channels(m_arp.m_srcLayout);
     m_dstChannels = av_get_channel_layout_nb_channels(m_arp.m_dstLayout);
-    m_fifo = av_audio_fifo_alloc(m_arp.m_dstFmt, m_dstChannels, 1);
-    CHECK(m_fifo != nullptr);
+    const int capacity = (int)av_rescale(m_arp.m_maxBufferedMs, m_arp.m_dstSamplerate, 1000);
+    ret = m_ring.init(m_arp.m_dstFmt, m_dstChannels, capacity);
+    if (ret < 0) {
+        LOG(ERROR) << m_logtag << " failed to allocate audio ring with capacity " << capacity << ". " << m_arp;
+        return ret;
+    }
 
     if (m_arp.m_srcFmt == m_arp.m_dstFmt &&
         m_arp.m_srcSamplerate == m_arp.m_dstSamplerate &&
@@ -43,8 +143,15 @@ int AudioResample::initResampler(const AudioResampleParams & arp) {
     av_opt_set_sample_fmt(m_swrCtx, "out_sample_fmt",     m_arp.m_dstFmt, 0);
     av_opt_set_int(m_swrCtx,        "out_channel_layout", m_arp.m_dstLayout, 0);
     av_opt_set_int(m_swrCtx,        "out_sample_rate",    m_arp.m_dstSamplerate, 0);
-    /* initialize the resampling context */
+    /* initialize the resampling context; soxr may not be compiled in, fall back to swr then */
+    const bool bUseSoxr = m_arp.m_quality == EAudioResampleQuality::eHigh;
+    setQualityOptions(bUseSoxr);
     ret = swr_init(m_swrCtx);
+    if (ret < 0 && bUseSoxr) {
+        LOG(WARNING) << m_logtag << " soxr resampler not available, use swr with high quality settings";
+        setQualityOptions(false);
+        ret = swr_init(m_swrCtx);
+    }
     if (ret < 0) {
         LOG(ERROR) << m_logtag << " failed to initialize the resampling context. " << m_arp;
         return ret;
@@ -59,13 +166,14 @@ int AudioResample::initResampler(const AudioResampleParams & arp) {
 int AudioResample::closeResample() {
     if (m_swrCtx)
         swr_free(&m_swrCtx);
-    if (m_fifo) {
-        av_audio_fifo_free(m_fifo);
-        m_fifo = nullptr;
-    }
+    m_passFrame.reset();
+    m_framePool.clear();
     if (m_resampledData)
         av_freep(&m_resampledData[0]);
     av_freep(&m_resampledData);
+    if (m_passthroughNum > 0 || m_overflowSamples > 0)
+        LOG(INFO) << m_logtag << " resampler closed, output " << m_totalResampledNum << " samples, passthrough "
+                  << m_passthroughNum << ", dropped by overflow " << m_overflowSamples;
     return 0;
 }
 
@@ -85,7 +193,20 @@ int AudioResample::sendResampleFrame(AVFrame *frame) {
     }
 
     if (m_bFifoOnly) {
-        return srcData ? av_audio_fifo_write(m_fifo, (void **)srcData, srcNbSamples) : 0;
+        if (!srcData)
+            return 0;
+        int ret = spillPassFrame();
+        if (ret < 0)
+            return ret;
+        if (m_ring.size() == 0) {
+            /* hold a reference only; data is copied to the ring if it cannot be passed through */
+            AVFrame *ref = av_frame_clone(frame);
+            if (ref) {
+                m_passFrame = shared_ptr<AVFrame>(ref, [](AVFrame *p) {if (p) av_frame_free(&p);});
+                return srcNbSamples;
+            }
+        }
+        return writeToRing(srcData, srcNbSamples);
     }
 
     const int dstNbSamples = av_rescale_rnd(swr_get_delay(m_swrCtx, m_arp.m_srcSamplerate) + srcNbSamples,
@@ -97,13 +218,15 @@ int AudioResample::sendResampleFrame(AVFrame *frame) {
             return AVERROR(ENOMEM);
     }
     int nbSamples = swr_convert(m_swrCtx, m_resampledData, dstNbSamples, (const uint8_t **)srcData, srcNbSamples);
-    return av_audio_fifo_write(m_fifo, (void **)m_resampledData, nbSamples);
+    if (nbSamples < 0)
+        return nbSamples;
+    return writeToRing(m_resampledData, nbSamples);
 }
 
 shared_ptr<AVFrame> AudioResample::receiveResampledFrame(int desiredSize) {
     std::lock_guard<std::mutex> lock(m_mutex);
-    desiredSize = desiredSize == 0 ? av_audio_fifo_size(m_fifo) : desiredSize;
-    if (av_audio_fifo_size(m_fifo) < desiredSize || desiredSize == 0)
+    desiredSize = desiredSize == 0 ? bufferedSize() : desiredSize;
+    if (bufferedSize() < desiredSize || desiredSize == 0)
         return {};
     /* this call cannot identify the right time of flush, the caller should keep this state */
     return getOneFrame(desiredSize);
@@ -112,9 +235,9 @@ shared_ptr<AVFrame> AudioResample::receiveResampledFrame(int desiredSize) {
 int AudioResample::receiveResampledFrame(vector<shared_ptr<AVFrame>> & frames, int desiredSize) {
     std::lock_guard<std::mutex> lock(m_mutex);
     int ret = 0;
-    desiredSize = desiredSize == 0 ? av_audio_fifo_size(m_fifo) : desiredSize;
+    desiredSize = desiredSize == 0 ? bufferedSize() : desiredSize;
     do {
-        if (av_audio_fifo_size(m_fifo) < desiredSize || desiredSize == 0)
+        if (bufferedSize() < desiredSize || desiredSize == 0)
             break;
         auto frame = getOneFrame(desiredSize);
         if (frame) {
@@ -132,12 +255,70 @@ int AudioResample::receiveResampledFrame(vector<shared_ptr<AVFrame>> & frames, i
     return ret;
 }
 
+int AudioResample::discardResampledData(const int size) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (size <= 0)
+        return 0;
+    int discardNum = 0;
+    if (m_passFrame && m_passFrame->nb_samples <= size) {
+        discardNum = m_passFrame->nb_samples;
+        m_passFrame.reset();
+    } else if (spillPassFrame() < 0) {
+        return AVERROR(ENOMEM);
+    }
+    discardNum += m_ring.drain(size - discardNum);
+    m_curPts += discardNum;
+    return discardNum;
+}
+
 ///////////////////////////////
 // [ helpers]
+int AudioResample::writeToRing(const uint8_t * const *data, const int nbSamples) {
+    if (nbSamples <= 0)
+        return 0;
+    if (nbSamples > m_ring.capacity()) {
+        LOG(ERROR) << m_logtag << " input samples " << nbSamples << " exceed ring capacity " << m_ring.capacity();
+        return AVERROR(ENOSPC);
+    }
+    if (nbSamples > m_ring.space()) {
+        /* fixed capacity: keep the newest data, the same as a consumer skipping delayed data */
+        const int dropNum = m_ring.drain(nbSamples - m_ring.space());
+        m_curPts += dropNum;
+        m_overflowSamples += dropNum;
+        LOG(WARNING) << m_logtag << " audio ring full, drop " << dropNum << " oldest samples, total dropped "
+                     << m_overflowSamples;
+    }
+    return m_ring.write(data, nbSamples);
+}
+
+int AudioResample::spillPassFrame() {
+    if (!m_passFrame)
+        return 0;
+    auto passFrame = m_passFrame;
+    m_passFrame.reset();
+    return writeToRing(passFrame->extended_data, passFrame->nb_samples);
+}
+
 shared_ptr<AVFrame> AudioResample::getOneFrame(const int desiredSize) {
-    auto frame = allocOutFrame(desiredSize);
+    if (m_passFrame) {
+        if (m_passFrame->nb_samples == desiredSize) {
+            /* ring is always empty while holding a passthrough frame; hand it out directly */
+            auto frame = m_passFrame;
+            m_passFrame.reset();
+            frame->channel_layout = m_arp.m_dstLayout;
+            frame->pts = m_curPts;
+            m_curPts += desiredSize;
+            m_totalResampledNum += desiredSize;
+            m_passthroughNum += desiredSize;
+            return frame;
+        }
+        if (spillPassFrame() < 0)
+            return {};
+    }
+
+    auto frame = getPooledFrame(desiredSize);
     if (frame) {
-        av_audio_fifo_read(m_fifo, (void **)frame->data, desiredSize);
+        m_ring.read(frame->extended_data, desiredSize);
         frame->pts = m_curPts;
         m_curPts += desiredSize;
         m_totalResampledNum += desiredSize;
@@ -145,6 +326,52 @@ shared_ptr<AVFrame> AudioResample::getOneFrame(const int desiredSize) {
     return frame;
 }
 
+shared_ptr<AVFrame> AudioResample::getPooledFrame(const int nbSamples) {
+    for (auto & f : m_framePool) {
+        /* not referenced by callers, nor by any AVFrame (encoders may keep a reference) */
+        if (f.use_count() == 1 && av_frame_is_writable(f.get()) &&
+            f->linesize[0] >= nbSamples * m_ring.sampleBytes()) {
+            f->nb_samples = nbSamples;
+            f->pts = AV_NOPTS_VALUE;
+            return f;
+        }
+    }
+    auto frame = allocOutFrame(nbSamples);
+    if (frame && m_framePool.size() < MAX_POOLED_FRAMES)
+        m_framePool.push_back(frame);
+    return frame;
+}
+
+int AudioResample::setQualityOptions(const bool bUseSoxr) {
+    /* filter_size / phase_shift / cutoff / linear_interp are the swr engine knobs; defaults are 32/10/0.97/0 */
+    av_opt_set_int(m_swrCtx, "resampler", bUseSoxr ? SWR_ENGINE_SOXR : SWR_ENGINE_SWR, 0);
+    switch (m_arp.m_quality) {
+    case EAudioResampleQuality::eFast:
+        av_opt_set_int(m_swrCtx,    "filter_size",   8, 0);
+        av_opt_set_int(m_swrCtx,    "phase_shift",   6, 0);
+        av_opt_set_double(m_swrCtx, "cutoff",        0.90, 0);
+        av_opt_set_int(m_swrCtx,    "linear_interp", 1, 0);
+        break;
+    case EAudioResampleQuality::eBalanced:
+        av_opt_set_int(m_swrCtx,    "filter_size",   32, 0);
+        av_opt_set_int(m_swrCtx,    "phase_shift",   10, 0);
+        av_opt_set_double(m_swrCtx, "cutoff",        0.97, 0);
+        av_opt_set_int(m_swrCtx,    "linear_interp", 0, 0);
+        break;
+    case EAudioResampleQuality::eHigh:
+        if (bUseSoxr) {
+            av_opt_set_double(m_swrCtx, "precision", 28.0, 0); /* soxr very high quality */
+        } else {
+            av_opt_set_int(m_swrCtx,    "filter_size",   64, 0);
+            av_opt_set_int(m_swrCtx,    "phase_shift",   12, 0);
+            av_opt_set_double(m_swrCtx, "cutoff",        0.98, 0);
+            av_opt_set_int(m_swrCtx,    "linear_interp", 1, 0);
+        }
+        break;
+    }
+    return 0;
+}
+
 int AudioResample::initResampledData() {
     if (m_resampledData)
         av_freep(&m_resampledData[0]);
@@ -8,7 +8,7 @@
 #include <glog/logging.h>
 
 extern "C" {
-#include "libavutil/audio_fifo.h"
+#include "libavutil/samplefmt.h"
 #include "libavutil/opt.h"
 #include "libavutil/avutil.h"
 #include "libswresample/swresample.h"
@@ -21,6 +21,19 @@ using::std::string;
 using::std::vector;
 using::std::shared_ptr;
 
+/* resampler quality/speed trade off:
+   fast     - short filter, linear interpolation; good enough for inputs that are mixed and re-encoded
+   balanced - swr default settings
+   high     - soxr engine if it is compiled in, otherwise a long swr filter */
+enum class EAudioResampleQuality {
+    eFast = 0,
+    eBalanced = 1,
+    eHigh = 2
+};
+
+extern int audioResampleQualityFromStr(const string & str, EAudioResampleQuality & quality);
+extern string audioResampleQualityToStr(const EAudioResampleQuality quality);
+
 struct AudioResampleParams {
     enum AVSampleFormat m_srcFmt;
     enum AVSampleFormat m_dstFmt;
@@ -28,11 +41,43 @@ struct AudioResampleParams {
     int m_dstSamplerate  = 0;
     uint64_t m_srcLayout = 0;
     uint64_t m_dstLayout = 0;
+    /* fixed capacity of the resampled data ring; when it is full, the oldest samples are dropped */
+    int m_maxBufferedMs = 5000;
+    EAudioResampleQuality m_quality = EAudioResampleQuality::eBalanced;
     string m_logtag = "audioResample";
 };
 
 extern std::ostream & operator<<(std::ostream & os, const AudioResampleParams & arp);
 
+/* Fixed capacity ring of audio samples, one ring per plane (a single plane for packed formats).
+   Storage is allocated once in init; write/read only copy, no allocation and no reallocation. */
+class AudioRingBuffer {
+public:
+    AudioRingBuffer() = default;
+    virtual ~AudioRingBuffer() {release();}
+    int init(enum AVSampleFormat fmt, const int channels, const int capacity);
+    /* return samples written, or AVERROR(ENOSPC) if there is no enough space (nothing written) */
+    int write(const uint8_t * const *data, const int nbSamples);
+    /* return samples read (copied to data and consumed) */
+    int read(uint8_t * const *data, const int nbSamples);
+    /* consume samples without copy */
+    int drain(const int nbSamples);
+    inline int size() const {return m_size;}
+    inline int space() const {return m_capacity - m_size;}
+    inline int capacity() const {return m_capacity;}
+    inline int sampleBytes() const {return m_sampleBytes;}
+
+private:
+    AudioRingBuffer(const AudioRingBuffer &) = delete;
+    AudioRingBuffer & operator= (const AudioRingBuffer &) = delete;
+    void release();
+    vector<uint8_t *> m_planes;
+    int m_sampleBytes = 0; /* bytes of one sample in one plane */
+    int m_capacity = 0;    /* in samples */
+    int m_readPos = 0;
+    int m_size = 0;
+};
+
 class AudioResample {
 public:
     AudioResample() = default;
@@ -41,22 +86,30 @@ public:
     int sendResampleFrame(AVFrame *frame);
     shared_ptr<AVFrame> receiveResampledFrame(int desiredSize = 0);
     int receiveResampledFrame(vector<shared_ptr<AVFrame>> & frames, int desiredSize);
+    /* throw away buffered samples without output them; return samples discarded */
+    int discardResampledData(const int size);
 
     inline int getFifoCurSize() {
         std::lock_guard<std::mutex> lock(m_mutex);
-        return av_audio_fifo_size(m_fifo);
+        return bufferedSize();
     }
     inline double getFifoCurSizeInMs() {
         std::lock_guard<std::mutex> lock(m_mutex);
-        return av_audio_fifo_size(m_fifo) * 1000.0 / m_arp.m_dstSamplerate;
+        return bufferedSize() * 1000.0 / m_arp.m_dstSamplerate;
     }
     inline int64_t getStartPts() const {return m_startPts;}
     inline int64_t getCurPts() {std::lock_guard<std::mutex> lock(m_mutex); return m_curPts;}
+    inline int64_t getOverflowSamples() {std::lock_guard<std::mutex> lock(m_mutex); return m_overflowSamples;}
 
 private:
     int closeResample();
     int initResampledData();
+    int setQualityOptions(const bool bUseSoxr);
+    int writeToRing(const uint8_t * const *data, const int nbSamples);
+    int spillPassFrame();
+    inline int bufferedSize() const {return m_ring.size() + (m_passFrame ? m_passFrame->nb_samples : 0);}
     shared_ptr<AVFrame> allocOutFrame(const int nbSamples);
+    shared_ptr<AVFrame> getPooledFrame(const int nbSamples);
     shared_ptr<AVFrame> getOneFrame(const int desiredSize);
 
 private:
@@ -67,7 +120,13 @@ private:
     AudioResampleParams m_arp;
     bool m_bFifoOnly = false;
     bool m_bFlushed = false;
-    AVAudioFifo *m_fifo = nullptr;
+    AudioRingBuffer m_ring;
+    /* fifo only mode: keep a reference of the incoming frame while the ring is empty, so it could be
+       passed through directly if the desired output size is the same as the input one */
+    shared_ptr<AVFrame> m_passFrame;
+    /* output frames are reused once callers released them */
+    static constexpr size_t MAX_POOLED_FRAMES = 8;
+    vector<shared_ptr<AVFrame>> m_framePool;
     int64_t m_startPts = AV_NOPTS_VALUE;
     int64_t m_curPts = AV_NOPTS_VALUE;
 
@@ -76,6 +135,8 @@ private:
     int m_srcChannels = 0;
     int m_dstChannels = 0;
     int64_t m_totalResampledNum = 0;
+    int64_t m_passthroughNum = 0;
+    int64_t m_overflowSamples = 0;
     string m_logtag;
 };
 
@@ -47,17 +47,19 @@ int AppService::riverMonitor(std::function<int()> afterMonitorDone) {
         m_monitorCV.wait_for(uniqueGuard, timeInterval, [this]() {return (m_bMonitorCheck ? true : false);});
         m_bMonitorCheck = false;
         /* timeout check or event driven check stopped streamlet and then erase it */
-        vector<DavStreamletTag> stopped;
+        vector<shared_ptr<DavStreamlet>> stopped;
         auto streamlets = m_river.getStreamlets();
         for (const auto & s : streamlets)
             if (s->isStopped())
-                stopped.push_back(s->getTag());
-        for (const auto & e : stopped)
-            m_river.erase(e);
+                stopped.push_back(s);
+        for (const auto & s : stopped)
+            m_river.erase(s->getTag());
+        pruneSharedEncodes(stopped);
     } while (!m_bExit);
 
     m_river.stop();
     m_river.clear();
+    clearSharedEncodes();
 
     /* at last */
     afterMonitorDone();
@@ -173,6 +175,95 @@ int AppService::failResponse(shared_ptr<Response> & response, const int errCode,
     return 0;
 }
 
+/* low latency hls from DavLiveSegmentStore: /llhls/<name>/index.m3u8 (blocking reload with _HLS_msn and
+   _HLS_part), init<n>.mp4, seg<msn>.m4s and part<msn>.<part>.m4s. A response is sent once the last
+   reference to it goes, so a blocked request just keeps it in the store's wait callback (which may run on
+   a muxer's thread) without holding an http thread */
+static void liveRespond(shared_ptr<Response> & response, const int err,
+                        const shared_ptr<const string> & content, const char *contentType) {
+    CaseInsensitiveMultimap header {{"Access-Control-Allow-Origin", "*"}};
+    if (err < 0 || !content) {
+        StatusCode code = StatusCode::client_error_not_found;
+        if (err == AVERROR(EINVAL))
+            code = StatusCode::client_error_bad_request;
+        else if (err == AVERROR(ETIMEDOUT))
+            code = StatusCode::server_error_service_unavailable;
+        response->write(code, header);
+        return;
+    }
+    header.emplace("Content-Type", contentType);
+    /* media of a sequence number never changes, the playlist always does */
+    header.emplace("Cache-Control", string(contentType) == "application/vnd.apple.mpegurl" ? "no-cache" : "max-age=60");
+    response->write(*content, StatusCode::success_ok, header);
+}
+
+static int64_t liveQueryInt(const CaseInsensitiveMultimap & query, const string & key) {
+    auto it = query.find(key);
+    if (it == query.end() || it->second.empty())
+        return -1;
+    char *end = nullptr;
+    const long long v = strtoll(it->second.c_str(), &end, 10);
+    return *end == '\0' && v >= 0 ? v : -1;
+}
+
+int AppService::registerLiveSegmentHandlers() {
+    m_httpServer.m_resources["^/llhls/([^/]+)/index\\.m3u8$"]["GET"] =
+        [] (shared_ptr<Response> & response, shared_ptr<Request> & request) {
+        const string name = request->m_pathMatch[1];
+        const auto query = request->parseQueryString();
+        const int64_t msn = liveQueryInt(query, "_HLS_msn");
+        const int part = (int)liveQueryInt(query, "_HLS_part");
+        auto servePlaylist = [name] (shared_ptr<Response> & resp, const int ret) {
+            auto playlist = std::make_shared<string>();
+            const int err = ret < 0 ? ret : DavLiveSegmentStore::getOnlyInstance().getPlaylist(name, *playlist);
+            liveRespond(resp, err, playlist, "application/vnd.apple.mpegurl");
+        };
+        if (msn < 0) {
+            servePlaylist(response, 0);
+            return 0;
+        }
+        /* hold the reload up to three target durations, as the spec suggests */
+        auto & store = DavLiveSegmentStore::getOnlyInstance();
+        shared_ptr<Response> resp = response;
+        return store.waitFor(name, msn, part, 3 * store.getSegmentUs(name),
+                             [resp, servePlaylist] (const int ret) mutable {servePlaylist(resp, ret);});
+    };
+
+    m_httpServer.m_resources["^/llhls/([^/]+)/init([0-9]{1,9})\\.mp4$"]["GET"] =
+        [] (shared_ptr<Response> & response, shared_ptr<Request> & request) {
+        auto init = DavLiveSegmentStore::getOnlyInstance().getInit(request->m_pathMatch[1],
+                                                                  std::stoi(request->m_pathMatch[2]));
+        liveRespond(response, 0, init, "video/mp4");
+        return 0;
+    };
+
+    /* a segment or part not out yet (e.g. the preload hint) is held till published */
+    m_httpServer.m_resources["^/llhls/([^/]+)/seg([0-9]{1,18})\\.m4s$"]["GET"] =
+        [] (shared_ptr<Response> & response, shared_ptr<Request> & request) {
+        const string name = request->m_pathMatch[1];
+        const int64_t msn = std::stoll(request->m_pathMatch[2]);
+        auto & store = DavLiveSegmentStore::getOnlyInstance();
+        shared_ptr<Response> resp = response;
+        return store.waitFor(name, msn, -1, 3 * store.getSegmentUs(name), [resp, name, msn] (const int ret) mutable {
+                liveRespond(resp, ret, DavLiveSegmentStore::getOnlyInstance().getSegment(name, msn), "video/iso.segment");
+            });
+    };
+
+    m_httpServer.m_resources["^/llhls/([^/]+)/part([0-9]{1,18})\\.([0-9]{1,6})\\.m4s$"]["GET"] =
+        [] (shared_ptr<Response> & response, shared_ptr<Request> & request) {
+        const string name = request->m_pathMatch[1];
+        const int64_t msn = std::stoll(request->m_pathMatch[2]);
+        const int part = std::stoi(request->m_pathMatch[3]);
+        auto & store = DavLiveSegmentStore::getOnlyInstance();
+        shared_ptr<Response> resp = response;
+        return store.waitFor(name, msn, part, 3 * store.getSegmentUs(name), [resp, name, msn, part] (const int ret) mutable {
+                liveRespond(resp, ret, DavLiveSegmentStore::getOnlyInstance().getPart(name, msn, part), "video/iso.segment");
+            });
+    };
+    LOG(INFO) << m_logtag << "serve memhls outputs under /llhls/<name>/index.m3u8";
+    return 0;
+}
+
 /////////////////////
 // [report helpers]
 int AppService::appMsgJsonReport(const shared_ptr<AVDictionary> & msg) {
@@ -226,6 +317,7 @@ int AppService::buildInputStreamlet(const string & inputUrl,
         return APP_ERROR_BUILD_STREAMLET;
     }
     m_river.add(streamletInput);
+    subscribeOwnOutputSource(inputUrl, *streamletInput);
     LOG(INFO) << m_logtag << m_river.dumpRiver();
     return 0;
 }
@@ -271,4 +363,188 @@ int AppService::buildOutputStreamlet(const string & outputId,
     return 0;
 }
 
+int AppService::buildSharedEncodeOutputStreamlet(const string & outputId,
+                                                 const DavStreamletSetting::OutputStreamletSetting & outStreamletSetting,
+                                                 const vector<string> & fullOutputUrls,
+                                                 shared_ptr<DavStreamlet> & encodeStreamlet,
+                                                 bool & bNewEncode) {
+    bNewEncode = false;
+    DavStreamletOption so;
+    so.set(DavOptionBufLimitNum(), std::to_string(m_appGlobalSetting.output_max_buf_num()));
+    vector<DavWaveOption> waveOptions;
+    PbStreamletSettingToDavOption::mkOutputStreamletWaveOptions(fullOutputUrls,
+                                                                outStreamletSetting, waveOptions);
+    DavStreamletOption encodeSo(so);
+    encodeSo.set(DavOptionGopCacheKB(), std::to_string(m_appGlobalSetting.gop_cache_kb()));
+    vector<DavWaveOption> encodeOptions;
+    vector<DavWaveOption> muxOptions;
+    splitEncodeMuxOptions(waveOptions, encodeOptions, muxOptions);
+    if (encodeOptions.size() == 0 || muxOptions.size() == 0) {
+        ERRORIT(APP_ERROR_BUILD_STREAMLET, "output " + outputId + " should have both encoders and muxers");
+        return APP_ERROR_BUILD_STREAMLET;
+    }
+
+    const string encodeKey = encodeSettingKey(encodeOptions);
+    if (m_sharedEncodes.count(encodeKey) &&
+        !m_river.get(DavSharedEncodeStreamletTag(m_sharedEncodes.at(encodeKey).m_tagName))) {
+        LOG(WARNING) << m_logtag << m_sharedEncodes.at(encodeKey).m_tagName << " is gone, build a new one";
+        dropSharedEncode(encodeKey);
+    }
+    if (m_sharedEncodes.count(encodeKey) == 0) {
+        SharedEncode sharedEncode;
+        sharedEncode.m_tagName = "SharedEncode_" + std::to_string(m_sharedEncodeSeq++);
+        sharedEncode.m_bBitrateAdapt = isBitrateAdaptEnabled(encodeOptions);
+        DavSharedEncodeStreamletBuilder builder;
+        encodeStreamlet = builder.build(encodeOptions, DavSharedEncodeStreamletTag(sharedEncode.m_tagName), encodeSo);
+        if (!encodeStreamlet) {
+            ERRORIT(APP_ERROR_BUILD_STREAMLET, ("build shared encode streamlet fail; for output " +
+                                                outputId + ", " + toStringViaOss(builder.m_buildInfo)));
+            return APP_ERROR_BUILD_STREAMLET;
+        }
+        m_river.add(encodeStreamlet);
+        m_sharedEncodes.emplace(encodeKey, sharedEncode);
+        bNewEncode = true;
+    } else {
+        encodeStreamlet = m_river.get(DavSharedEncodeStreamletTag(m_sharedEncodes.at(encodeKey).m_tagName));
+        LOG(INFO) << m_logtag << "output " << outputId << " reuses encoders of "
+                  << m_sharedEncodes.at(encodeKey).m_tagName;
+    }
+
+    DavMuxOutputStreamletBuilder muxBuilder;
+    auto muxStreamlet = muxBuilder.build(muxOptions, DavDefaultOutputStreamletTag(outputId), so);
+    if (!muxStreamlet) {
+        if (bNewEncode) {
+            m_river.erase(DavSharedEncodeStreamletTag(m_sharedEncodes.at(encodeKey).m_tagName));
+            m_sharedEncodes.erase(encodeKey);
+            encodeStreamlet.reset();
+            bNewEncode = false;
+        }
+        ERRORIT(APP_ERROR_BUILD_STREAMLET, ("build mux output streamlet fail; with id " +
+                                            outputId + ", " + toStringViaOss(muxBuilder.m_buildInfo)));
+        return APP_ERROR_BUILD_STREAMLET;
+    }
+    connectEncodeToMuxers(*encodeStreamlet, *muxStreamlet, m_sharedEncodes.at(encodeKey).m_bBitrateAdapt);
+    m_river.add(muxStreamlet);
+    m_sharedEncodes.at(encodeKey).m_users.insert(outputId);
+    m_outputEncodeKey[outputId] = encodeKey;
+    {
+        std::lock_guard<mutex> lock(m_outputUrlLock);
+        for (auto & url : fullOutputUrls)
+            m_outputUrls[url] = {outputId, m_sharedEncodes.at(encodeKey).m_tagName};
+    }
+    /* inputs already reading this output */
+    for (auto & url : fullOutputUrls) {
+        auto inputStreamlet = m_river.get(DavDefaultInputStreamletTag(url));
+        if (inputStreamlet)
+            subscribeOwnOutputSource(url, *inputStreamlet);
+    }
+    return 0;
+}
+
+int AppService::subscribeOwnOutputSource(const string & inputUrl, DavStreamlet & inputStreamlet) {
+    string tagName;
+    {
+        std::lock_guard<mutex> lock(m_outputUrlLock);
+        if (m_outputUrls.count(inputUrl) == 0)
+            return 0;
+        tagName = m_outputUrls.at(inputUrl).m_encodeTagName;
+    }
+    auto encodeStreamlet = m_river.get(DavSharedEncodeStreamletTag(tagName));
+    if (!encodeStreamlet)
+        return 0;
+    LOG(INFO) << m_logtag << "input " << inputUrl << " reads output of " << tagName
+              << ", its key frame requests go to the encoders";
+    return subscribeKeyFrameRequests(inputStreamlet, *encodeStreamlet);
+}
+
+int AppService::unsubscribeOwnOutputSource(const string & inputUrl, DavStreamlet & inputStreamlet) {
+    string tagName;
+    {
+        std::lock_guard<mutex> lock(m_outputUrlLock);
+        if (m_outputUrls.count(inputUrl) == 0)
+            return 0;
+        tagName = m_outputUrls.at(inputUrl).m_encodeTagName;
+    }
+    auto encodeStreamlet = m_river.get(DavSharedEncodeStreamletTag(tagName));
+    if (encodeStreamlet)
+        unsubscribeKeyFrameRequests(inputStreamlet, *encodeStreamlet);
+    return 0;
+}
+
+int AppService::closeSharedEncodeOutputStreamlet(const string & outputId) {
+    const DavDefaultOutputStreamletTag muxTag(outputId);
+    auto muxStreamlet = m_river.get(muxTag);
+    if (!muxStreamlet || m_outputEncodeKey.count(outputId) == 0)
+        return AVERROR(EINVAL);
+
+    /* detach first, so the shared encoders never push to a stopped muxer */
+    releaseSharedEncode(outputId, *muxStreamlet);
+    muxStreamlet->stop();
+    m_river.erase(muxTag);
+    return 0;
+}
+
+int AppService::releaseSharedEncode(const string & outputId, DavStreamlet & muxStreamlet) {
+    if (m_outputEncodeKey.count(outputId) == 0)
+        return AVERROR(EINVAL);
+    const string encodeKey = m_outputEncodeKey.at(outputId);
+    m_outputEncodeKey.erase(outputId);
+    {
+        std::lock_guard<mutex> lock(m_outputUrlLock);
+        for (auto it = m_outputUrls.begin(); it != m_outputUrls.end();)
+            it = it->second.m_outputId == outputId ? m_outputUrls.erase(it) : std::next(it);
+    }
+    if (m_sharedEncodes.count(encodeKey) == 0)
+        return 0;
+
+    auto & sharedEncode = m_sharedEncodes.at(encodeKey);
+    const DavSharedEncodeStreamletTag encodeTag(sharedEncode.m_tagName);
+    auto encodeStreamlet = m_river.get(encodeTag);
+    if (encodeStreamlet)
+        disconnectEncodeFromMuxers(*encodeStreamlet, muxStreamlet, sharedEncode.m_bBitrateAdapt);
+    sharedEncode.m_users.erase(outputId);
+    if (sharedEncode.m_users.empty()) {
+        LOG(INFO) << m_logtag << "last user of " << sharedEncode.m_tagName << " gone, close it";
+        if (encodeStreamlet) {
+            encodeStreamlet->stop();
+            m_river.erase(encodeTag);
+        }
+        m_sharedEncodes.erase(encodeKey);
+    }
+    return 0;
+}
+
+void AppService::dropSharedEncode(const string & encodeKey) {
+    if (m_sharedEncodes.count(encodeKey) == 0)
+        return;
+    const string tagName = m_sharedEncodes.at(encodeKey).m_tagName;
+    for (auto & outputId : m_sharedEncodes.at(encodeKey).m_users)
+        m_outputEncodeKey.erase(outputId);
+    {
+        std::lock_guard<mutex> lock(m_outputUrlLock);
+        for (auto it = m_outputUrls.begin(); it != m_outputUrls.end();)
+            it = it->second.m_encodeTagName == tagName ? m_outputUrls.erase(it) : std::next(it);
+    }
+    m_sharedEncodes.erase(encodeKey);
+}
+
+void AppService::pruneSharedEncodes(const vector<shared_ptr<DavStreamlet>> & erased) {
+    for (const auto & s : erased) {
+        const auto & tag = s->getTag();
+        if (tag.m_streamletCategory == type_index(typeid(DavDefaultOutputStreamletTag)) &&
+            m_outputEncodeKey.count(tag.m_streamletName)) {
+            LOG(INFO) << m_logtag << "output " << tag.m_streamletName << " stopped, release its shared encode";
+            releaseSharedEncode(tag.m_streamletName, *s);
+        } else if (tag.m_streamletCategory == type_index(typeid(DavSharedEncodeStreamletTag))) {
+            auto it = std::find_if(m_sharedEncodes.begin(), m_sharedEncodes.end(),
+                                   [&tag](const std::pair<const string, SharedEncode> & e) {
+                                       return e.second.m_tagName == tag.m_streamletName;});
+            if (it != m_sharedEncodes.end()) {
+                LOG(INFO) << m_logtag << it->second.m_tagName << " stopped, drop it";
+                dropSharedEncode(it->first);
+            }
+        }
+    }
+}
+
 } // namespace app_common
@@ -1,4 +1,6 @@
 #include <vector>
+#include <map>
+#include <set>
 #include <memory>
 #include <string>
 #include <mutex>
@@ -18,11 +20,15 @@
 #include "appGlobalSetting.pb.h"
 #include "davStreamlet.h"
 #include "davStreamletBuilder.h"
+#include "davThreadBudget.h"
+#include "davLiveSegmentStore.h"
 #include "pbToDavOptionEvent.h"
 
 namespace app_common {
 using ::std::string;
 using ::std::vector;
+using ::std::map;
+using ::std::set;
 using ::std::mutex;
 using ::std::shared_ptr;
 using namespace pb_tree;
@@ -84,6 +90,7 @@ protected:
         m_monitorFuture = std::async(std::launch::async,
                                      [this, afterMonitorDone] () {return riverMonitor(afterMonitorDone);});
         if (!m_httpIp.empty()) {
+            registerLiveSegmentHandlers();
             m_httpServer.init(m_httpIp, m_httpPort);
             LOG(INFO) << m_logtag << "Http Server Start";
             m_httpServer.start(); /* thread block here*/
@@ -122,6 +129,7 @@ protected:
         m_httpPort = (int16_t)m_appGlobalSetting.http_server_port();
         /* log setting */
         doLogSetting();
+        DavThreadBudget::getOnlyInstance().setCoreBudget(m_appGlobalSetting.ffmpeg_thread_budget());
         /* prepare a common cr */
         m_successCR.set_code(0);
         m_successCR.set_msg("ok");
@@ -140,6 +148,8 @@ protected: /* http interface */
     virtual int failResponse(shared_ptr<Response> & response, const int errCode,
                              const string & errDetail, const bool bSync = true);
     virtual int afterHttpResponse() {m_bMonitorCheck = true; m_monitorCV.notify_one(); return 0;}
+    /* serve "memhls://<name>" outputs under /llhls/<name>/ */
+    virtual int registerLiveSegmentHandlers();
     /* default on error */
     virtual int onRequestError(shared_ptr<Request> & request, const error_code & ec) {
         asio::streambuf::const_buffers_type cbt = request->m_request.data();
@@ -164,6 +174,45 @@ protected: /* provides few default streamlet builders */
     virtual int buildOutputStreamlet(const string & outputId,
                                      const DavStreamletSetting::OutputStreamletSetting & outStreamletSetting,
                                      const vector<string> & fullOutputUrls);
+    /* outputs with identical encode settings share one encode streamlet; each output only owns
+       its muxers. bNewEncode is set when the encode streamlet is created by this call */
+    virtual int buildSharedEncodeOutputStreamlet(const string & outputId,
+                                                 const DavStreamletSetting::OutputStreamletSetting & outStreamletSetting,
+                                                 const vector<string> & fullOutputUrls,
+                                                 shared_ptr<DavStreamlet> & encodeStreamlet,
+                                                 bool & bNewEncode);
+    virtual int closeSharedEncodeOutputStreamlet(const string & outputId);
+    /* the monitor erased these streamlets: forget them and release the encoders of dead outputs */
+    void pruneSharedEncodes(const vector<shared_ptr<DavStreamlet>> & erased);
+    /* an input reading one of our shared encode outputs: its fast join key frame request goes to the encoders */
+    int subscribeOwnOutputSource(const string & inputUrl, DavStreamlet & inputStreamlet);
+    int unsubscribeOwnOutputSource(const string & inputUrl, DavStreamlet & inputStreamlet);
+    /* only book keeping; streamlets themselves are cleared via m_river */
+    inline void clearSharedEncodes() {
+        std::lock_guard<mutex> lock(m_outputUrlLock);
+        m_sharedEncodes.clear();
+        m_outputEncodeKey.clear();
+        m_outputUrls.clear();
+    }
+
+private:
+    int releaseSharedEncode(const string & outputId, DavStreamlet & muxStreamlet);
+    void dropSharedEncode(const string & encodeKey);
+    struct SharedEncode {
+        string m_tagName;
+        set<string> m_users; /* output ids */
+        bool m_bBitrateAdapt = false; /* video encoder subscribes muxers' throughput */
+    };
+    map<string, SharedEncode> m_sharedEncodes; /* encode setting key -> shared encode */
+    map<string, string> m_outputEncodeKey;     /* output id -> encode setting key */
+    struct OutputUrl {
+        string m_outputId;
+        string m_encodeTagName;
+    };
+    std::mutex m_outputUrlLock;          /* inputs are built on other threads */
+    map<string, OutputUrl> m_outputUrls; /* output url -> its output and shared encode */
+    int m_sharedEncodeSeq = 0;
+
 protected:
     AppGlobalSetting::GlobalSetting m_appGlobalSetting;
     DavRiver m_river; /* a set of all implementations */
@@ -19,7 +19,23 @@ public:
         o.set(DavOptionImplType(), ds.demux_type().empty() ? "auto" : ds.demux_type());
         o.set(DavOptionInputFpsEmulate(), ds.input_fps_emulate() ? "true" : "false");
         o.set(DavOptionReconnectRetries(), std::to_string(ds.reconnect_times()));
-        o.set(DavOptionRWTimeout(), std::to_string(ds.read_timeout()));
+        o.set(DavOptionRWTimeout(), std::to_string(ds.read_timeout() * 1000)); /* seconds to ms */
+        o.set(DavOptionFastJoin(), ds.fast_join() ? "true" : "false");
+        string backupUrls;
+        for (const auto & url : ds.backup_urls())
+            backupUrls += (backupUrls.empty() ? "" : "|") + url;
+        if (!backupUrls.empty())
+            o.set(DavOptionInputBackupUrls(), backupUrls);
+        if (ds.probe_size() > 0)
+            o.set("probe_size", std::to_string(ds.probe_size()), 0);
+        if (ds.analyze_duration_ms() > 0)
+            o.set("analyze_duration_ms", std::to_string(ds.analyze_duration_ms()), 0);
+        o.set("stream_info_cache", ds.stream_info_cache() ? "true" : "false", 0);
+        o.set("mmap_io", ds.mmap_io() ? "true" : "false", 0);
+        if (!ds.programs().empty())
+            o.set(DavOptionDemuxPrograms(), ds.programs());
+        if (!ds.stream_info_cache_key().empty())
+            o.set("stream_info_cache_key", ds.stream_info_cache_key(), 0);
         if (!inputUrl.empty())
             o.set(DavOptionInputUrl(), inputUrl);
         for (const auto & m : ds.avdict_demux_option())
@@ -44,6 +60,8 @@ public:
     static int toVideoDecodeOption(const VideoDecodeSetting & vds, DavWaveOption & o) {
         o.setCategory(DavOptionClassCategory(), DavWaveClassVideoDecode());
         o.set(DavOptionImplType(), vds.decode_type().empty() ? "auto" : vds.decode_type());
+        if (!vds.thread_policy().empty())
+            o.set(DavOptionDecodeThreadPolicy(), vds.thread_policy());
         for (const auto & m : vds.avdict_decode_option())
             o.set(m.first, m.second, 0);
         return 0;
@@ -84,6 +102,10 @@ public:
         o.set(DavOptionImplType(), "auto");
         o.setInt("frame_size", ams.frame_size(), 0);
         o.setBool("b_mute_at_start", ams.b_mute_at_start());
+        if (!ams.resample_quality().empty())
+            o.set(DavOptionAudioResampleQuality(), ams.resample_quality());
+        if (ams.level_interval_ms() != 0)
+            o.setInt("level_interval_ms", ams.level_interval_ms(), 0);
         return 0;
     }
 
@@ -92,6 +114,12 @@ public:
         o.set(DavOptionImplType(), ves.encode_type().empty() ? "auto" : ves.encode_type());
         o.set(DavOptionCodecName(), ves.codec_name());
         o.setAVRational("framerate", {ves.fps_num(), ves.fps_den()});
+        if (!ves.encode_profile().empty())
+            o.set(DavOptionEncodeProfile(), ves.encode_profile());
+        if (ves.bitrate_adapt_min() > 0)
+            o.setInt(DavOptionBitrateAdaptMin(), ves.bitrate_adapt_min());
+        if (ves.bitrate_adapt_max() > 0)
+            o.setInt(DavOptionBitrateAdaptMax(), ves.bitrate_adapt_max());
         for (auto & d : ves.avdict_encode_option())
             o.set(d.first, d.second, 0);
         return 0;
@@ -101,6 +129,8 @@ public:
         o.setCategory(DavOptionClassCategory(), DavWaveClassAudioEncode());
         o.set(DavOptionImplType(), aes.encode_type().empty() ? "auto" : aes.encode_type());
         o.set(DavOptionCodecName(), aes.codec_name());
+        if (!aes.resample_quality().empty())
+            o.set(DavOptionAudioResampleQuality(), aes.resample_quality());
         for (auto & d : aes.avdict_encode_option())
             o.set(d.first, d.second, 0);
         return 0;
@@ -72,9 +72,12 @@ int IalService::onCreateRoom(shared_ptr<Response> & response, const IalRequest::
             for (const auto & u : oneOutputInfo.output_urls())
                 outputFullUrls.emplace_back(u);
         }
-        ret = buildOutputStreamlet(oid, outSettingUsed, outputFullUrls);
+        shared_ptr<DavStreamlet> encodeStreamlet;
+        bool bNewEncode = false;
+        ret = buildSharedEncodeOutputStreamlet(oid, outSettingUsed, outputFullUrls, encodeStreamlet, bNewEncode);
         if (ret < 0) {
             m_river.clear();
+            clearSharedEncodes();
             ERRORIT(IAL_ERROR_CREATE_ROOM,
                     "create room with id: " + createRoom.room_id() + ";" + m_appInfo.m_msgDetail);
             return failResponse(response, API_ERRCODE_INVALID_OUTPUT_SETTING,
@@ -86,6 +89,7 @@ int IalService::onCreateRoom(shared_ptr<Response> & response, const IalRequest::
     ret = buildMixStreamlet(m_mixStreamletName, m_mixSetting);
     if (ret < 0) {
         m_river.clear();
+        clearSharedEncodes();
         ERRORIT(IAL_ERROR_CREATE_ROOM,
                 "create room with id: " + createRoom.room_id() + ";" + m_appInfo.m_msgDetail);
         return failResponse(response, API_ERRCODE_INVALID_MIX_SETTING,
@@ -93,11 +97,11 @@ int IalService::onCreateRoom(shared_ptr<Response> & response, const IalRequest::
     }
     LOG(INFO) << m_logtag << "craete mix streamlet done";
 
-    /* 3. connect mix & outputs */
+    /* 3. connect mix & shared encoders (encoders to muxers are connected when built) */
     auto mixStreamlet = m_river.get(DavMixStreamletTag(m_mixStreamletName));
-    auto outputStreamlets = m_river.getStreamletsByCategory(DavDefaultOutputStreamletTag());
-    for (auto & o : outputStreamlets)
-        mixStreamlet >> o;
+    auto encodeStreamlets = m_river.getStreamletsByCategory(DavSharedEncodeStreamletTag());
+    for (auto & e : encodeStreamlets)
+        mixStreamlet >> e;
 
     LOG(INFO) << m_logtag << "connect mix streamlet done. start async create input streamlet";
 
@@ -185,6 +189,7 @@ int IalService::onCloseOneInputStream(shared_ptr<Response> & response,
     }
 
     auto inputStreamlet = m_river.get(closeInputTag);
+    unsubscribeOwnOutputSource(inputUrl, *inputStreamlet);
     /* stop will make a flush and quit wave's thread; also disconnect with its peers;
        this may take a while, but should less than 50ms */
     inputStreamlet->stop();
@@ -228,16 +233,22 @@ int IalService::onAddNewOutput(shared_ptr<Response> & response,
         for (const auto & u : oneOutputInfo.output_urls())
             outputFullUrls.emplace_back(u);
     }
-    int ret = buildOutputStreamlet(oid, outSettingUsed, outputFullUrls);
+    shared_ptr<DavStreamlet> encodeStreamlet;
+    bool bNewEncode = false;
+    int ret = buildSharedEncodeOutputStreamlet(oid, outSettingUsed, outputFullUrls, encodeStreamlet, bNewEncode);
     if (ret < 0)
         return failResponse(response, API_ERRCODE_INVALID_OUTPUT_SETTING,
                             "Fail add new output straem " + m_appInfo.m_msgDetail);
 
     auto newOutputStreamlet = m_river.get(DavDefaultOutputStreamletTag(oid));
     auto mixStreamlet = m_river.get(DavMixStreamletTag(m_mixStreamletName));
-    CHECK(newOutputStreamlet != nullptr && mixStreamlet != nullptr);
+    CHECK(newOutputStreamlet != nullptr && mixStreamlet != nullptr && encodeStreamlet != nullptr);
     newOutputStreamlet->start();
-    mixStreamlet >> newOutputStreamlet;
+    /* an existing shared encoder is already running and fed by the mix */
+    if (bNewEncode) {
+        encodeStreamlet->start();
+        mixStreamlet >> encodeStreamlet;
+    }
     response->write(m_successCRJsonStr);
     return 0;
 }
@@ -251,9 +262,7 @@ int IalService::onCloseOneOutput(shared_ptr<Response> & response,
         ERRORIT(IAL_ERROR_PARTICIPANT_LEFT, detail);
         return failResponse(response, API_ERRCODE_CLOSE_NONE_EXIST_OUTPUT, detail);
     }
-    auto outputStreamlet = m_river.get(spcificOutputTag);
-    outputStreamlet->stop();
-    m_river.erase(spcificOutputTag);
+    closeSharedEncodeOutputStreamlet(closeOutput.output_setting_id());
     response->write(m_successCRJsonStr);
     return 0;
 }
@@ -424,6 +433,7 @@ int IalService::onIalStop(shared_ptr<Response> & response, shared_ptr<Request> &
     m_roomOutputBaseUrl.clear();
     m_river.stop();
     m_river.clear();
+    clearSharedEncodes();
     IalService::setExit();
     return 0;
 }
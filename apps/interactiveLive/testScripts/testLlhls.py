@@ -0,0 +1,112 @@
+# -*- coding: utf-8 -*-
+
+# Low latency hls served from memory: create a room whose output is memhls://<name>, then act as a
+# player against the ial http server. Run ial first (with ialConfig.json), then: python testLlhls.py
+
+import re
+import sys
+import time
+from requests import request
+from google.protobuf.json_format import MessageToJson
+sys.path.append("../build/protos")
+
+import ialRequest_pb2 as ial_request
+
+http_dst = "http://127.0.0.1:8080"
+uri_create_room = "/api1/ial/create_room"
+uri_stop = "/api1/ial/stop"
+
+# chnage to your file
+input1 = "bunny.avi"
+out_setting_id = "720p_2000kb"
+live_name = "ial_test"
+live_base = http_dst + "/llhls/" + live_name + "/"
+
+failures = []
+
+def check(cond, what):
+    print (("ok     " if cond else "FAILED ") + what)
+    if not cond:
+        failures.append(what)
+
+def createRoom():
+    create_room = ial_request.CreateRoom()
+    create_room.room_id = "ial_llhls_test"
+    create_room.input_urls.append(input1)
+    create_room.room_output_base_url = "./"
+    new_output = create_room.output_stream_infos.add()
+    new_output.output_setting_id = out_setting_id
+    new_output.output_urls.append("memhls://" + live_name)
+    response = request("POST", http_dst + uri_create_room, data = MessageToJson(create_room))
+    print (response.url, response.text)
+
+def getPlaylist(query = ""):
+    start = time.time()
+    response = request("GET", live_base + "index.m3u8" + query, timeout = 30)
+    return response, time.time() - start
+
+# (msn, part) of the last listed part
+def lastPart(playlist):
+    msn = int(re.search(r"#EXT-X-MEDIA-SEQUENCE:(\d+)", playlist).group(1))
+    last = None
+    for line in playlist.splitlines():
+        if line.startswith("#EXT-X-PART:"):
+            m = re.search(r'URI="part(\d+)\.(\d+)\.m4s"', line)
+            last = (int(m.group(1)), int(m.group(2)))
+    return last if last else (msn, -1)
+
+def run():
+    # 1. wait for the stream to publish parts
+    playlist = None
+    for _ in range(100):
+        response, _ = getPlaylist()
+        if response.status_code == 200 and "#EXT-X-PART:" in response.text:
+            playlist = response.text
+            break
+        time.sleep(0.2)
+    check(playlist is not None, "playlist with parts served")
+    if playlist is None:
+        return
+    check("#EXT-X-SERVER-CONTROL:CAN-BLOCK-RELOAD=YES" in playlist, "blocking reload advertised")
+    target = float(re.search(r"#EXT-X-PART-INF:PART-TARGET=([0-9.]+)", playlist).group(1))
+
+    # 2. init section and the latest part are fmp4
+    init = re.search(r'#EXT-X-MAP:URI="([^"]+)"', playlist).group(1)
+    response = request("GET", live_base + init)
+    check(response.status_code == 200 and response.content[4:8] == b"ftyp", "init section " + init)
+    msn, part = lastPart(playlist)
+    response = request("GET", live_base + "part%d.%d.m4s" % (msn, part))
+    check(response.status_code == 200 and b"moof" in response.content[:64], "part %d.%d" % (msn, part))
+
+    # 3. blocking reload for the next part returns once it is published, about a part target later
+    response, elapsed = getPlaylist("?_HLS_msn=%d&_HLS_part=%d" % (msn, part + 1))
+    check(response.status_code == 200, "blocking reload answered")
+    nmsn, npart = lastPart(response.text)
+    check((nmsn, npart) >= (msn, part + 1) or nmsn > msn, "reload lists part %d.%d" % (msn, part + 1))
+    check(elapsed < 3 * target + 1.0, "reload blocked %.3fs, part target %.3fs" % (elapsed, target))
+
+    # 4. the preload hint is held till published
+    hint = re.search(r'#EXT-X-PRELOAD-HINT:TYPE=PART,URI="([^"]+)"', response.text)
+    if hint:
+        response = request("GET", live_base + hint.group(1), timeout = 30)
+        check(response.status_code == 200 and b"moof" in response.content[:64], "preload hint " + hint.group(1))
+
+    # 5. too far ahead is refused at once
+    response, elapsed = getPlaylist("?_HLS_msn=%d" % (nmsn + 100))
+    check(response.status_code == 400 and elapsed < 1.0, "far ahead reload refused")
+
+    # 6. an unknown stream is not held either
+    response = request("GET", http_dst + "/llhls/no_such_stream/part0.0.m4s", timeout = 30)
+    check(response.status_code == 404, "unknown stream refused")
+
+############################################################
+if __name__ == "__main__":
+    createRoom()
+    try:
+        run()
+    except Exception as e:
+        failures.append(str(e))
+        print ("exception ", e)
+    request("POST", http_dst + uri_stop)
+    print ("=> %s" % ("all passed" if not failures else "%d failed" % len(failures)))
+    sys.exit(1 if failures else 0)
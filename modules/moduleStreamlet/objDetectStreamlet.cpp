@@ -16,11 +16,10 @@ ObjDetectStreamletBuilder::build(const vector<DavWaveOption> & waveOptions,
     /* get waves used in this streamlet */
     auto dataRelaies = streamlet->getWavesByCategory(DavWaveClassDataRelay());
     auto postDraws = streamlet->getWavesByCategory(DavWaveClassCvPostDraw());
-    CHECK(dataRelaies.size() == 1 && postDraws.size() == 1)
-        << m_logtag << "cv dnn should only have one DataRelay and one PostDraw"
+    CHECK(dataRelaies.size() == 1 && postDraws.size() <= 1)
+        << m_logtag << "cv dnn should only have one DataRelay and (0 or 1) PostDraw"
         << dataRelaies.size() << ", " << postDraws.size();
     auto dataRelay = dataRelaies[0];
-    auto postDraw = postDraws[0];
 
     auto objDetectors = streamlet->getWavesByCategory(DavWaveClassObjDetect());
     CHECK(objDetectors.size() > 0)
@@ -30,12 +29,17 @@ ObjDetectStreamletBuilder::build(const vector<DavWaveOption> & waveOptions,
     streamlet->addOneInVideoRawEntry(dataRelay);
     for (auto & d : objDetectors) {
         DavWave::connect(dataRelay.get(), d.get());
+        // relay collects detectors' frame demand for upstream decoder
+        DavWave::subscribe(d.get(), dataRelay.get());
         // peer event subscribe: postDraw subscribe detector's result event
-        DavWave::subscribe(d.get(), postDraw.get());
-
+        if (postDraws.size())
+            DavWave::subscribe(d.get(), postDraws[0].get());
+    }
+    /* without post draw, it is detection only: no video output, results are events */
+    if (postDraws.size()) {
+        streamlet->addOneOutVideoRawEntry(postDraws[0]);
+        DavWave::connect(dataRelay.get(), postDraws[0].get());
     }
-    streamlet->addOneOutVideoRawEntry(postDraw);
-    DavWave::connect(dataRelay.get(), postDraw.get());
     return streamlet;
 }
 
@@ -50,20 +54,41 @@ addDetector(shared_ptr<DavStreamlet> & streamlet, const DavWaveOption & detector
     }
     auto dataRelaies = streamlet->getWavesByCategory(DavWaveClassDataRelay());
     auto postDraws = streamlet->getWavesByCategory(DavWaveClassCvPostDraw());
-    CHECK(dataRelaies.size() == 1 && postDraws.size() == 1)
-        << m_logtag << "cv dnn should only have one DataRelay and one PostDraw"
+    CHECK(dataRelaies.size() == 1 && postDraws.size() <= 1)
+        << m_logtag << "cv dnn should only have one DataRelay and (0 or 1) PostDraw"
         << dataRelaies.size() << ", " << postDraws.size();
     auto dataRelay = dataRelaies[0];
-    auto postDraw = postDraws[0];
     DavWave::connect(dataRelay.get(), newDetector.get());
+    DavWave::subscribe(newDetector.get(), dataRelay.get());
 
     // peer event subscribe: postDraw subscribe detector's result event
-    DavWave::subscribe(newDetector.get(), postDraw.get());
+    if (postDraws.size())
+        DavWave::subscribe(newDetector.get(), postDraws[0].get());
     streamlet->addOneWave(newDetector);
     newDetector->start();
     return 0;
 }
 
+int ObjDetectStreamletBuilder::
+subscribeFrameDemand(shared_ptr<DavStreamlet> & streamlet, shared_ptr<DavStreamlet> & decodeStreamlet) {
+    auto dataRelaies = streamlet->getWavesByCategory(DavWaveClassDataRelay());
+    auto videoDecodes = decodeStreamlet->getWavesByCategory(DavWaveClassVideoDecode());
+    for (auto & r : dataRelaies)
+        for (auto & d : videoDecodes)
+            DavWave::subscribe(r.get(), d.get());
+    return 0;
+}
+
+int ObjDetectStreamletBuilder::
+subscribeRoiEncode(shared_ptr<DavStreamlet> & streamlet, shared_ptr<DavStreamlet> & encodeStreamlet) {
+    auto objDetectors = streamlet->getWavesByCategory(DavWaveClassObjDetect());
+    auto videoEncodes = encodeStreamlet->getWavesByCategory(DavWaveClassVideoEncode());
+    for (auto & d : objDetectors)
+        for (auto & e : videoEncodes)
+            DavWave::subscribe(d.get(), e.get());
+    return 0;
+}
+
 int ObjDetectStreamletBuilder::
 deleteDetector(shared_ptr<DavStreamlet> & streamlet, const string & detectorName) {
     return 0;
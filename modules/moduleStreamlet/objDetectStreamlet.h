@@ -27,6 +27,10 @@ public:
     /* additional one put here */
     int addDetector(shared_ptr<DavStreamlet> & streamlet, const DavWaveOption & detectorOption);
     int deleteDetector(shared_ptr<DavStreamlet> & streamlet, const string & detectorName);
+    /* video decoders of 'decodeStreamlet' skip frames if detectors are its only (sparse) consumers */
+    int subscribeFrameDemand(shared_ptr<DavStreamlet> & streamlet, shared_ptr<DavStreamlet> & decodeStreamlet);
+    /* video encoders of 'encodeStreamlet' subscribe detectors' results for roi encoding */
+    int subscribeRoiEncode(shared_ptr<DavStreamlet> & streamlet, shared_ptr<DavStreamlet> & encodeStreamlet);
 };
 
 /* follow other cv streamlet builders */
@@ -85,6 +85,10 @@ int main(int argc, char **argv) {
     /* connect streamlets */
     /* video part */
     streamletInput >= objDetectStreamlet >= streamletOutput;
+    /* decoder skips frames only if nothing but detectors consume them; post draw here takes all */
+    objDetectBuilder.subscribeFrameDemand(objDetectStreamlet, streamletInput);
+    /* spend more bits on detected objects */
+    objDetectBuilder.subscribeRoiEncode(objDetectStreamlet, streamletOutput);
     /* audio bitstream TODO:  streamletInput * streamletOutput; */
 
     // start
@@ -46,6 +46,7 @@ int CvDnnDetect::onConstruct() {
     m_options.getInt("height", m_dps.m_height);
     m_options.getDouble("conf_threshold", m_dps.m_confThreshold);
     m_options.getInt("detect_interval", m_dps.m_detectInterval);
+    m_options.getBool("reference_exact", m_dps.m_bReferenceExact);
     vector<double> means;
     m_options.getDoubleArray("means", means);
     if (means.size() == 3) {
@@ -109,12 +110,6 @@ int CvDnnDetect::onProcess(DavProcCtx & ctx) {
     if (!ctx.m_inBuf)
         return 0;
 
-    /* detect with interval (frame skip) */
-    m_inputCount++;
-    const bool bSkipDetect = (m_inputCount % m_dps.m_detectInterval) == 0 ? false : true;
-    if (bSkipDetect)
-        return 0;
-
     int ret = 0;
     /* ref frame is a frame ref to original frame (data shared),
        but timestamp is convert to current impl's timebase */
@@ -126,6 +121,12 @@ int CvDnnDetect::onProcess(DavProcCtx & ctx) {
         return AVERROR_EOF;
     }
 
+    /* detect with interval (frame skip) */
+    const auto & in = *m_inputTravelStatic.at(ctx.m_inBuf->getAddress());
+    m_pacer.publishFrameDemand(ctx, in, m_dps);
+    if (!m_pacer.shouldDetect(inFrame, in, m_dps.m_detectInterval))
+        return 0;
+
     // convert this frame to opencv Mat
     cv::Mat yuvMat;
     FrameMat::frameToMatYuv420(inFrame, yuvMat);
@@ -172,6 +173,9 @@ int CvDnnDetect::onProcess(DavProcCtx & ctx) {
     detectEvent->m_detectOrClassify = m_dps.m_detectOrClassify;
     detectEvent->m_detectorFrameworkTag = m_dps.m_detectorFrameworkTag;
     detectEvent->m_framePts = inFrame->pts;
+    detectEvent->m_timebase = in.m_timebase;
+    detectEvent->m_frameWidth = inFrame->width;
+    detectEvent->m_frameHeight = inFrame->height;
     ctx.m_pubEvents.emplace_back(detectEvent);
     /* No travel static needed for detectors, just events */
     return 0;
@@ -43,7 +43,7 @@ private:
     ObjDetectParams m_dps;
     vector<cv::String> m_outBlobNames;
     vector<string> m_classNames;
-    unsigned long m_inputCount = 0;
+    ObjDetectPacer m_pacer;
 };
 
 } //namespace ff_dynamic
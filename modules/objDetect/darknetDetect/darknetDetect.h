@@ -37,7 +37,7 @@ private:
     ObjDetectParams m_dps;
     cv::Scalar m_means;
     vector<string> m_classNames;
-    unsigned long m_inputCount = 0;
+    ObjDetectPacer m_pacer;
 };
 
 } //namespace ff_dynamic
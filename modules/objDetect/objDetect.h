@@ -2,6 +2,7 @@
 
 #include <iostream>
 #include "davWave.h"
+#include "davImpl.h"
 
 namespace ff_dynamic {
 
@@ -28,6 +29,7 @@ struct ObjDetectParams {
     int m_height = -1;
     double m_confThreshold = 0.7;
     int m_detectInterval = 1;
+    bool m_bReferenceExact = true; /* false lets upstream decoder skip deblocking */
 };
 
 inline std::ostream & operator<<(std::ostream & os, const ObjDetectParams & p) {
@@ -38,8 +40,44 @@ inline std::ostream & operator<<(std::ostream & os, const ObjDetectParams & p) {
        << ", means [" << p.m_means[0] << ", " << p.m_means[1] << ", " << p.m_means[2]
        << "], bSwapRb " << p.m_bSwapRb << ", width " << p.m_width
        << ", height " << p.m_height << ", confThreshold " << p.m_confThreshold
-       << ", detectInterval" << p.m_detectInterval;
+       << ", detectInterval" << p.m_detectInterval << ", bReferenceExact " << p.m_bReferenceExact;
     return os;
 }
 
+/* Detect every 'detectInterval' frames by timestamp rather than by count, so the detect rate
+   holds when upstream decoder skips frames on the demand detectors declare */
+struct ObjDetectPacer {
+    uint64_t m_inputCount = 0;
+    int64_t m_lastDetectPts = AV_NOPTS_VALUE;
+    bool m_bDemandPublished = false;
+
+    bool shouldDetect(const AVFrame *frame, const DavTravelStatic & in, const int detectInterval) {
+        m_inputCount++;
+        if (detectInterval <= 1)
+            return true;
+        if (frame->pts == AV_NOPTS_VALUE || in.m_framerate.num <= 0 || in.m_framerate.den <= 0)
+            return (m_inputCount % detectInterval) == 0;
+        const int64_t frameDuration = av_rescale_q(1, av_inv_q(in.m_framerate), in.m_timebase);
+        const int64_t gap = detectInterval * frameDuration - frameDuration / 2; /* timestamp jitter */
+        if (m_lastDetectPts != AV_NOPTS_VALUE && frame->pts >= m_lastDetectPts &&
+            frame->pts - m_lastDetectPts < gap)
+            return false;
+        m_lastDetectPts = frame->pts;
+        return true;
+    }
+
+    /* declare once how many frames detection needs */
+    void publishFrameDemand(DavProcCtx & ctx, const DavTravelStatic & in, const ObjDetectParams & dps) {
+        if (m_bDemandPublished)
+            return;
+        m_bDemandPublished = true;
+        auto demand = make_shared<DavEventFrameDemand>();
+        if (dps.m_detectInterval > 1 && in.m_framerate.num > 0 && in.m_framerate.den > 0)
+            demand->m_fps = av_q2d(in.m_framerate) / dps.m_detectInterval;
+        demand->m_bReferenceExact = dps.m_bReferenceExact;
+        demand->getAddress().setFromStreamIndex(IMPL_SINGLE_OUTPUT_STREAM_INDEX);
+        ctx.m_pubEvents.emplace_back(demand);
+    }
+};
+
 } // namespace